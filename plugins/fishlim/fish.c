@@ -92,8 +92,14 @@ static const signed char fish_unbase64[256] = {
 static OSSL_PROVIDER *legacy_provider;
 static OSSL_PROVIDER *default_provider;
 static OSSL_LIB_CTX *ossl_ctx;
+static EVP_CIPHER *cipher_bf_cbc;
+static EVP_CIPHER *cipher_bf_ecb;
 #endif
 
+/* Initialised cipher contexts, see fish_cipher_ctx() */
+#define FISH_CTX_CACHE_MAX 256
+static GHashTable *cipher_ctx_cache;
+
 int fish_init(void)
 {
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
@@ -118,7 +124,22 @@ int fish_init(void)
 
 void fish_deinit(void)
 {
+    if (cipher_ctx_cache) {
+        g_hash_table_destroy(cipher_ctx_cache);
+        cipher_ctx_cache = NULL;
+    }
+
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (cipher_bf_cbc) {
+        EVP_CIPHER_free(cipher_bf_cbc);
+        cipher_bf_cbc = NULL;
+    }
+
+    if (cipher_bf_ecb) {
+        EVP_CIPHER_free(cipher_bf_ecb);
+        cipher_bf_ecb = NULL;
+    }
+
     if (legacy_provider) {
         OSSL_PROVIDER_unload(legacy_provider);
         legacy_provider = NULL;
@@ -225,6 +246,96 @@ char *fish_base64_decode(const char *message, size_t *final_len) {
     return bytes;
 }
 
+/**
+ * Returns the Blowfish cipher for a mode, fetched once per session
+ */
+static const EVP_CIPHER *fish_get_cipher(int mode) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (mode == EVP_CIPH_CBC_MODE) {
+        if (!cipher_bf_cbc)
+            cipher_bf_cbc = EVP_CIPHER_fetch(ossl_ctx, "BF-CBC", NULL);
+        return cipher_bf_cbc;
+    } else if (mode == EVP_CIPH_ECB_MODE) {
+        if (!cipher_bf_ecb)
+            cipher_bf_ecb = EVP_CIPHER_fetch(ossl_ctx, "BF-ECB", NULL);
+        return cipher_bf_ecb;
+    }
+#else
+    if (mode == EVP_CIPH_CBC_MODE)
+        return EVP_bf_cbc();
+    else if (mode == EVP_CIPH_ECB_MODE)
+        return EVP_bf_ecb();
+#endif
+    return NULL;
+}
+
+/**
+ * Returns a cipher context ready to process a new message. Contexts are kept
+ * per key, mode and direction, since setting up the Blowfish key schedule
+ * costs far more than ciphering a line of IRC text.
+ *
+ * @param [in] key     Bytes of key
+ * @param [in] keylen  Size of key
+ * @param [in] encode  1 or encrypt 0 for decrypt
+ * @param [in] mode    EVP_CIPH_ECB_MODE or EVP_CIPH_CBC_MODE
+ * @param [in] iv      Initialization vector for CBC mode, NULL for ECB
+ * @return The context, owned by the cache
+ */
+static EVP_CIPHER_CTX *fish_cipher_ctx(const char *key, size_t keylen, int encode, int mode, const unsigned char *iv) {
+    EVP_CIPHER_CTX *ctx;
+    const EVP_CIPHER *cipher;
+    unsigned char *id_data;
+    GBytes *id;
+
+    if (!cipher_ctx_cache)
+        cipher_ctx_cache = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+                                                 (GDestroyNotify) g_bytes_unref,
+                                                 (GDestroyNotify) EVP_CIPHER_CTX_free);
+
+    id_data = g_malloc(keylen + 2);
+    id_data[0] = mode;
+    id_data[1] = encode;
+    memcpy(id_data + 2, key, keylen);
+    id = g_bytes_new_take(id_data, keylen + 2);
+
+    ctx = g_hash_table_lookup(cipher_ctx_cache, id);
+    if (ctx) {
+        g_bytes_unref(id);
+
+        /* No key given, so the schedule stays and only the IV and state reset */
+        if (1 != EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, encode))
+            return NULL;
+        return ctx;
+    }
+
+    cipher = fish_get_cipher(mode);
+
+    /* Create and initialise the context */
+    if (!cipher || !(ctx = EVP_CIPHER_CTX_new())) {
+        g_bytes_unref(id);
+        return NULL;
+    }
+
+    /* Initialise the cipher operation only with mode, set the custom key
+     * length and then finish the initiation with the key */
+    if (!EVP_CipherInit_ex(ctx, cipher, NULL, NULL, NULL, encode) ||
+        !EVP_CIPHER_CTX_set_key_length(ctx, keylen) ||
+        1 != EVP_CipherInit_ex(ctx, NULL, NULL, (const unsigned char *) key, iv, encode)) {
+        EVP_CIPHER_CTX_free(ctx);
+        g_bytes_unref(id);
+        return NULL;
+    }
+
+    /* We will manage this */
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+    if (g_hash_table_size(cipher_ctx_cache) >= FISH_CTX_CACHE_MAX)
+        g_hash_table_remove_all(cipher_ctx_cache);
+    g_hash_table_insert(cipher_ctx_cache, id, ctx);
+
+    return ctx;
+}
+
 /**
  * Encrypt or decrypt data with Blowfish cipher, support binary data.
  *
@@ -249,7 +360,6 @@ char *fish_base64_decode(const char *message, size_t *final_len) {
  */
 char *fish_cipher(const char *plaintext, size_t plaintext_len, const char *key, size_t keylen, int encode, int mode, size_t *ciphertext_len) {
     EVP_CIPHER_CTX *ctx;
-    EVP_CIPHER *cipher = NULL;
     int bytes_written = 0;
     unsigned char *ciphertext = NULL;
     unsigned char *iv_ciphertext = NULL;
@@ -276,20 +386,6 @@ char *fish_cipher(const char *plaintext, size_t plaintext_len, const char *key,
             plaintext += 8;
             plaintext_len -= 8;
         }
-
-#if OPENSSL_VERSION_NUMBER >= 0x30000000L
-        cipher = EVP_CIPHER_fetch(ossl_ctx, "BF-CBC", NULL);
-#else
-        cipher = (EVP_CIPHER *) EVP_bf_cbc();
-#endif
-
-    } else if (mode == EVP_CIPH_ECB_MODE) {
-
-#if OPENSSL_VERSION_NUMBER >= 0x30000000L
-        cipher = EVP_CIPHER_fetch(ossl_ctx, "BF-ECB", NULL);
-#else
-        cipher = (EVP_CIPHER *) EVP_bf_ecb();
-#endif
     }
 
     /* Zero Padding */
@@ -300,25 +396,10 @@ char *fish_cipher(const char *plaintext, size_t plaintext_len, const char *key,
     ciphertext = (unsigned char *) g_malloc0(block_size);
     memcpy(ciphertext, plaintext, plaintext_len);
 
-    /* Create and initialise the context */
-    if (!(ctx = EVP_CIPHER_CTX_new()))
-        return NULL;
-
-    /* Initialise the cipher operation only with mode */
-    if (!EVP_CipherInit_ex(ctx, cipher, NULL, NULL, NULL, encode))
-        return NULL;
-
-    /* Set custom key length */
-    if (!EVP_CIPHER_CTX_set_key_length(ctx, keylen))
+    /* Get a context with the key schedule in place */
+    if (!(ctx = fish_cipher_ctx(key, keylen, encode, mode, iv)))
         return NULL;
 
-    /* Finish the initiation the cipher operation */
-    if (1 != EVP_CipherInit_ex(ctx, NULL, NULL, (const unsigned char *) key, iv, encode))
-        return NULL;
-
-    /* We will manage this */
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-
     /* Do cipher operation */
     if (1 != EVP_CipherUpdate(ctx, ciphertext, &bytes_written, ciphertext, block_size))
         return NULL;
@@ -331,10 +412,6 @@ char *fish_cipher(const char *plaintext, size_t plaintext_len, const char *key,
 
     *ciphertext_len += bytes_written;
 
-    /* Clean up */
-    EVP_CIPHER_CTX_free(ctx);
-
-
     if (mode == EVP_CIPH_CBC_MODE && encode == 1) {
         /* Join IV + DATA */
         iv_ciphertext = g_malloc0(8 + *ciphertext_len);
@@ -25,6 +25,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "irc.h"
@@ -35,6 +36,21 @@
 
 static char *keystore_password = NULL;
 
+/**
+ * A loaded key store entry. The stored value is only decrypted the first
+ * time the key is asked for.
+ */
+typedef struct {
+    gchar *value;
+    char *key;
+    enum fish_mode mode;
+} keystore_entry;
+
+/* casefolded, escaped nick -> keystore_entry, NULL until first use */
+static GHashTable *keystore_cache = NULL;
+static time_t keystore_mtime;
+static goffset keystore_size;
+
 
 /**
  * Opens the key store file: ~/.config/hexchat/addon_fishlim.conf
@@ -100,59 +116,147 @@ static gchar *get_nick_value(GKeyFile *keyfile, const char *nick, const char *it
 }
 
 
+static void keystore_entry_free(keystore_entry *entry) {
+    g_free(entry->value);
+    g_free(entry->key);
+    g_free(entry);
+}
+
 /**
- * Extracts a key from the key store file.
+ * Lowercases a nick with the rfc1459 casemapping, matching irc_nick_cmp
+ * on a default server.
  */
-char *keystore_get_key(const char *nick, enum fish_mode *mode) {
-    GKeyFile *keyfile;
-    char *escaped_nick;
-    gchar *value, *key_mode;
-    int encrypted_mode;
-    char *password;
-    char *encrypted;
-    char *decrypted;
+static char *casefold_nickname(const char *nick) {
+    char *folded = g_strdup(nick);
+    char *p;
 
-    /* Get the key */
-    keyfile = getConfigFile();
-    escaped_nick = escape_nickname(nick);
-    value = get_nick_value(keyfile, escaped_nick, "key");
-    key_mode = get_nick_value(keyfile, escaped_nick, "mode");
-    g_key_file_free(keyfile);
-    g_free(escaped_nick);
+    for (p = folded; *p; ++p) {
+        if (*p >= 'A' && *p <= '^')
+            *p += 'a' - 'A';
+    }
+
+    return folded;
+}
+
+/**
+ * Drops the loaded key store, it's read again on the next lookup.
+ */
+static void keystore_cache_invalidate(void) {
+    g_clear_pointer(&keystore_cache, g_hash_table_destroy);
+}
+
+/**
+ * Loads addon_fishlim.conf into the cache, unless it's already loaded and
+ * the file hasn't changed since.
+ */
+static GHashTable *keystore_cache_get(void) {
+    GKeyFile *keyfile;
+    GStatBuf st;
+    gchar *filename;
+    gchar **group, **groups;
+    gchar *key_mode;
+    keystore_entry *entry;
+    char *folded;
 
-    /* Determine cipher mode */
-    *mode = FISH_ECB_MODE;
-    if (key_mode) {
-        if (*key_mode == '1')
-            *mode = FISH_ECB_MODE;
-        else if (*key_mode == '2')
-            *mode = FISH_CBC_MODE;
-        g_free(key_mode);
+    filename = get_config_filename();
+    if (g_stat(filename, &st) != 0) {
+        st.st_mtime = 0;
+        st.st_size = 0;
     }
+    g_free(filename);
 
-    if (!value)
-        return NULL;
+    if (keystore_cache && st.st_mtime == keystore_mtime && st.st_size == keystore_size)
+        return keystore_cache;
 
-    if (strncmp(value, "+OK ", 4) == 0) {
-        /* Key is encrypted */
-        encrypted = (char *) value;
-        encrypted += 4;
+    keystore_cache_invalidate();
+    keystore_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify) keystore_entry_free);
+    keystore_mtime = st.st_mtime;
+    keystore_size = st.st_size;
 
-        encrypted_mode = FISH_ECB_MODE;
+    keyfile = getConfigFile();
+    groups = g_key_file_get_groups(keyfile, NULL);
 
-        if (*encrypted == '*') {
-            ++encrypted;
-            encrypted_mode = FISH_CBC_MODE;
+    for (group = groups; *group != NULL; group++) {
+        folded = casefold_nickname(*group);
+
+        /* Like the old linear scan, the first matching group wins */
+        if (g_hash_table_contains(keystore_cache, folded)) {
+            g_free(folded);
+            continue;
         }
 
-        password = (char *) get_keystore_password();
-        decrypted = fish_decrypt_str((const char *) password, strlen(password), (const char *) encrypted, encrypted_mode);
-        g_free(value);
-        return decrypted;
-    } else {
+        entry = g_new0(keystore_entry, 1);
+        entry->value = g_key_file_get_string(keyfile, *group, "key", NULL);
+
+        /* Determine cipher mode */
+        entry->mode = FISH_ECB_MODE;
+        key_mode = g_key_file_get_string(keyfile, *group, "mode", NULL);
+        if (key_mode) {
+            if (*key_mode == '1')
+                entry->mode = FISH_ECB_MODE;
+            else if (*key_mode == '2')
+                entry->mode = FISH_CBC_MODE;
+            g_free(key_mode);
+        }
+
+        g_hash_table_insert(keystore_cache, folded, entry);
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(keyfile);
+    return keystore_cache;
+}
+
+/**
+ * Decrypts the value stored for an entry.
+ */
+static char *decrypt_value(const char *value) {
+    const char *password;
+    const char *encrypted;
+    int encrypted_mode;
+
+    if (strncmp(value, "+OK ", 4) != 0) {
         /* Key is stored in plaintext */
-        return value;
+        return g_strdup(value);
+    }
+
+    /* Key is encrypted */
+    encrypted = value + 4;
+    encrypted_mode = FISH_ECB_MODE;
+
+    if (*encrypted == '*') {
+        ++encrypted;
+        encrypted_mode = FISH_CBC_MODE;
     }
+
+    password = get_keystore_password();
+    return fish_decrypt_str(password, strlen(password), encrypted, encrypted_mode);
+}
+
+/**
+ * Extracts a key from the key store file.
+ */
+char *keystore_get_key(const char *nick, enum fish_mode *mode) {
+    keystore_entry *entry;
+    char *escaped_nick;
+    char *folded;
+
+    escaped_nick = escape_nickname(nick);
+    folded = casefold_nickname(escaped_nick);
+    entry = g_hash_table_lookup(keystore_cache_get(), folded);
+    g_free(folded);
+    g_free(escaped_nick);
+
+    *mode = entry ? entry->mode : FISH_ECB_MODE;
+
+    if (!entry || !entry->value)
+        return NULL;
+
+    if (!entry->key)
+        entry->key = decrypt_value(entry->value);
+
+    return g_strdup(entry->key);
 }
 
 /**
@@ -252,6 +356,7 @@ gboolean keystore_store_key(const char *nick, const char *key, enum fish_mode mo
     
     /* Save key store file */
     ok = save_keystore(keyfile);
+    keystore_cache_invalidate();
     
   end:
     g_key_file_free(keyfile);
@@ -271,8 +376,16 @@ gboolean keystore_delete_nick(const char *nick) {
     
     /* Save */
     if (ok) save_keystore(keyfile);
+    keystore_cache_invalidate();
     
     g_key_file_free(keyfile);
     g_free(escaped_nick);
     return ok;
 }
+
+/**
+ * Frees the loaded key store.
+ */
+void keystore_deinit(void) {
+    keystore_cache_invalidate();
+}
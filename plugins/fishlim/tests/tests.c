@@ -123,6 +123,51 @@ test_cbc(void)
     }
 }
 
+/**
+ * Check that cipher contexts reused across keys and messages don't leak state
+ */
+static void
+test_key_reuse(void)
+{
+    char *b64[2][2];
+    char *de = NULL;
+    const char *keys[] = {"first key", "second key"};
+    const char *message = "the same message twice";
+    int i, k = 0;
+
+    for (i = 0; i < 2; ++i) {
+        for (k = 0; k < 2; ++k) {
+            b64[i][k] = fish_encrypt(keys[k], strlen(keys[k]), message, strlen(message), FISH_ECB_MODE);
+            g_assert_nonnull(b64[i][k]);
+        }
+    }
+
+    /* ECB is deterministic, so a reused context must give the same output */
+    g_assert_cmpstr(b64[0][0], ==, b64[1][0]);
+    g_assert_cmpstr(b64[0][1], ==, b64[1][1]);
+    g_assert_cmpstr(b64[0][0], !=, b64[0][1]);
+
+    for (i = 0; i < 2; ++i) {
+        for (k = 0; k < 2; ++k) {
+            de = fish_decrypt_str(keys[k], strlen(keys[k]), b64[i][k], FISH_ECB_MODE);
+            g_assert_cmpstr(de, ==, message);
+            g_free(de);
+            g_free(b64[i][k]);
+        }
+    }
+
+    /* CBC with alternating keys */
+    for (i = 0; i < 4; ++i) {
+        k = i % 2;
+        b64[0][0] = fish_encrypt(keys[k], strlen(keys[k]), message, strlen(message), FISH_CBC_MODE);
+        g_assert_nonnull(b64[0][0]);
+        de = fish_decrypt_str(keys[k], strlen(keys[k]), b64[0][0], FISH_CBC_MODE);
+        g_assert_cmpstr(de, ==, message);
+        g_free(de);
+        g_free(b64[0][0]);
+    }
+}
+
 /**
  * Check the calculation of final length from an encoded string in Base64
  */
@@ -271,6 +316,7 @@ main(int argc, char *argv[]) {
 
     g_test_add_func("/fishlim/ecb", test_ecb);
     g_test_add_func("/fishlim/cbc", test_cbc);
+    g_test_add_func("/fishlim/key_reuse", test_key_reuse);
     g_test_add_func("/fishlim/base64_len", test_base64_len);
     g_test_add_func("/fishlim/base64_fish_len", test_base64_fish_len);
     g_test_add_func("/fishlim/base64_ecb_len", test_base64_ecb_len);
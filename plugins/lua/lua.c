@@ -51,6 +51,7 @@ static char command_help[] =
 	"            console";
 
 static char registry_field[] = "plugin";
+static char listfields_field[] = "listfields";
 
 static hexchat_plugin *ph;
 
@@ -67,6 +68,13 @@ typedef struct
 }
 hook_info;
 
+typedef struct
+{
+	hexchat_list *list;
+	int fields;
+}
+list_info;
+
 typedef struct
 {
 	char *name;
@@ -124,6 +132,31 @@ static int api_hexchat_command(lua_State *L)
 	return 0;
 }
 
+static int api_hexchat_command_batch(lua_State *L)
+{
+	char const **commands;
+	int i, count;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	count = lua_rawlen(L, 1);
+	luaL_checkstack(L, count, "too many commands");
+	commands = g_new(char const *, count ? count : 1);
+	for(i = 0; i < count; i++)
+	{
+		lua_rawgeti(L, 1, i + 1);
+		commands[i] = lua_tostring(L, -1);
+		if(!commands[i])
+		{
+			g_free(commands);
+			return luaL_argerror(L, 1, "commands must be strings");
+		}
+	}
+	count = hexchat_command_batch(ph, commands, count, lua_toboolean(L, 2) ? HEXCHAT_BATCH_SKIP_SELF : 0);
+	g_free(commands);
+	lua_pushinteger(L, count);
+	return 1;
+}
+
 static int tostring(lua_State *L, int n)
 {
 	luaL_checkany(L, n);
@@ -264,28 +297,193 @@ static int unregister_hook(hook_info *hook)
 	return 0;
 }
 
-static int api_command_closure(char *word[], char *word_eol[], void *udata)
+/*
+ * Hook word arrays are handed to scripts as proxy tables: the strings are
+ * copied into one userdata per array and only turned into Lua strings when a
+ * script indexes them, which most hooks do for two or three entries at most.
+ * Nothing read is cached in the proxy itself, so every write, nil included,
+ * reaches __newindex, which turns it into a plain table before the write
+ * lands. table.remove and friends then see ordinary table semantics.
+ * The copy keeps a proxy usable after the hook returns. Lua 5.1 and 5.2 do not
+ * honour __index in table.concat, ipairs or unpack, so there the tables are
+ * still filled up front.
+ */
+#if LUA_VERSION_NUM >= 503
+static char wordframes_field[] = "wordframes";
+
+typedef struct
 {
-	int base, i, ret;
-	hook_info *info = udata;
-	lua_State *L = info->state;
-	script_info *script = get_info(L);
+	int count;
+	char const *word[WORD_ARRAY_LEN];
+}
+word_frame;
+
+static word_frame *get_word_frame(lua_State *L, int index)
+{
+	word_frame *frame;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, wordframes_field);
+	lua_pushvalue(L, index);
+	lua_rawget(L, -2);
+	frame = lua_touserdata(L, -1);
+	lua_pop(L, 2);
+	return frame;
+}
+
+static void push_words(lua_State *L, char *word[], int count)
+{
+	word_frame *frame;
+	size_t len[WORD_ARRAY_LEN];
+	size_t root_len, size = 0;
+	char const *root = word[1];
+	char *buf;
+	int i;
+
+	/* word_eol entries are normally suffixes of word_eol[1], store those once */
+	root_len = count ? strlen(root) : 0;
+	for(i = 1; i <= count; i++)
+	{
+		if(i > 1 && word[i] >= root && word[i] <= root + root_len)
+			len[i] = 0;
+		else
+			size += (len[i] = strlen(word[i])) + 1;
+	}
 
-	lua_rawgeti(L, LUA_REGISTRYINDEX, script->traceback);
-	base = lua_gettop(L);
-	lua_rawgeti(L, LUA_REGISTRYINDEX, info->ref);
 	lua_newtable(L);
-	for(i = 1; i < WORD_ARRAY_LEN && *word_eol[i]; i++)
+	lua_getfield(L, LUA_REGISTRYINDEX, wordframes_field);
+	lua_pushvalue(L, -2);
+	frame = lua_newuserdata(L, sizeof(word_frame) + size);
+	buf = (char *)(frame + 1);
+	frame->count = count;
+	for(i = 1; i <= count; i++)
+	{
+		if(i > 1 && word[i] >= root && word[i] <= root + root_len)
+		{
+			frame->word[i] = frame->word[1] + (word[i] - root);
+			continue;
+		}
+		memcpy(buf, word[i], len[i] + 1);
+		frame->word[i] = buf;
+		buf += len[i] + 1;
+	}
+	lua_rawset(L, -3);
+	lua_pop(L, 1);
+	luaL_getmetatable(L, "wordlist");
+	lua_setmetatable(L, -2);
+}
+
+static int api_wordlist_meta_index(lua_State *L)
+{
+	word_frame *frame = get_word_frame(L, 1);
+	lua_Integer i;
+	int isnum;
+
+	i = lua_tointegerx(L, 2, &isnum);
+	if(!frame || !isnum || i < 1 || i > frame->count)
+		return 0;
+	lua_pushstring(L, frame->word[i]);
+	return 1;
+}
+
+static int api_wordlist_meta_len(lua_State *L)
+{
+	word_frame *frame = get_word_frame(L, 1);
+
+	lua_pushinteger(L, frame ? frame->count : 0);
+	return 1;
+}
+
+/* a script writing to it gets a plain table from then on */
+static int api_wordlist_meta_newindex(lua_State *L)
+{
+	word_frame *frame = get_word_frame(L, 1);
+	int i;
+
+	if(frame)
 	{
-		lua_pushstring(L, word[i]);
-		lua_rawseti(L, -2, i);
+		for(i = 1; i <= frame->count; i++)
+		{
+			lua_pushstring(L, frame->word[i]);
+			lua_rawseti(L, 1, i);
+		}
+		lua_getfield(L, LUA_REGISTRYINDEX, wordframes_field);
+		lua_pushvalue(L, 1);
+		lua_pushnil(L);
+		lua_rawset(L, -3);
+		lua_pop(L, 1);
 	}
+	lua_pushnil(L);
+	lua_setmetatable(L, 1);
+	lua_settop(L, 3);
+	lua_rawset(L, 1);
+	return 0;
+}
+
+static int api_wordlist_pairs_next(lua_State *L)
+{
+	lua_Integer i = luaL_checkinteger(L, 2) + 1;
+
+	if(lua_geti(L, 1, i) == LUA_TNIL)
+		return 1;
+	lua_pushinteger(L, i);
+	lua_insert(L, -2);
+	return 2;
+}
+
+static int api_wordlist_meta_pairs(lua_State *L)
+{
+	lua_pushcfunction(L, api_wordlist_pairs_next);
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, 0);
+	return 3;
+}
+#else
+static void push_words(lua_State *L, char *word[], int count)
+{
+	int i;
+
 	lua_newtable(L);
-	for(i = 1; i < WORD_ARRAY_LEN && *word_eol[i]; i++)
+	for(i = 1; i <= count; i++)
 	{
-		lua_pushstring(L, word_eol[i]);
+		lua_pushstring(L, word[i]);
 		lua_rawseti(L, -2, i);
 	}
+}
+#endif
+
+static inline int word_eol_count(char *word_eol[])
+{
+	int i;
+
+	for(i = 1; i < WORD_ARRAY_LEN && *word_eol[i]; i++);
+	return i - 1;
+}
+
+static inline int word_count(char *word[])
+{
+	int j;
+
+	for(j = 31; j >= 1; j--)
+	{
+		if(*word[j])
+			break;
+	}
+	return j;
+}
+
+static int api_command_closure(char *word[], char *word_eol[], void *udata)
+{
+	int base, count, ret;
+	hook_info *info = udata;
+	lua_State *L = info->state;
+	script_info *script = get_info(L);
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, script->traceback);
+	base = lua_gettop(L);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, info->ref);
+	count = word_eol_count(word_eol);
+	push_words(L, word, count);
+	push_words(L, word_eol, count);
 	script->status |= STATUS_ACTIVE;
 	if(lua_pcall(L, 2, 1, base))
 	{
@@ -329,23 +527,13 @@ static int api_print_closure(char *word[], void *udata)
 	hook_info *info = udata;
 	lua_State *L = info->state;
 	script_info *script = get_info(L);
-	int i, j, base, ret;
+	int base, ret;
 
 	lua_rawgeti(L, LUA_REGISTRYINDEX, script->traceback);
 	base = lua_gettop(L);
 	lua_rawgeti(L, LUA_REGISTRYINDEX, info->ref);
 
-	for(j = 31; j >= 1; j--)
-	{
-		if(*word[j])
-			break;
-	}
-	lua_newtable(L);
-	for(i = 1; i <= j; i++)
-	{
-		lua_pushstring(L, word[i]);
-		lua_rawseti(L, -2, i);
-	}
+	push_words(L, word, word_count(word));
 	script->status |= STATUS_ACTIVE;
 	if(lua_pcall(L, 1, 1, base))
 	{
@@ -394,23 +582,13 @@ static int api_print_attrs_closure(char *word[], hexchat_event_attrs *attrs, voi
 	hook_info *info = udata;
 	lua_State *L = info->state;
 	script_info *script = get_info(L);
-	int base, i, j, ret;
+	int base, ret;
 	hexchat_event_attrs **u;
 
 	lua_rawgeti(L, LUA_REGISTRYINDEX, script->traceback);
 	base = lua_gettop(L);
 	lua_rawgeti(L, LUA_REGISTRYINDEX, info->ref);
-	for(j = 31; j >= 1; j--)
-	{
-		if(*word[j])
-			break;
-	}
-	lua_newtable(L);
-	for(i = 1; i <= j; i++)
-	{
-		lua_pushstring(L, word[i]);
-		lua_rawseti(L, -2, i);
-	}
+	push_words(L, word, word_count(word));
 	u = lua_newuserdata(L, sizeof(hexchat_event_attrs *));
 	*u = event_attrs_copy(attrs);
 	luaL_newmetatable(L, "attrs");
@@ -456,23 +634,14 @@ static int api_server_closure(char *word[], char *word_eol[], void *udata)
 	hook_info *info = udata;
 	lua_State *L = info->state;
 	script_info *script = get_info(L);
-	int base, i, ret;
+	int base, count, ret;
 
 	lua_rawgeti(L, LUA_REGISTRYINDEX, script->traceback);
 	base = lua_gettop(L);
 	lua_rawgeti(L, LUA_REGISTRYINDEX, info->ref);
-	lua_newtable(L);
-	for(i = 1; i < WORD_ARRAY_LEN && *word_eol[i]; i++)
-	{
-		lua_pushstring(L, word[i]);
-		lua_rawseti(L, -2, i);
-	}
-	lua_newtable(L);
-	for(i = 1; i < WORD_ARRAY_LEN && *word_eol[i]; i++)
-	{
-		lua_pushstring(L, word_eol[i]);
-		lua_rawseti(L, -2, i);
-	}
+	count = word_eol_count(word_eol);
+	push_words(L, word, count);
+	push_words(L, word_eol, count);
 	script->status |= STATUS_ACTIVE;
 	if(lua_pcall(L, 2, 1, base))
 	{
@@ -514,24 +683,15 @@ static int api_server_attrs_closure(char *word[], char *word_eol[], hexchat_even
 	hook_info *info = udata;
 	lua_State *L = info->state;
 	script_info *script = get_info(L);
-	int base, i, ret;
+	int base, count, ret;
 	hexchat_event_attrs **u;
 
 	lua_rawgeti(L, LUA_REGISTRYINDEX, script->traceback);
 	base = lua_gettop(L);
 	lua_rawgeti(L, LUA_REGISTRYINDEX, info->ref);
-	lua_newtable(L);
-	for(i = 1; i < WORD_ARRAY_LEN && *word_eol[i]; i++)
-	{
-		lua_pushstring(L, word[i]);
-		lua_rawseti(L, -2, i);
-	}
-	lua_newtable(L);
-	for(i = 1; i < WORD_ARRAY_LEN && *word_eol[i]; i++)
-	{
-		lua_pushstring(L, word_eol[i]);
-		lua_rawseti(L, -2, i);
-	}
+	count = word_eol_count(word_eol);
+	push_words(L, word, count);
+	push_words(L, word_eol, count);
 
 	u = lua_newuserdata(L, sizeof(hexchat_event_attrs *));
 	*u = event_attrs_copy(attrs);
@@ -747,10 +907,46 @@ static int api_hexchat_attrs(lua_State *L)
 	return 1;
 }
 
+/*
+ * Field names of a list mapped to (id << 8 | type), built once per list name
+ * so that reading an entry is a table lookup and a typed call.
+ */
+static void push_list_fields(lua_State *L, char const *name)
+{
+	char const *const *fields;
+	int id;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, listfields_field);
+	if(lua_isnil(L, -1))
+	{
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, listfields_field);
+	}
+	lua_getfield(L, -1, name);
+	if(lua_isnil(L, -1))
+	{
+		lua_pop(L, 1);
+		lua_newtable(L);
+		for(fields = hexchat_list_fields(ph, name); fields && *fields; fields++)
+		{
+			id = hexchat_list_field_id(ph, name, *fields + 1);
+			if(id == -1)
+				continue;
+			lua_pushinteger(L, id << 8 | (unsigned char)**fields);
+			lua_setfield(L, -2, *fields + 1);
+		}
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -3, name);
+	}
+	lua_remove(L, -2);
+}
+
 static int api_iterate_closure(lua_State *L)
 {
-	hexchat_list *list = *(hexchat_list **)luaL_checkudata(L, lua_upvalueindex(1), "list");
-	if(hexchat_list_next(ph, list))
+	list_info *info = luaL_checkudata(L, lua_upvalueindex(1), "list");
+	if(hexchat_list_next(ph, info->list))
 	{
 		lua_pushvalue(L, lua_upvalueindex(1));
 		return 1;
@@ -765,8 +961,10 @@ static int api_hexchat_iterate(lua_State *L)
 	hexchat_list *list = hexchat_list_get(ph, name);
 	if(list)
 	{
-		hexchat_list **u = lua_newuserdata(L, sizeof(hexchat_list *));
-		*u = list;
+		list_info *u = lua_newuserdata(L, sizeof(list_info));
+		u->list = list;
+		push_list_fields(L, name);
+		u->fields = luaL_ref(L, LUA_REGISTRYINDEX);
 		luaL_newmetatable(L, "list");
 		lua_setmetatable(L, -2);
 		lua_pushcclosure(L, api_iterate_closure, 1);
@@ -806,37 +1004,55 @@ static int api_hexchat_prefs_meta_newindex(lua_State *L)
 	return luaL_error(L, "hexchat.prefs is read-only");
 }
 
+/* expects the list's field table on top of the stack and replaces it with the value */
 static inline int list_marshal(lua_State *L, const char *key, hexchat_list *list)
 {
-	char const *str = hexchat_list_str(ph, list, key);
-	int number;
-	if(str)
-	{
-		if(!strcmp(key, "context"))
-		{
-			hexchat_context **u = lua_newuserdata(L, sizeof(hexchat_context *));
-			*u = (hexchat_context *)str;
-			luaL_newmetatable(L, "context");
-			lua_setmetatable(L, -2);
-			return 1;
-		}
-		lua_pushstring(L, str);
-		return 1;
-	}
-	number = hexchat_list_int(ph, list, key);
-	if(number != -1)
+	char const *str;
+	time_t tm;
+	int number, id, type;
+
+	lua_getfield(L, -1, key);
+	if(lua_isnil(L, -1))
 	{
-		lua_pushinteger(L, number);
+		lua_pop(L, 2);
+		lua_pushnil(L);
 		return 1;
 	}
-	if (list != NULL)
-	{
-		time_t tm = hexchat_list_time(ph, list, key);
-		if(tm != -1)
-		{
+	id = lua_tointeger(L, -1);
+	lua_pop(L, 2);
+	type = id & 0xff;
+	id >>= 8;
+	switch(type)
+	{
+		case 'p':
+			str = hexchat_list_str_id(ph, list, id);
+			if(!str)
+				break;
+			{
+				hexchat_context **u = lua_newuserdata(L, sizeof(hexchat_context *));
+				*u = (hexchat_context *)str;
+				luaL_newmetatable(L, "context");
+				lua_setmetatable(L, -2);
+				return 1;
+			}
+		case 's':
+			str = hexchat_list_str_id(ph, list, id);
+			if(!str)
+				break;
+			lua_pushstring(L, str);
+			return 1;
+		case 'i':
+			number = hexchat_list_int_id(ph, list, id);
+			if(number == -1)
+				break;
+			lua_pushinteger(L, number);
+			return 1;
+		case 't':
+			tm = hexchat_list_time_id(ph, list, id);
+			if(tm == -1)
+				break;
 			lua_pushinteger(L, tm);
 			return 1;
-		}
 	}
 
 	lua_pushnil(L);
@@ -846,6 +1062,7 @@ static inline int list_marshal(lua_State *L, const char *key, hexchat_list *list
 static int api_hexchat_props_meta_index(lua_State *L)
 {
 	char const *key = luaL_checkstring(L, 2);
+	push_list_fields(L, "channels");
 	return list_marshal(L, key, NULL);
 }
 
@@ -1010,9 +1227,10 @@ static int api_attrs_meta_gc(lua_State *L)
 
 static int api_list_meta_index(lua_State *L)
 {
-	hexchat_list *list = *(hexchat_list **)luaL_checkudata(L, 1, "list");
+	list_info *info = luaL_checkudata(L, 1, "list");
 	char const *key = luaL_checkstring(L, 2);
-	return list_marshal(L, key, list);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, info->fields);
+	return list_marshal(L, key, info->list);
 }
 
 static int api_list_meta_newindex(lua_State *L)
@@ -1022,14 +1240,16 @@ static int api_list_meta_newindex(lua_State *L)
 
 static int api_list_meta_gc(lua_State *L)
 {
-	hexchat_list *list = *(hexchat_list **)luaL_checkudata(L, 1, "list");
-	hexchat_list_free(ph, list);
+	list_info *info = luaL_checkudata(L, 1, "list");
+	hexchat_list_free(ph, info->list);
+	luaL_unref(L, LUA_REGISTRYINDEX, info->fields);
 	return 0;
 }
 
 static luaL_Reg api_hexchat[] = {
 	{"register", api_hexchat_register},
 	{"command", api_hexchat_command},
+	{"command_batch", api_hexchat_command_batch},
 	{"print", api_hexchat_print},
 	{"emit_print", api_hexchat_emit_print},
 	{"emit_print_attrs", api_hexchat_emit_print_attrs},
@@ -1091,6 +1311,16 @@ static luaL_Reg api_list_meta[] = {
 	{NULL, NULL}
 };
 
+#if LUA_VERSION_NUM >= 503
+static luaL_Reg api_wordlist_meta[] = {
+	{"__index", api_wordlist_meta_index},
+	{"__newindex", api_wordlist_meta_newindex},
+	{"__len", api_wordlist_meta_len},
+	{"__pairs", api_wordlist_meta_pairs},
+	{NULL, NULL}
+};
+#endif
+
 static int luaopen_hexchat(lua_State *L)
 {
 	lua_newtable(L);
@@ -1156,6 +1386,19 @@ static int luaopen_hexchat(lua_State *L)
 	luaL_setfuncs(L, api_list_meta, 0);
 	lua_pop(L, 1);
 
+#if LUA_VERSION_NUM >= 503
+	luaL_newmetatable(L, "wordlist");
+	luaL_setfuncs(L, api_wordlist_meta, 0);
+	lua_pop(L, 1);
+
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_pushstring(L, "k");
+	lua_setfield(L, -2, "__mode");
+	lua_setmetatable(L, -2);
+	lua_setfield(L, LUA_REGISTRYINDEX, wordframes_field);
+#endif
+
 	return 1;
 }
 
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015-2016 mniip
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/* the word proxies are static, so build the plugin source right in here */
+#include "lua.c"
+
+static char line[] = "PRIVMSG #chan :hello there";
+
+/* runs code with a hook word table as its ... */
+static void run_with_words(char *word[], int count, char const *code)
+{
+	lua_State *L = luaL_newstate();
+
+	luaL_openlibs(L);
+	luaopen_hexchat(L);
+	lua_setglobal(L, "hexchat");
+
+	if(luaL_loadstring(L, code) != 0)
+		g_error("%s", lua_tostring(L, -1));
+	push_words(L, word, count);
+	if(lua_pcall(L, 1, 0, 0) != 0)
+		g_error("%s", lua_tostring(L, -1));
+
+	lua_close(L);
+}
+
+static void test_word_remove(void)
+{
+	char *word[WORD_ARRAY_LEN] = { "", "PRIVMSG", "#chan", ":hello", "there" };
+
+	run_with_words(word, 4,
+		"local word = ...\n"
+		"assert(#word == 4)\n"
+		"assert(word[1] == 'PRIVMSG')\n"
+		"assert(table.remove(word, 1) == 'PRIVMSG')\n"
+		"assert(#word == 3)\n"
+		"assert(word[1] == '#chan')\n"
+		"assert(word[3] == 'there')\n"
+		"assert(word[4] == nil)\n");
+}
+
+static void test_word_assign_nil(void)
+{
+	char *word[WORD_ARRAY_LEN] = { "", "PRIVMSG", "#chan", ":hello", "there" };
+
+	run_with_words(word, 4,
+		"local word = ...\n"
+		"assert(word[4] == 'there')\n"
+		"word[4] = nil\n"
+		"assert(word[4] == nil)\n"
+		"assert(#word == 3)\n"
+		"assert(word[2] == '#chan')\n"
+		"word[2] = nil\n"
+		"assert(word[2] == nil)\n"
+		"assert(word[3] == ':hello')\n");
+}
+
+static void test_word_eol_remove(void)
+{
+	char *word_eol[WORD_ARRAY_LEN] = { "", line, line + 8, line + 14 };
+
+	run_with_words(word_eol, 3,
+		"local word_eol = ...\n"
+		"assert(word_eol[2] == '#chan :hello there')\n"
+		"table.remove(word_eol, 1)\n"
+		"assert(#word_eol == 2)\n"
+		"assert(word_eol[1] == '#chan :hello there')\n"
+		"assert(word_eol[2] == ':hello there')\n"
+		"assert(word_eol[3] == nil)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/lua/word_remove", test_word_remove);
+	g_test_add_func("/lua/word_assign_nil", test_word_assign_nil);
+	g_test_add_func("/lua/word_eol_remove", test_word_eol_remove);
+
+	return g_test_run();
+}
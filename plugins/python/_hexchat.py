@@ -7,7 +7,7 @@ from _hexchat_embedded import ffi, lib
 __all__ = [
     'EAT_ALL', 'EAT_HEXCHAT', 'EAT_NONE', 'EAT_PLUGIN', 'EAT_XCHAT',
     'PRI_HIGH', 'PRI_HIGHEST', 'PRI_LOW', 'PRI_LOWEST', 'PRI_NORM',
-    '__doc__', '__version__', 'command', 'del_pluginpref', 'emit_print',
+    '__doc__', '__version__', 'command', 'command_batch', 'del_pluginpref', 'emit_print',
     'find_context', 'get_context', 'get_info',
     'get_list', 'get_lists', 'get_pluginpref', 'get_prefs', 'hook_command',
     'hook_print', 'hook_print_attrs', 'hook_server', 'hook_server_attrs',
@@ -83,6 +83,15 @@ def command(command):
     lib.hexchat_command(lib.ph, command.encode())
 
 
+# Matches HEXCHAT_BATCH_SKIP_SELF, cffi does not see the header's defines
+BATCH_SKIP_SELF = 1
+
+
+def command_batch(commands, skip_self=False):
+    encoded = [ffi.new('char[]', command.encode()) for command in commands]
+    return lib.hexchat_command_batch(lib.ph, encoded, len(encoded), BATCH_SKIP_SELF if skip_self else 0)
+
+
 def nickcmp(string1, string2):
     return lib.hexchat_nickcmp(lib.ph, string1.encode(), string2.encode())
 
@@ -168,9 +177,27 @@ else:
         return name[0]
 
 
+__FIELD_ID_CACHE = {}
+
+
+# (attribute, type, id) for each field of a list, resolved once
+def __get_field_ids(name):
+    ids = __FIELD_ID_CACHE.get(name)
+    if ids is None:
+        ids = []
+        for field in __get_fields(name):
+            field_id = lib.hexchat_list_field_id(lib.ph, name, field[1:])
+            if field_id != -1:
+                ids.append((__cached_decoded_str(field[1:]), get_getter(field), field_id))
+
+        __FIELD_ID_CACHE[name] = ids
+
+    return ids
+
+
 def get_list(name):
-    # XXX: This function is extremely inefficient and could be interators and
-    # lazily loaded properties, but for API compat we stay slow
+    # XXX: This function could be interators and lazily loaded properties,
+    # but for API compat every item is filled in
     orig_name = name
     name = name.encode()
 
@@ -182,37 +209,34 @@ def get_list(name):
         return None
 
     ret = []
-    fields = __get_fields(name)
+    fields = __get_field_ids(name)
 
-    def string_getter(field):
-        string = lib.hexchat_list_str(lib.ph, list_, field)
+    def string_getter(field_id):
+        string = lib.hexchat_list_str_id(lib.ph, list_, field_id)
         if string != ffi.NULL:
             return __decode(ffi.string(string))
 
         return ''
 
-    def ptr_getter(field):
-        if field == b'context':
-            ptr = lib.hexchat_list_str(lib.ph, list_, field)
-            ctx = ffi.cast('hexchat_context*', ptr)
-            return Context(ctx)
+    def ptr_getter(field_id):
+        ptr = lib.hexchat_list_str_id(lib.ph, list_, field_id)
+        if ptr != ffi.NULL:
+            return Context(ffi.cast('hexchat_context*', ptr))
 
         return None
 
     getters = {
         ord('s'): string_getter,
-        ord('i'): lambda field: lib.hexchat_list_int(lib.ph, list_, field),
-        ord('t'): lambda field: lib.hexchat_list_time(lib.ph, list_, field),
+        ord('i'): lambda field_id: lib.hexchat_list_int_id(lib.ph, list_, field_id),
+        ord('t'): lambda field_id: lib.hexchat_list_time_id(lib.ph, list_, field_id),
         ord('p'): ptr_getter,
     }
+    fields = [(attr, getters[getter], field_id) for attr, getter, field_id in fields if getter in getters]
 
     while lib.hexchat_list_next(lib.ph, list_) == 1:
         item = ListItem(orig_name)
-        for _field in fields:
-            getter = getters.get(get_getter(_field))
-            if getter is not None:
-                field_name = _field[1:]
-                setattr(item, __cached_decoded_str(field_name), getter(field_name))
+        for attr, getter, field_id in fields:
+            setattr(item, attr, getter(field_id))
 
         ret.append(item)
 
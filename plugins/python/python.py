@@ -203,7 +203,7 @@ else:
 # There can be empty entries between non-empty ones so find the actual last value
 def wordlist_len(words):
     for i in range(31, 0, -1):
-        if ffi.string(words[i]):
+        if words[i][0] != b'\0':
             return i
 
     return 0
@@ -0,0 +1,392 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#include <string.h>
+#include <glib.h>
+
+#include "hexchat.h"
+#include "hexchatc.h"
+#include "fe.h"
+#include "modes.h"
+#include "text.h"
+#include "netsplit.h"
+#include "chathistory.h"
+#include "batch.h"
+
+/* a server that never closes its batch must not eat all our memory; past
+   this the lines held so far are run and the rest passes straight through */
+#define BATCH_MAX_LINES 10000
+
+enum
+{
+	BATCH_OTHER,
+	BATCH_PLAYBACK,
+	BATCH_NETSPLIT,
+	BATCH_NETJOIN
+};
+
+struct batch
+{
+	char *ref;				/* also the key in serv->batches */
+	char *type;
+	char *params;
+	int kind;				/* BATCH_* */
+	GPtrArray *lines;		/* raw lines, tags included */
+	gboolean overflow;
+
+	/* a batch opened inside another one: its lines, BATCH lines included,
+	   go to the outermost batch and it is opened for real on replay */
+	struct batch *root;
+	int children;			/* on a root, how many point at it */
+};
+
+static int
+batch_kind (const char *type)
+{
+	if (!strcmp (type, "chathistory") || !strcmp (type, "znc.in/playback"))
+		return BATCH_PLAYBACK;
+	if (!strcmp (type, "netsplit"))
+		return BATCH_NETSPLIT;
+	if (!strcmp (type, "netjoin"))
+		return BATCH_NETJOIN;
+	return BATCH_OTHER;
+}
+
+static struct batch *
+batch_new (const char *ref, const char *type, const char *params)
+{
+	struct batch *b;
+
+	b = g_new0 (struct batch, 1);
+	b->ref = g_strdup (ref);
+	b->type = g_strdup (type);
+	b->params = g_strdup (params);
+	b->kind = type ? batch_kind (type) : BATCH_OTHER;
+	b->lines = g_ptr_array_new_with_free_func (g_free);
+	return b;
+}
+
+static void
+batch_free (struct batch *b)
+{
+	g_free (b->ref);
+	g_free (b->type);
+	g_free (b->params);
+	g_ptr_array_free (b->lines, TRUE);
+	g_free (b);
+}
+
+static gboolean
+batch_is_child (gpointer key, gpointer value, gpointer root)
+{
+	return ((struct batch *) value)->root == root;
+}
+
+/* root is going away: its children can't hold anything any more */
+static void
+batch_unlink_children (server *serv, struct batch *root)
+{
+	if (root->children && serv->batches)
+		g_hash_table_foreach_remove (serv->batches, batch_is_child, root);
+	root->children = 0;
+}
+
+/* the window a playback batch is for, from its first parameter */
+static session *
+batch_target (server *serv, const char *params)
+{
+	char target[CHANLEN];
+	gsize n;
+
+	n = strcspn (params, " ");
+	if (!n || n >= sizeof (target))
+		return NULL;
+	memcpy (target, params, n);
+	target[n] = 0;
+
+	if (is_channel (serv, target))
+		return find_channel (serv, target);
+	return find_dialog (serv, target);
+}
+
+static void
+batch_run (server *serv, struct batch *b)
+{
+	GPtrArray *lines = b->lines;
+	session *sess = NULL;
+	gboolean split = FALSE;
+	gboolean prepend = FALSE;
+	int answer = CHATHISTORY_NONE;
+	tab_state_flags tab_state = 0;
+	guint replayed = 0;
+	char count[16];
+	char *line;
+	guint i;
+
+	b->lines = g_ptr_array_new_with_free_func (g_free);
+
+	switch (b->kind)
+	{
+	case BATCH_NETSPLIT:
+	case BATCH_NETJOIN:
+		split = netsplit_batch_begin (serv, b->kind == BATCH_NETJOIN, b->params);
+		break;
+	case BATCH_PLAYBACK:
+		sess = batch_target (serv, b->params);
+		if (!sess)
+			break;
+
+		if (!strcmp (b->type, "chathistory"))
+			answer = chathistory_answer (sess);
+		if (answer != CHATHISTORY_NONE)
+		{
+			/* drop what the window already shows before anything runs */
+			for (i = 0; i < lines->len; i++)
+			{
+				if (!chathistory_wanted (sess, answer, lines->pdata[i]))
+				{
+					g_free (lines->pdata[i]);
+					lines->pdata[i] = NULL;
+				}
+			}
+		}
+
+		/* older than the window: goes on top, isn't new activity and
+		   is neither logged nor saved to scrollback again */
+		prepend = answer == CHATHISTORY_BEFORE && sess->text_batch == 0;
+		if (prepend)
+		{
+			tab_state = sess->tab_state;
+			sess->text_prepend = TRUE;
+		}
+		if (sess->text_batch++ == 0)
+			fe_text_batch (sess, prepend ? FE_TEXT_BATCH_PREPEND : FE_TEXT_BATCH_APPEND);
+		break;
+	}
+
+	for (i = 0; i < lines->len; i++)
+	{
+		line = lines->pdata[i];
+		if (!line)
+			continue;
+		serv->p_inline (serv, line, strlen (line));
+		replayed++;
+	}
+
+	if (split)
+		netsplit_batch_end (serv);
+
+	/* a plugin may have closed it meanwhile */
+	if (sess && is_session (sess))
+	{
+		g_snprintf (count, sizeof (count), "%u", replayed);
+
+		if (prepend)
+		{
+			/* marks where the older page ends */
+			EMIT_SIGNAL (XP_TE_PLAYBACK, sess, sess->channel, count, b->type, NULL, 0);
+			if (--sess->text_batch == 0)
+				fe_text_batch (sess, FE_TEXT_BATCH_END);
+			sess->text_prepend = FALSE;
+			sess->tab_state = tab_state;
+			lastact_update (sess);
+		}
+		else
+		{
+			if (--sess->text_batch == 0)
+				fe_text_batch (sess, FE_TEXT_BATCH_END);
+
+			/* printed normally, so the tab gets one activity update */
+			EMIT_SIGNAL (XP_TE_PLAYBACK, sess, sess->channel, count, b->type, NULL, 0);
+		}
+
+		if (answer != CHATHISTORY_NONE)
+			chathistory_answered (sess, answer, replayed);
+	}
+
+	g_ptr_array_free (lines, TRUE);
+}
+
+/* a BATCH line inside a batch: the sign and reference of the one it opens
+   or closes */
+static gboolean
+batch_nested (const char *p, const char *end, char *sign, char *ref, gsize size)
+{
+	const char *start;
+	gsize n;
+
+	while (p < end && *p == ' ')
+		p++;
+	if (p < end && *p == ':')
+	{
+		p = memchr (p, ' ', end - p);
+		if (!p)
+			return FALSE;
+		while (p < end && *p == ' ')
+			p++;
+	}
+
+	if (end - p < 8 || g_ascii_strncasecmp (p, "BATCH ", 6) != 0)
+		return FALSE;
+	p += 6;
+	while (p < end && *p == ' ')
+		p++;
+	if (p >= end || (*p != '+' && *p != '-'))
+		return FALSE;
+
+	*sign = *p++;
+	start = p;
+	while (p < end && *p != ' ' && *p != '\r' && *p != '\n')
+		p++;
+	n = p - start;
+	if (!n || n >= size)
+		return FALSE;
+	memcpy (ref, start, n);
+	ref[n] = 0;
+	return TRUE;
+}
+
+/* a server that won't close its batch: run what it has and let the rest
+   through, a stub keeps the later lines from being held again */
+static void
+batch_overflow (server *serv, struct batch *b)
+{
+	struct batch *stub;
+
+	batch_unlink_children (serv, b);
+	g_hash_table_steal (serv->batches, b->ref);
+	stub = batch_new (b->ref, b->type, b->params);
+	stub->overflow = TRUE;
+	g_hash_table_replace (serv->batches, stub->ref, stub);
+
+	/* out of the table, so a disconnect while it runs can't free it */
+	batch_run (serv, b);
+	batch_free (b);
+}
+
+gboolean
+batch_hold (server *serv, const char *buf, int len)
+{
+	struct batch *b, *root, *child;
+	const char *tag, *next, *end;
+	char ref[64], child_ref[64];
+	char sign;
+	gsize n;
+
+	if (!serv->batches || buf[0] != '@')
+		return FALSE;
+
+	end = memchr (buf, ' ', len);
+	if (!end)
+		return FALSE;
+
+	ref[0] = 0;
+	for (tag = buf + 1; tag < end; tag = next + 1)
+	{
+		next = memchr (tag, ';', end - tag);
+		if (!next)
+			next = end;
+		if (next - tag > 6 && strncmp (tag, "batch=", 6) == 0)
+		{
+			n = MIN ((gsize)(next - tag - 6), sizeof (ref) - 1);
+			memcpy (ref, tag + 6, n);
+			ref[n] = 0;
+			break;
+		}
+	}
+
+	b = ref[0] ? g_hash_table_lookup (serv->batches, ref) : NULL;
+	if (!b || b->overflow)
+		return FALSE;
+	root = b->root ? b->root : b;
+
+	/* the child is tracked now so that its lines are held too, the line
+	   itself stays in order with the rest and opens it for real on replay */
+	if (batch_nested (end, buf + len, &sign, child_ref, sizeof (child_ref)))
+	{
+		child = g_hash_table_lookup (serv->batches, child_ref);
+		if (sign == '+' && !child)
+		{
+			child = batch_new (child_ref, NULL, NULL);
+			child->root = root;
+			root->children++;
+			g_hash_table_replace (serv->batches, child->ref, child);
+		}
+		else if (sign == '-' && child && child->root == root)
+		{
+			root->children--;
+			g_hash_table_remove (serv->batches, child_ref);
+		}
+	}
+
+	g_ptr_array_add (root->lines, g_strndup (buf, len));
+	if (root->lines->len >= BATCH_MAX_LINES)
+		batch_overflow (serv, root);
+	return TRUE;
+}
+
+void
+batch_command (server *serv, char *ref, char *type, char *params)
+{
+	struct batch *b;
+
+	if (ref[0] == '+' && ref[1] && *type)
+	{
+		if (!serv->batches)
+			serv->batches = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+																(GDestroyNotify) batch_free);
+
+		b = g_hash_table_lookup (serv->batches, ref + 1);
+		if (b)
+			batch_unlink_children (serv, b);
+
+		b = batch_new (ref + 1, type, params);
+		g_hash_table_replace (serv->batches, b->ref, b);
+	}
+	else if (ref[0] == '-' && serv->batches &&
+				(b = g_hash_table_lookup (serv->batches, ref + 1)))
+	{
+		/* out of the table first, its lines must not be held again */
+		g_hash_table_steal (serv->batches, b->ref);
+		batch_unlink_children (serv, b);
+
+		if (b->root)
+		{
+			/* a child closed without its parent's tag: close it on replay */
+			b->root->children--;
+			g_ptr_array_add (b->root->lines,
+								  g_strdup_printf (":%s BATCH -%s", serv->servername, b->ref));
+		}
+		else if (!b->overflow)
+			batch_run (serv, b);
+		batch_free (b);
+	}
+}
+
+void
+batch_server_free (server *serv)
+{
+	if (serv->batches)
+	{
+		g_hash_table_destroy (serv->batches);
+		serv->batches = NULL;
+	}
+}
@@ -0,0 +1,39 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#ifndef HEXCHAT_BATCH_H
+#define HEXCHAT_BATCH_H
+
+#include "hexchat.h"
+
+/* IRCv3 BATCH: lines tagged with an open batch are held back and run as
+   one unit when the server closes it. Playback batches are printed with
+   the frontend's rendering and activity updates held, netsplit/netjoin
+   batches go to netsplit.c. A nested batch is held inside its outermost
+   parent and opened for real when that one is replayed */
+
+/* returns TRUE when the raw line belongs to an open batch and was kept */
+gboolean batch_hold (server *serv, const char *buf, int len);
+/* BATCH +ref type [params] / BATCH -ref */
+void batch_command (server *serv, char *ref, char *type, char *params);
+void batch_server_free (server *serv);
+
+#endif
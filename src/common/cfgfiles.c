@@ -218,15 +218,294 @@ cfg_get_str (char *cfg, const char *var, char *dest, int dest_len)
 	}
 }
 
+/* copy var lowercased into key, the form names are indexed by */
+
+static void
+cfg_fold_name (const char *var, char *key, int key_len)
+{
+	int i;
+
+	for (i = 0; var[i] && i < key_len - 1; i++)
+		key[i] = g_ascii_tolower (var[i]);
+	key[i] = 0;
+}
+
+/* one pass over "name = value" lines. Like cfg_get_str() names are matched
+   without case and the first occurrence wins. */
+
+static void
+cfg_parse_into (const char *cfg, GHashTable *values, GPtrArray *names)
+{
+	const char *name, *value, *end;
+	char name_buf[128], key[128];
+	gsize len;
+
+	while (*cfg)
+	{
+		while (*cfg == ' ' || *cfg == '\t')
+			cfg++;
+
+		name = cfg;
+		while (*cfg && *cfg != ' ' && *cfg != '=' && *cfg != '\n')
+			cfg++;
+		len = cfg - name;
+
+		while (*cfg == ' ')
+			cfg++;
+		if (*cfg == '=')
+			cfg++;
+		while (*cfg == ' ')
+			cfg++;
+
+		value = cfg;
+		end = strchr (cfg, '\n');
+		if (!end)
+			end = cfg + strlen (cfg);
+		cfg = *end ? end + 1 : end;
+
+		if (len == 0 || len >= sizeof (name_buf))
+			continue;
+
+		memcpy (name_buf, name, len);
+		name_buf[len] = 0;
+		cfg_fold_name (name_buf, key, sizeof (key));
+		if (g_hash_table_contains (values, key))
+			continue;
+
+		g_hash_table_insert (values, g_strdup (key), g_strndup (value, end - value));
+		if (names)
+			g_ptr_array_add (names, g_strdup (name_buf));
+	}
+}
+
+GHashTable *
+cfg_parse (const char *cfg)
+{
+	GHashTable *values;
+
+	values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	cfg_parse_into (cfg, values, NULL);
+	return values;
+}
+
+const char *
+cfg_lookup (GHashTable *cfg, const char *var)
+{
+	char key[128];
+
+	cfg_fold_name (var, key, sizeof (key));
+	return g_hash_table_lookup (cfg, key);
+}
+
+/* Config files other modules read and write key by key (plugin prefs). Each
+   is parsed once and kept; it is reread only if it changed on disk, and
+   changes are written back together a moment later. */
+
+#define CFGFILE_SAVE_DELAY 1000
+
+static GHashTable *cfgfile_cache;	/* filename -> cfgfile */
+
+static void
+cfgfile_free (cfgfile *file)
+{
+	if (file->save_tag)
+		fe_timeout_remove (file->save_tag);
+	g_hash_table_destroy (file->values);
+	g_ptr_array_free (file->names, TRUE);
+	g_free (file->filename);
+	g_free (file);
+}
+
+static void
+cfgfile_stat (cfgfile *file)
+{
+	GStatBuf st;
+
+	if (g_stat (file->filename, &st) == 0)
+	{
+		file->mtime = st.st_mtime;
+		file->size = st.st_size;
+	}
+	else
+	{
+		file->mtime = 0;
+		file->size = -1;
+	}
+}
+
+static void
+cfgfile_load (cfgfile *file)
+{
+	char *cfg;
+
+	g_hash_table_remove_all (file->values);
+	g_ptr_array_set_size (file->names, 0);
+
+	cfgfile_stat (file);
+	if (g_file_get_contents (file->filename, &cfg, NULL, NULL))
+	{
+		cfg_parse_into (cfg, file->values, file->names);
+		g_free (cfg);
+	}
+}
+
+cfgfile *
+cfgfile_open (const char *filename)
+{
+	cfgfile *file;
+	time_t mtime;
+	goffset size;
+
+	if (!cfgfile_cache)
+		cfgfile_cache = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+															(GDestroyNotify) cfgfile_free);
+
+	file = g_hash_table_lookup (cfgfile_cache, filename);
+	if (!file)
+	{
+		file = g_new0 (cfgfile, 1);
+		file->filename = g_strdup (filename);
+		file->values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+		file->names = g_ptr_array_new_with_free_func (g_free);
+		g_hash_table_insert (cfgfile_cache, file->filename, file);
+		cfgfile_load (file);
+		return file;
+	}
+
+	/* unsaved changes win over whatever is on disk */
+	if (file->save_tag)
+		return file;
+
+	mtime = file->mtime;
+	size = file->size;
+	cfgfile_stat (file);
+	if (file->mtime != mtime || file->size != size)
+		cfgfile_load (file);
+
+	return file;
+}
+
+const char *
+cfgfile_lookup (cfgfile *file, const char *var)
+{
+	return cfg_lookup (file->values, var);
+}
+
+gboolean
+cfgfile_save (cfgfile *file)
+{
+	GString *buf;
+	const char *value;
+	GError *error = NULL;
+	guint i;
+
+	if (file->save_tag)
+	{
+		fe_timeout_remove (file->save_tag);
+		file->save_tag = 0;
+	}
+
+	buf = g_string_sized_new (1024);
+	for (i = 0; i < file->names->len; i++)
+	{
+		value = cfgfile_lookup (file, file->names->pdata[i]);
+		g_string_append_printf (buf, "%s = %s\n", (char *) file->names->pdata[i], value);
+	}
+
+	/* written to a temporary file and renamed over the old one */
+	if (!g_file_set_contents_full (file->filename, buf->str, buf->len,
+											 G_FILE_SET_CONTENTS_CONSISTENT, 0600, &error))
+	{
+		g_warning ("Failed to write %s: %s", file->filename, error->message);
+		g_error_free (error);
+		g_string_free (buf, TRUE);
+		return FALSE;
+	}
+
+	g_string_free (buf, TRUE);
+	cfgfile_stat (file);
+	return TRUE;
+}
+
 static int
-cfg_put_str (int fh, char *var, char *value)
+cfgfile_save_cb (cfgfile *file)
 {
-	char buf[512];
-	int len;
+	file->save_tag = 0;
+	cfgfile_save (file);
+	return 0;
+}
 
-	g_snprintf (buf, sizeof buf, "%s = %s\n", var, value);
-	len = strlen (buf);
-	return (write (fh, buf, len) == len);
+/* the save happens later, this is what tells whether it can: the new file
+   is written next to the old one and renamed over it */
+
+static gboolean
+cfgfile_writable (cfgfile *file)
+{
+	char *dir;
+	gboolean ok;
+
+	dir = g_path_get_dirname (file->filename);
+	ok = g_access (dir, W_OK) == 0;
+	g_free (dir);
+	return ok;
+}
+
+/* value NULL removes var. Returns FALSE, changing nothing, when the file
+   can't be written */
+
+gboolean
+cfgfile_set (cfgfile *file, const char *var, const char *value)
+{
+	char key[128];
+	guint i;
+
+	if (!cfgfile_writable (file))
+		return FALSE;
+
+	cfg_fold_name (var, key, sizeof (key));
+
+	if (value)
+	{
+		if (!g_hash_table_contains (file->values, key))
+			g_ptr_array_add (file->names, g_strdup (var));
+		g_hash_table_insert (file->values, g_strdup (key), g_strdup (value));
+	}
+	else if (g_hash_table_remove (file->values, key))
+	{
+		for (i = 0; i < file->names->len; i++)
+		{
+			if (!g_ascii_strcasecmp (file->names->pdata[i], var))
+			{
+				g_ptr_array_remove_index (file->names, i);
+				break;
+			}
+		}
+	}
+	else
+		return TRUE;
+
+	if (!file->save_tag)
+		file->save_tag = fe_timeout_add (CFGFILE_SAVE_DELAY, cfgfile_save_cb, file);
+	return TRUE;
+}
+
+/* write out every pending change, e.g. before exiting */
+
+void
+cfgfile_flush_all (void)
+{
+	GHashTableIter iter;
+	cfgfile *file;
+
+	if (!cfgfile_cache)
+		return;
+
+	g_hash_table_iter_init (&iter, cfgfile_cache);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &file))
+	{
+		if (file->save_tag)
+			cfgfile_save (file);
+	}
 }
 
 int
@@ -336,6 +615,8 @@ const struct prefs vars[] =
 	{"away_timeout", P_OFFINT (hex_away_timeout), TYPE_INT},
 	{"away_track", P_OFFINT (hex_away_track), TYPE_BOOL},
 
+	{"chanopt_prune_days", P_OFFINT (hex_chanopt_prune_days), TYPE_INT},
+
 	{"completion_amount", P_OFFINT (hex_completion_amount), TYPE_INT},
 	{"completion_auto", P_OFFINT (hex_completion_auto), TYPE_BOOL},
 	{"completion_sort", P_OFFINT (hex_completion_sort), TYPE_INT},
@@ -404,6 +685,7 @@ const struct prefs vars[] =
 	{"gui_slist_fav", P_OFFINT (hex_gui_slist_fav), TYPE_BOOL},
 	{"gui_slist_select", P_OFFINT (hex_gui_slist_select), TYPE_INT},
 	{"gui_slist_skip", P_OFFINT (hex_gui_slist_skip), TYPE_BOOL},
+	{"gui_stall_threshold", P_OFFINT (hex_gui_stall_threshold), TYPE_INT},
 	{"gui_tab_chans", P_OFFINT (hex_gui_tab_chans), TYPE_BOOL},
 	{"gui_tab_dialogs", P_OFFINT (hex_gui_tab_dialogs), TYPE_BOOL},
 	{"gui_tab_dots", P_OFFINT (hex_gui_tab_dots), TYPE_BOOL},
@@ -475,6 +757,7 @@ const struct prefs vars[] =
 	{"irc_reconnect_rejoin", P_OFFINT (hex_irc_reconnect_rejoin), TYPE_BOOL},
 	{"irc_ban_type", P_OFFINT (hex_irc_ban_type), TYPE_INT},
 	{"irc_cap_server_time", P_OFFINT (hex_irc_cap_server_time), TYPE_BOOL},
+	{"irc_chathistory_lines", P_OFFINT (hex_irc_chathistory_lines), TYPE_INT},
 	{"irc_conf_mode", P_OFFINT (hex_irc_conf_mode), TYPE_BOOL},
 	{"irc_extra_hilight", P_OFFSET (hex_irc_extra_hilight), TYPE_STR},
 	{"irc_hide_nickchange", P_OFFINT (hex_irc_hide_nickchange), TYPE_BOOL},
@@ -506,6 +789,8 @@ const struct prefs vars[] =
 	{"net_auto_reconnect", P_OFFINT (hex_net_auto_reconnect), TYPE_BOOL},
 	{"net_auto_reconnectonfail", P_OFFINT (hex_net_auto_reconnectonfail), TYPE_BOOL},
 	{"net_bind_host", P_OFFSET (hex_net_bind_host), TYPE_STR},
+	{"net_connect_limit", P_OFFINT (hex_net_connect_limit), TYPE_INT},
+	{"net_dns_cache_ttl", P_OFFINT (hex_net_dns_cache_ttl), TYPE_INT},
 	{"net_ping_timeout", P_OFFINT (hex_net_ping_timeout), TYPE_INT, hexchat_reinit_timers},
 	{"net_proxy_auth", P_OFFINT (hex_net_proxy_auth), TYPE_BOOL},
 	{"net_proxy_host", P_OFFSET (hex_net_proxy_host), TYPE_STR},
@@ -516,6 +801,9 @@ const struct prefs vars[] =
 	{"net_proxy_user", P_OFFSET (hex_net_proxy_user), TYPE_STR},
 	{"net_reconnect_delay", P_OFFINT (hex_net_reconnect_delay), TYPE_INT},
 	{"net_throttle", P_OFFINT (hex_net_throttle), TYPE_BOOL},
+	{"net_throttle_burst", P_OFFINT (hex_net_throttle_burst), TYPE_INT},
+	{"net_throttle_bytes", P_OFFINT (hex_net_throttle_bytes), TYPE_INT},
+	{"net_throttle_refill", P_OFFINT (hex_net_throttle_refill), TYPE_INT},
 
 	{"notify_timeout", P_OFFINT (hex_notify_timeout), TYPE_INT},
 	{"notify_whois_online", P_OFFINT (hex_notify_whois_online), TYPE_BOOL},
@@ -539,6 +827,7 @@ const struct prefs vars[] =
 	{"text_max_indent", P_OFFINT (hex_text_max_indent), TYPE_INT},
 	{"text_stamp_width", P_OFFINT (hex_text_stamp_width), TYPE_INT},
 	{"text_max_lines", P_OFFINT (hex_text_max_lines), TYPE_INT},
+	{"text_rawlog_size", P_OFFINT (hex_text_rawlog_size), TYPE_INT},
 	{"text_replay", P_OFFINT (hex_text_replay), TYPE_BOOL},
 	{"text_search_case_match", P_OFFINT (hex_text_search_case_match), TYPE_BOOL},
 	{"text_search_highlight_all", P_OFFINT (hex_text_search_highlight_all), TYPE_BOOL},
@@ -789,6 +1078,7 @@ load_default_config(void)
 	prefs.hex_gui_pane_left_size = 128;		/* with treeview icons we need a bit bigger space */
 	prefs.hex_gui_pane_right_size = 200;
 	prefs.hex_gui_pane_right_size_min = 220;
+	prefs.hex_gui_stall_threshold = 1000;	/* ms, 0 disables the watchdog */
 	prefs.hex_gui_tab_layout = 2;			/* 0=Tabs 1=Reserved 2=Tree */
 	prefs.hex_gui_tab_newtofront = 2;
 	prefs.hex_gui_tab_pos = 1;
@@ -798,13 +1088,20 @@ load_default_config(void)
 	prefs.hex_gui_win_height = 800;
 	prefs.hex_gui_win_width = 1280;
 	prefs.hex_irc_ban_type = 1;
+	prefs.hex_irc_chathistory_lines = 50;
 	prefs.hex_irc_join_delay = 5;
+	prefs.hex_net_connect_limit = 4;
+	prefs.hex_net_dns_cache_ttl = 300;
 	prefs.hex_net_ping_timeout = 60;
 	prefs.hex_net_reconnect_delay = 10;
+	prefs.hex_net_throttle_burst = 5;		/* these three match the old ircu2.10 formula */
+	prefs.hex_net_throttle_bytes = 240;
+	prefs.hex_net_throttle_refill = 2000;
 	prefs.hex_notify_timeout = 15;
 	prefs.hex_text_max_indent = 256;
 	prefs.hex_text_stamp_width = 0;
 	prefs.hex_text_max_lines = 5000;
+	prefs.hex_text_rawlog_size = 4096;
 	prefs.hex_url_grabber_limit = 100; 		/* 0 means unlimited */
 
 	/* STRINGS */
@@ -907,38 +1204,44 @@ make_dcc_dirs (void)
 int
 load_config (void)
 {
+	GHashTable *values;
+	const char *val;
 	char *cfg, *sp;
-	int res, val, i;
+	int i;
 
 	g_assert(check_config_dir () == 0);
 
 	if (!g_file_get_contents (default_file (), &cfg, NULL, NULL))
 		return -1;
 
+	values = cfg_parse (cfg);
+	g_free (cfg);
+
 	/* If the config is incomplete we have the default values loaded */
 	load_default_config();
 
 	i = 0;
 	do
 	{
-		switch (vars[i].type)
+		val = cfg_lookup (values, vars[i].name);
+		if (val)
 		{
-		case TYPE_STR:
-			cfg_get_str (cfg, vars[i].name, (char *) &prefs + vars[i].offset,
-				     vars[i].len);
-			break;
-		case TYPE_BOOL:
-		case TYPE_INT:
-			val = cfg_get_int_with_result (cfg, vars[i].name, &res);
-			if (res)
-				*((int *) &prefs + vars[i].offset) = val;
-			break;
+			switch (vars[i].type)
+			{
+			case TYPE_STR:
+				safe_strcpy ((char *) &prefs + vars[i].offset, val, vars[i].len);
+				break;
+			case TYPE_BOOL:
+			case TYPE_INT:
+				*((int *) &prefs + vars[i].offset) = atoi (val);
+				break;
+			}
 		}
 		i++;
 	}
 	while (vars[i].name);
 
-	g_free (cfg);
+	g_hash_table_destroy (values);
 
 	if (prefs.hex_gui_win_height < 138)
 		prefs.hex_gui_win_height = 138;
@@ -960,31 +1263,25 @@ load_config (void)
 	return 0;
 }
 
+static int save_config_tag;
+
 int
 save_config (void)
 {
-	int fh, i;
-	char *config, *new_config;
+	GString *buf;
+	int i, val, ret;
 
-	if (check_config_dir () != 0)
-		make_config_dirs ();
-
-	config = default_file ();
-	new_config = g_strconcat (config, ".new", NULL);
-
-	fh = g_open (new_config, OFLAGS | O_TRUNC | O_WRONLY | O_CREAT, 0600);
-	if (fh == -1)
+	if (save_config_tag)
 	{
-		g_free (new_config);
-		return 0;
+		fe_timeout_remove (save_config_tag);
+		save_config_tag = 0;
 	}
 
-	if (!cfg_put_str (fh, "version", PACKAGE_VERSION))
-	{
-		close (fh);
-		g_free (new_config);
-		return 0;
-	}
+	if (check_config_dir () != 0)
+		make_config_dirs ();
+
+	buf = g_string_sized_new (16384);
+	g_string_append_printf (buf, "%s = %s\n", "version", PACKAGE_VERSION);
 
 	i = 0;
 	do
@@ -992,21 +1289,13 @@ save_config (void)
 		switch (vars[i].type)
 		{
 		case TYPE_STR:
-			if (!cfg_put_str (fh, vars[i].name, (char *) &prefs + vars[i].offset))
-			{
-				close (fh);
-				g_free (new_config);
-				return 0;
-			}
+			g_string_append_printf (buf, "%s = %s\n", vars[i].name,
+											(char *) &prefs + vars[i].offset);
 			break;
 		case TYPE_INT:
 		case TYPE_BOOL:
-			if (!cfg_put_int (fh, *((int *) &prefs + vars[i].offset), vars[i].name))
-			{
-				close (fh);
-				g_free (new_config);
-				return 0;
-			}
+			val = *((int *) &prefs + vars[i].offset);
+			g_string_append_printf (buf, "%s = %d\n", vars[i].name, val == -1 ? 1 : val);
 		}
 
 		if (vars[i].after_update != NULL)
@@ -1017,20 +1306,31 @@ save_config (void)
 	}
 	while (vars[i].name);
 
-	if (close (fh) == -1)
-	{
-		g_free (new_config);
-		return 0;
-	}
+	/* written to a temporary file and renamed over the old one */
+	ret = g_file_set_contents_full (default_file (), buf->str, buf->len,
+											  G_FILE_SET_CONTENTS_CONSISTENT, 0600, NULL);
+	g_string_free (buf, TRUE);
 
-	if (g_rename (new_config, config) == -1)
-	{
-		g_free (new_config);
-		return 0;
-	}
-	g_free (new_config);
+	return ret;
+}
 
-	return 1;
+static int
+save_config_cb (void *unused)
+{
+	save_config_tag = 0;
+	if (!save_config () && current_sess)
+		PrintText (current_sess, "Error saving changes to disk.\n");
+	return 0;
+}
+
+/* coalesce a burst of changes (e.g. a script's /set -quiet calls) into
+   one write */
+
+void
+save_config_later (void)
+{
+	if (!save_config_tag)
+		save_config_tag = fe_timeout_add (CFGFILE_SAVE_DELAY, save_config_cb, NULL);
 }
 
 static void
@@ -1094,22 +1394,37 @@ set_list (session * sess, char *tbuf)
 	while (vars[i].name);
 }
 
-int
-cfg_get_bool (char *var)
+/* index of the vars[] entry called name, or -1 */
+
+static int
+cfg_find_var (const char *name)
 {
-	int i = 0;
+	static GHashTable *index;
+	char key[128];
+	gpointer pos;
+	int i;
 
-	do
+	if (!index)
 	{
-		if (!g_ascii_strcasecmp (var, vars[i].name))
-		{
-			return *((int *) &prefs + vars[i].offset);
-		}
-		i++;
+		index = g_hash_table_new (g_str_hash, g_str_equal);
+		for (i = 0; vars[i].name; i++)
+			g_hash_table_insert (index, vars[i].name, GINT_TO_POINTER (i + 1));
 	}
-	while (vars[i].name);
 
-	return -1;
+	cfg_fold_name (name, key, sizeof (key));
+	pos = g_hash_table_lookup (index, key);
+	return GPOINTER_TO_INT (pos) - 1;
+}
+
+int
+cfg_get_bool (char *var)
+{
+	int i = cfg_find_var (var);
+
+	if (i < 0)
+		return -1;
+
+	return *((int *) &prefs + vars[i].offset);
 }
 
 int
@@ -1120,7 +1435,7 @@ cmd_set (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	int off = FALSE;
 	int quiet = FALSE;
 	int erase = FALSE;
-	int i = 0, finds = 0, found;
+	int i, finds = 0;
 	int idx = 2;
 	int prev_numeric;
 	char *var, *val, *prev_string;
@@ -1170,18 +1485,12 @@ cmd_set (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 		val++;
 	}
 
-	do
-	{
-		if (wild)
-		{
-			found = !match (var, vars[i].name);
-		}
-		else
-		{
-			found = g_ascii_strcasecmp (var, vars[i].name);
-		}
+	/* an exact name goes straight to its entry, wildcards scan them all */
+	i = wild ? 0 : cfg_find_var (var);
 
-		if (found == 0)
+	while (i >= 0 && vars[i].name)
+	{
+		if (!wild || match (var, vars[i].name))
 		{
 			finds++;
 			switch (vars[i].type)
@@ -1265,17 +1574,19 @@ cmd_set (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 				break;
 			}
 		}
+
+		if (!wild)
+			break;
 		i++;
 	}
-	while (vars[i].name);
 
 	if (!finds && !quiet)
 	{
 		PrintText (sess, "No such variable.\n");
 	}
-	else if (!save_config ())
+	else
 	{
-		PrintText (sess, "Error saving changes to disk.\n");
+		save_config_later ();
 	}
 
 	return TRUE;
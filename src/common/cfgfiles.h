@@ -29,7 +29,24 @@
 extern char *xdir;
 extern const char * const languages[LANGUAGES_LENGTH];
 
+typedef struct cfgfile
+{
+	char *filename;
+	GHashTable *values;		/* lowercased name -> value */
+	GPtrArray *names;			/* names as written, in file order */
+	time_t mtime;
+	goffset size;
+	int save_tag;				/* pending batched save */
+} cfgfile;
+
 char *cfg_get_str (char *cfg, const char *var, char *dest, int dest_len);
+GHashTable *cfg_parse (const char *cfg);
+const char *cfg_lookup (GHashTable *cfg, const char *var);
+cfgfile *cfgfile_open (const char *filename);
+const char *cfgfile_lookup (cfgfile *file, const char *var);
+gboolean cfgfile_set (cfgfile *file, const char *var, const char *value);
+gboolean cfgfile_save (cfgfile *file);
+void cfgfile_flush_all (void);
 int cfg_get_bool (char *var);
 int cfg_get_int_with_result (char *cfg, char *var, int *result);
 int cfg_get_int (char *cfg, char *var);
@@ -43,6 +60,7 @@ int make_config_dirs (void);
 int make_dcc_dirs (void);
 int load_config (void);
 int save_config (void);
+void save_config_later (void);
 void list_free (GSList ** list);
 void list_loadconf (char *file, GSList ** list, char *defaultconf);
 int list_delentry (GSList ** list, char *name);
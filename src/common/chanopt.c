@@ -32,15 +32,19 @@
 #include "hexchat.h"
 
 #include "cfgfiles.h"
+#include "chanopt.h"
 #include "server.h"
 #include "text.h"
 #include "util.h"
 #include "hexchatc.h"
 
 
-static GSList *chanopt_list = NULL;
+/* "network\nchannel", ascii-folded -> chanopt_in_memory */
+static GHashTable *chanopt_table = NULL;
+static GPtrArray *chanopt_dirty = NULL;	/* entries to append on the next save */
 static gboolean chanopt_open = FALSE;
-static gboolean chanopt_changed = FALSE;
+static gboolean chanopt_compact = FALSE;	/* rewrite the file on the next save */
+static guint chanopt_file_blocks = 0;		/* blocks in chanopt.conf, stale ones too */
 
 
 typedef struct
@@ -134,7 +138,7 @@ chanopt_command (session *sess, char *tbuf, char *word[], char *word_eol[])
 			if (newval != -1)	/* set new value */
 			{
 				*(guint8 *)G_STRUCT_MEMBER_P(sess, chanopt[i].offset) = newval;
-				chanopt_changed = TRUE;
+				chanopt_save (sess);
 			}
 
 			if (!quiet)	/* print value */
@@ -192,32 +196,70 @@ typedef struct
 
 	char *network;
 	char *channel;
+	gint64 last_seen;		/* unix time we last joined it, for pruning */
+	gboolean dirty;
 
 } chanopt_in_memory;
 
+/* only rewrite last_seen to disk once a day per channel */
+#define CHANOPT_SEEN_GRANULARITY (24 * 60 * 60)
+
+static char *
+chanopt_key (const char *network, const char *channel)
+{
+	char *key = g_strconcat (network, "\n", channel, NULL);
+	char *p;
+
+	/* same folding as the g_ascii_strcasecmp this used to be */
+	for (p = key; *p; p++)
+		*p = g_ascii_tolower (*p);
+	return key;
+}
+
+static void
+chanopt_free (chanopt_in_memory *co)
+{
+	g_free (co->network);
+	g_free (co->channel);
+	g_free (co);
+}
+
+static void
+chanopt_set_dirty (chanopt_in_memory *co)
+{
+	if (co->dirty)
+		return;
+	co->dirty = TRUE;
+	g_ptr_array_add (chanopt_dirty, co);
+}
 
 static chanopt_in_memory *
 chanopt_find (char *network, char *channel, gboolean add_new)
 {
-	GSList *list;
 	chanopt_in_memory *co;
+	char *key;
 	int i;
 
-	for (list = chanopt_list; list; list = list->next)
+	if (!chanopt_table)
 	{
-		co = list->data;
-		if (!g_ascii_strcasecmp (co->channel, channel) &&
-			 !g_ascii_strcasecmp (co->network, network))
-			return co;
+		chanopt_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+															(GDestroyNotify) chanopt_free);
+		chanopt_dirty = g_ptr_array_new ();
 	}
 
-	if (!add_new)
-		return NULL;
+	key = chanopt_key (network, channel);
+	co = g_hash_table_lookup (chanopt_table, key);
+	if (co || !add_new)
+	{
+		g_free (key);
+		return co;
+	}
 
 	/* allocate a new one */
 	co = g_new0 (chanopt_in_memory, 1);
 	co->channel = g_strdup (channel);
 	co->network = g_strdup (network);
+	co->last_seen = g_get_real_time () / G_USEC_PER_SEC;
 
 	/* set all values to SET_DEFAULT */
 	i = 0;
@@ -227,8 +269,7 @@ chanopt_find (char *network, char *channel, gboolean add_new)
 		i++;
 	}
 
-	chanopt_list = g_slist_prepend (chanopt_list, co);
-	chanopt_changed = TRUE;
+	g_hash_table_insert (chanopt_table, key, co);
 
 	return co;
 }
@@ -250,7 +291,48 @@ chanopt_add_opt (chanopt_in_memory *co, char *var, int new_value)
 	}
 }
 
-/* load chanopt.conf from disk into our chanopt_list GSList */
+/* opts is a session or a chanopt_in_memory, they share the option layout */
+static gboolean
+chanopt_has_values (gpointer opts)
+{
+	int i;
+
+	for (i = 0; i < sizeof (chanopt) / sizeof (channel_options); i++)
+	{
+		/* not using global/default setting, must save */
+		if (G_STRUCT_MEMBER (guint8, opts, chanopt[i].offset) != SET_DEFAULT)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* drop entries for channels not joined in chanopt_prune_days */
+static void
+chanopt_prune (void)
+{
+	GHashTableIter iter;
+	chanopt_in_memory *co;
+	gint64 cutoff;
+
+	if (prefs.hex_chanopt_prune_days <= 0)
+		return;
+
+	cutoff = g_get_real_time () / G_USEC_PER_SEC -
+				(gint64)prefs.hex_chanopt_prune_days * 24 * 60 * 60;
+
+	g_hash_table_iter_init (&iter, chanopt_table);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&co))
+	{
+		if (co->last_seen < cutoff && !co->dirty)
+		{
+			g_hash_table_iter_remove (&iter);
+			chanopt_compact = TRUE;
+		}
+	}
+}
+
+/* load chanopt.conf from disk into chanopt_table. Later blocks for the
+   same channel override earlier ones, which is how saves append. */
 
 static void
 chanopt_load_all (void)
@@ -261,7 +343,9 @@ chanopt_load_all (void)
 	char *network = NULL;
 	chanopt_in_memory *current = NULL;
 
-	/* 1. load the old file into our GSList */
+	chanopt_file_blocks = 0;
+
+	/* 1. load the old file into chanopt_table */
 	fh = hexchat_open_file ("chanopt.conf", O_RDONLY, 0, 0);
 	if (fh != -1)
 	{
@@ -282,8 +366,13 @@ chanopt_load_all (void)
 			}
 			else if (!strcmp (buf, "channel"))
 			{
-				current = chanopt_find (network, eq + 2, TRUE);
-				chanopt_changed = FALSE;
+				current = network ? chanopt_find (network, eq + 2, TRUE) : NULL;
+				chanopt_file_blocks++;
+			}
+			else if (!strcmp (buf, "seen"))
+			{
+				if (current)
+					current->last_seen = g_ascii_strtoll (eq + 2, NULL, 10);
 			}
 			else
 			{
@@ -295,6 +384,10 @@ chanopt_load_all (void)
 		close (fh);
 		g_free (network);
 	}
+
+	/* entries from before "seen" existed start out as seen now */
+	if (chanopt_table)
+		chanopt_prune ();
 }
 
 void
@@ -304,6 +397,7 @@ chanopt_load (session *sess)
 	guint8 val;
 	chanopt_in_memory *co;
 	char *network;
+	gint64 now;
 
 	if (sess->session_name[0] == 0)
 		return;
@@ -322,6 +416,14 @@ chanopt_load (session *sess)
 	if (!co)
 		return;
 
+	now = g_get_real_time () / G_USEC_PER_SEC;
+	if (now - co->last_seen > CHANOPT_SEEN_GRANULARITY)
+	{
+		co->last_seen = now;
+		if (chanopt_has_values (co))
+			chanopt_set_dirty (co);
+	}
+
 	/* fill in all the sess->xxxxx fields */
 	i = 0;
 	while (i < sizeof (chanopt) / sizeof (channel_options))
@@ -348,9 +450,19 @@ chanopt_save (session *sess)
 	if (!network)
 		return;
 
+	if (!chanopt_open)
+	{
+		chanopt_open = TRUE;
+		chanopt_load_all ();
+	}
+
 	/* 2. reconcile sess with what we loaded from disk */
 
-	co = chanopt_find (network, sess->session_name, TRUE);
+	co = chanopt_find (network, sess->session_name, FALSE);
+	if (!co && !chanopt_has_values (sess))
+		return;
+	if (!co)
+		co = chanopt_find (network, sess->session_name, TRUE);
 
 	i = 0;
 	while (i < sizeof (chanopt) / sizeof (channel_options))
@@ -361,102 +473,123 @@ chanopt_save (session *sess)
 		if (vals != valm)
 		{
 			*(guint8 *)G_STRUCT_MEMBER_P(co, chanopt[i].offset) = vals;
-			chanopt_changed = TRUE;
+			chanopt_set_dirty (co);
 		}
 
 		i++;
 	}
 }
 
+/* full: write every option, so the block overrides an older one for the
+   same channel; otherwise only the non-default ones */
 static void
-chanopt_save_one_channel (chanopt_in_memory *co, int fh)
+chanopt_format_one_channel (GString *buf, chanopt_in_memory *co, gboolean full)
 {
 	int i;
-	char buf[256];
 	guint8 val;
 
-	g_snprintf (buf, sizeof (buf), "%s = %s\n", "network", co->network);
-	if (write (fh, buf, strlen (buf)) < 0)
-		g_warning ("Failed to write chanopt.conf");
+	if (buf->len)
+		g_string_append_c (buf, '\n');
 
-	g_snprintf (buf, sizeof (buf), "%s = %s\n", "channel", co->channel);
-	if (write (fh, buf, strlen (buf)) < 0)
-		g_warning ("Failed to write chanopt.conf");
+	g_string_append_printf (buf, "%s = %s\n", "network", co->network);
+	g_string_append_printf (buf, "%s = %s\n", "channel", co->channel);
+	g_string_append_printf (buf, "%s = %" G_GINT64_FORMAT "\n", "seen", co->last_seen);
 
 	i = 0;
 	while (i < sizeof (chanopt) / sizeof (channel_options))
 	{
 		val = G_STRUCT_MEMBER (guint8, co, chanopt[i].offset);
-		if (val != SET_DEFAULT)
-		{
-			g_snprintf (buf, sizeof (buf), "%s = %d\n", chanopt[i].name, val);
-			if (write (fh, buf, strlen (buf)) < 0)
-				g_warning ("Failed to write chanopt.conf");
-		}
+		if (full || val != SET_DEFAULT)
+			g_string_append_printf (buf, "%s = %d\n", chanopt[i].name, val);
 		i++;
 	}
 }
 
-void
-chanopt_save_all (gboolean flush)
+/* rewrite chanopt.conf with one block per channel that has settings */
+static void
+chanopt_write_compacted (void)
 {
-	int i;
-	int num_saved;
-	int fh;
-	GSList *list;
+	GHashTableIter iter;
 	chanopt_in_memory *co;
-	guint8 val;
+	GString *buf = g_string_sized_new (4096);
+	char *path;
+	GError *error = NULL;
 
-	if (!chanopt_list || !chanopt_changed)
+	chanopt_file_blocks = 0;
+	g_hash_table_iter_init (&iter, chanopt_table);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&co))
 	{
-		return;
+		if (!chanopt_has_values (co))
+			continue;
+		chanopt_format_one_channel (buf, co, FALSE);
+		chanopt_file_blocks++;
 	}
 
-	fh = hexchat_open_file ("chanopt.conf", O_TRUNC | O_WRONLY | O_CREAT, 0600, XOF_DOMODE);
-	if (fh == -1)
+	/* written to a temporary file and renamed over the old one */
+	path = g_build_filename (get_xdir (), "chanopt.conf", NULL);
+	if (!g_file_set_contents_full (path, buf->str, buf->len,
+											 G_FILE_SET_CONTENTS_CONSISTENT, 0600, &error))
 	{
-		return;
+		g_warning ("Failed to write chanopt.conf: %s", error->message);
+		g_error_free (error);
 	}
+	g_free (path);
+	g_string_free (buf, TRUE);
+}
 
-	for (num_saved = 0, list = chanopt_list; list; list = list->next)
+/* append just the changed entries */
+static void
+chanopt_write_dirty (void)
+{
+	GString *buf = g_string_sized_new (1024);
+	chanopt_in_memory *co;
+	guint i;
+	int fh;
+
+	for (i = 0; i < chanopt_dirty->len; i++)
 	{
-		co = list->data;
+		co = g_ptr_array_index (chanopt_dirty, i);
+		chanopt_format_one_channel (buf, co, TRUE);
+	}
 
-		i = 0;
-		while (i < sizeof (chanopt) / sizeof (channel_options))
-		{
-			val = G_STRUCT_MEMBER (guint8, co, chanopt[i].offset);
-			/* not using global/default setting, must save */
-			if (val != SET_DEFAULT)
-			{
-				if (num_saved != 0)
-					if (write (fh, "\n", 1) < 0)
-						g_warning ("Failed to write chanopt.conf");
+	fh = hexchat_open_file ("chanopt.conf", O_APPEND | O_WRONLY | O_CREAT, 0600, XOF_DOMODE);
+	if (fh != -1)
+	{
+		if (write (fh, "\n", 1) < 0 || write (fh, buf->str, buf->len) < 0)
+			g_warning ("Failed to write chanopt.conf");
+		close (fh);
+		chanopt_file_blocks += chanopt_dirty->len;
+	}
+	g_string_free (buf, TRUE);
+}
 
-				chanopt_save_one_channel (co, fh);
-				num_saved++;
-				goto cont;
-			}
-			i++;
-		}
+void
+chanopt_save_all (gboolean flush)
+{
+	guint live, i;
 
-cont:
-		if (flush)
-		{
-			g_free (co->network);
-			g_free (co->channel);
-			g_free (co);
-		}
-	}
+	if (!chanopt_table)
+		return;
 
-	close (fh);
+	if (chanopt_dirty->len || chanopt_compact)
+	{
+		/* compact once superseded blocks outnumber the live ones */
+		live = g_hash_table_size (chanopt_table);
+		if (chanopt_compact || chanopt_file_blocks + chanopt_dirty->len > live * 2 + 32)
+			chanopt_write_compacted ();
+		else
+			chanopt_write_dirty ();
+
+		for (i = 0; i < chanopt_dirty->len; i++)
+			((chanopt_in_memory *) g_ptr_array_index (chanopt_dirty, i))->dirty = FALSE;
+		g_ptr_array_set_size (chanopt_dirty, 0);
+		chanopt_compact = FALSE;
+	}
 
 	if (flush)
 	{
-		g_slist_free (chanopt_list);
-		chanopt_list = NULL;
+		g_clear_pointer (&chanopt_table, g_hash_table_destroy);
+		g_clear_pointer (&chanopt_dirty, g_ptr_array_unref);
+		chanopt_open = FALSE;
 	}
-
-	chanopt_open = FALSE;
-	chanopt_changed = FALSE;
 }
@@ -0,0 +1,250 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "hexchat.h"
+#include "hexchatc.h"
+#include "proto-irc.h"
+#include "server.h"
+#include "chathistory.h"
+
+#define CHATHISTORY_MSGIDS 1024	/* recent msgids remembered per window */
+#define CHATHISTORY_TIMEOUT (60 * G_USEC_PER_SEC)	/* an unanswered request is lost after this */
+
+struct chathistory
+{
+	time_t newest;				/* server-time range the window holds */
+	time_t oldest;
+	char *newest_msgid;
+	char *oldest_msgid;
+	GHashTable *msgids;		/* recent msgids, owned by the table */
+	GQueue msgid_order;		/* the same strings, oldest first */
+	int pending;				/* CHATHISTORY_* request in flight */
+	gint64 pending_since;	/* monotonic time it was sent */
+	time_t boundary;			/* newest/oldest when it was sent */
+	gboolean exhausted;		/* BEFORE came back empty */
+};
+
+static struct chathistory *
+chathistory_get (session *sess)
+{
+	struct chathistory *ch = sess->chathistory;
+
+	if (!ch)
+	{
+		ch = g_new0 (struct chathistory, 1);
+		ch->msgids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		g_queue_init (&ch->msgid_order);
+		sess->chathistory = ch;
+	}
+	return ch;
+}
+
+static gboolean
+chathistory_usable (session *sess)
+{
+	server *serv = sess->server;
+
+	if (sess->type != SESS_CHANNEL && sess->type != SESS_DIALOG)
+		return FALSE;
+
+	return serv->connected && serv->have_chathistory && serv->have_batch &&
+			 prefs.hex_irc_chathistory_lines > 0;
+}
+
+void
+chathistory_seen (session *sess, time_t stamp, const char *msgid)
+{
+	struct chathistory *ch = chathistory_get (sess);
+	char *key;
+
+	if (msgid && *msgid && !g_hash_table_contains (ch->msgids, msgid))
+	{
+		key = g_strdup (msgid);
+		g_hash_table_add (ch->msgids, key);
+		g_queue_push_tail (&ch->msgid_order, key);
+		if (g_queue_get_length (&ch->msgid_order) > CHATHISTORY_MSGIDS)
+			g_hash_table_remove (ch->msgids, g_queue_pop_head (&ch->msgid_order));
+	}
+	else
+		msgid = NULL;
+
+	if (!stamp)
+		stamp = time (NULL);
+
+	if (stamp >= ch->newest)
+	{
+		ch->newest = stamp;
+		g_free (ch->newest_msgid);
+		ch->newest_msgid = g_strdup (msgid);
+	}
+	if (!ch->oldest || stamp <= ch->oldest)
+	{
+		ch->oldest = stamp;
+		g_free (ch->oldest_msgid);
+		ch->oldest_msgid = g_strdup (msgid);
+	}
+}
+
+static void
+chathistory_send (session *sess, const char *subcommand, const char *msgid,
+						time_t stamp)
+{
+	server *serv = sess->server;
+	char ref[160];
+	int limit;
+
+	limit = prefs.hex_irc_chathistory_lines;
+	if (serv->chathistory_limit > 0 && limit > serv->chathistory_limit)
+		limit = serv->chathistory_limit;
+
+	/* a msgid is exact; a whole second may repeat a line we have, but
+	   never loses one */
+	if (msgid && !strpbrk (msgid, " \r\n"))
+		g_snprintf (ref, sizeof (ref), "msgid=%s", msgid);
+	else if (stamp)
+		strftime (ref, sizeof (ref), "timestamp=%Y-%m-%dT%H:%M:%S.000Z", gmtime (&stamp));
+	else
+		strcpy (ref, "*");
+
+	tcp_sendf (serv, "CHATHISTORY %s %s %s %d\r\n", subcommand, sess->channel,
+				  ref, limit);
+}
+
+void
+chathistory_join (session *sess)
+{
+	struct chathistory *ch;
+
+	if (!chathistory_usable (sess))
+		return;
+
+	ch = chathistory_get (sess);
+	ch->exhausted = FALSE;
+	ch->pending = CHATHISTORY_LATEST;
+	ch->pending_since = g_get_monotonic_time ();
+	ch->boundary = ch->newest;
+	chathistory_send (sess, "LATEST", ch->newest_msgid, ch->newest);
+}
+
+gboolean
+chathistory_request_older (session *sess)
+{
+	struct chathistory *ch;
+
+	if (!sess->channel[0] || !chathistory_usable (sess))
+		return FALSE;
+
+	ch = chathistory_get (sess);
+	if (ch->exhausted || !ch->oldest)
+		return FALSE;
+	/* neither a batch nor a FAIL came back for the last one: ask again */
+	if (ch->pending && g_get_monotonic_time () - ch->pending_since < CHATHISTORY_TIMEOUT)
+		return FALSE;
+
+	ch->pending = CHATHISTORY_BEFORE;
+	ch->pending_since = g_get_monotonic_time ();
+	ch->boundary = ch->oldest;
+	chathistory_send (sess, "BEFORE", ch->oldest_msgid, ch->oldest);
+	return TRUE;
+}
+
+int
+chathistory_answer (session *sess)
+{
+	struct chathistory *ch = sess->chathistory;
+	int answer;
+
+	if (!ch)
+		return CHATHISTORY_NONE;
+
+	answer = ch->pending;
+	ch->pending = CHATHISTORY_NONE;
+	return answer;
+}
+
+gboolean
+chathistory_wanted (session *sess, int answer, const char *line)
+{
+	struct chathistory *ch = sess->chathistory;
+	message_tags_data tags_data = MESSAGE_TAGS_DATA_INIT;
+	gboolean wanted = TRUE;
+
+	if (!ch)
+		return TRUE;
+
+	message_tags_data_from_line (sess->server, line, &tags_data);
+
+	if (tags_data.msgid && g_hash_table_contains (ch->msgids, tags_data.msgid))
+		wanted = FALSE;
+	else if (tags_data.timestamp && ch->boundary)
+	{
+		if (answer == CHATHISTORY_LATEST && tags_data.timestamp < ch->boundary)
+			wanted = FALSE;
+		else if (answer == CHATHISTORY_BEFORE && tags_data.timestamp > ch->boundary)
+			wanted = FALSE;
+	}
+
+	message_tags_data_free (&tags_data);
+	return wanted;
+}
+
+void
+chathistory_answered (session *sess, int answer, guint lines)
+{
+	if (answer == CHATHISTORY_BEFORE && !lines)
+		chathistory_get (sess)->exhausted = TRUE;
+}
+
+/* FAIL CHATHISTORY doesn't reliably say for which target, so let every
+   window of the server ask again */
+void
+chathistory_failed (server *serv)
+{
+	GSList *list;
+	session *sess;
+
+	for (list = sess_list; list; list = list->next)
+	{
+		sess = list->data;
+		if (sess->server == serv && sess->chathistory)
+			sess->chathistory->pending = CHATHISTORY_NONE;
+	}
+}
+
+void
+chathistory_free (session *sess)
+{
+	struct chathistory *ch = sess->chathistory;
+
+	if (!ch)
+		return;
+
+	g_queue_clear (&ch->msgid_order);
+	g_hash_table_destroy (ch->msgids);
+	g_free (ch->newest_msgid);
+	g_free (ch->oldest_msgid);
+	g_free (ch);
+	sess->chathistory = NULL;
+}
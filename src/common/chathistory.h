@@ -0,0 +1,54 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#ifndef HEXCHAT_CHATHISTORY_H
+#define HEXCHAT_CHATHISTORY_H
+
+#include "hexchat.h"
+
+/* IRCv3 draft/chathistory: on join only the messages since the newest one
+   we hold are fetched, and older pages are asked for when the user
+   scrolls up, instead of a bouncer replaying everything on connect */
+
+enum
+{
+	CHATHISTORY_NONE,
+	CHATHISTORY_LATEST,
+	CHATHISTORY_BEFORE
+};
+
+/* note a message the window holds; stamp 0 means now */
+void chathistory_seen (session *sess, time_t stamp, const char *msgid);
+void chathistory_join (session *sess);
+/* returns FALSE when there's nothing (more) to ask for */
+gboolean chathistory_request_older (session *sess);
+
+/* a chathistory batch for sess begins: returns which request it answers
+   (CHATHISTORY_*), which is then no longer pending */
+int chathistory_answer (session *sess);
+/* FALSE for a raw line of the answer that the window already holds */
+gboolean chathistory_wanted (session *sess, int answer, const char *line);
+void chathistory_answered (session *sess, int answer, guint lines);
+void chathistory_failed (server *serv);
+
+void chathistory_free (session *sess);
+
+#endif
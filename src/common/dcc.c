@@ -50,6 +50,7 @@
 #include "plugin.h"
 #include "server.h"
 #include "text.h"
+#include "timerwheel.h"
 #include "url.h"
 #include "hexchatc.h"
 
@@ -358,36 +359,35 @@ dcc_check_timeouts (void)
 	return 1;
 }
 
-static int
-dcc_lookup_proxy (char *host, struct sockaddr_in *addr)
+/* the address of an IPv4-only name (the proxy, or our configured DCC ip).
+   This blocks, but the resolver is the shared DNS cache, so only the first
+   lookup of a name actually waits on the network. */
+
+static gboolean
+dcc_lookup_ipv4 (const char *host, guint32 *addr)
 {
-	struct hostent *h;
-	static char *cache_host = NULL;
-	static guint32 cache_addr;
+	GResolver *resolver;
+	GList *addrs;
 
-	/* too lazy to thread this, so we cache results */
-	if (cache_host)
-	{
-		if (strcmp (host, cache_host) == 0)
-		{
-			memcpy (&addr->sin_addr, &cache_addr, 4);
-			return TRUE;
-		}
-		g_free (cache_host);
-		cache_host = NULL;
-	}
+	resolver = g_resolver_get_default ();
+	addrs = g_resolver_lookup_by_name_with_flags (resolver, host,
+																 G_RESOLVER_NAME_LOOKUP_FLAGS_IPV4_ONLY,
+																 NULL, NULL);
+	g_object_unref (resolver);
 
-	h = gethostbyname (host);
-	if (h != NULL && h->h_length == 4 && h->h_addr_list[0] != NULL)
-	{
-		memcpy (&addr->sin_addr, h->h_addr, 4);
-		memcpy (&cache_addr, h->h_addr, 4);
-		cache_host = g_strdup (host);
-		/* cppcheck-suppress memleak */
-		return TRUE;
-	}
+	if (!addrs)
+		return FALSE;
 
-	return FALSE;
+	/* we're offered at least one IPv4 address: we take the first */
+	memcpy (addr, g_inet_address_to_bytes (addrs->data), 4);
+	g_resolver_free_addresses (addrs);
+	return TRUE;
+}
+
+static int
+dcc_lookup_proxy (char *host, struct sockaddr_in *addr)
+{
+	return dcc_lookup_ipv4 (host, (guint32 *) &addr->sin_addr);
 }
 
 #define DCC_USE_PROXY() (prefs.hex_net_proxy_host[0] && prefs.hex_net_proxy_type>0 && prefs.hex_net_proxy_type<5 && prefs.hex_net_proxy_use!=1)
@@ -485,7 +485,7 @@ dcc_close (struct DCC *dcc, enum dcc_state dccstat, int destroy)
 		g_free (dcc);
 		if (dcc_list == NULL && timeout_timer != 0)
 		{
-			fe_timeout_remove (timeout_timer);
+			timerwheel_remove (timeout_timer);
 			timeout_timer = 0;
 		}
 		return;
@@ -1691,23 +1691,12 @@ dcc_accept (GIOChannel *source, GIOCondition condition, struct DCC *dcc)
 guint32
 dcc_get_my_address (session *sess)	/* the address we'll tell the other person */
 {
-	struct hostent *dns_query;
 	guint32 addr = 0;
 
 	if (prefs.hex_dcc_ip_from_server && sess->server->dcc_ip)
 		addr = sess->server->dcc_ip;
 	else if (prefs.hex_dcc_ip[0])
-	{
-	   dns_query = gethostbyname ((const char *) prefs.hex_dcc_ip);
-
-	   if (dns_query != NULL &&
-	       dns_query->h_length == 4 &&
-	       dns_query->h_addr_list[0] != NULL)
-		{
-			/*we're offered at least one IPv4 address: we take the first*/
-			addr = *((guint32*) dns_query->h_addr_list[0]);
-		}
-	}
+		dcc_lookup_ipv4 (prefs.hex_dcc_ip, &addr);
 
 	return addr;
 }
@@ -2323,7 +2312,7 @@ new_dcc (void)
 	dcc_list = g_slist_prepend (dcc_list, dcc);
 	if (timeout_timer == 0)
 	{
-		timeout_timer = fe_timeout_add_seconds (1, dcc_check_timeouts, NULL);
+		timeout_timer = timerwheel_add (1000, 100, (GSourceFunc) dcc_check_timeouts, NULL);
 	}
 	return dcc;
 }
@@ -0,0 +1,532 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* A caching GResolver, installed as the process default so that server
+ * connects (through GSocketClient), DCC and /dns all share it.
+ *
+ * Forward lookups are cached for net_dns_cache_ttl seconds; GResolver does
+ * not report record TTLs, so that pref is the upper bound. Concurrent
+ * lookups of the same name (e.g. the separate A and AAAA queries made for
+ * Happy Eyeballs) share one query to the real resolver. Every cache hit
+ * rotates the address list by one, so repeated reconnects walk through all
+ * of a round-robin name's records instead of hammering the first one.
+ * Reverse and SRV/record lookups are passed straight through. */
+
+#include "config.h"
+
+#include <string.h>
+#include <gio/gio.h>
+
+#include "hexchat.h"
+#include "hexchatc.h"
+#include "dnscache.h"
+
+typedef struct
+{
+	GList *addrs;			/* GInetAddress, NULL while the lookup is in flight */
+	gint64 expires;			/* monotonic time */
+	guint rotate[3];		/* per lookup kind: any family, IPv4 only, IPv6 only */
+	GSList *waiters;		/* GTasks waiting for the in-flight lookup */
+} dns_entry;
+
+typedef struct _HcResolver
+{
+	GResolver parent_instance;
+	GResolver *inner;		/* the resolver GIO would have used */
+	GHashTable *cache;		/* lowercased hostname -> dns_entry */
+} HcResolver;
+
+typedef struct _HcResolverClass
+{
+	GResolverClass parent_class;
+} HcResolverClass;
+
+#define HC_TYPE_RESOLVER (hc_resolver_get_type ())
+#define HC_RESOLVER(o) ((HcResolver *)(o))
+GType hc_resolver_get_type (void);
+G_DEFINE_TYPE (HcResolver, hc_resolver, G_TYPE_RESOLVER)
+
+#define DNS_CACHE_PRUNE 64		/* sweep expired entries past this many */
+
+static HcResolver *dns_resolver;
+
+static void
+dns_entry_free (dns_entry *ent)
+{
+	g_resolver_free_addresses (ent->addrs);
+	g_free (ent);
+}
+
+/* a copy of ent's addresses, restricted to the wanted family and rotated;
+ * Happy Eyeballs asks per family, so each family rotates on its own */
+
+static GList *
+dns_entry_addresses (dns_entry *ent, GResolverNameLookupFlags flags)
+{
+	GList *list, *ret = NULL;
+	GInetAddress *addr;
+	GSocketFamily family;
+	guint len, start, kind;
+
+	if (flags & G_RESOLVER_NAME_LOOKUP_FLAGS_IPV4_ONLY)
+		kind = 1;
+	else if (flags & G_RESOLVER_NAME_LOOKUP_FLAGS_IPV6_ONLY)
+		kind = 2;
+	else
+		kind = 0;
+
+	for (list = ent->addrs; list; list = list->next)
+	{
+		addr = list->data;
+		family = g_inet_address_get_family (addr);
+
+		if (kind == 1 && family != G_SOCKET_FAMILY_IPV4)
+			continue;
+		if (kind == 2 && family != G_SOCKET_FAMILY_IPV6)
+			continue;
+
+		ret = g_list_prepend (ret, g_object_ref (addr));
+	}
+
+	len = g_list_length (ret);
+	if (len == 0)
+		return NULL;
+	ret = g_list_reverse (ret);
+
+	/* move the first start addresses to the back */
+	start = ent->rotate[kind]++ % len;
+	while (start--)
+	{
+		list = ret;
+		ret = g_list_remove_link (ret, list);
+		ret = g_list_concat (ret, list);
+	}
+
+	return ret;
+}
+
+static void
+dns_task_return (GTask *task, dns_entry *ent)
+{
+	GResolverNameLookupFlags flags = GPOINTER_TO_INT (g_task_get_task_data (task));
+	GList *addrs;
+
+	addrs = dns_entry_addresses (ent, flags);
+	if (addrs)
+		g_task_return_pointer (task, addrs, (GDestroyNotify) g_resolver_free_addresses);
+	else
+		g_task_return_new_error (task, G_RESOLVER_ERROR, G_RESOLVER_ERROR_NOT_FOUND,
+										 _("No addresses of the requested family"));
+}
+
+static gboolean
+dns_entry_expired (gpointer key, dns_entry *ent, gint64 *now)
+{
+	return ent->addrs && ent->expires <= *now;
+}
+
+/* a cached entry for hostname, or NULL when it's missing or stale */
+
+static dns_entry *
+dns_cache_find (HcResolver *res, const char *key)
+{
+	dns_entry *ent;
+
+	ent = g_hash_table_lookup (res->cache, key);
+	if (ent && ent->addrs && ent->expires <= g_get_monotonic_time ())
+	{
+		g_hash_table_remove (res->cache, key);
+		return NULL;
+	}
+
+	return ent;
+}
+
+static dns_entry *
+dns_cache_add (HcResolver *res, char *key)
+{
+	dns_entry *ent;
+	gint64 now;
+
+	if (g_hash_table_size (res->cache) >= DNS_CACHE_PRUNE)
+	{
+		now = g_get_monotonic_time ();
+		g_hash_table_foreach_remove (res->cache, (GHRFunc) dns_entry_expired, &now);
+	}
+
+	ent = g_new0 (dns_entry, 1);
+	g_hash_table_insert (res->cache, key, ent);
+	return ent;
+}
+
+static void
+dns_cache_store (dns_entry *ent, GList *addrs)
+{
+	ent->addrs = addrs;
+	ent->expires = g_get_monotonic_time () + (gint64) prefs.hex_net_dns_cache_ttl * G_USEC_PER_SEC;
+}
+
+static void
+dns_lookup_done (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	char *key = user_data;
+	dns_entry *ent;
+	GSList *waiters, *list;
+	GList *addrs;
+	GError *error = NULL;
+
+	addrs = g_resolver_lookup_by_name_finish (G_RESOLVER (source), result, &error);
+
+	/* the cache may have been flushed meanwhile */
+	ent = dns_resolver ? g_hash_table_lookup (dns_resolver->cache, key) : NULL;
+	if (!ent || ent->addrs)
+	{
+		g_resolver_free_addresses (addrs);
+		g_clear_error (&error);
+		g_free (key);
+		return;
+	}
+
+	waiters = ent->waiters;
+	ent->waiters = NULL;
+
+	if (addrs)
+		dns_cache_store (ent, addrs);
+	else
+		g_hash_table_remove (dns_resolver->cache, key);	/* no negative caching */
+
+	for (list = waiters; list; list = list->next)
+	{
+		if (addrs)
+			dns_task_return (list->data, ent);
+		else
+			g_task_return_error (list->data, g_error_copy (error));
+		g_object_unref (list->data);
+	}
+
+	g_slist_free (waiters);
+	g_clear_error (&error);
+	g_free (key);
+}
+
+/* lookups still in flight keep their entry so the waiters get answered */
+
+static void
+dns_cache_clear (HcResolver *res)
+{
+	GHashTableIter iter;
+	dns_entry *ent;
+
+	g_hash_table_iter_init (&iter, res->cache);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &ent))
+	{
+		if (ent->addrs)
+			g_hash_table_iter_remove (&iter);
+	}
+}
+
+/* start a real lookup for key unless one is cached or already running */
+
+static dns_entry *
+dns_cache_fetch (HcResolver *res, const char *hostname)
+{
+	dns_entry *ent;
+	char *key;
+
+	key = g_ascii_strdown (hostname, -1);
+	ent = dns_cache_find (res, key);
+	if (ent)
+	{
+		g_free (key);
+		return ent;
+	}
+
+	ent = dns_cache_add (res, key);
+	g_resolver_lookup_by_name_async (res->inner, hostname, NULL, dns_lookup_done,
+												g_strdup (key));
+	return ent;
+}
+
+static void
+hc_resolver_lookup_async (GResolver *resolver, const gchar *hostname,
+								  GResolverNameLookupFlags flags, GCancellable *cancellable,
+								  GAsyncReadyCallback callback, gpointer user_data)
+{
+	HcResolver *res = HC_RESOLVER (resolver);
+	dns_entry *ent;
+	GTask *task;
+
+	if (prefs.hex_net_dns_cache_ttl <= 0)
+	{
+		g_resolver_lookup_by_name_with_flags_async (res->inner, hostname, flags,
+																  cancellable, callback, user_data);
+		return;
+	}
+
+	task = g_task_new (resolver, cancellable, callback, user_data);
+	g_task_set_source_tag (task, hc_resolver_lookup_async);
+	g_task_set_task_data (task, GINT_TO_POINTER (flags), NULL);
+
+	ent = dns_cache_fetch (res, hostname);
+	if (ent->addrs)
+	{
+		dns_task_return (task, ent);
+		g_object_unref (task);
+	}
+	else
+		ent->waiters = g_slist_append (ent->waiters, task);
+}
+
+static void
+hc_resolver_lookup_by_name_async (GResolver *resolver, const gchar *hostname,
+											 GCancellable *cancellable,
+											 GAsyncReadyCallback callback, gpointer user_data)
+{
+	hc_resolver_lookup_async (resolver, hostname, G_RESOLVER_NAME_LOOKUP_FLAGS_DEFAULT,
+									  cancellable, callback, user_data);
+}
+
+static GList *
+hc_resolver_lookup_finish (GResolver *resolver, GAsyncResult *result, GError **error)
+{
+	HcResolver *res = HC_RESOLVER (resolver);
+
+	/* pass-through lookups complete on the inner resolver */
+	if (!g_task_is_valid (result, resolver))
+		return g_resolver_lookup_by_name_with_flags_finish (res->inner, result, error);
+
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static GList *
+hc_resolver_lookup (GResolver *resolver, const gchar *hostname,
+						  GResolverNameLookupFlags flags, GCancellable *cancellable,
+						  GError **error)
+{
+	HcResolver *res = HC_RESOLVER (resolver);
+	dns_entry *ent;
+	GList *addrs;
+	char *key;
+
+	if (prefs.hex_net_dns_cache_ttl <= 0)
+		return g_resolver_lookup_by_name_with_flags (res->inner, hostname, flags,
+																	cancellable, error);
+
+	key = g_ascii_strdown (hostname, -1);
+	ent = dns_cache_find (res, key);
+	if (ent)
+	{
+		g_free (key);
+		/* a blocking caller can't join an async lookup, so it does its own */
+		if (!ent->addrs)
+			return g_resolver_lookup_by_name_with_flags (res->inner, hostname, flags,
+																		cancellable, error);
+		addrs = dns_entry_addresses (ent, flags);
+		if (!addrs)
+			g_set_error_literal (error, G_RESOLVER_ERROR, G_RESOLVER_ERROR_NOT_FOUND,
+										_("No addresses of the requested family"));
+		return addrs;
+	}
+
+	addrs = g_resolver_lookup_by_name (res->inner, hostname, cancellable, error);
+	if (!addrs)
+	{
+		g_free (key);
+		return NULL;
+	}
+
+	ent = dns_cache_add (res, key);
+	dns_cache_store (ent, addrs);
+	return dns_entry_addresses (ent, flags);
+}
+
+static GList *
+hc_resolver_lookup_by_name (GResolver *resolver, const gchar *hostname,
+									 GCancellable *cancellable, GError **error)
+{
+	return hc_resolver_lookup (resolver, hostname, G_RESOLVER_NAME_LOOKUP_FLAGS_DEFAULT,
+										cancellable, error);
+}
+
+/* everything else goes straight to the real resolver */
+
+static gchar *
+hc_resolver_lookup_by_address (GResolver *resolver, GInetAddress *address,
+										 GCancellable *cancellable, GError **error)
+{
+	return g_resolver_lookup_by_address (HC_RESOLVER (resolver)->inner, address,
+													 cancellable, error);
+}
+
+static void
+hc_resolver_lookup_by_address_async (GResolver *resolver, GInetAddress *address,
+												 GCancellable *cancellable,
+												 GAsyncReadyCallback callback, gpointer user_data)
+{
+	g_resolver_lookup_by_address_async (HC_RESOLVER (resolver)->inner, address,
+													cancellable, callback, user_data);
+}
+
+static gchar *
+hc_resolver_lookup_by_address_finish (GResolver *resolver, GAsyncResult *result,
+												  GError **error)
+{
+	return g_resolver_lookup_by_address_finish (HC_RESOLVER (resolver)->inner, result, error);
+}
+
+static GList *
+hc_resolver_lookup_records (GResolver *resolver, const gchar *rrname,
+									 GResolverRecordType type, GCancellable *cancellable,
+									 GError **error)
+{
+	return g_resolver_lookup_records (HC_RESOLVER (resolver)->inner, rrname, type,
+												 cancellable, error);
+}
+
+static void
+hc_resolver_lookup_records_async (GResolver *resolver, const gchar *rrname,
+											 GResolverRecordType type, GCancellable *cancellable,
+											 GAsyncReadyCallback callback, gpointer user_data)
+{
+	g_resolver_lookup_records_async (HC_RESOLVER (resolver)->inner, rrname, type,
+												cancellable, callback, user_data);
+}
+
+static GList *
+hc_resolver_lookup_records_finish (GResolver *resolver, GAsyncResult *result,
+											  GError **error)
+{
+	return g_resolver_lookup_records_finish (HC_RESOLVER (resolver)->inner, result, error);
+}
+
+/* g_resolver_lookup_service() builds the SRV name itself and hands it to
+   ->lookup_service, so forward to the inner class rather than the public
+   call, which would prefix it a second time */
+
+static GList *
+hc_resolver_lookup_service (GResolver *resolver, const gchar *rrname,
+									 GCancellable *cancellable, GError **error)
+{
+	GResolver *inner = HC_RESOLVER (resolver)->inner;
+
+	return G_RESOLVER_GET_CLASS (inner)->lookup_service (inner, rrname, cancellable, error);
+}
+
+static void
+hc_resolver_lookup_service_async (GResolver *resolver, const gchar *rrname,
+											 GCancellable *cancellable,
+											 GAsyncReadyCallback callback, gpointer user_data)
+{
+	GResolver *inner = HC_RESOLVER (resolver)->inner;
+
+	G_RESOLVER_GET_CLASS (inner)->lookup_service_async (inner, rrname, cancellable,
+																		 callback, user_data);
+}
+
+static GList *
+hc_resolver_lookup_service_finish (GResolver *resolver, GAsyncResult *result,
+											  GError **error)
+{
+	GResolver *inner = HC_RESOLVER (resolver)->inner;
+
+	return G_RESOLVER_GET_CLASS (inner)->lookup_service_finish (inner, result, error);
+}
+
+/* GResolver emits this when resolv.conf changes */
+
+static void
+hc_resolver_reload (GResolver *resolver)
+{
+	dns_cache_clear (HC_RESOLVER (resolver));
+}
+
+static void
+hc_resolver_finalize (GObject *object)
+{
+	HcResolver *res = HC_RESOLVER (object);
+
+	g_hash_table_destroy (res->cache);
+	g_object_unref (res->inner);
+
+	G_OBJECT_CLASS (hc_resolver_parent_class)->finalize (object);
+}
+
+static void
+hc_resolver_class_init (HcResolverClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	GResolverClass *resolver_class = G_RESOLVER_CLASS (klass);
+
+	object_class->finalize = hc_resolver_finalize;
+
+	resolver_class->reload = hc_resolver_reload;
+	resolver_class->lookup_by_name = hc_resolver_lookup_by_name;
+	resolver_class->lookup_by_name_async = hc_resolver_lookup_by_name_async;
+	resolver_class->lookup_by_name_finish = hc_resolver_lookup_finish;
+	resolver_class->lookup_by_name_with_flags = hc_resolver_lookup;
+	resolver_class->lookup_by_name_with_flags_async = hc_resolver_lookup_async;
+	resolver_class->lookup_by_name_with_flags_finish = hc_resolver_lookup_finish;
+	resolver_class->lookup_by_address = hc_resolver_lookup_by_address;
+	resolver_class->lookup_by_address_async = hc_resolver_lookup_by_address_async;
+	resolver_class->lookup_by_address_finish = hc_resolver_lookup_by_address_finish;
+	resolver_class->lookup_service = hc_resolver_lookup_service;
+	resolver_class->lookup_service_async = hc_resolver_lookup_service_async;
+	resolver_class->lookup_service_finish = hc_resolver_lookup_service_finish;
+	resolver_class->lookup_records = hc_resolver_lookup_records;
+	resolver_class->lookup_records_async = hc_resolver_lookup_records_async;
+	resolver_class->lookup_records_finish = hc_resolver_lookup_records_finish;
+}
+
+static void
+hc_resolver_init (HcResolver *res)
+{
+	res->cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+													(GDestroyNotify) dns_entry_free);
+}
+
+void
+dnscache_init (void)
+{
+	if (dns_resolver)
+		return;
+
+	dns_resolver = g_object_new (HC_TYPE_RESOLVER, NULL);
+	dns_resolver->inner = g_resolver_get_default ();
+	g_resolver_set_default (G_RESOLVER (dns_resolver));
+}
+
+/* warm the cache for a host we'll probably connect to soon */
+
+void
+dnscache_prefetch (const char *hostname)
+{
+	GInetAddress *addr;
+
+	if (!dns_resolver || prefs.hex_net_dns_cache_ttl <= 0 || !hostname || !hostname[0])
+		return;
+
+	addr = g_inet_address_new_from_string (hostname);
+	if (addr)
+	{
+		g_object_unref (addr);
+		return;
+	}
+
+	dns_cache_fetch (dns_resolver, hostname);
+}
@@ -97,6 +97,16 @@ void fe_progressbar_start (struct session *sess);
 void fe_progressbar_end (struct server *serv);
 void fe_print_text (struct session *sess, char *text, time_t stamp,
 					gboolean no_activity);
+/* text printed between a begin (APPEND/PREPEND) and the END only has to
+   reach the scrollback, the end shows it in one go. PREPEND text is older
+   than everything in the window and goes on top of it. */
+typedef enum
+{
+	FE_TEXT_BATCH_END = 0,
+	FE_TEXT_BATCH_APPEND,
+	FE_TEXT_BATCH_PREPEND
+} fe_text_batch_mode;
+void fe_text_batch (struct session *sess, fe_text_batch_mode mode);
 void fe_userlist_insert (struct session *sess, struct User *newuser, gboolean sel);
 int fe_userlist_remove (struct session *sess, struct User *user);
 void fe_userlist_rehash (struct session *sess, struct User *user);
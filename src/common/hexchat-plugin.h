@@ -39,6 +39,8 @@
 #define HEXCHAT_EAT_PLUGIN	2	/* don't let other plugins see this event */
 #define HEXCHAT_EAT_ALL		(HEXCHAT_EAT_HEXCHAT|HEXCHAT_EAT_PLUGIN)	/* don't let anything see this event */
 
+#define HEXCHAT_BATCH_SKIP_SELF	1	/* don't run the calling plugin's own command hooks */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -193,6 +195,22 @@ struct _hexchat_plugin
 	hexchat_event_attrs *(*hexchat_event_attrs_create) (hexchat_plugin *ph);
 	void (*hexchat_event_attrs_free) (hexchat_plugin *ph,
 									  hexchat_event_attrs *attrs);
+	int (*hexchat_list_field_id) (hexchat_plugin *ph,
+		const char *list,
+		const char *name);
+	const char * (*hexchat_list_str_id) (hexchat_plugin *ph,
+		hexchat_list *xlist,
+		int id);
+	int (*hexchat_list_int_id) (hexchat_plugin *ph,
+		hexchat_list *xlist,
+		int id);
+	time_t (*hexchat_list_time_id) (hexchat_plugin *ph,
+		hexchat_list *xlist,
+		int id);
+	int (*hexchat_command_batch) (hexchat_plugin *ph,
+		const char * const *commands,
+		int count,
+		int flags);
 };
 #endif
 
@@ -272,6 +290,15 @@ void
 hexchat_command (hexchat_plugin *ph,
 	       const char *command);
 
+/* Runs commands like hexchat_command(), folding runs of OP/VOICE-style
+   commands into shared MODE lines and /MSGs with the same text into one
+   multi-target PRIVMSG. Returns how many commands were run. */
+int
+hexchat_command_batch (hexchat_plugin *ph,
+		 const char * const *commands,
+		 int count,
+		 int flags);
+
 void
 hexchat_commandf (hexchat_plugin *ph,
 		const char *format, ...)
@@ -338,6 +365,28 @@ hexchat_list_time (hexchat_plugin *ph,
 		 hexchat_list *xlist,
 		 const char *name);
 
+/* Resolve a field name (without its type prefix) once, then read it for
+   every entry with the _id getters. Returns -1 for unknown fields. */
+int
+hexchat_list_field_id (hexchat_plugin *ph,
+		 const char *list,
+		 const char *name);
+
+const char *
+hexchat_list_str_id (hexchat_plugin *ph,
+		 hexchat_list *xlist,
+		 int id);
+
+int
+hexchat_list_int_id (hexchat_plugin *ph,
+		 hexchat_list *xlist,
+		 int id);
+
+time_t
+hexchat_list_time_id (hexchat_plugin *ph,
+		 hexchat_list *xlist,
+		 int id);
+
 void *
 hexchat_plugingui_add (hexchat_plugin *ph,
 		     const char *filename,
@@ -441,6 +490,11 @@ hexchat_pluginpref_list (hexchat_plugin *ph,
 #define hexchat_emit_print ((HEXCHAT_PLUGIN_HANDLE)->hexchat_emit_print)
 #define hexchat_emit_print_attrs ((HEXCHAT_PLUGIN_HANDLE)->hexchat_emit_print_attrs)
 #define hexchat_list_time ((HEXCHAT_PLUGIN_HANDLE)->hexchat_list_time)
+#define hexchat_list_field_id ((HEXCHAT_PLUGIN_HANDLE)->hexchat_list_field_id)
+#define hexchat_list_str_id ((HEXCHAT_PLUGIN_HANDLE)->hexchat_list_str_id)
+#define hexchat_list_int_id ((HEXCHAT_PLUGIN_HANDLE)->hexchat_list_int_id)
+#define hexchat_list_time_id ((HEXCHAT_PLUGIN_HANDLE)->hexchat_list_time_id)
+#define hexchat_command_batch ((HEXCHAT_PLUGIN_HANDLE)->hexchat_command_batch)
 #define hexchat_gettext ((HEXCHAT_PLUGIN_HANDLE)->hexchat_gettext)
 #define hexchat_send_modes ((HEXCHAT_PLUGIN_HANDLE)->hexchat_send_modes)
 #define hexchat_strip ((HEXCHAT_PLUGIN_HANDLE)->hexchat_strip)
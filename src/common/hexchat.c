@@ -35,6 +35,8 @@
 #include "util.h"
 #include "cfgfiles.h"
 #include "chanopt.h"
+#include "chathistory.h"
+#include "dnscache.h"
 #include "ignore.h"
 #include "hexchat-plugin.h"
 #include "inbound.h"
@@ -46,6 +48,7 @@
 #include "servlist.h"
 #include "outbound.h"
 #include "text.h"
+#include "timerwheel.h"
 #include "url.h"
 #include "hexchatc.h"
 
@@ -81,7 +84,7 @@ GSList *tabmenu_list = 0;
  * beginning of one of the lists.  The aim is to be able to switch to the
  * session with the most important/recent activity.
  */
-GList *sess_list_by_lastact[5] = {NULL, NULL, NULL, NULL, NULL};
+GQueue sess_list_by_lastact[5] = {G_QUEUE_INIT, G_QUEUE_INIT, G_QUEUE_INIT, G_QUEUE_INIT, G_QUEUE_INIT};
 
 
 static int in_hexchat_exit = FALSE;
@@ -105,7 +108,8 @@ struct hexchatprefs prefs;
 
 /*
  * Update the priority queue of the "interesting sessions"
- * (sess_list_by_lastact).
+ * (sess_list_by_lastact). Each session carries its own list link, so
+ * moving it around is O(1) however many sessions are queued.
  */
 void
 lastact_update(session *sess)
@@ -123,17 +127,17 @@ lastact_update(session *sess)
 
 	/* If already first at the right position, just return */
 	if (oldidx == newidx &&
-		 (newidx == LACT_NONE || g_list_index(sess_list_by_lastact[newidx], sess) == 0))
+		 (newidx == LACT_NONE || sess_list_by_lastact[newidx].head == &sess->lastact_link))
 		return;
 
 	/* Remove from the old position */
 	if (oldidx != LACT_NONE)
-		sess_list_by_lastact[oldidx] = g_list_remove(sess_list_by_lastact[oldidx], sess);
+		g_queue_unlink (&sess_list_by_lastact[oldidx], &sess->lastact_link);
 
 	/* Add at the new position */
 	sess->lastact_idx = newidx;
 	if (newidx != LACT_NONE)
-		sess_list_by_lastact[newidx] = g_list_prepend(sess_list_by_lastact[newidx], sess);
+		g_queue_push_head_link (&sess_list_by_lastact[newidx], &sess->lastact_link);
 	return;
 }
 
@@ -149,31 +153,25 @@ session *
 lastact_getfirst(int (*filter) (session *sess))
 {
 	int i;
-	session *sess = NULL;
+	session *sess;
 	GList *curitem;
 
 	/* 5 is the number of priority classes LACT_ */
-	for (i = 0; i < 5 && !sess; i++)
+	for (i = 0; i < 5; i++)
 	{
-		curitem = sess_list_by_lastact[i];
-		while (curitem && !sess)
+		for (curitem = sess_list_by_lastact[i].head; curitem; curitem = curitem->next)
 		{
-			sess = g_list_nth_data(curitem, 0);
-			if (!sess || (filter && !filter(sess)))
-			{
-				sess = NULL;
-				curitem = g_list_next(curitem);
-			}
-		}
+			sess = curitem->data;
+			if (filter && !filter (sess))
+				continue;
 
-		if (sess)
-		{
-			sess_list_by_lastact[i] = g_list_remove(sess_list_by_lastact[i], sess);
+			g_queue_unlink (&sess_list_by_lastact[i], curitem);
 			sess->lastact_idx = LACT_NONE;
+			return sess;
 		}
 	}
-	
-	return sess;
+
+	return NULL;
 }
 
 int
@@ -182,60 +180,87 @@ is_session (session * sess)
 	return g_slist_find (sess_list, sess) ? 1 : 0;
 }
 
-session *
-find_dialog (server *serv, char *nick)
+/* recompute sess->channel_fold, must follow every change to sess->channel */
+void
+session_fold_channel (session *sess)
+{
+	casemap_fold (sess->server->p_casemap, sess->channel_fold, sess->channel, CHANLEN);
+}
+
+static session *
+find_session_folded (server *serv, const char *name, int type)
 {
 	GSList *list = sess_list;
 	session *sess;
+	char key[CHANLEN];
+
+	casemap_fold (serv->p_casemap, key, name, sizeof (key));
 
 	while (list)
 	{
 		sess = list->data;
-		if (sess->server == serv && sess->type == SESS_DIALOG)
-		{
-			if (!serv->p_cmp (nick, sess->channel))
-				return (sess);
-		}
+		if (sess->server == serv && sess->type == type &&
+			 strcmp (key, sess->channel_fold) == 0)
+			return sess;
 		list = list->next;
 	}
 	return NULL;
 }
 
+session *
+find_dialog (server *serv, char *nick)
+{
+	return find_session_folded (serv, nick, SESS_DIALOG);
+}
+
 session *
 find_channel (server *serv, char *chan)
 {
-	session *sess;
-	GSList *list = sess_list;
-	while (list)
+	return find_session_folded (serv, chan, SESS_CHANNEL);
+}
+
+/* periodic tasks, see hexchat_reinit_timers(). One whose work list runs
+   empty stops its timer and is started again when there's work. */
+static int lag_check_update_tag = 0;
+static int lag_check_tag = 0;
+static int away_tag = 0;
+
+static gboolean
+any_server_connected (void)
+{
+	GSList *list;
+
+	for (list = serv_list; list; list = list->next)
 	{
-		sess = list->data;
-		if ((serv == sess->server) && sess->type == SESS_CHANNEL)
-		{
-			if (!serv->p_cmp (chan, sess->channel))
-				return sess;
-		}
-		list = list->next;
+		if (((server *)list->data)->connected)
+			return TRUE;
 	}
-	return NULL;
+	return FALSE;
 }
 
-static void
+/* returns FALSE when no server is waiting for a lag reply */
+static gboolean
 lagcheck_update (void)
 {
 	server *serv;
 	GSList *list = serv_list;
+	gboolean waiting = FALSE;
 	
 	if (!prefs.hex_gui_lagometer)
-		return;
+		return FALSE;
 
 	while (list)
 	{
 		serv = list->data;
 		if (serv->lag_sent)
+		{
 			fe_set_lag (serv, -1);
+			waiting = TRUE;
+		}
 
 		list = list->next;
 	}
+	return waiting;
 }
 
 void
@@ -278,6 +303,9 @@ lag_check (void)
 		}
 		list = list->next;
 	}
+
+	/* the lag-o-meter has something to count up again */
+	hexchat_reinit_timers ();
 }
 
 static int
@@ -290,6 +318,12 @@ away_check (void)
 	if (!prefs.hex_away_track)
 		return 1;
 
+	if (!any_server_connected ())
+	{
+		away_tag = 0;
+		return 0;
+	}
+
 doover:
 	/* request an update of AWAY status of 1 channel every 30 seconds */
 	full = TRUE;
@@ -299,9 +333,11 @@ doover:
 	{
 		sess = list->data;
 
+		/* a deferred join WHO brings the away status along when it's sent */
 		if (sess->server->connected &&
 			 sess->type == SESS_CHANNEL &&
 			 sess->channel[0] &&
+			 !sess->who_deferred &&
 			 (sess->total <= prefs.hex_away_size_max || !prefs.hex_away_size_max))
 		{
 			if (!sess->done_away_check)
@@ -346,6 +382,12 @@ doover:
 static int
 hexchat_lag_check (void)   /* this gets called every 30 seconds */
 {
+	if (!any_server_connected ())
+	{
+		lag_check_tag = 0;
+		return 0;
+	}
+
 	lag_check ();
 	return 1;
 }
@@ -353,62 +395,81 @@ hexchat_lag_check (void)   /* this gets called every 30 seconds */
 static int
 hexchat_lag_check_update (void)   /* this gets called every 0.5 seconds */
 {
-	lagcheck_update ();
+	if (!lagcheck_update ())
+	{
+		lag_check_update_tag = 0;
+		return 0;
+	}
 	return 1;
 }
 
-/* call whenever timeout intervals change */
+static int
+hexchat_notify_check (void)
+{
+	/* everything on MONITOR/WATCH lists, or no list at all: nothing to poll */
+	if (!any_server_connected () || !notify_polling_needed ())
+	{
+		notify_tag = 0;
+		return 0;
+	}
+
+	return notify_checklist ();
+}
+
+/* call whenever timeout intervals change, or a server connects and the
+   timers of an idle client have to be started again. They all share the
+   one timer wheel source, and the slack lets them wake up together. */
 void
 hexchat_reinit_timers (void)
 {
-	static int lag_check_update_tag = 0;
-	static int lag_check_tag = 0;
-	static int away_tag = 0;
+	gboolean connected = any_server_connected ();
 
-	/* notify timeout */
-	if (prefs.hex_notify_timeout && notify_tag == 0)
+	/* notify timeout, notify_checklist() spreads each server's polls itself */
+	if (prefs.hex_notify_timeout && connected && notify_tag == 0 &&
+		 notify_polling_needed ())
 	{
-		notify_tag = fe_timeout_add_seconds (prefs.hex_notify_timeout,
-						     notify_checklist, NULL);
+		notify_tag = timerwheel_add (1000, 250, (GSourceFunc) hexchat_notify_check, NULL);
 	}
 	else if (!prefs.hex_notify_timeout && notify_tag != 0)
 	{
-		fe_timeout_remove (notify_tag);
+		timerwheel_remove (notify_tag);
 		notify_tag = 0;
 	}
 
 	/* away status tracking */
-	if (prefs.hex_away_track && away_tag == 0)
+	if (prefs.hex_away_track && connected && away_tag == 0)
 	{
-		away_tag = fe_timeout_add_seconds (prefs.hex_away_timeout, away_check, NULL);
+		away_tag = timerwheel_add (prefs.hex_away_timeout * 1000, 1000,
+											(GSourceFunc) away_check, NULL);
 	}
 	else if (!prefs.hex_away_track && away_tag != 0)
 	{
-		fe_timeout_remove (away_tag);
+		timerwheel_remove (away_tag);
 		away_tag = 0;
 	}
 
-	/* lag-o-meter */
-	if (prefs.hex_gui_lagometer && lag_check_update_tag == 0)
+	/* lag-o-meter, only counts while a lag reply is outstanding */
+	if (prefs.hex_gui_lagometer && connected && lag_check_update_tag == 0)
 	{
-		lag_check_update_tag = fe_timeout_add (500, hexchat_lag_check_update, NULL);
+		lag_check_update_tag = timerwheel_add (500, 100,
+															(GSourceFunc) hexchat_lag_check_update, NULL);
 	}
 	else if (!prefs.hex_gui_lagometer && lag_check_update_tag != 0)
 	{
-		fe_timeout_remove (lag_check_update_tag);
+		timerwheel_remove (lag_check_update_tag);
 		lag_check_update_tag = 0;
 	}
 
 	/* network timeouts and lag-o-meter */
 	if ((prefs.hex_net_ping_timeout != 0 || prefs.hex_gui_lagometer)
-	    && lag_check_tag == 0)
+	    && connected && lag_check_tag == 0)
 	{
-		lag_check_tag = fe_timeout_add_seconds (30, hexchat_lag_check, NULL);
+		lag_check_tag = timerwheel_add (30000, 1000, (GSourceFunc) hexchat_lag_check, NULL);
 	}
 	else if ((!prefs.hex_net_ping_timeout && !prefs.hex_gui_lagometer)
 					 && lag_check_tag != 0)
 	{
-		fe_timeout_remove (lag_check_tag);
+		timerwheel_remove (lag_check_tag);
 		lag_check_tag = 0;
 	}
 }
@@ -492,11 +553,13 @@ session_new (server *serv, char *from, int type, int focus)
 	sess->text_strip = SET_DEFAULT;
 
 	sess->lastact_idx = LACT_NONE;
+	sess->lastact_link.data = sess;
 
 	if (from != NULL)
 	{
 		safe_strcpy(sess->channel, from, CHANLEN);
 		safe_strcpy(sess->session_name, from, CHANLEN);
+		session_fold_channel (sess);
 	}
 
 	sess_list = g_slist_prepend (sess_list, sess);
@@ -545,8 +608,8 @@ new_ircwindow (server *serv, char *name, int type, int focus)
 		log_open_or_close (sess);
 
 		user = userlist_find_global (serv, name);
-		if (user && user->hostname)
-			set_topic (sess, user->hostname, user->hostname);
+		if (user && user->info->hostname)
+			set_topic (sess, user->info->hostname, user->info->hostname);
 	}
 	plugin_emit_dummy_print (sess, "Open Context");
 
@@ -660,7 +723,7 @@ session_free (session *killsess)
 
 	oldidx = killsess->lastact_idx;
 	if (oldidx != LACT_NONE)
-		sess_list_by_lastact[oldidx] = g_list_remove(sess_list_by_lastact[oldidx], killsess);
+		g_queue_unlink (&sess_list_by_lastact[oldidx], &killsess->lastact_link);
 
 	exec_notify_kill (killsess);
 
@@ -671,6 +734,7 @@ session_free (session *killsess)
 	send_quit_or_part (killsess);
 
 	history_free (&killsess->history);
+	chathistory_free (killsess);
 	g_free (killsess->topic);
 	g_free (killsess->current_modes);
 
@@ -934,6 +998,7 @@ xchat_init (void)
 	list_loadconf ("urlhandlers.conf", &urlhandler_list,
 						defaultconf_urlhandlers);
 
+	dnscache_init ();
 	servlist_init ();							/* load server list */
 
 	/* if we got a URL, don't open the server list GUI */
@@ -969,6 +1034,7 @@ hexchat_exit (void)
 	plugin_kill_all ();
 	fe_cleanup ();
 
+	cfgfile_flush_all ();
 	save_config ();
 	if (prefs.save_pevents)
 	{
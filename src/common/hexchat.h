@@ -207,6 +207,7 @@ struct hexchatprefs
 	/* NUMBERS */
 	int hex_away_size_max;
 	int hex_away_timeout;
+	int hex_chanopt_prune_days;
 	int hex_completion_amount;
 	int hex_completion_sort;
 	int hex_dcc_auto_recv;
@@ -240,6 +241,7 @@ struct hexchatprefs
 	int hex_gui_pane_right_size_min;
 	int hex_gui_search_pos;
 	int hex_gui_slist_select;
+	int hex_gui_stall_threshold;
 	int hex_gui_tab_layout;
 	int hex_gui_tab_middleclose;
 	int hex_gui_tab_newtofront;
@@ -259,17 +261,24 @@ struct hexchatprefs
 	int hex_gui_win_width;
 	int hex_identd_port;
 	int hex_irc_ban_type;
+	int hex_irc_chathistory_lines;
 	int hex_irc_join_delay;
 	int hex_irc_notice_pos;
+	int hex_net_connect_limit;
+	int hex_net_dns_cache_ttl;
 	int hex_net_ping_timeout;
 	int hex_net_proxy_port;
 	int hex_net_proxy_type;				/* 0=disabled, 1=wingate 2=socks4, 3=socks5, 4=http */
 	int hex_net_proxy_use;				/* 0=all 1=IRC_ONLY 2=DCC_ONLY */
 	int hex_net_reconnect_delay;
+	int hex_net_throttle_burst;			/* lines sent back to back before throttling */
+	int hex_net_throttle_bytes;			/* payload bytes that cost one extra line */
+	int hex_net_throttle_refill;		/* ms to earn one line back */
 	int hex_notify_timeout;
 	int hex_text_max_indent;
 	int hex_text_stamp_width;
 	int hex_text_max_lines;
+	int hex_text_rawlog_size;			/* KB of raw log kept per server */
 	int hex_url_grabber_limit;
 
 	/* STRINGS */
@@ -370,8 +379,10 @@ typedef struct session
 
 	struct server *server;
 	tree *usertree;					/* alphabetical tree */
+	struct slab *user_slab;			/* storage for the struct Users in usertree */
 	struct User *me;					/* points to myself in the usertree */
 	char channel[CHANLEN];
+	char channel_fold[CHANLEN];		/* channel, casefolded by server->p_casemap */
 	char waitchannel[CHANLEN];		  /* waiting to join channel (/join sent) */
 	char willjoinchannel[CHANLEN];	  /* will issue /join for this channel */
 	char session_name[CHANLEN];		 /* the name of the session, should not modified */
@@ -405,15 +416,22 @@ typedef struct session
 
 	int type;					/* SESS_* */
 
+	int text_batch;			/* >0 while a playback batch is printed, see batch.c */
+	struct chathistory *chathistory;	/* what the server may still give us, see chathistory.c */
+
 	int lastact_idx;		/* the sess_list_by_lastact[] index of the list we're in.
 							 * For valid values, see defines of LACT_*. */
+	GList lastact_link;		/* our node in that list, data points back to us */
 
 	int ignore_date:1;
 	int ignore_mode:1;
 	int ignore_names:1;
 	int end_of_names:1;
 	int doing_who:1;		/* /who sent on this channel */
+	int who_deferred:1;		/* join WHO waits for the users to be needed, see joinsched.c */
 	int done_away_check:1;	/* done checking for away status changes */
+	int userlist_frozen:1;	/* fe holds userlist model updates, see netsplit.c */
+	int text_prepend:1;		/* printing history older than the buffer, see batch.c */
 	tab_state_flags tab_state;
 	tab_state_flags last_tab_state; /* before event is handled */
 	gtk_xtext_search_flags lastlog_flags;
@@ -469,15 +487,10 @@ typedef struct server
 /*	void (*p_set_away)(struct server *);*/
 	int (*p_raw)(struct server *, char *raw);
 	int (*p_cmp)(const char *s1, const char *s2);
+	const unsigned char *p_casemap;	/* fold table matching p_cmp */
 
 	int port;
-	int sok;					/* is equal to sok4 or sok6 (the one we are using) */
-	int sok4;					/* tcp4 socket */
-	int sok6;					/* tcp6 socket */
-	int proxy_type;
-	int proxy_sok;				/* Additional information for MS Proxy beast */
-	int proxy_sok4;
-	int proxy_sok6;
+	int sok;
 	int id;					/* unique ID number (for plugin API) */
 
 	/* dcc_ip moved from hexchatprefs to make it per-server */
@@ -490,12 +503,11 @@ typedef struct server
 #else
 	void *ssl;
 #endif
-	int childread;
-	int childwrite;
-	int childpid;
+	void *connect_attempt;		/* in-flight connect, NULL once connected or queued */
 	int iotag;
 	int recondelay_tag;				/* reconnect delay timeout */
 	int joindelay_tag;				/* waiting before we send JOIN */
+	struct joinsched *joinsched;	/* autojoins not sent yet, see joinsched.c */
 	char hostname[128];				/* real ip number */
 	char servername[128];			/* what the server says is its name */
 	char password[1024];
@@ -512,13 +524,31 @@ typedef struct server
 	char *nick_modes;					/* e.g. "aohv" */
 	char *bad_nick_prefixes;		/* for ircd that doesn't give the modes */
 	int modes_per_line;				/* 6 on undernet, 4 on efnet etc... */
+	int privmsg_targets;				/* TARGMAX for PRIVMSG from 005, 1 if not given, 0 unlimited */
 
 	void *network;						/* points to entry in servlist.c or NULL! */
 
+	GHashTable *users;				/* nick_fold -> struct userinfo, see userlist.c */
+	GHashTable *user_strings;		/* interned userinfo strings -> refcount */
+	struct slab *userinfo_slab;	/* storage for the records in users */
+	GHashTable *notify_index;		/* nick_fold -> notify_per_server, see notify.c */
+	guint notify_gen;
+	const unsigned char *notify_casemap;
+	GPtrArray *notify_pending;		/* "+nick"/"-nick" MONITOR/WATCH changes to send */
+	int monitor_limit;				/* MONITOR=/WATCH= from 005, 0 if unlimited */
+	int monitor_count;				/* notify entries on the server's list */
+	GQueue *ison_shards;				/* char **: ISON lines left in this round */
+	GQueue *ison_sent;				/* ISONs awaiting their 303, see notify.c */
+	gint64 ison_next_poll;			/* monotonic time of the next round */
+	struct netsplit *netsplit;		/* pending split/join batch, see netsplit.c */
+	GHashTable *batches;				/* open IRCv3 batches by reference, see batch.c */
+	int chathistory_limit;			/* CHATHISTORY= from 005, 0 if unlimited */
+
 	GSList *outbound_queue;
-	time_t next_send;						/* cptr->since in ircu */
-	time_t prev_now;					/* previous now-time */
+	gint64 throttle_stamp;				/* monotonic ms of the last bucket refill */
+	int throttle_tokens;				/* token bucket credit, in ms of send time */
 	int sendq_len;						/* queue size */
+	int sendq_lines;					/* lines waiting in outbound_queue */
 	int lag;								/* milliseconds */
 
 	struct session *front_session;	/* front-most window/tab */
@@ -569,6 +599,8 @@ typedef struct server
 	unsigned int have_extjoin:1;	/* cap extended-join */
 	unsigned int have_account_tag:1;	/* cap account-tag */
 	unsigned int have_server_time:1;	/* cap server-time */
+	unsigned int have_batch:1;		/* cap batch */
+	unsigned int have_chathistory:1;	/* cap draft/chathistory */
 	unsigned int have_sasl:1;		/* SASL capability */
 	unsigned int have_except:1;	/* ban exemptions +e */
 	unsigned int have_invite:1;	/* invite exemptions +I */
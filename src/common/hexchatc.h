@@ -45,10 +45,11 @@ extern GSList *ignore_list;
 extern GSList *usermenu_list;
 extern GSList *urlhandler_list;
 extern GSList *tabmenu_list;
-extern GList *sess_list_by_lastact[];
+extern GQueue sess_list_by_lastact[];
 
 session * find_channel (server *serv, char *chan);
 session * find_dialog (server *serv, char *nick);
+void session_fold_channel (session *sess);
 session * new_ircwindow (server *serv, char *name, int type, int focus);
 void hexchat_reinit_timers (void);
 void lastact_update (session * sess);
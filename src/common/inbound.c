@@ -43,6 +43,9 @@
 #include "ctcp.h"
 #include "hexchatc.h"
 #include "chanopt.h"
+#include "chathistory.h"
+#include "joinsched.h"
+#include "netsplit.h"
 
 
 void
@@ -51,7 +54,9 @@ clear_channel (session *sess)
 	if (sess->channel[0])
 		strcpy (sess->waitchannel, sess->channel);
 	sess->channel[0] = 0;
+	sess->channel_fold[0] = 0;
 	sess->doing_who = FALSE;
+	sess->who_deferred = FALSE;
 	sess->done_away_check = FALSE;
 
 	log_close (sess);
@@ -202,7 +207,7 @@ inbound_privmsg (server *serv, char *from, char *ip, char *text, int id,
 	if (user)
 	{
 		user->lasttalk = time (0);
-		if (user->account)
+		if (user->info->account)
 			id = TRUE;
 	}
 	
@@ -302,16 +307,19 @@ alert_match_text (char *text, char *masks)
 static int
 is_hilight (char *from, char *text, session *sess, server *serv)
 {
+	static GString *scratch;
+
 	if (alert_match_word (from, prefs.hex_irc_no_hilight))
 		return 0;
 
-	text = strip_color (text, -1, STRIP_ALL);
+	if (!scratch)
+		scratch = g_string_sized_new (512);
+	text = (char *) strip_color_scratch (text, STRIP_ALL, scratch);
 
 	if (alert_match_text (text, serv->nick) ||
 		 alert_match_text (text, prefs.hex_irc_extra_hilight) ||
 		 alert_match_word (from, prefs.hex_irc_nick_hilight))
 	{
-		g_free (text);
 		if (sess != current_tab)
 		{
 			sess->tab_state |= TAB_STATE_NEW_HILIGHT;
@@ -320,7 +328,6 @@ is_hilight (char *from, char *text, session *sess, server *serv)
 		return 1;
 	}
 
-	g_free (text);
 	return 0;
 }
 
@@ -368,6 +375,8 @@ inbound_action (session *sess, char *chan, char *from, char *ip, char *text,
 	if (!sess)
 		sess = def;
 
+	chathistory_seen (sess, tags_data->timestamp, tags_data->msgid);
+
 	if (sess != current_tab)
 	{
 		if (fromme)
@@ -382,7 +391,7 @@ inbound_action (session *sess, char *chan, char *from, char *ip, char *text,
 	{
 		nickchar[0] = user->prefix[0];
 		user->lasttalk = time (0);
-		if (user->account)
+		if (user->info->account)
 			id = TRUE;
 		if (user->me)
 			fromme = TRUE;
@@ -439,6 +448,8 @@ inbound_chanmsg (server *serv, session *sess, char *chan, char *from,
 			return;
 	}
 
+	chathistory_seen (sess, tags_data->timestamp, tags_data->msgid);
+
 	if (sess != current_tab)
 	{
 		sess->tab_state |= TAB_STATE_NEW_MSG;
@@ -448,7 +459,7 @@ inbound_chanmsg (server *serv, session *sess, char *chan, char *from,
 	user = userlist_find (sess, from);
 	if (user)
 	{
-		if (user->account)
+		if (user->info->account)
 			id = TRUE;
 		nickchar[0] = user->prefix[0];
 		user->lasttalk = time (0);
@@ -487,7 +498,9 @@ inbound_newnick (server *serv, char *nick, char *newnick, int quiet,
 {
 	int me = FALSE;
 	session *sess;
-	GSList *list = sess_list;
+	struct userinfo *info;
+	struct User *user;
+	GSList *list;
 
 	if (!serv->p_cmp (nick, serv->nick))
 	{
@@ -495,32 +508,45 @@ inbound_newnick (server *serv, char *nick, char *newnick, int quiet,
 		safe_strcpy (serv->nick, newnick, NICKLEN);
 	}
 
-	while (list)
+	/* only the channels this nick is on need to hear about it */
+	info = userlist_change (serv, nick, newnick);
+	if (info && !quiet)
 	{
-		sess = list->data;
-		if (sess->server == serv)
+		for (user = info->members; user; user = user->next_member)
 		{
-			if (userlist_change (sess, nick, newnick) || (me && sess->type == SESS_SERVER))
-			{
-				if (!quiet)
-				{
-					if (me)
-						EMIT_SIGNAL_TIMESTAMP (XP_TE_UCHANGENICK, sess, nick, 
-													  newnick, NULL, NULL, 0,
-													  tags_data->timestamp);
-					else
-						EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANGENICK, sess, nick,
-													  newnick, NULL, NULL, 0, tags_data->timestamp);
-				}
-			}
-			if (sess->type == SESS_DIALOG && !serv->p_cmp (sess->channel, nick))
-			{
-				safe_strcpy (sess->channel, newnick, CHANLEN);
-				fe_set_channel (sess);
-			}
+			if (me)
+				EMIT_SIGNAL_TIMESTAMP (XP_TE_UCHANGENICK, user->sess, nick,
+											  newnick, NULL, NULL, 0,
+											  tags_data->timestamp);
+			else
+				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANGENICK, user->sess, nick,
+											  newnick, NULL, NULL, 0, tags_data->timestamp);
+		}
+	}
+
+	sess = find_dialog (serv, nick);
+	if (sess)
+	{
+		safe_strcpy (sess->channel, newnick, CHANLEN);
+		session_fold_channel (sess);
+		fe_set_channel (sess);
+		fe_set_title (sess);
+	}
+
+	/* our own nick is part of every title on this server */
+	if (me)
+	{
+		for (list = sess_list; list; list = list->next)
+		{
+			sess = list->data;
+			if (sess->server != serv)
+				continue;
+			if (sess->type == SESS_SERVER && !quiet)
+				EMIT_SIGNAL_TIMESTAMP (XP_TE_UCHANGENICK, sess, nick,
+											  newnick, NULL, NULL, 0,
+											  tags_data->timestamp);
 			fe_set_title (sess);
 		}
-		list = list->next;
 	}
 
 	dcc_change_nick (serv, nick, newnick);
@@ -592,6 +618,7 @@ inbound_ujoin (server *serv, char *chan, char *nick, char *ip,
 	}
 
 	safe_strcpy (sess->channel, chan, CHANLEN);
+	session_fold_channel (sess);
 	if (found_unused)
 	{
 		chanopt_load (sess);
@@ -621,10 +648,14 @@ inbound_ujoin (server *serv, char *chan, char *nick, char *ip,
 
 	if (prefs.hex_irc_who_join)
 	{
-		/* sends WHO #channel */
-		serv->p_user_list (sess->server, chan);
-		sess->doing_who = TRUE;
+		/* WHO #channel goes out once the window is shown or its users
+		   are needed, not for every channel of a big autojoin */
+		sess->who_deferred = TRUE;
+		if (sess == current_tab)
+			joinsched_users_needed (sess);
 	}
+
+	chathistory_join (sess);
 }
 
 void
@@ -767,8 +798,9 @@ inbound_join (server *serv, char *chan, char *user, char *ip, char *account,
 	session *sess = find_channel (serv, chan);
 	if (sess)
 	{
-		EMIT_SIGNAL_TIMESTAMP (XP_TE_JOIN, sess, user, chan, ip, account, 0,
-									  tags_data->timestamp);
+		if (!netsplit_join (sess, user, tags_data->timestamp))
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_JOIN, sess, user, chan, ip, account, 0,
+										  tags_data->timestamp);
 		userlist_add (sess, user, ip, account, realname, tags_data);
 	}
 }
@@ -824,32 +856,34 @@ void
 inbound_quit (server *serv, char *nick, char *ip, char *reason,
 				  const message_tags_data *tags_data)
 {
-	GSList *list = sess_list;
 	session *sess;
-	struct User *user;
+	struct userinfo *info;
+	struct User *user, *next = NULL;
 	int was_on_front_session = FALSE;
 
-	while (list)
+	if (current_sess && current_sess->server == serv)
+		was_on_front_session = TRUE;
+
+	/* split victims are printed and removed per channel, all at once */
+	if (!netsplit_quit (serv, nick, reason, tags_data->timestamp))
 	{
-		sess = (session *) list->data;
-		if (sess->server == serv)
+		/* removing the last membership frees info, so don't touch it again */
+		info = userlist_find_info (serv, nick);
+		for (user = info ? info->members : NULL; user; user = next)
 		{
- 			if (sess == current_sess)
- 				was_on_front_session = TRUE;
-			if ((user = userlist_find (sess, nick)))
-			{
-				EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, nick, reason, ip, NULL, 0,
-											  tags_data->timestamp);
-				userlist_remove_user (sess, user);
-			} else if (sess->type == SESS_DIALOG && !serv->p_cmp (sess->channel, nick))
-			{
-				EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, nick, reason, ip, NULL, 0,
-											  tags_data->timestamp);
-			}
+			next = user->next_member;
+			sess = user->sess;
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, nick, reason, ip, NULL, 0,
+										  tags_data->timestamp);
+			userlist_remove_user (sess, user);
 		}
-		list = list->next;
 	}
 
+	sess = find_dialog (serv, nick);
+	if (sess)
+		EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, nick, reason, ip, NULL, 0,
+									  tags_data->timestamp);
+
 	notify_set_offline (serv, nick, was_on_front_session, tags_data);
 }
 
@@ -857,17 +891,7 @@ void
 inbound_account (server *serv, char *nick, char *account,
 					  const message_tags_data *tags_data)
 {
-	session *sess = NULL;
-	GSList *list;
-
-	list = sess_list;
-	while (list)
-	{
-		sess = list->data;
-		if (sess->server == serv)
-			userlist_set_account (sess, nick, account);
-		list = list->next;
-	}
+	userlist_set_account (serv, nick, account);
 }
 
 void
@@ -1038,7 +1062,6 @@ inbound_away (server *serv, char *nick, char *msg,
 {
 	struct away_msg *away = server_away_find_message (serv, nick);
 	session *sess = NULL;
-	GSList *list;
 
 	if (away && !strcmp (msg, away->message))	/* Seen the msg before? */
 	{
@@ -1064,41 +1087,24 @@ inbound_away (server *serv, char *nick, char *msg,
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_WHOIS5, sess, nick, msg, NULL, NULL, 0,
 									  tags_data->timestamp);
 
-	list = sess_list;
-	while (list)
-	{
-		sess = list->data;
-		if (sess->server == serv)
-			userlist_set_away (sess, nick, TRUE);
-		list = list->next;
-	}
+	userlist_set_away (serv, nick, TRUE);
 }
 
 void
 inbound_away_notify (server *serv, char *nick, char *reason,
 							const message_tags_data *tags_data)
 {
-	session *sess = NULL;
-	GSList *list;
+	session *sess = serv->front_session;
 
-	list = sess_list;
-	while (list)
+	userlist_set_away (serv, nick, reason ? TRUE : FALSE);
+	if (sess && notify_is_in_list (serv, nick))
 	{
-		sess = list->data;
-		if (sess->server == serv)
-		{
-			userlist_set_away (sess, nick, reason ? TRUE : FALSE);
-			if (sess == serv->front_session && notify_is_in_list (serv, nick))
-			{
-				if (reason)
-					EMIT_SIGNAL_TIMESTAMP (XP_TE_NOTIFYAWAY, sess, nick, reason, NULL,
-												  NULL, 0, tags_data->timestamp);
-				else
-					EMIT_SIGNAL_TIMESTAMP (XP_TE_NOTIFYBACK, sess, nick, NULL, NULL, 
-												  NULL, 0, tags_data->timestamp);
-			}
-		}
-		list = list->next;
+		if (reason)
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_NOTIFYAWAY, sess, nick, reason, NULL,
+										  NULL, 0, tags_data->timestamp);
+		else
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_NOTIFYBACK, sess, nick, NULL, NULL,
+										  NULL, 0, tags_data->timestamp);
 	}
 }
 
@@ -1193,7 +1199,7 @@ check_autojoin_channels (server *serv)
 
 	if (sess_channels)
 	{
-		serv->p_join_list (serv, sess_channels);
+		joinsched_queue (serv, sess_channels);
 		g_slist_free_full (sess_channels, (GDestroyNotify) servlist_favchan_free);
 	}
 	else
@@ -1201,7 +1207,7 @@ check_autojoin_channels (server *serv)
 		/* If there's no session, just autojoin to favorites. */
 		if (serv->favlist)
 		{
-			serv->p_join_list (serv, serv->favlist);
+			joinsched_queue (serv, serv->favlist);
 			i++;
 
 			/* FIXME this is not going to work and is not needed either. server_free() does the job already. */
@@ -1379,17 +1385,7 @@ inbound_login_start (session *sess, char *nick, char *servname,
 static void
 inbound_set_all_away_status (server *serv, char *nick, unsigned int status)
 {
-	GSList *list;
-	session *sess;
-
-	list = sess_list;
-	while (list)
-	{
-		sess = list->data;
-		if (sess->server == serv)
-			userlist_set_away (sess, nick, status);
-		list = list->next;
-	}
+	userlist_set_away (serv, nick, status);
 }
 
 void
@@ -1446,7 +1442,6 @@ inbound_user_info (session *sess, char *chan, char *user, char *host,
 {
 	server *serv = sess->server;
 	session *who_sess;
-	GSList *list;
 	char *uhost = NULL;
 
 	if (user && host)
@@ -1458,7 +1453,7 @@ inbound_user_info (session *sess, char *chan, char *user, char *host,
 	{
 		who_sess = find_channel (serv, chan);
 		if (who_sess)
-			userlist_add_hostname (who_sess, nick, uhost, realname, servname, account, away);
+			userlist_add_hostname (serv, nick, uhost, realname, servname, account, away);
 		else
 		{
 			if (serv->doing_dns && nick && host)
@@ -1468,21 +1463,11 @@ inbound_user_info (session *sess, char *chan, char *user, char *host,
 	else
 	{
 		/* came from WHOIS, not channel specific */
-		for (list = sess_list; list; list = list->next)
-		{
-			sess = list->data;
-			if (sess->server != serv)
-				continue;
+		userlist_add_hostname (serv, nick, uhost, realname, servname, account, away);
 
-			if (sess->type == SESS_CHANNEL)
-			{
-				userlist_add_hostname (sess, nick, uhost, realname, servname, account, away);
-			}
-			else if (sess->type == SESS_DIALOG && uhost && !serv->p_cmp (sess->channel, nick))
-			{
-				set_topic (sess, uhost, uhost);
-			}
-		}
+		sess = find_dialog (serv, nick);
+		if (sess && uhost)
+			set_topic (sess, uhost, uhost);
 	}
 
 	g_free (uhost);
@@ -1681,6 +1666,10 @@ inbound_toggle_caps (server *serv, const char *extensions_str, gboolean enable)
 			serv->have_awaynotify = enable;
 		else if (!strcmp (extension, "account-tag"))
 			serv->have_account_tag = enable;
+		else if (!strcmp (extension, "batch"))
+			serv->have_batch = enable;
+		else if (!strcmp (extension, "draft/chathistory"))
+			serv->have_chathistory = enable;
 		else if (!strcmp (extension, "sasl"))
 		{
 			serv->have_sasl = enable;
@@ -1742,6 +1731,11 @@ static const char * const supported_caps[] = {
 	"invite-notify",
 	"account-tag",
 	"extended-monitor",
+	"batch",
+	"message-tags",
+
+	/* IRCv3 drafts */
+	"draft/chathistory",
 
 	/* ZNC */
 	"znc.in/server-time-iso",
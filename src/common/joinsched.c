@@ -0,0 +1,206 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#include <string.h>
+#include <glib.h>
+
+#include "hexchat.h"
+#include "hexchatc.h"
+#include "fe.h"
+#include "server.h"
+#include "servlist.h"
+#include "joinsched.h"
+
+#define JOINSCHED_CHUNK 4		/* channels per JOIN line */
+#define JOINSCHED_STEP 1500		/* ms between JOIN lines, at least */
+
+struct joinsched
+{
+	GQueue pending;			/* favchannel *, in join order */
+	int tag;
+};
+
+typedef struct
+{
+	favchannel *fav;
+	int rank;				/* from the window's activity, lower goes first */
+	int favpos;				/* position in the network's favorites */
+	int order;				/* as queued, keeps the sort stable */
+} joinsched_item;
+
+static session *
+joinsched_find_window (server *serv, const char *channel)
+{
+	GSList *list;
+	session *sess;
+
+	for (list = sess_list; list; list = list->next)
+	{
+		sess = list->data;
+		if (sess->server == serv && sess->type == SESS_CHANNEL &&
+			 (!serv->p_cmp (sess->waitchannel, channel) ||
+			  !serv->p_cmp (sess->channel, channel)))
+			return sess;
+	}
+	return NULL;
+}
+
+static int
+joinsched_rank (session *sess)
+{
+	if (!sess)
+		return LACT_CHAN_DATA + 2;
+	if (sess == current_tab)
+		return -1;
+	if (sess->lastact_idx == LACT_NONE)
+		return LACT_CHAN_DATA + 1;
+	return sess->lastact_idx;
+}
+
+static gint
+joinsched_item_cmp (gconstpointer a, gconstpointer b)
+{
+	const joinsched_item *x = *(const joinsched_item **) a;
+	const joinsched_item *y = *(const joinsched_item **) b;
+
+	if (x->rank != y->rank)
+		return x->rank - y->rank;
+	if (x->favpos != y->favpos)
+		return x->favpos - y->favpos;
+	return x->order - y->order;
+}
+
+static gboolean
+joinsched_step (server *serv)
+{
+	struct joinsched *js;
+	GSList *chunk = NULL;
+	int i;
+
+	if (!is_server (serv) || !serv->joinsched)
+		return FALSE;
+
+	js = serv->joinsched;
+	if (!serv->connected || g_queue_is_empty (&js->pending))
+	{
+		js->tag = 0;
+		joinsched_server_free (serv);
+		return FALSE;
+	}
+
+	/* NAMES replies of the last JOIN line are still coming in while our
+	   own queue is busy, let both settle first */
+	if (server_throttle_drain (serv) > 0)
+		return TRUE;
+
+	for (i = 0; i < JOINSCHED_CHUNK && !g_queue_is_empty (&js->pending); i++)
+		chunk = g_slist_append (chunk, g_queue_pop_head (&js->pending));
+
+	serv->p_join_list (serv, chunk);
+	g_slist_free_full (chunk, (GDestroyNotify) servlist_favchan_free);
+
+	return TRUE;
+}
+
+void
+joinsched_queue (server *serv, GSList *channels)
+{
+	struct joinsched *js;
+	GPtrArray *items;
+	joinsched_item *item;
+	favchannel *fav;
+	GSList *list;
+	int i, pos;
+
+	if (!channels)
+		return;
+
+	items = g_ptr_array_new_with_free_func (g_free);
+	for (list = channels, i = 0; list; list = list->next, i++)
+	{
+		fav = list->data;
+		item = g_new (joinsched_item, 1);
+		item->fav = servlist_favchan_copy (fav);
+		item->rank = joinsched_rank (joinsched_find_window (serv, fav->name));
+		item->favpos = G_MAXINT;
+		if (serv->network && servlist_favchan_find (serv->network, fav->name, &pos))
+			item->favpos = pos;
+		item->order = i;
+		g_ptr_array_add (items, item);
+	}
+	g_ptr_array_sort (items, joinsched_item_cmp);
+
+	js = serv->joinsched;
+	if (!js)
+	{
+		js = g_new0 (struct joinsched, 1);
+		g_queue_init (&js->pending);
+		serv->joinsched = js;
+	}
+	for (i = 0; i < items->len; i++)
+	{
+		item = items->pdata[i];
+		g_queue_push_tail (&js->pending, item->fav);
+	}
+	g_ptr_array_free (items, TRUE);
+
+	/* the first line goes now, the rest as the link allows */
+	if (!js->tag)
+	{
+		joinsched_step (serv);
+		if (serv->joinsched)
+			js->tag = fe_timeout_add (JOINSCHED_STEP, joinsched_step, serv);
+	}
+}
+
+void
+joinsched_users_needed (session *sess)
+{
+	server *serv;
+
+	if (!sess || !sess->who_deferred || sess->type != SESS_CHANNEL)
+		return;
+
+	serv = sess->server;
+	sess->who_deferred = FALSE;
+	if (!serv->connected || !sess->channel[0])
+		return;
+
+	/* the WHO also tells who's away, no need to ask again this round */
+	sess->doing_who = TRUE;
+	sess->done_away_check = TRUE;
+	serv->p_user_list (serv, sess->channel);
+}
+
+void
+joinsched_server_free (server *serv)
+{
+	struct joinsched *js = serv->joinsched;
+
+	if (!js)
+		return;
+
+	if (js->tag)
+		fe_timeout_remove (js->tag);
+	g_queue_clear_full (&js->pending, (GDestroyNotify) servlist_favchan_free);
+	g_free (js);
+	serv->joinsched = NULL;
+}
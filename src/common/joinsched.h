@@ -0,0 +1,37 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#ifndef HEXCHAT_JOINSCHED_H
+#define HEXCHAT_JOINSCHED_H
+
+#include "hexchat.h"
+
+/* Autojoins go out a few channels at a time, busiest windows first, once
+   the send queue has drained; the WHO of a joined channel waits until
+   its users are actually looked at. */
+
+/* queue favchannels to join; the list stays the caller's */
+void joinsched_queue (server *serv, GSList *channels);
+/* the window is shown or its users are needed: send its deferred WHO */
+void joinsched_users_needed (session *sess);
+void joinsched_server_free (server *serv);
+
+#endif
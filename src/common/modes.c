@@ -843,6 +843,31 @@ parse_005_token (const char *token, char **name, char **value, gboolean *adding)
 	}
 }
 
+/* switch serv to another casemapping and refold every cached key */
+static void
+set_casemapping (server *serv, const unsigned char *map,
+					  int (*cmp)(const char *s1, const char *s2))
+{
+	GSList *list;
+	session *sess;
+
+	serv->p_cmp = cmp;
+	if (serv->p_casemap == map)
+		return;
+	serv->p_casemap = map;
+	userlist_refold_server (serv);
+
+	for (list = sess_list; list; list = list->next)
+	{
+		sess = list->data;
+		if (sess->server == serv)
+		{
+			session_fold_channel (sess);
+			userlist_refold (sess);
+		}
+	}
+}
+
 /* handle the 005 numeric */
 
 void
@@ -863,6 +888,16 @@ inbound_005 (server * serv, char *word[], const message_tags_data *tags_data)
 		if (g_strcmp0 (tokname, "MODES") == 0)
 		{
 			serv->modes_per_line = atoi (tokvalue);
+		} else if (g_strcmp0 (tokname, "TARGMAX") == 0)
+		{
+			pre = strstr (tokvalue, "PRIVMSG:");
+			if (!tokadding)
+				serv->privmsg_targets = 1;
+			else if (pre && (pre == tokvalue || pre[-1] == ','))
+				serv->privmsg_targets = atoi (pre + 8);
+		} else if (g_strcmp0 (tokname, "MAXTARGETS") == 0)
+		{
+			serv->privmsg_targets = tokadding ? atoi (tokvalue) : 1;
 		} else if (g_strcmp0 (tokname, "CHANTYPES") == 0)
 		{
 			g_free (serv->chantypes);
@@ -892,21 +927,31 @@ inbound_005 (server * serv, char *word[], const message_tags_data *tags_data)
 		} else if (g_strcmp0 (tokname, "WATCH") == 0)
 		{
 			serv->supports_watch = tokadding;
+			serv->monitor_limit = tokadding ? atoi (tokvalue) : 0;
 		} else if (g_strcmp0 (tokname, "MONITOR") == 0)
 		{
 			serv->supports_monitor = tokadding;
+			serv->monitor_limit = tokadding ? atoi (tokvalue) : 0;
+		} else if (g_strcmp0 (tokname, "CHATHISTORY") == 0)
+		{
+			serv->chathistory_limit = tokadding ? atoi (tokvalue) : 0;
 		} else if (g_strcmp0 (tokname, "NETWORK") == 0)
 		{
 			if (serv->server_session->type == SESS_SERVER && strlen (tokvalue))
 			{
 				safe_strcpy (serv->server_session->channel, tokvalue, CHANLEN);
+				session_fold_channel (serv->server_session);
 				fe_set_channel (serv->server_session);
 			}
 
 		} else if (g_strcmp0 (tokname, "CASEMAPPING") == 0)
 		{
 			if (g_strcmp0 (tokvalue, "ascii") == 0)
-				serv->p_cmp = (void *)g_ascii_strcasecmp;
+				set_casemapping (serv, ascii_tolowertab, (void *)g_ascii_strcasecmp);
+			else if (g_strcmp0 (tokvalue, "strict-rfc1459") == 0)
+				set_casemapping (serv, strict_rfc_tolowertab, strict_rfc_casecmp);
+			else if (g_strcmp0 (tokvalue, "rfc1459") == 0)
+				set_casemapping (serv, rfc_tolowertab, rfc_casecmp);
 		} else if (g_strcmp0 (tokname, "CHARSET") == 0)
 		{
 			if (g_ascii_strcasecmp (tokvalue, "UTF-8") == 0)
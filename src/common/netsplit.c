@@ -0,0 +1,427 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#include <string.h>
+#include <glib.h>
+
+#include "hexchat.h"
+#include "hexchatc.h"
+#include "fe.h"
+#include "text.h"
+#include "userlist.h"
+#include "util.h"
+#include "netsplit.h"
+
+#define NETSPLIT_QUIET 1000	/* ms without a matching line before a batch is applied */
+#define NETSPLIT_MEMORY (15 * 60 * G_USEC_PER_SEC)	/* how long split nicks count as rejoining */
+
+enum
+{
+	BATCH_NONE,
+	BATCH_QUIT,
+	BATCH_JOIN
+};
+
+struct netsplit_chan
+{
+	char *channel;
+	char channel_fold[CHANLEN];
+	GPtrArray *nicks;
+};
+
+struct netsplit
+{
+	int kind;					/* BATCH_* */
+	char *servers;				/* "hub.example.net leaf.example.net" */
+	time_t stamp;				/* server-time of the first line, or 0 */
+	GPtrArray *chans;			/* struct netsplit_chan, in order of first appearance */
+	gint64 last_line;			/* monotonic time the batch last grew */
+	int flush_tag;
+	gboolean forced;			/* an IRCv3 batch said so, see batch.c */
+
+	GHashTable *victims;		/* nick_fold -> servers, for spotting the netjoin */
+	GPtrArray *split_servers;	/* owns the servers strings victims points to */
+	gint64 last_split;
+};
+
+/* the reason servers give when a link breaks: "hub.example.net
+   leaf.example.net", two distinct host names (possibly masked with *) */
+static gboolean
+netsplit_is_split (const char *reason)
+{
+	const char *space, *p;
+	int dots = 0;
+
+	space = strchr (reason, ' ');
+	if (!space || space == reason || !space[1] || strchr (space + 1, ' '))
+		return FALSE;
+
+	for (p = reason; *p; p++)
+	{
+		if (*p == ' ')
+		{
+			if (!dots)
+				return FALSE;
+			dots = 0;
+		}
+		else if (*p == '.')
+		{
+			if (p == reason || p[-1] == ' ' || p[-1] == '.' || p[1] == ' ' || !p[1])
+				return FALSE;
+			dots++;
+		}
+		else if (!g_ascii_isalnum (*p) && *p != '-' && *p != '_' && *p != '*')
+			return FALSE;
+	}
+	if (!dots)
+		return FALSE;
+
+	return strlen (space + 1) != (size_t)(space - reason) ||
+			 strncmp (reason, space + 1, space - reason) != 0;
+}
+
+static void
+netsplit_chan_free (struct netsplit_chan *chan)
+{
+	g_free (chan->channel);
+	g_ptr_array_free (chan->nicks, TRUE);
+	g_free (chan);
+}
+
+static struct netsplit *
+netsplit_get (server *serv)
+{
+	struct netsplit *ns = serv->netsplit;
+
+	if (!ns)
+	{
+		ns = g_new0 (struct netsplit, 1);
+		ns->chans = g_ptr_array_new_with_free_func ((GDestroyNotify) netsplit_chan_free);
+		ns->victims = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		ns->split_servers = g_ptr_array_new_with_free_func (g_free);
+		serv->netsplit = ns;
+	}
+	return ns;
+}
+
+static void
+netsplit_forget (struct netsplit *ns)
+{
+	g_hash_table_remove_all (ns->victims);
+	g_ptr_array_set_size (ns->split_servers, 0);
+}
+
+static struct netsplit_chan *
+netsplit_chan (struct netsplit *ns, session *sess)
+{
+	struct netsplit_chan *chan;
+	guint i;
+
+	/* a handful of channels at most, a linear scan is fine */
+	for (i = 0; i < ns->chans->len; i++)
+	{
+		chan = ns->chans->pdata[i];
+		if (strcmp (chan->channel_fold, sess->channel_fold) == 0)
+			return chan;
+	}
+
+	chan = g_new (struct netsplit_chan, 1);
+	chan->channel = g_strdup (sess->channel);
+	safe_strcpy (chan->channel_fold, sess->channel_fold, sizeof (chan->channel_fold));
+	chan->nicks = g_ptr_array_new_with_free_func (g_free);
+	g_ptr_array_add (ns->chans, chan);
+	return chan;
+}
+
+static int
+netsplit_timeout (server *serv)
+{
+	struct netsplit *ns = serv->netsplit;
+
+	/* still growing, a quiet link is what ends a batch */
+	if (g_get_monotonic_time () - ns->last_line < NETSPLIT_QUIET * G_GINT64_CONSTANT (1000))
+		return 1;
+
+	ns->flush_tag = 0;
+	netsplit_flush (serv);
+	return 0;
+}
+
+/* make sure a batch of this kind and server pair is open */
+static struct netsplit *
+netsplit_batch (server *serv, int kind, const char *servers, time_t stamp)
+{
+	struct netsplit *ns = netsplit_get (serv);
+
+	if (ns->kind != BATCH_NONE && (ns->kind != kind || strcmp (ns->servers, servers) != 0))
+		netsplit_flush (serv);
+
+	if (ns->kind == BATCH_NONE)
+	{
+		ns->kind = kind;
+		ns->servers = g_strdup (servers);
+		ns->stamp = stamp;
+		ns->flush_tag = fe_timeout_add (NETSPLIT_QUIET, netsplit_timeout, serv);
+	}
+	if (!ns->stamp)
+		ns->stamp = stamp;
+	ns->last_line = g_get_monotonic_time ();
+	return ns;
+}
+
+gboolean
+netsplit_quit (server *serv, char *nick, char *reason, time_t stamp)
+{
+	struct netsplit *ns = serv->netsplit;
+	struct userinfo *info;
+	struct User *user;
+	char fold[NICKLEN];
+	char *servers;
+
+	/* inside a netsplit batch the reason doesn't matter */
+	if (ns && ns->forced && ns->kind == BATCH_QUIT)
+		reason = ns->servers;
+	else if (!netsplit_is_split (reason))
+	{
+		/* a plain quit, so a later join is just a join */
+		if (serv->netsplit && g_hash_table_size (serv->netsplit->victims))
+		{
+			casemap_fold (serv->p_casemap, fold, nick, sizeof (fold));
+			g_hash_table_remove (serv->netsplit->victims, fold);
+		}
+		return FALSE;
+	}
+
+	ns = netsplit_batch (serv, BATCH_QUIT, reason, stamp);
+
+	/* the users stay listed until the batch is applied */
+	info = userlist_find_info (serv, nick);
+	for (user = info ? info->members : NULL; user; user = user->next_member)
+		g_ptr_array_add (netsplit_chan (ns, user->sess)->nicks, g_strdup (info->nick));
+
+	if (ns->last_split && ns->last_line - ns->last_split > NETSPLIT_MEMORY)
+		netsplit_forget (ns);
+	ns->last_split = ns->last_line;
+
+	servers = ns->split_servers->len ?
+		ns->split_servers->pdata[ns->split_servers->len - 1] : NULL;
+	if (!servers || strcmp (servers, reason) != 0)
+	{
+		servers = g_strdup (reason);
+		g_ptr_array_add (ns->split_servers, servers);
+	}
+	casemap_fold (serv->p_casemap, fold, nick, sizeof (fold));
+	g_hash_table_replace (ns->victims, g_strdup (fold), servers);
+
+	return TRUE;
+}
+
+gboolean
+netsplit_join (session *sess, char *nick, time_t stamp)
+{
+	server *serv = sess->server;
+	struct netsplit *ns = serv->netsplit;
+	char fold[NICKLEN];
+	const char *servers;
+
+	if (ns && ns->forced && ns->kind == BATCH_JOIN)
+		servers = ns->servers;
+	else if (!ns || !g_hash_table_size (ns->victims))
+		return FALSE;
+	else if (g_get_monotonic_time () - ns->last_split > NETSPLIT_MEMORY)
+	{
+		netsplit_forget (ns);
+		return FALSE;
+	}
+	else
+	{
+		casemap_fold (serv->p_casemap, fold, nick, sizeof (fold));
+		servers = g_hash_table_lookup (ns->victims, fold);
+		if (!servers)
+			return FALSE;
+	}
+
+	ns = netsplit_batch (serv, BATCH_JOIN, servers, stamp);
+	g_ptr_array_add (netsplit_chan (ns, sess)->nicks, g_strdup (nick));
+
+	/* the frontend holds its model updates until the flush */
+	sess->userlist_frozen = TRUE;
+	return TRUE;
+}
+
+void
+netsplit_line (server *serv, const char *command)
+{
+	struct netsplit *ns = serv->netsplit;
+
+	if (!ns || ns->kind == BATCH_NONE || ns->forced)
+		return;
+
+	/* anything else may look at the userlist, so it must be current */
+	if (ns->kind == BATCH_QUIT && g_ascii_strcasecmp (command, "QUIT") == 0)
+		return;
+	if (ns->kind == BATCH_JOIN && g_ascii_strcasecmp (command, "JOIN") == 0)
+		return;
+
+	netsplit_flush (serv);
+}
+
+void
+netsplit_flush (server *serv)
+{
+	struct netsplit *ns = serv->netsplit;
+	struct netsplit_chan *chan;
+	GPtrArray *chans;
+	GString *nicks;
+	GSList *list;
+	session *sess;
+	char *servers, *split;
+	char count[16];
+	char fold[NICKLEN];
+	time_t stamp;
+	int kind;
+	guint i, j;
+
+	if (!ns || ns->kind == BATCH_NONE)
+		return;
+
+	if (ns->flush_tag)
+	{
+		fe_timeout_remove (ns->flush_tag);
+		ns->flush_tag = 0;
+	}
+
+	/* detach the batch first, the events below run plugins and they may
+	   well send us back in here */
+	kind = ns->kind;
+	servers = ns->servers;
+	stamp = ns->stamp;
+	chans = ns->chans;
+	ns->kind = BATCH_NONE;
+	ns->servers = NULL;
+	ns->forced = FALSE;
+	ns->chans = g_ptr_array_new_with_free_func ((GDestroyNotify) netsplit_chan_free);
+
+	if (kind == BATCH_JOIN)
+	{
+		/* they're back, so their next join is an ordinary one */
+		for (i = 0; i < chans->len; i++)
+		{
+			chan = chans->pdata[i];
+			for (j = 0; j < chan->nicks->len; j++)
+			{
+				casemap_fold (serv->p_casemap, fold, chan->nicks->pdata[j], sizeof (fold));
+				g_hash_table_remove (ns->victims, fold);
+			}
+		}
+		if (!g_hash_table_size (ns->victims))
+			netsplit_forget (ns);
+
+		/* the joined users are in the userlist already */
+		for (list = sess_list; list; list = list->next)
+		{
+			sess = list->data;
+			if (sess->server == serv && sess->userlist_frozen)
+			{
+				sess->userlist_frozen = FALSE;
+				fe_userlist_numbers (sess);
+			}
+		}
+	}
+
+	split = strchr (servers, ' ');
+	*split++ = 0;
+
+	nicks = g_string_new (NULL);
+	for (i = 0; i < chans->len; i++)
+	{
+		chan = chans->pdata[i];
+		sess = find_channel (serv, chan->channel);
+		if (!sess)
+			continue;
+
+		g_string_truncate (nicks, 0);
+		for (j = 0; j < chan->nicks->len; j++)
+		{
+			if (j)
+				g_string_append (nicks, ", ");
+			g_string_append (nicks, chan->nicks->pdata[j]);
+		}
+		g_snprintf (count, sizeof (count), "%u", chan->nicks->len);
+
+		if (kind == BATCH_QUIT)
+		{
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_NETSPLIT, sess, servers, split, count,
+										  nicks->str, 0, stamp);
+			if (is_session (sess))
+				userlist_remove_nicks (sess, chan->nicks);
+		}
+		else
+		{
+			EMIT_SIGNAL_TIMESTAMP (XP_TE_NETJOIN, sess, servers, split, count,
+										  nicks->str, 0, stamp);
+		}
+	}
+
+	g_string_free (nicks, TRUE);
+	g_ptr_array_free (chans, TRUE);
+	g_free (servers);
+}
+
+gboolean
+netsplit_batch_begin (server *serv, gboolean join, const char *servers)
+{
+	struct netsplit *ns;
+	const char *space;
+
+	/* "hub.example.net leaf.example.net" */
+	space = strchr (servers, ' ');
+	if (!space || space == servers || !space[1])
+		return FALSE;
+
+	ns = netsplit_batch (serv, join ? BATCH_JOIN : BATCH_QUIT, servers, 0);
+	ns->forced = TRUE;
+	return TRUE;
+}
+
+void
+netsplit_batch_end (server *serv)
+{
+	netsplit_flush (serv);
+}
+
+void
+netsplit_server_free (server *serv)
+{
+	struct netsplit *ns = serv->netsplit;
+
+	if (!ns)
+		return;
+
+	if (ns->flush_tag)
+		fe_timeout_remove (ns->flush_tag);
+	g_ptr_array_free (ns->chans, TRUE);
+	g_hash_table_destroy (ns->victims);
+	g_ptr_array_free (ns->split_servers, TRUE);
+	g_free (ns->servers);
+	g_free (ns);
+	serv->netsplit = NULL;
+}
@@ -0,0 +1,47 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#ifndef HEXCHAT_NETSPLIT_H
+#define HEXCHAT_NETSPLIT_H
+
+#include "hexchat.h"
+
+/* collapses the QUIT flood of a netsplit, and the JOIN flood when the
+   servers relink, into one "Netsplit"/"Netjoin" event per channel.
+   Batches are applied before the next unrelated line from the server,
+   or after a short quiet period */
+
+/* returns TRUE when the quit is part of a split and has been queued; the
+   caller must then neither print nor remove it */
+gboolean netsplit_quit (server *serv, char *nick, char *reason, time_t stamp);
+/* returns TRUE when the join is a netsplit victim coming back; the user is
+   still added by the caller, but silently */
+gboolean netsplit_join (session *sess, char *nick, time_t stamp);
+/* every line from the server passes through here first */
+void netsplit_line (server *serv, const char *command);
+void netsplit_flush (server *serv);
+/* an IRCv3 netsplit/netjoin batch: every QUIT or JOIN until the end is
+   part of the split between servers; FALSE if servers isn't a pair */
+gboolean netsplit_batch_begin (server *serv, gboolean join, const char *servers);
+void netsplit_batch_end (server *serv);
+void netsplit_server_free (server *serv);
+
+#endif
@@ -20,23 +20,7 @@
 #ifndef HEXCHAT_NETWORK_H
 #define HEXCHAT_NETWORK_H
 
-typedef struct netstore_
-{
-#ifdef NETWORK_PRIVATE
-	struct addrinfo *ip6_hostent;
-#else
-	int _dummy;	/* some compilers don't like empty structs */
-#endif
-} netstore;
-
-#define MAX_HOSTNAME 128
-
-netstore *net_store_new (void);
-void net_store_destroy (netstore *ns);
-int net_connect (netstore *ns, int sok4, int sok6, int *sok_return);
-char *net_resolve (netstore *ns, char *hostname, int port, char **real_host);
-void net_bind (netstore *tobindto, int sok4, int sok6);
 char *net_ip (guint32 addr);
-void net_sockets (int *sok4, int *sok6);
+void net_set_socket_options (int sok);
 
 #endif
@@ -39,6 +39,11 @@
 GSList *notify_list = 0;
 int notify_tag = 0;
 
+/* bumped whenever notify_list or its per-server records change, so each
+   server's index knows to rebuild itself */
+static guint notify_gen = 1;
+static gboolean notify_flush_queued = FALSE;
+
 
 static char *
 despacify_dup (char *str)
@@ -111,6 +116,7 @@ notify_find_server_entry (struct notify *notify, struct server *serv)
 	servnot->server = serv;
 	servnot->notify = notify;
 	notify->server_list = g_slist_prepend (notify->server_list, servnot);
+	notify_gen++;
 	return servnot;
 }
 
@@ -176,31 +182,54 @@ notify_load (void)
 	}
 }
 
-static struct notify_per_server *
-notify_find (server *serv, char *nick)
+/* casefolded nick -> notify_per_server, for the notifies that apply to
+   this server's network */
+static GHashTable *
+notify_server_index (server *serv)
 {
-	GSList *list = notify_list;
-	struct notify_per_server *servnot;
+	GSList *list;
 	struct notify *notify;
+	struct notify_per_server *servnot;
+	char key[NICKLEN];
 
-	while (list)
+	if (serv->notify_index && serv->notify_gen == notify_gen &&
+		 serv->notify_casemap == serv->p_casemap)
+		return serv->notify_index;
+
+	if (serv->notify_index)
+		g_hash_table_remove_all (serv->notify_index);
+	else
+		serv->notify_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	for (list = notify_list; list; list = list->next)
 	{
 		notify = (struct notify *) list->data;
-
 		servnot = notify_find_server_entry (notify, serv);
 		if (!servnot)
-		{
-			list = list->next;
 			continue;
-		}
 
-		if (!serv->p_cmp (notify->name, nick))
-			return servnot;
-
-		list = list->next;
+		/* on duplicates the newest entry wins, as the old list walk did */
+		casemap_fold (serv->p_casemap, key, notify->name, sizeof (key));
+		if (!g_hash_table_contains (serv->notify_index, key))
+			g_hash_table_insert (serv->notify_index, g_strdup (key), servnot);
 	}
 
-	return NULL;
+	serv->notify_gen = notify_gen;
+	serv->notify_casemap = serv->p_casemap;
+	return serv->notify_index;
+}
+
+static struct notify_per_server *
+notify_find (server *serv, char *nick)
+{
+	GHashTable *index = notify_server_index (serv);
+	char key[NICKLEN];
+
+	if (g_hash_table_size (index) == 0)
+		return NULL;
+
+	casemap_fold (serv->p_casemap, key, nick, sizeof (key));
+	return g_hash_table_lookup (index, key);
 }
 
 static void
@@ -335,217 +364,421 @@ notify_set_online_list (server * serv, char *users,
 	}
 }
 
+/* sends MONITOR/WATCH lines for names, packing as many as fit per line */
 static void
-notify_watch (server * serv, char *nick, int add)
+notify_send_batch (server *serv, char sign, char **names, guint count)
 {
-	char tbuf[256];
-	char addchar = '+';
+	GString *line = g_string_sized_new (512);
+	gsize name_len;
+	guint i;
+
+	for (i = 0; i < count; i++)
+	{
+		name_len = strlen (names[i]);
+		if (line->len && line->len + name_len + 2 > 500)
+		{
+			serv->p_raw (serv, line->str);
+			g_string_truncate (line, 0);
+		}
 
-	if (!add)
-		addchar = '-';
+		if (!line->len)
+		{
+			if (serv->supports_monitor)
+				g_string_append_printf (line, "MONITOR %c %s", sign, names[i]);
+			else
+				g_string_append_printf (line, "WATCH %c%s", sign, names[i]);
+		}
+		else if (serv->supports_monitor)
+		{
+			g_string_append_c (line, ',');
+			g_string_append_len (line, names[i], name_len);
+		}
+		else
+		{
+			g_string_append_c (line, ' ');
+			g_string_append_c (line, sign);
+			g_string_append_len (line, names[i], name_len);
+		}
+	}
 
-	if (serv->supports_monitor)
-		g_snprintf (tbuf, sizeof (tbuf), "MONITOR %c %s", addchar, nick);
-	else if (serv->supports_watch)
-		g_snprintf (tbuf, sizeof (tbuf), "WATCH %c%s", addchar, nick);
-	else
+	if (line->len)
+		serv->p_raw (serv, line->str);
+	g_string_free (line, TRUE);
+}
+
+static void
+notify_flush_server (server *serv)
+{
+	GPtrArray *add, *del;
+	char *entry;
+	guint i;
+
+	if (!serv->notify_pending || serv->notify_pending->len == 0)
 		return;
 
-	serv->p_raw (serv, tbuf);
+	add = g_ptr_array_new ();
+	del = g_ptr_array_new ();
+	for (i = 0; i < serv->notify_pending->len; i++)
+	{
+		entry = g_ptr_array_index (serv->notify_pending, i);
+		g_ptr_array_add (entry[0] == '+' ? add : del, entry + 1);
+	}
+
+	if (serv->connected && (serv->supports_monitor || serv->supports_watch))
+	{
+		notify_send_batch (serv, '-', (char **)del->pdata, del->len);
+		notify_send_batch (serv, '+', (char **)add->pdata, add->len);
+	}
+
+	g_ptr_array_free (add, TRUE);
+	g_ptr_array_free (del, TRUE);
+	g_ptr_array_set_size (serv->notify_pending, 0);
+}
+
+static gboolean
+notify_flush_watches (gpointer unused)
+{
+	GSList *list;
+
+	for (list = serv_list; list; list = list->next)
+		notify_flush_server (list->data);
+
+	notify_flush_queued = FALSE;
+	return FALSE;
+}
+
+/* queue the change, so adding or removing many nicks in one go costs a
+   handful of MONITOR/WATCH lines instead of one each */
+static void
+notify_watch (server * serv, char *nick, int add)
+{
+	if (!serv->supports_monitor && !serv->supports_watch)
+		return;
+
+	if (!serv->notify_pending)
+		serv->notify_pending = g_ptr_array_new_with_free_func (g_free);
+	g_ptr_array_add (serv->notify_pending, g_strdup_printf ("%c%s", add ? '+' : '-', nick));
+
+	if (!notify_flush_queued)
+	{
+		notify_flush_queued = TRUE;
+		fe_idle_add (notify_flush_watches, NULL);
+	}
+}
+
+/* room left on the server's MONITOR/WATCH list? */
+static gboolean
+notify_can_watch (server *serv)
+{
+	if (!serv->supports_monitor && !serv->supports_watch)
+		return FALSE;
+	return serv->monitor_limit <= 0 || serv->monitor_count < serv->monitor_limit;
 }
 
 static void
 notify_watch_all (struct notify *notify, int add)
 {
+	struct notify_per_server *servnot;
 	server *serv;
 	GSList *list = serv_list;
 	while (list)
 	{
 		serv = list->data;
 		if (serv->connected && serv->end_of_motd && notify_do_network (notify, serv))
-			notify_watch (serv, notify->name, add);
+		{
+			servnot = notify_find_server_entry (notify, serv);
+			if (add && !servnot->monitored && notify_can_watch (serv))
+			{
+				servnot->monitored = TRUE;
+				serv->monitor_count++;
+				notify_watch (serv, notify->name, TRUE);
+			}
+			else if (!add && servnot->monitored)
+			{
+				servnot->monitored = FALSE;
+				serv->monitor_count--;
+				notify_watch (serv, notify->name, FALSE);
+			}
+			/* anything else is left to the ISON poll */
+		}
 		list = list->next;
 	}
 }
 
-static void
-notify_flush_watches (server * serv, GSList *from, GSList *end)
+/* called when logging in. e.g. when End of motd. */
+
+void
+notify_send_watches (server * serv)
 {
-	char tbuf[512];
-	GSList *list;
-	struct notify *notify;
+	GHashTableIter iter;
+	struct notify_per_server *servnot;
+	GPtrArray *names;
 
-	serv->supports_monitor ? strcpy (tbuf, "MONITOR + ") : strcpy (tbuf, "WATCH");
+	/* whatever was queued before is covered by the full list */
+	if (serv->notify_pending)
+		g_ptr_array_set_size (serv->notify_pending, 0);
 
-	list = from;
-	while (list != end)
+	/* fill the server's list up to its advertised limit, the rest is polled */
+	serv->monitor_count = 0;
+	names = g_ptr_array_new ();
+	g_hash_table_iter_init (&iter, notify_server_index (serv));
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&servnot))
 	{
-		notify = list->data;
-		if (serv->supports_monitor)
-			g_strlcat (tbuf, ",", sizeof(tbuf));
-		else
-			g_strlcat (tbuf, " +", sizeof(tbuf));
-		g_strlcat (tbuf, notify->name, sizeof(tbuf));
-		list = list->next;
+		servnot->monitored = notify_can_watch (serv);
+		if (servnot->monitored)
+		{
+			serv->monitor_count++;
+			g_ptr_array_add (names, servnot->notify->name);
+		}
 	}
-	serv->p_raw (serv, tbuf);
+
+	notify_send_batch (serv, '+', (char **)names->pdata, names->len);
+	g_ptr_array_free (names, TRUE);
 }
 
-/* called when logging in. e.g. when End of motd. */
+/* whether the ISON poll has anything to do on any connected server. One
+   still logging in counts, its MONITOR/WATCH list isn't sent yet */
 
-void
-notify_send_watches (server * serv)
+gboolean
+notify_polling_needed (void)
 {
-	struct notify *notify;
-	const int format_len = serv->supports_monitor ? 1 : 2; /* just , for monitor or + and space for watch */
+	GHashTableIter iter;
+	struct notify_per_server *servnot;
+	server *serv;
 	GSList *list;
-	GSList *point;
-	GSList *send_list = NULL;
-	int len = 0;
 
-	/* Only get the list for this network */
-	list = notify_list;
-	while (list)
+	if (!notify_list)
+		return FALSE;
+
+	for (list = serv_list; list; list = list->next)
 	{
-		notify = list->data;
+		serv = list->data;
+		if (!serv->connected)
+			continue;
+		if (!serv->end_of_motd || (serv->ison_shards && !g_queue_is_empty (serv->ison_shards)))
+			return TRUE;
 
-		if (notify_do_network (notify, serv))
+		g_hash_table_iter_init (&iter, notify_server_index (serv));
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&servnot))
 		{
-			send_list = g_slist_append (send_list, notify);
+			if (!servnot->monitored)
+				return TRUE;
 		}
-
-		list = list->next;
 	}
 
-	/* Now send that list in batches */
-	point = list = send_list;
-	while (list)
-	{
-		notify = list->data;
+	return FALSE;
+}
 
-		len += strlen (notify->name) + format_len;
-		if (len > 500)
-		{
-			/* Too long send existing list */
-			notify_flush_watches (serv, point, list);
-			len = strlen (notify->name) + format_len;
-			point = list; /* We left off here */
-		}
+/* handles numeric 734: targets didn't fit on the MONITOR list */
 
-		list = g_slist_next (list);
-	}
+void
+notify_monitor_full (server *serv, int limit, char *targets)
+{
+	struct notify_per_server *servnot;
+	char *token;
+
+	if (limit > 0)
+		serv->monitor_limit = limit;
 
-	if (len) /* We had leftovers under 500, send them all */
+	for (token = strtok (targets, ","); token; token = strtok (NULL, ","))
 	{
-		notify_flush_watches (serv, point, NULL);
+		servnot = notify_find (serv, token);
+		if (servnot && servnot->monitored)
+		{
+			servnot->monitored = FALSE;
+			serv->monitor_count--;
+		}
 	}
 
-	g_slist_free (send_list);
+	/* those are polled now, the timer may have stopped */
+	hexchat_reinit_timers ();
 }
 
-/* called when receiving a ISON 303 - should this func go? */
+/* set while notify_send_shard hands its line to p_raw */
+static char **ison_ours;
+
+struct ison_sent
+{
+	char **names;				/* NULL if we didn't send it */
+	gint64 sent;				/* monotonic time */
+};
+
+static void
+ison_sent_free (struct ison_sent *is)
+{
+	g_strfreev (is->names);
+	g_free (is);
+}
+
+/* called for every ISON leaving through irc_raw, ours or the user's,
+   so that replies can be paired with them in order */
 
 void
-notify_markonline (server *serv, char *word[], const message_tags_data *tags_data)
+notify_ison_outgoing (server *serv)
+{
+	struct ison_sent *is;
+
+	if (!serv->ison_sent)
+		serv->ison_sent = g_queue_new ();
+
+	/* names NULL stands in for one we didn't send, e.g. /quote ISON */
+	is = g_new (struct ison_sent, 1);
+	is->names = ison_ours;
+	is->sent = g_get_monotonic_time ();
+	g_queue_push_tail (serv->ison_sent, is);
+}
+
+/* called when receiving a ISON 303. Each reply answers the oldest ISON
+   still in flight, so only the nicks asked about in that one can be
+   declared offline. */
+
+void
+notify_markonline (server *serv, char *nicks, const message_tags_data *tags_data)
 {
-	struct notify *notify;
 	struct notify_per_server *servnot;
-	GSList *list = notify_list;
-	int i, seen;
+	struct ison_sent *is;
+	char **asked;
+	char *copy, *token;
+	int i;
 
-	while (list)
+	/* nothing in flight, or the user's own: leave our state alone */
+	if (!serv->ison_sent || g_queue_is_empty (serv->ison_sent))
+		return;
+	is = g_queue_pop_head (serv->ison_sent);
+	asked = is->names;
+	g_free (is);
+	if (!asked)
+		return;
+
+	copy = g_strdup (nicks);
+	for (token = strtok (copy, " "); token; token = strtok (NULL, " "))
 	{
-		notify = (struct notify *) list->data;
-		servnot = notify_find_server_entry (notify, serv);
-		if (!servnot)
+		servnot = notify_find (serv, token);
+		if (servnot)
 		{
-			list = list->next;
-			continue;
+			servnot->seen = TRUE;
+			notify_announce_online (serv, servnot, servnot->notify->name, tags_data);
 		}
-		i = 4;
-		seen = FALSE;
-		while (*word[i])
+	}
+	g_free (copy);
+
+	for (i = 0; asked[i]; i++)
+	{
+		servnot = notify_find (serv, asked[i]);
+		if (!servnot)
+			continue;
+		if (!servnot->seen && servnot->ison)
+			notify_announce_offline (serv, servnot, servnot->notify->name, FALSE, tags_data);
+		servnot->seen = FALSE;
+	}
+	g_strfreev (asked);
+	fe_notify_update (0);
+}
+
+/* ISON lines must stay well under the 512 byte limit */
+#define ISON_LINE_MAX 460
+
+/* splits everything that isn't on a MONITOR/WATCH list into ISON lines */
+static void
+notify_build_shards (server *serv)
+{
+	GHashTableIter iter;
+	struct notify_per_server *servnot;
+	GPtrArray *shard = NULL;
+	gsize len = 0, name_len;
+
+	if (!serv->ison_shards)
+		serv->ison_shards = g_queue_new ();
+
+	g_hash_table_iter_init (&iter, notify_server_index (serv));
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&servnot))
+	{
+		if (servnot->monitored)
+			continue;
+
+		name_len = strlen (servnot->notify->name);
+		if (shard && len + name_len + 1 > ISON_LINE_MAX)
 		{
-			if (!serv->p_cmp (notify->name, word[i]))
-			{
-				seen = TRUE;
-				notify_announce_online (serv, servnot, notify->name, tags_data);
-				break;
-			}
-			i++;
-			/* FIXME: word[] is only a 32 element array, limits notify list to
-			   about 27 people */
-			if (i > PDIWORDS - 5)
-			{
-				/*fprintf (stderr, _("*** HEXCHAT WARNING: notify list too large.\n"));*/
-				break;
-			}
+			g_ptr_array_add (shard, NULL);
+			g_queue_push_tail (serv->ison_shards, g_ptr_array_free (shard, FALSE));
+			shard = NULL;
 		}
-		if (!seen && servnot->ison)
+		if (!shard)
 		{
-			notify_announce_offline (serv, servnot, notify->name, FALSE, tags_data);
+			shard = g_ptr_array_new ();
+			len = 4;	/* "ISON" */
 		}
-		list = list->next;
+		g_ptr_array_add (shard, g_strdup (servnot->notify->name));
+		len += name_len + 1;
+	}
+
+	if (shard)
+	{
+		g_ptr_array_add (shard, NULL);
+		g_queue_push_tail (serv->ison_shards, g_ptr_array_free (shard, FALSE));
 	}
-	fe_notify_update (0);
 }
 
-/* yuck! Old routine for ISON notify */
+static void
+notify_send_shard (server *serv)
+{
+	char **names = g_queue_pop_head (serv->ison_shards);
+	char *joined, *line;
+
+	joined = g_strjoinv (" ", names);
+	line = g_strconcat ("ISON ", joined, NULL);
+	ison_ours = names;
+	serv->p_raw (serv, line);
+	ison_ours = NULL;
+	g_free (line);
+	g_free (joined);
+}
 
 static void
-notify_checklist_for_server (server *serv)
+notify_checklist_for_server (server *serv, gint64 now)
 {
-	char outbuf[512];
-	struct notify *notify;
-	GSList *list = notify_list;
-	int i = 0;
+	gint64 interval = (gint64)prefs.hex_notify_timeout * G_USEC_PER_SEC;
 
-	g_strlcpy (outbuf, "ISON ", sizeof (outbuf));
-	while (list)
+	if (!serv->ison_shards || g_queue_is_empty (serv->ison_shards))
 	{
-		gsize outlen;
-		gsize name_len;
+		if (now < serv->ison_next_poll)
+			return;
+		serv->ison_next_poll = now + interval;
 
-		notify = list->data;
-		if (notify_do_network (notify, serv))
-		{
-			outlen = strlen (outbuf);
-			name_len = strlen (notify->name);
-			if (outlen + name_len + 1 >= sizeof (outbuf))
-				break;
-
-			i++;
-			g_strlcat (outbuf, notify->name, sizeof (outbuf));
-			g_strlcat (outbuf, " ", sizeof (outbuf));
-			if (strlen (outbuf) > 460)
-			{
-				/* LAME: we can't send more than 512 bytes to the server, but     *
-				 * if we split it in two packets, our offline detection wouldn't  *
-				 work                                                           */
-				/*fprintf (stderr, _("*** HEXCHAT WARNING: notify list too large.\n"));*/
-				break;
-			}
-		}
-		list = list->next;
+		/* a script may have eaten a 303: give up on replies this late */
+		while (serv->ison_sent && !g_queue_is_empty (serv->ison_sent) &&
+				 now - ((struct ison_sent *) g_queue_peek_head (serv->ison_sent))->sent > 2 * interval)
+			ison_sent_free (g_queue_pop_head (serv->ison_sent));
+
+		/* still waiting on the last round? don't let requests pile up */
+		if (serv->ison_sent && !g_queue_is_empty (serv->ison_sent))
+			return;
+
+		notify_build_shards (serv);
 	}
 
-	if (i)
-		serv->p_raw (serv, outbuf);
+	/* one line per tick spreads a long list over the interval instead of
+	   bursting it into the send queue */
+	if (!g_queue_is_empty (serv->ison_shards))
+		notify_send_shard (serv);
 }
 
 int
-notify_checklist (void)	/* check ISON list */
+notify_checklist (void)	/* check ISON list, runs every second */
 {
 	struct server *serv;
 	GSList *list = serv_list;
+	gint64 now;
 
+	if (!prefs.hex_notify_timeout)
+		return 1;
+
+	now = g_get_monotonic_time ();
 	while (list)
 	{
 		serv = list->data;
-		if (serv->connected && serv->end_of_motd && !serv->supports_watch && !serv->supports_monitor)
-		{
-			notify_checklist_for_server (serv);
-		}
+		if (serv->connected && serv->end_of_motd)
+			notify_checklist_for_server (serv, now);
 		list = list->next;
 	}
 	return 1;
@@ -597,6 +830,7 @@ notify_deluser (char *name)
 		if (!rfc_casecmp (notify->name, name))
 		{
 			fe_notify_update (notify->name);
+			notify_watch_all (notify, FALSE);
 			/* Remove the records for each server */
 			while (notify->server_list)
 			{
@@ -606,7 +840,7 @@ notify_deluser (char *name)
 				g_free (servnot);
 			}
 			notify_list = g_slist_remove (notify_list, notify);
-			notify_watch_all (notify, FALSE);
+			notify_gen++;
 			g_free (notify->networks);
 			g_free (notify->name);
 			g_free (notify);
@@ -618,6 +852,16 @@ notify_deluser (char *name)
 	return 0;
 }
 
+/* check new entries on the next tick rather than a full interval later */
+static void
+notify_poll_soon (void)
+{
+	GSList *list;
+
+	for (list = serv_list; list; list = list->next)
+		((server *)list->data)->ison_next_poll = 0;
+}
+
 void
 notify_adduser (char *name, char *networks)
 {
@@ -629,49 +873,67 @@ notify_adduser (char *name, char *networks)
 		notify->networks = despacify_dup (networks);
 	notify->server_list = 0;
 	notify_list = g_slist_prepend (notify_list, notify);
-	notify_checklist ();
+	notify_gen++;
+	notify_poll_soon ();
 	fe_notify_update (notify->name);
 	fe_notify_update (0);
 	notify_watch_all (notify, TRUE);
+	hexchat_reinit_timers ();
 }
 
 gboolean
 notify_is_in_list (server *serv, char *name)
 {
-	struct notify *notify;
-	GSList *list = notify_list;
+	return notify_find (serv, name) != NULL;
+}
 
-	while (list)
-	{
-		notify = (struct notify *) list->data;
-		if (!serv->p_cmp (notify->name, name))
-			return TRUE;
-		list = list->next;
-	}
+int
+notify_isnotify (struct session *sess, char *name)
+{
+	struct notify_per_server *servnot;
+
+	servnot = notify_find (sess->server, name);
+	if (servnot && servnot->ison)
+		return TRUE;
 
 	return FALSE;
 }
 
-int
-notify_isnotify (struct session *sess, char *name)
+/* forget ISON rounds in flight and the old MONITOR list, e.g. on reconnect */
+void
+notify_server_reset (server *serv)
 {
-	struct notify *notify;
+	GSList *list, *slist;
 	struct notify_per_server *servnot;
-	GSList *list = notify_list;
 
-	while (list)
+	for (list = notify_list; list; list = list->next)
 	{
-		notify = (struct notify *) list->data;
-		if (!sess->server->p_cmp (notify->name, name))
+		slist = ((struct notify *) list->data)->server_list;
+		for (; slist; slist = slist->next)
 		{
-			servnot = notify_find_server_entry (notify, sess->server);
-			if (servnot && servnot->ison)
-				return TRUE;
+			servnot = slist->data;
+			if (servnot->server == serv)
+				servnot->monitored = FALSE;
 		}
-		list = list->next;
 	}
 
-	return FALSE;
+	if (serv->ison_shards)
+		g_queue_free_full (serv->ison_shards, (GDestroyNotify) g_strfreev);
+	if (serv->ison_sent)
+		g_queue_free_full (serv->ison_sent, (GDestroyNotify) ison_sent_free);
+	serv->ison_shards = NULL;
+	serv->ison_sent = NULL;
+	serv->ison_next_poll = 0;
+	serv->monitor_limit = 0;
+	serv->monitor_count = 0;
+}
+
+void
+notify_server_free (server *serv)
+{
+	notify_server_reset (serv);
+	g_clear_pointer (&serv->notify_index, g_hash_table_destroy);
+	g_clear_pointer (&serv->notify_pending, g_ptr_array_unref);
 }
 
 void
@@ -712,6 +974,7 @@ notify_cleanup ()
 				notify->server_list =
 					g_slist_remove (notify->server_list, servnot);
 				g_free (servnot);
+				notify_gen++;
 				nslist = notify->server_list;
 			} else
 			{
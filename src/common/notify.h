@@ -37,6 +37,8 @@ struct notify_per_server
 	time_t lastseen;
 	time_t lastoff;
 	unsigned int ison:1;
+	unsigned int seen:1;	/* named in the ISON reply being processed */
+	unsigned int monitored:1;	/* on the server's MONITOR/WATCH list, else polled */
 };
 
 extern GSList *notify_list;
@@ -53,11 +55,14 @@ void notify_set_online_list (server * serv, char *users,
 void notify_set_offline_list (server * serv, char *users, int quiet,
 								 const message_tags_data *tags_data);
 void notify_send_watches (server * serv);
+void notify_monitor_full (server *serv, int limit, char *targets);
 
 /* the general stuff */
 void notify_adduser (char *name, char *networks);
 int notify_deluser (char *name);
 void notify_cleanup (void);
+void notify_server_reset (server *serv);
+void notify_server_free (server *serv);
 void notify_load (void);
 void notify_save (void);
 void notify_showlist (session *sess, const message_tags_data *tags_data);
@@ -66,8 +71,10 @@ int notify_isnotify (session *sess, char *name);
 struct notify_per_server *notify_find_server_entry (struct notify *notify, struct server *serv);
 
 /* the old ISON stuff - remove me? */
-void notify_markonline (server *serv, char *word[], 
+void notify_markonline (server *serv, char *nicks,
 								const message_tags_data *tags_data);
 int notify_checklist (void);
+void notify_ison_outgoing (server *serv);
+gboolean notify_polling_needed (void);
 
 #endif
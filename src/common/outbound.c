@@ -50,6 +50,9 @@
 #include "hexchatc.h"
 #include "servlist.h"
 #include "server.h"
+#include "slab.h"
+#include "perf.h"
+#include "stall.h"
 #include "tree.h"
 #include "outbound.h"
 #include "chanopt.h"
@@ -420,14 +423,14 @@ create_mask (session * sess, char *mask, char *mode, char *typestr, int deop)
 	char username[64], fullhost[128], domain[128], buf[512], *p2;
 
 	user = userlist_find (sess, mask);
-	if (user && user->hostname)  /* it's a nickname, let's find a proper ban mask */
+	if (user && user->info->hostname)  /* it's a nickname, let's find a proper ban mask */
 	{
 		if (deop)
 			p2 = user->nick;
 		else
 			p2 = "";
 
-		mask = user->hostname;
+		mask = user->info->hostname;
 
 		at = strchr (mask, '@');	/* FIXME: utf8 */
 		if (!at)
@@ -880,6 +883,38 @@ cmd_dcc (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	return TRUE;
 }
 
+static void
+debug_stats_row (const char *name, perf_unit unit, const perf_hist *hist, gpointer userdata)
+{
+	char buf[256];
+
+	g_snprintf (buf, sizeof (buf), "%-32.32s %-5s %-10" G_GUINT64_FORMAT " %-12" G_GUINT64_FORMAT
+					" %-9" G_GUINT64_FORMAT " %-8" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT "\n",
+					name, unit == PERF_UNIT_US ? "us" : "bytes", hist->count, hist->sum, hist->max,
+					perf_hist_percentile (hist, 50), perf_hist_percentile (hist, 99));
+	PrintText (userdata, buf);
+}
+
+/* hot path counters and latencies, see perf.c */
+static void
+debug_stats (struct session *sess, char *tbuf)
+{
+	struct server *v;
+	GSList *list;
+
+	PrintText (sess, "Stat                             Unit  Count      Sum          Max       p50      p99\n");
+	perf_foreach (debug_stats_row, sess);
+	plugin_perf_foreach (debug_stats_row, sess);
+
+	PrintText (sess, "\nServer    SendQ     Lines\n");
+	for (list = serv_list; list; list = list->next)
+	{
+		v = (struct server *) list->data;
+		sprintf (tbuf, "%p %-9d %d\n", v, v->sendq_len, v->sendq_lines);
+		PrintText (sess, tbuf);
+	}
+}
+
 static int
 cmd_debug (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
@@ -887,6 +922,18 @@ cmd_debug (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	struct server *v;
 	GSList *list = sess_list;
 
+	if (!g_ascii_strcasecmp (word[2], "stats"))
+	{
+		if (!g_ascii_strcasecmp (word[3], "reset"))
+		{
+			perf_reset ();
+			plugin_perf_reset ();
+		}
+		else
+			debug_stats (sess, tbuf);
+		return TRUE;
+	}
+
 	PrintText (sess, "Session   T Channel    WaitChan  WillChan  Server\n");
 	while (list)
 	{
@@ -909,6 +956,32 @@ cmd_debug (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 		list = list->next;
 	}
 
+	/* userlist storage, see userlist.c */
+	PrintText (sess, "\nServer    Users   Chunks  Bytes     Strings\n");
+	for (list = serv_list; list; list = list->next)
+	{
+		v = (struct server *) list->data;
+		if (!v->userinfo_slab)
+			continue;
+		sprintf (tbuf, "%p %-7u %-7u %-9lu %u\n",
+					v, v->userinfo_slab->in_use, v->userinfo_slab->n_chunks,
+					(unsigned long)slab_bytes (v->userinfo_slab),
+					v->user_strings ? g_hash_table_size (v->user_strings) : 0);
+		PrintText (sess, tbuf);
+	}
+
+	PrintText (sess, "Session   Members Chunks  Bytes\n");
+	for (list = sess_list; list; list = list->next)
+	{
+		s = (struct session *) list->data;
+		if (!s->user_slab)
+			continue;
+		sprintf (tbuf, "%p %-7u %-7u %lu\n",
+					s, s->user_slab->in_use, s->user_slab->n_chunks,
+					(unsigned long)slab_bytes (s->user_slab));
+		PrintText (sess, tbuf);
+	}
+
 	sprintf (tbuf,
 				"\nfront_session: %p\n"
 				"current_tab: %p\n\n",
@@ -1430,9 +1503,9 @@ cmd_dns (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 		user = userlist_find (sess, nick);
 		if (user)
 		{
-			if (user->hostname)
+			if (user->info->hostname)
 			{
-				do_dns (sess, user->nick, user->hostname, &no_tags);
+				do_dns (sess, user->nick, user->info->hostname, &no_tags);
 			} else
 			{
 				sess->server->p_get_ip (sess->server, nick);
@@ -2691,8 +2764,8 @@ split_up_text(struct session *sess, char *text, int cmd_length, char *split_text
 	max -= cmd_length;
 	max -= strlen (sess->server->nick);
 	max -= strlen (sess->channel);
-	if (sess->me && sess->me->hostname)
-		max -= strlen (sess->me->hostname);
+	if (sess->me && sess->me->info->hostname)
+		max -= strlen (sess->me->info->hostname);
 	else
 	{
 		max -= 9;	/* username */
@@ -2845,12 +2918,56 @@ cmd_mop (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	return TRUE;
 }
 
+/* show a sent /msg in its dialog or channel, or as a Message Send event */
+static void
+msg_echo (session *sess, char *nick, char *msg, int cmd_length)
+{
+	struct session *newsess;
+	char *split_text = NULL;
+	int offset = 0;
+
+	newsess = find_dialog (sess->server, nick);
+	if (!newsess)
+		newsess = find_channel (sess->server, nick);
+	if (newsess)
+	{
+		message_tags_data no_tags = MESSAGE_TAGS_DATA_INIT;
+
+		while ((split_text = split_up_text (sess, msg + offset, cmd_length, split_text)))
+		{
+			inbound_chanmsg (newsess->server, NULL, newsess->channel,
+								  newsess->server->nick, split_text, TRUE, FALSE,
+								  &no_tags);
+
+			if (*split_text)
+				offset += strlen(split_text);
+
+			g_free (split_text);
+		}
+		inbound_chanmsg (newsess->server, NULL, newsess->channel,
+							  newsess->server->nick, msg + offset, TRUE, FALSE,
+							  &no_tags);
+	}
+	else
+	{
+		/* mask out passwords */
+		if (g_ascii_strcasecmp (nick, "nickserv") == 0)
+		{
+			if (g_ascii_strncasecmp (msg, "identify ", 9) == 0)
+				msg = "identify ****";
+			else if (g_ascii_strncasecmp (msg, "ghost ", 6) == 0)
+				msg = "ghost ****";
+		}
+
+		EMIT_SIGNAL (XP_TE_MSGSEND, sess, nick, msg, NULL, NULL, 0);
+	}
+}
+
 static int
 cmd_msg (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
 	char *nick = word[2];
 	char *msg = word_eol[3];
-	struct session *newsess;
 	char *split_text = NULL;
 	int cmd_length = 13; /* " PRIVMSG ", " ", :, \r, \n */
 	int offset = 0;
@@ -2894,43 +3011,8 @@ cmd_msg (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 					g_free (split_text);
 				}
 				sess->server->p_message (sess->server, nick, msg + offset);
-				offset = 0;
-			}
-			newsess = find_dialog (sess->server, nick);
-			if (!newsess)
-				newsess = find_channel (sess->server, nick);
-			if (newsess)
-			{
-				message_tags_data no_tags = MESSAGE_TAGS_DATA_INIT;
-
-				while ((split_text = split_up_text (sess, msg + offset, cmd_length, split_text)))
-				{
-					inbound_chanmsg (newsess->server, NULL, newsess->channel,
-										  newsess->server->nick, split_text, TRUE, FALSE,
-										  &no_tags);
-
-					if (*split_text)
-						offset += strlen(split_text);
-
-					g_free (split_text);
-				}
-				inbound_chanmsg (newsess->server, NULL, newsess->channel,
-									  newsess->server->nick, msg + offset, TRUE, FALSE,
-									  &no_tags);
-			}
-			else
-			{
-				/* mask out passwords */
-				if (g_ascii_strcasecmp (nick, "nickserv") == 0)
-				{
-					if (g_ascii_strncasecmp (msg, "identify ", 9) == 0)
-						msg = "identify ****";
-					else if (g_ascii_strncasecmp (msg, "ghost ", 6) == 0)
-						msg = "ghost ****";
-				}
-
-				EMIT_SIGNAL (XP_TE_MSGSEND, sess, nick, msg, NULL, NULL, 0);
 			}
+			msg_echo (sess, nick, msg, cmd_length);
 
 			return TRUE;
 		}
@@ -3417,6 +3499,41 @@ cmd_splay (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	return FALSE;
 }
 
+static int
+cmd_throttle (struct session *sess, char *tbuf, char *word[], char *word_eol[])
+{
+	server *serv = sess->server;
+	ircnet *net = serv->network;
+	throttleprofile prof;
+	int drain;
+
+	if (*word[2])
+	{
+		if (!net)
+		{
+			PrintText (sess, _("This server is not in the network list, use /set net_throttle_* instead.\n"));
+			return TRUE;
+		}
+
+		if (!g_ascii_strcasecmp (word[2], "RESET"))
+			servlist_throttle_set (net, 0, 0, 0);
+		else if (*word[4])
+			servlist_throttle_set (net, atoi (word[2]), atoi (word[3]), atoi (word[4]));
+		else
+			return FALSE;
+	}
+
+	servlist_throttle_get (net, &prof);
+	PrintTextf (sess, _("Flood control: burst of %d lines, one line per %d ms, plus one per %d bytes.\n"),
+					prof.burst, prof.refill, prof.bytes);
+
+	drain = server_throttle_drain (serv);
+	PrintTextf (sess, _("Send queue: %d lines, %d bytes, empty in %d.%d seconds.\n"),
+					serv->sendq_lines, serv->sendq_len, drain / 1000, (drain / 100) % 10);
+
+	return TRUE;
+}
+
 static int
 parse_irc_url (char *url, char *server_name[], char *port[], char *channel[], char *key[], int *use_ssl)
 {
@@ -3859,7 +3976,7 @@ userlist_cb (struct User *user, session *sess)
 		lt = time (0) - user->lasttalk;
 	PrintTextf (sess,
 				"\00306%s\t\00314[\00310%-38s\00314] \017ov\0033=\017%d%d away=%u lt\0033=\017%ld\n",
-				user->nick, user->hostname, user->op, user->voice, user->away, (long)lt);
+				user->nick, user->info->hostname, user->op, user->voice, user->info->away, (long)lt);
 
 	return TRUE;
 }
@@ -4181,6 +4298,8 @@ const struct commands xc_cmds[] = {
 	{"SETTAB", cmd_settab, 0, 0, 1, N_("SETTAB <new name>, change a tab's name, tab_trunc limit still applies")},
 	{"SETTEXT", cmd_settext, 0, 0, 1, N_("SETTEXT <new text>, replace the text in the input box")},
 	{"SPLAY", cmd_splay, 0, 0, 1, "SPLAY <soundfile>"},
+	{"THROTTLE", cmd_throttle, 0, 0, 1,
+	 N_("THROTTLE [<burst> <refill ms> <bytes>|RESET], shows or sets the current network's flood control")},
 	{"TOPIC", cmd_topic, 1, 1, 1,
 	 N_("TOPIC [<topic>], sets the topic if one is given, else shows the current topic")},
 	{"TRAY", cmd_tray, 0, 0, 1,
@@ -4837,6 +4956,8 @@ handle_command (session *sess, char *cmd, int check_spch)
 	word[PDIWORDS] = "\000\000";
 	word_eol[PDIWORDS] = "\000\000";
 
+	stall_region_push ("command", word[1], NULL);
+
 	int_cmd = find_internal_command (word[1]);
 	/* redo it without quotes processing, for some commands like /JOIN */
 	if (int_cmd && !int_cmd->handle_quotes)
@@ -4918,6 +5039,7 @@ handle_command (session *sess, char *cmd, int check_spch)
 	}
 
 xit:
+	stall_region_pop ();
 	command_level--;
 
 	g_free (pdibuf);
@@ -4926,6 +5048,192 @@ xit:
 	return ret;
 }
 
+/* handle_command() for several commands at once, see hexchat_command_batch() */
+
+static const struct
+{
+	const char *name;
+	char sign;
+	char mode;
+} batch_mode_cmds[] =
+{
+	{"OP", '+', 'o'},
+	{"DEOP", '-', 'o'},
+	{"HOP", '+', 'h'},
+	{"DEHOP", '-', 'h'},
+	{"VOICE", '+', 'v'},
+	{"DEVOICE", '-', 'v'},
+};
+
+/* name and the rest of cmd, if its first word is name */
+static char *
+batch_args (char *cmd, const char *name)
+{
+	size_t len = strlen (name);
+
+	if (g_ascii_strncasecmp (cmd, name, len) != 0 || (cmd[len] && cmd[len] != ' '))
+		return NULL;
+	cmd += len;
+	while (*cmd == ' ')
+		cmd++;
+	return cmd;
+}
+
+/* only fold commands that nothing but the built-in handler would see */
+static int
+batch_builtin (const char *name)
+{
+	GSList *list;
+
+	if (plugin_command_hooked (name))
+		return FALSE;
+	for (list = command_list; list; list = list->next)
+	{
+		if (!g_ascii_strcasecmp (((struct popup *)list->data)->name, name))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* /OP a, /OP b, /OP c ... as MODE lines of modes_per_line nicks each */
+static int
+batch_modes (session *sess, char **cmds, int count, int m)
+{
+	GPtrArray *nicks;
+	char *args, *copy, *nick, *save;
+	char tbuf[514];	/* modes.c needs 512 + null */
+	int i;
+
+	nicks = g_ptr_array_new_with_free_func (g_free);
+	for (i = 0; i < count; i++)
+	{
+		args = batch_args (cmds[i], batch_mode_cmds[m].name);
+		if (!args || !*args)
+			break;
+		copy = g_strdup (args);
+		for (nick = strtok_r (copy, " ", &save); nick; nick = strtok_r (NULL, " ", &save))
+			g_ptr_array_add (nicks, g_strdup (nick));
+		g_free (copy);
+	}
+
+	send_channel_modes (sess, tbuf, (char **)nicks->pdata, 0, nicks->len,
+							  batch_mode_cmds[m].sign, batch_mode_cmds[m].mode, 0);
+	g_ptr_array_free (nicks, TRUE);
+	return i;
+}
+
+/* the target and text of a /MSG that could share a PRIVMSG with others */
+static char *
+batch_msg_target (char *cmd, char **text)
+{
+	char *args = batch_args (cmd, "MSG");
+	char *end;
+
+	if (!args || *args == '=' || *args == '.' || *args == '"')
+		return NULL;
+	end = strchr (args, ' ');
+	if (!end)
+		return NULL;
+	*text = end;
+	while (**text == ' ')
+		(*text)++;
+	if (!**text)
+		return NULL;
+	return g_strndup (args, end - args);
+}
+
+/* /MSG a hi, /MSG b hi ... as PRIVMSG a,b :hi, up to TARGMAX targets */
+static int
+batch_msgs (session *sess, char **cmds, int count)
+{
+	server *serv = sess->server;
+	GPtrArray *targets;
+	GString *joined;
+	char *text, *next_text, *target;
+	int cmd_length = 13; /* " PRIVMSG ", " ", :, \r, \n */
+	char *split_text;
+	int i;
+
+	target = batch_msg_target (cmds[0], &text);
+	if (!target)
+		return 0;
+
+	targets = g_ptr_array_new_with_free_func (g_free);
+	joined = g_string_new (target);
+	g_ptr_array_add (targets, target);
+	for (i = 1; i < count; i++)
+	{
+		if (serv->privmsg_targets && targets->len >= serv->privmsg_targets)
+			break;
+		target = batch_msg_target (cmds[i], &next_text);
+		if (!target)
+			break;
+		split_text = split_up_text (sess, text, cmd_length + joined->len + strlen (target) + 1, NULL);
+		if (strcmp (text, next_text) != 0 || split_text)
+		{
+			g_free (split_text);
+			g_free (target);
+			break;
+		}
+		g_string_append_c (joined, ',');
+		g_string_append (joined, target);
+		g_ptr_array_add (targets, target);
+	}
+
+	if (targets->len > 1)
+	{
+		serv->p_message (serv, joined->str, text);
+		for (i = 0; i < targets->len; i++)
+			msg_echo (sess, targets->pdata[i], text, cmd_length);
+		safe_strcpy (sess->lastnick, targets->pdata[targets->len - 1], NICKLEN);
+	}
+	i = targets->len > 1 ? targets->len : 0;
+
+	g_string_free (joined, TRUE);
+	g_ptr_array_free (targets, TRUE);
+	return i;
+}
+
+/* Runs cmds in order like handle_command(), except that consecutive
+   /OP-style commands become shared MODE lines and consecutive /MSGs with
+   the same text become one PRIVMSG where the server's TARGMAX allows.
+   Returns how many commands were handled. */
+int
+handle_command_batch (session *sess, char **cmds, int count)
+{
+	int i = 0, done, m;
+
+	while (i < count && is_session (sess))
+	{
+		done = 0;
+
+		if (sess->server->connected)
+		{
+			for (m = 0; m < G_N_ELEMENTS (batch_mode_cmds); m++)
+			{
+				if (batch_args (cmds[i], batch_mode_cmds[m].name))
+				{
+					if (sess->channel[0] && batch_builtin (batch_mode_cmds[m].name))
+						done = batch_modes (sess, cmds + i, count - i, m);
+					break;
+				}
+			}
+
+			if (!done && batch_args (cmds[i], "MSG") && batch_builtin ("MSG"))
+				done = batch_msgs (sess, cmds + i, count - i);
+		}
+
+		if (!done)
+		{
+			handle_command (sess, cmds[i], FALSE);
+			done = 1;
+		}
+		i += done;
+	}
+
+	return i;
+}
+
 /* handle one line entered into the input box */
 
 static int
@@ -0,0 +1,272 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <glib/gstdio.h>
+
+#include "perf.h"
+
+#define PERF_MAX_DEPTH 16
+
+static const char * const stage_names[PERF_NUM_STAGES] =
+{
+	"framing", "parse", "plugin", "text_emit", "display", "logging", "frontend"
+};
+
+static perf_hist stage_hist[PERF_NUM_STAGES];
+static perf_hist read_hist;		/* bytes per recv() */
+static perf_hist line_hist;		/* bytes per line */
+static perf_hist sendq_hist;	/* send queue depth at each enqueue */
+static perf_hist stall_hist;	/* main loop stalls, see stall.c */
+
+static struct
+{
+	perf_stage stage;
+	gint64 start;
+} stack[PERF_MAX_DEPTH];
+static int depth;
+
+/* exclusive thread CPU time per stage, for benchmarks */
+static gboolean cpu_enabled;
+static guint64 cpu_ns[PERF_NUM_STAGES];
+static guint64 cpu_mark;
+
+void
+perf_hist_add (perf_hist *hist, guint64 value)
+{
+	int bucket = value ? g_bit_storage (value) : 0;
+
+	hist->count++;
+	hist->sum += value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->buckets[MIN (bucket, PERF_HIST_BUCKETS - 1)]++;
+}
+
+/* an upper bound, as good as the power of two buckets allow */
+guint64
+perf_hist_percentile (const perf_hist *hist, int pct)
+{
+	guint64 want, seen = 0;
+	int i;
+
+	if (!hist->count)
+		return 0;
+
+	want = (hist->count * pct + 99) / 100;
+	for (i = 0; i < PERF_HIST_BUCKETS - 1; i++)
+	{
+		seen += hist->buckets[i];
+		if (seen >= want)
+			return MIN ((G_GUINT64_CONSTANT (1) << i) - 1, hist->max);
+	}
+
+	return hist->max;
+}
+
+static guint64
+perf_cpu_now (void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		return (guint64)ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+#endif
+	return (guint64)g_get_monotonic_time () * 1000;
+}
+
+static void
+perf_cpu_charge (void)
+{
+	guint64 now = perf_cpu_now ();
+
+	if (depth > 0 && depth <= PERF_MAX_DEPTH)
+		cpu_ns[stack[depth - 1].stage] += now - cpu_mark;
+	cpu_mark = now;
+}
+
+void
+perf_stage_enter (perf_stage stage)
+{
+	if (G_UNLIKELY (cpu_enabled))
+		perf_cpu_charge ();
+
+	if (depth < PERF_MAX_DEPTH)
+	{
+		stack[depth].stage = stage;
+		stack[depth].start = g_get_monotonic_time ();
+	}
+	depth++;
+}
+
+void
+perf_stage_leave (void)
+{
+	gint64 elapsed;
+
+	if (depth == 0)
+		return;
+
+	if (G_UNLIKELY (cpu_enabled))
+		perf_cpu_charge ();
+
+	depth--;
+	if (depth < PERF_MAX_DEPTH)
+	{
+		elapsed = g_get_monotonic_time () - stack[depth].start;
+		perf_hist_add (&stage_hist[stack[depth].stage], MAX (elapsed, 0));
+	}
+}
+
+void
+perf_count_read (gsize len)
+{
+	perf_hist_add (&read_hist, len);
+}
+
+void
+perf_count_line (gsize len)
+{
+	perf_hist_add (&line_hist, len);
+}
+
+void
+perf_count_sendq (int depth)
+{
+	perf_hist_add (&sendq_hist, MAX (depth, 0));
+}
+
+void
+perf_count_stall (guint64 us)
+{
+	perf_hist_add (&stall_hist, us);
+}
+
+void
+perf_foreach (perf_row_func *func, gpointer userdata)
+{
+	int i;
+
+	func ("read", PERF_UNIT_BYTES, &read_hist, userdata);
+	func ("line", PERF_UNIT_BYTES, &line_hist, userdata);
+	for (i = 0; i < PERF_NUM_STAGES; i++)
+		func (stage_names[i], PERF_UNIT_US, &stage_hist[i], userdata);
+	func ("sendq", PERF_UNIT_BYTES, &sendq_hist, userdata);
+	func ("stall", PERF_UNIT_US, &stall_hist, userdata);
+}
+
+void
+perf_reset (void)
+{
+	memset (stage_hist, 0, sizeof (stage_hist));
+	memset (&read_hist, 0, sizeof (read_hist));
+	memset (&line_hist, 0, sizeof (line_hist));
+	memset (&sendq_hist, 0, sizeof (sendq_hist));
+	memset (&stall_hist, 0, sizeof (stall_hist));
+	memset (cpu_ns, 0, sizeof (cpu_ns));
+}
+
+static void
+perf_append_json_string (GString *out, const char *str)
+{
+	g_string_append_c (out, '"');
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			g_string_append_c (out, '\\');
+		if ((unsigned char)*str < 0x20)
+			g_string_append_printf (out, "\\u%04x", (unsigned char)*str);
+		else
+			g_string_append_c (out, *str);
+	}
+	g_string_append_c (out, '"');
+}
+
+/* "name": {...} with the summary a scraper wants, not the raw buckets */
+void
+perf_append_json (GString *out, const char *name, perf_unit unit,
+						const perf_hist *hist)
+{
+	perf_append_json_string (out, name);
+	g_string_append_printf (out, ": {\"unit\": \"%s\", \"count\": %" G_GUINT64_FORMAT
+							", \"sum\": %" G_GUINT64_FORMAT ", \"max\": %" G_GUINT64_FORMAT
+							", \"p50\": %" G_GUINT64_FORMAT ", \"p99\": %" G_GUINT64_FORMAT "}",
+							unit == PERF_UNIT_US ? "us" : "bytes",
+							hist->count, hist->sum, hist->max,
+							perf_hist_percentile (hist, 50), perf_hist_percentile (hist, 99));
+}
+
+void
+perf_enable (void)
+{
+	cpu_enabled = TRUE;
+	perf_reset ();
+	cpu_mark = perf_cpu_now ();
+}
+
+static void
+perf_report_row (const char *name, perf_unit unit, const perf_hist *hist, gpointer userdata)
+{
+	GString *out = userdata;
+
+	g_string_append (out, out->str[out->len - 1] == '{' ? "\n    " : ",\n    ");
+	perf_append_json (out, name, unit, hist);
+}
+
+/* one JSON object, so benchmark runs can be compared by a script */
+gboolean
+perf_write_report (const char *filename)
+{
+	GString *out;
+	struct rusage ru;
+	gboolean ret;
+	int i;
+
+	out = g_string_new ("{\n");
+	g_string_append_printf (out, "  \"lines\": %" G_GUINT64_FORMAT ",\n  \"bytes\": %" G_GUINT64_FORMAT ",\n",
+							line_hist.count, line_hist.sum);
+	g_string_append (out, "  \"stages\": {\n");
+	for (i = 0; i < PERF_NUM_STAGES; i++)
+	{
+		g_string_append_printf (out, "    \"%s\": {\"calls\": %" G_GUINT64_FORMAT ", \"cpu_ns\": %" G_GUINT64_FORMAT "}%s\n",
+								stage_names[i], stage_hist[i].count, cpu_ns[i],
+								i + 1 < PERF_NUM_STAGES ? "," : "");
+	}
+	g_string_append (out, "  },\n  \"stats\": {");
+	perf_foreach (perf_report_row, out);
+	g_string_append (out, "\n  }");
+	if (getrusage (RUSAGE_SELF, &ru) == 0)
+	{
+		g_string_append_printf (out, ",\n  \"user_cpu_us\": %" G_GINT64_FORMAT ",\n  \"sys_cpu_us\": %" G_GINT64_FORMAT ",\n  \"max_rss_kb\": %ld",
+								(gint64)ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec,
+								(gint64)ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec,
+								ru.ru_maxrss);
+	}
+	g_string_append (out, "\n}\n");
+
+	ret = g_file_set_contents (filename, out->str, out->len, NULL);
+	g_string_free (out, TRUE);
+
+	return ret;
+}
@@ -0,0 +1,80 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+#ifndef HEXCHAT_PERF_H
+#define HEXCHAT_PERF_H
+
+#include <glib.h>
+
+/* stages of the inbound path */
+typedef enum
+{
+	PERF_FRAMING,		/* splitting the socket stream into lines */
+	PERF_PARSE,			/* tags, words, inbound handlers */
+	PERF_PLUGIN,		/* hook lookup and plugin callbacks */
+	PERF_TEXT_EMIT,		/* text events, including plugin print hooks */
+	PERF_DISPLAY,		/* formatting a text event */
+	PERF_LOGGING,		/* log file and scrollback writes */
+	PERF_FRONTEND,		/* handing a line to the frontend */
+	PERF_NUM_STAGES
+} perf_stage;
+
+typedef enum
+{
+	PERF_UNIT_US,
+	PERF_UNIT_BYTES
+} perf_unit;
+
+/* bucket n counts values n bits wide, the last one everything wider */
+#define PERF_HIST_BUCKETS 24
+
+typedef struct perf_hist
+{
+	guint64 count;
+	guint64 sum;
+	guint64 max;
+	guint32 buckets[PERF_HIST_BUCKETS];
+} perf_hist;
+
+typedef void (perf_row_func) (const char *name, perf_unit unit,
+										const perf_hist *hist, gpointer userdata);
+
+void perf_hist_add (perf_hist *hist, guint64 value);
+guint64 perf_hist_percentile (const perf_hist *hist, int pct);
+
+/* always on: stages nest, and each records its own wall time */
+void perf_stage_enter (perf_stage stage);
+void perf_stage_leave (void);
+
+void perf_count_read (gsize len);
+void perf_count_line (gsize len);
+void perf_count_sendq (int depth);
+void perf_count_stall (guint64 us);
+
+void perf_foreach (perf_row_func *func, gpointer userdata);
+void perf_reset (void);
+void perf_append_json (GString *out, const char *name, perf_unit unit,
+							  const perf_hist *hist);
+
+/* benchmarks only: also charge thread CPU time to the innermost stage */
+void perf_enable (void);
+gboolean perf_write_report (const char *filename);
+
+#endif
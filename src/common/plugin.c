@@ -36,6 +36,9 @@
 #include "modes.h"
 #include "notify.h"
 #include "text.h"
+#include "perf.h"
+#include "stall.h"
+#include "timerwheel.h"
 #define PLUGIN_C
 typedef struct session hexchat_context;
 #include "hexchat-plugin.h"
@@ -64,6 +67,7 @@ struct _hexchat_hook
 	int tag;				/* for timers & FDs only */
 	int type;			/* HOOK_* */
 	int pri;	/* fd */	/* priority / fd for HOOK_FD only */
+	perf_hist time;	/* callback wall time, us */
 };
 
 struct _hexchat_list
@@ -71,8 +75,10 @@ struct _hexchat_list
 	int type;			/* LIST_* */
 	GSList *pos;		/* current pos */
 	GSList *next;		/* next pos */
-	GSList *head;		/* for LIST_USERS only */
+	GSList *head;		/* for LIST_NOTIFY and LIST_STATS only */
 	struct notify_per_server *notifyps;	/* notify_per_server * */
+	session *sess;		/* for LIST_USERS only */
+	userlist_cursor cursor;
 };
 
 typedef int (hexchat_cmd_cb) (char *word[], char *word_eol[], void *user_data);
@@ -91,7 +97,73 @@ enum
 	LIST_DCC,
 	LIST_IGNORE,
 	LIST_NOTIFY,
-	LIST_USERS
+	LIST_USERS,
+	LIST_STATS
+};
+
+/* ids handed out by hexchat_list_field_id(), grouped by list */
+enum
+{
+	FIELD_CHANNELS_CHANNEL,
+	FIELD_CHANNELS_CHANNELKEY,
+	FIELD_CHANNELS_CHANMODES,
+	FIELD_CHANNELS_CHANTYPES,
+	FIELD_CHANNELS_CONTEXT,
+	FIELD_CHANNELS_FLAGS,
+	FIELD_CHANNELS_ID,
+	FIELD_CHANNELS_LAG,
+	FIELD_CHANNELS_MAXMODES,
+	FIELD_CHANNELS_NETWORK,
+	FIELD_CHANNELS_NICKMODES,
+	FIELD_CHANNELS_NICKPREFIXES,
+	FIELD_CHANNELS_QUEUE,
+	FIELD_CHANNELS_SERVER,
+	FIELD_CHANNELS_TYPE,
+	FIELD_CHANNELS_USERS,
+
+	FIELD_DCC_ADDRESS32,
+	FIELD_DCC_CPS,
+	FIELD_DCC_DESTFILE,
+	FIELD_DCC_FILE,
+	FIELD_DCC_NICK,
+	FIELD_DCC_PORT,
+	FIELD_DCC_POS,
+	FIELD_DCC_POSHIGH,
+	FIELD_DCC_RESUME,
+	FIELD_DCC_RESUMEHIGH,
+	FIELD_DCC_SIZE,
+	FIELD_DCC_SIZEHIGH,
+	FIELD_DCC_STATUS,
+	FIELD_DCC_TYPE,
+
+	FIELD_IGNORE_FLAGS,
+	FIELD_IGNORE_MASK,
+
+	FIELD_NOTIFY_FLAGS,
+	FIELD_NOTIFY_NETWORKS,
+	FIELD_NOTIFY_NICK,
+	FIELD_NOTIFY_OFF,
+	FIELD_NOTIFY_ON,
+	FIELD_NOTIFY_SEEN,
+
+	FIELD_USERS_ACCOUNT,
+	FIELD_USERS_AWAY,
+	FIELD_USERS_HOST,
+	FIELD_USERS_LASTTALK,
+	FIELD_USERS_NICK,
+	FIELD_USERS_PREFIX,
+	FIELD_USERS_REALNAME,
+	FIELD_USERS_SELECTED,
+
+	FIELD_STATS_COUNT,
+	FIELD_STATS_MAX,
+	FIELD_STATS_NAME,
+	FIELD_STATS_P50,
+	FIELD_STATS_P99,
+	FIELD_STATS_SUM,
+	FIELD_STATS_UNIT,
+
+	FIELD_COUNT
 };
 
 /* We use binary flags here because it makes it possible for plugin_hook_find()
@@ -289,6 +361,11 @@ plugin_add (session *sess, char *filename, void *handle, void *init_func,
 		pl->hexchat_emit_print_attrs = hexchat_emit_print_attrs;
 		pl->hexchat_event_attrs_create = hexchat_event_attrs_create;
 		pl->hexchat_event_attrs_free = hexchat_event_attrs_free;
+		pl->hexchat_list_field_id = hexchat_list_field_id;
+		pl->hexchat_list_str_id = hexchat_list_str_id;
+		pl->hexchat_list_int_id = hexchat_list_int_id;
+		pl->hexchat_list_time_id = hexchat_list_time_id;
+		pl->hexchat_command_batch = hexchat_command_batch;
 
 		/* run hexchat_plugin_init, if it returns 0, close the plugin */
 		if (((hexchat_init_func *)init_func) (pl, &pl->name, &pl->desc, &pl->version, arg) == 0)
@@ -522,6 +599,22 @@ plugin_hook_find (GSList *list, int type, char *name)
 	return NULL;
 }
 
+/* while hexchat_command_batch() runs for a plugin that asked not to see
+   its own commands again */
+static hexchat_plugin *command_skip_plugin;
+
+/* plugin_hook_run() calls nested inside hook callbacks */
+static int hook_run_depth;
+
+static void
+plugin_hook_account (hexchat_hook *hook, gint64 start)
+{
+	gint64 elapsed = MAX (g_get_monotonic_time () - start, 0);
+
+	perf_hist_add (&hook->time, elapsed);
+	perf_hist_add (&hook->pl->hook_time, elapsed);
+}
+
 /* check for plugin hooks and run them */
 
 static int
@@ -530,8 +623,12 @@ plugin_hook_run (session *sess, char *name, char *word[], char *word_eol[],
 {
 	GSList *list, *next;
 	hexchat_hook *hook;
+	gint64 start;
 	int ret, eat = 0;
 
+	perf_stage_enter (PERF_PLUGIN);
+	hook_run_depth++;
+
 	list = hook_list;
 	while (1)
 	{
@@ -541,7 +638,14 @@ plugin_hook_run (session *sess, char *name, char *word[], char *word_eol[],
 
 		hook = list->data;
 		next = list->next;
+		if (hook->pl == command_skip_plugin && (type & HOOK_COMMAND))
+		{
+			list = next;
+			continue;
+		}
 		hook->pl->context = sess;
+		stall_region_push ("plugin_hook_run", hook->pl->name, hook->name);
+		start = g_get_monotonic_time ();
 
 		/* run the plugin's callback function */
 		switch (hook->type)
@@ -563,6 +667,12 @@ plugin_hook_run (session *sess, char *name, char *word[], char *word_eol[],
 			break;
 		}
 
+		stall_region_pop ();
+
+		/* an unhooked hook's plugin may be gone already */
+		if (hook->type != HOOK_DELETED)
+			plugin_hook_account (hook, start);
+
 		if ((ret & HEXCHAT_EAT_HEXCHAT) && (ret & HEXCHAT_EAT_PLUGIN))
 		{
 			eat = 1;
@@ -577,8 +687,12 @@ plugin_hook_run (session *sess, char *name, char *word[], char *word_eol[],
 	}
 
 xit:
-	/* really remove deleted hooks now */
-	list = hook_list;
+	/* really remove deleted hooks now, unless an outer run still holds
+	   pointers to them */
+	if (--hook_run_depth > 0)
+		list = NULL;
+	else
+		list = hook_list;
 	while (list)
 	{
 		hook = list->data;
@@ -591,6 +705,8 @@ xit:
 		list = next;
 	}
 
+	perf_stage_leave ();
+
 	return eat;
 }
 
@@ -602,6 +718,73 @@ plugin_emit_command (session *sess, char *name, char *word[], char *word_eol[])
 	return plugin_hook_run (sess, name, word, word_eol, NULL, HOOK_COMMAND);
 }
 
+/* would plugin_emit_command() run anything for this command? */
+
+int
+plugin_command_hooked (const char *name)
+{
+	GSList *list;
+
+	for (list = plugin_hook_find (hook_list, HOOK_COMMAND, (char *)name); list;
+		  list = plugin_hook_find (list->next, HOOK_COMMAND, (char *)name))
+	{
+		if (((hexchat_hook *)list->data)->pl != command_skip_plugin)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* per plugin and per hook callback time, for /debug stats */
+
+void
+plugin_perf_foreach (perf_row_func *func, gpointer userdata)
+{
+	GSList *list;
+	hexchat_plugin *pl;
+	hexchat_hook *hook;
+	char *name;
+
+	for (list = plugin_list; list; list = list->next)
+	{
+		pl = list->data;
+		if (pl->fake || !pl->hook_time.count)
+			continue;
+		name = g_strconcat ("plugin:", pl->name, NULL);
+		func (name, PERF_UNIT_US, &pl->hook_time, userdata);
+		g_free (name);
+	}
+
+	for (list = hook_list; list; list = list->next)
+	{
+		hook = list->data;
+		if (!hook || hook->type == HOOK_DELETED || !hook->time.count)
+			continue;
+		name = g_strdup_printf ("hook:%s:%s", hook->pl->name,
+										hook->name ? hook->name :
+										hook->type == HOOK_TIMER ? "timer" : "fd");
+		func (name, PERF_UNIT_US, &hook->time, userdata);
+		g_free (name);
+	}
+}
+
+void
+plugin_perf_reset (void)
+{
+	GSList *list;
+	hexchat_hook *hook;
+
+	for (list = plugin_list; list; list = list->next)
+		memset (&((hexchat_plugin *)list->data)->hook_time, 0, sizeof (perf_hist));
+
+	for (list = hook_list; list; list = list->next)
+	{
+		hook = list->data;
+		if (hook)
+			memset (&hook->time, 0, sizeof (perf_hist));
+	}
+}
+
 hexchat_event_attrs *
 hexchat_event_attrs_create (hexchat_plugin *ph)
 {
@@ -690,21 +873,27 @@ plugin_emit_keypress (session *sess, unsigned int state, unsigned int keyval, gu
 static int
 plugin_timeout_cb (hexchat_hook *hook)
 {
+	gint64 start;
 	int ret;
 
 	/* timer_cb's context starts as front-most-tab */
 	hook->pl->context = current_sess;
 
 	/* call the plugin's timeout function */
+	stall_region_push ("plugin timer", hook->pl->name, NULL);
+	start = g_get_monotonic_time ();
 	ret = ((hexchat_timer_cb *)hook->callback) (hook->userdata);
+	stall_region_pop ();
 
 	/* the callback might have already unhooked it! */
 	if (!g_slist_find (hook_list, hook) || hook->type == HOOK_DELETED)
 		return 0;
 
+	plugin_hook_account (hook, start);
+
 	if (ret == 0)
 	{
-		hook->tag = 0;	/* avoid fe_timeout_remove, returning 0 is enough! */
+		hook->tag = 0;	/* avoid timerwheel_remove, returning 0 is enough! */
 		hexchat_unhook (hook->pl, hook);
 	}
 
@@ -753,6 +942,7 @@ static gboolean
 plugin_fd_cb (GIOChannel *source, GIOCondition condition, hexchat_hook *hook)
 {
 	int flags = 0, ret;
+	gint64 start;
 	typedef int (hexchat_fd_cb2) (int fd, int flags, void *user_data, GIOChannel *);
 
 	if (condition & G_IO_IN)
@@ -762,12 +952,17 @@ plugin_fd_cb (GIOChannel *source, GIOCondition condition, hexchat_hook *hook)
 	if (condition & G_IO_PRI)
 		flags |= HEXCHAT_FD_EXCEPTION;
 
+	stall_region_push ("plugin fd", hook->pl->name, NULL);
+	start = g_get_monotonic_time ();
 	ret = ((hexchat_fd_cb2 *)hook->callback) (hook->pri, flags, hook->userdata, source);
+	stall_region_pop ();
 
 	/* the callback might have already unhooked it! */
 	if (!g_slist_find (hook_list, hook) || hook->type == HOOK_DELETED)
 		return 0;
 
+	plugin_hook_account (hook, start);
+
 	if (ret == 0)
 	{
 		hook->tag = 0; /* avoid fe_input_remove, returning 0 is enough! */
@@ -798,7 +993,8 @@ plugin_add_hook (hexchat_plugin *pl, int type, int pri, const char *name,
 	plugin_insert_hook (hook);
 
 	if (type == HOOK_TIMER)
-		hook->tag = fe_timeout_add (timeout, plugin_timeout_cb, hook);
+		hook->tag = timerwheel_add (timeout, timerwheel_default_slack (timeout),
+											 (GSourceFunc) plugin_timeout_cb, hook);
 
 	return hook;
 }
@@ -931,7 +1127,7 @@ hexchat_unhook (hexchat_plugin *ph, hexchat_hook *hook)
 		return NULL;
 
 	if (hook->type == HOOK_TIMER && hook->tag != 0)
-		fe_timeout_remove (hook->tag);
+		timerwheel_remove (hook->tag);
 
 	if (hook->type == HOOK_FD && hook->tag != 0)
 		fe_input_remove (hook->tag);
@@ -1046,6 +1242,35 @@ hexchat_command (hexchat_plugin *ph, const char *command)
 	g_free (command_utf8);
 }
 
+int
+hexchat_command_batch (hexchat_plugin *ph, const char * const *commands, int count, int flags)
+{
+	hexchat_plugin *old_skip = command_skip_plugin;
+	char **fixed;
+	int i, ret;
+
+	if (!is_session (ph->context))
+	{
+		DEBUG(PrintTextf(0, "%s\thexchat_command_batch called without a valid context.\n", ph->name));
+		return 0;
+	}
+
+	fixed = g_new (char *, count);
+	for (i = 0; i < count; i++)
+		fixed[i] = text_fixup_invalid_utf8 (commands[i], -1, NULL);
+
+	if (flags & HEXCHAT_BATCH_SKIP_SELF)
+		command_skip_plugin = ph;
+	ret = handle_command_batch (ph->context, fixed, count);
+	command_skip_plugin = old_skip;
+
+	for (i = 0; i < count; i++)
+		g_free (fixed[i]);
+	g_free (fixed);
+
+	return ret;
+}
+
 void
 hexchat_commandf (hexchat_plugin *ph, const char *format, ...)
 {
@@ -1089,6 +1314,33 @@ hexchat_find_context (hexchat_plugin *ph, const char *servname, const char *chan
 	return plugin_find_context (servname, channel, ph->context->server);
 }
 
+static void
+stats_json_row (const char *name, perf_unit unit, const perf_hist *hist, gpointer userdata)
+{
+	GString *out = userdata;
+
+	if (out->len > 1)
+		g_string_append (out, ", ");
+	perf_append_json (out, name, unit, hist);
+}
+
+/* one JSON object for monitoring scripts; valid until the next call */
+static const char *
+plugin_stats_json (void)
+{
+	static GString *out;
+
+	if (!out)
+		out = g_string_sized_new (4096);
+
+	g_string_assign (out, "{");
+	perf_foreach (stats_json_row, out);
+	plugin_perf_foreach (stats_json_row, out);
+	g_string_append_c (out, '}');
+
+	return out->str;
+}
+
 const char *
 hexchat_get_info (hexchat_plugin *ph, const char *id)
 {
@@ -1114,6 +1366,9 @@ hexchat_get_info (hexchat_plugin *ph, const char *id)
 			return NULL;
 #endif
 
+		case 0x68ac49f: /* stats */
+			return plugin_stats_json ();
+
 		case 0x14f51cd8: /* version */
 			return PACKAGE_VERSION;
 
@@ -1247,41 +1502,86 @@ hexchat_get_prefs (hexchat_plugin *ph, const char *name, const char **string, in
 	return 0;
 }
 
+static int
+list_type_from_name (const char *name)
+{
+	switch (str_hash (name))
+	{
+	case 0x556423d0: /* channels */
+		return LIST_CHANNELS;
+	case 0x183c4:	/* dcc */
+		return LIST_DCC;
+	case 0xb90bfdd2:	/* ignore */
+		return LIST_IGNORE;
+	case 0xc2079749:	/* notify */
+		return LIST_NOTIFY;
+	case 0x6a68e08: /* users */
+		return LIST_USERS;
+	case 0x68ac49f: /* stats */
+		return LIST_STATS;
+	}
+
+	return -1;
+}
+
+/* LIST_STATS is a snapshot, the counters keep moving while it is read */
+typedef struct
+{
+	char *name;
+	perf_unit unit;
+	perf_hist hist;
+} stats_row;
+
+static void
+stats_list_row (const char *name, perf_unit unit, const perf_hist *hist, gpointer userdata)
+{
+	GSList **rows = userdata;
+	stats_row *row = g_new (stats_row, 1);
+
+	row->name = g_strdup (name);
+	row->unit = unit;
+	row->hist = *hist;
+	*rows = g_slist_prepend (*rows, row);
+}
+
+static void
+stats_row_free (stats_row *row)
+{
+	g_free (row->name);
+	g_free (row);
+}
+
 hexchat_list *
 hexchat_list_get (hexchat_plugin *ph, const char *name)
 {
 	hexchat_list *list;
 
 	list = g_new0 (hexchat_list, 1);
+	list->type = list_type_from_name (name);
 
-	switch (str_hash (name))
+	switch (list->type)
 	{
-	case 0x556423d0: /* channels */
-		list->type = LIST_CHANNELS;
+	case LIST_CHANNELS:
 		list->next = sess_list;
 		break;
 
-	case 0x183c4:	/* dcc */
-		list->type = LIST_DCC;
+	case LIST_DCC:
 		list->next = dcc_list;
 		break;
 
-	case 0xb90bfdd2:	/* ignore */
-		list->type = LIST_IGNORE;
+	case LIST_IGNORE:
 		list->next = ignore_list;
 		break;
 
-	case 0xc2079749:	/* notify */
-		list->type = LIST_NOTIFY;
+	case LIST_NOTIFY:
 		list->next = notify_list;
 		list->head = (void *)ph->context;	/* reuse this pointer */
 		break;
 
-	case 0x6a68e08: /* users */
+	case LIST_USERS:
 		if (is_session (ph->context))
 		{
-			list->type = LIST_USERS;
-			list->head = list->next = userlist_flat_list (ph->context);
+			list->sess = ph->context;
 			fe_userlist_set_selected (ph->context);
 			break;
 		}	/* fall through */
@@ -1289,6 +1589,13 @@ hexchat_list_get (hexchat_plugin *ph, const char *name)
 	default:
 		g_free (list);
 		return NULL;
+
+	case LIST_STATS:
+		perf_foreach (stats_list_row, &list->head);
+		plugin_perf_foreach (stats_list_row, &list->head);
+		list->head = g_slist_reverse (list->head);
+		list->next = list->head;
+		break;
 	}
 
 	return list;
@@ -1297,14 +1604,22 @@ hexchat_list_get (hexchat_plugin *ph, const char *name)
 void
 hexchat_list_free (hexchat_plugin *ph, hexchat_list *xlist)
 {
-	if (xlist->type == LIST_USERS)
-		g_slist_free (xlist->head);
+	if (xlist->type == LIST_STATS)
+		g_slist_free_full (xlist->head, (GDestroyNotify) stats_row_free);
 	g_free (xlist);
 }
 
 int
 hexchat_list_next (hexchat_plugin *ph, hexchat_list *xlist)
 {
+	/* USERS: step through the channel's tree rather than a copy of it */
+	if (xlist->type == LIST_USERS)
+	{
+		if (!is_session (xlist->sess))
+			return 0;
+		return userlist_cursor_next (xlist->sess, &xlist->cursor) != NULL;
+	}
+
 	if (xlist->next == NULL)
 		return 0;
 
@@ -1350,9 +1665,13 @@ hexchat_list_fields (hexchat_plugin *ph, const char *name)
 	{
 		"saccount", "iaway", "shost", "tlasttalk", "snick", "sprefix", "srealname", "iselected", NULL
 	};
+	static const char * const stats_fields[] =
+	{
+		"icount", "imax", "sname", "ip50", "ip99", "isum", "sunit", NULL
+	};
 	static const char * const list_of_lists[] =
 	{
-		"channels",	"dcc", "ignore", "notify", "users", NULL
+		"channels",	"dcc", "ignore", "notify", "users", "stats", NULL
 	};
 
 	switch (str_hash (name))
@@ -1367,6 +1686,8 @@ hexchat_list_fields (hexchat_plugin *ph, const char *name)
 		return notify_fields;
 	case 0x6a68e08:	/* users */
 		return users_fields;
+	case 0x68ac49f:	/* stats */
+		return stats_fields;
 	case 0x6236395:	/* lists */
 		return list_of_lists;
 	}
@@ -1374,53 +1695,11 @@ hexchat_list_fields (hexchat_plugin *ph, const char *name)
 	return NULL;
 }
 
-time_t
-hexchat_list_time (hexchat_plugin *ph, hexchat_list *xlist, const char *name)
-{
-	guint32 hash = str_hash (name);
-	gpointer data;
-
-	switch (xlist->type)
-	{
-	case LIST_NOTIFY:
-		if (!xlist->notifyps)
-			return (time_t) -1;
-		switch (hash)
-		{
-		case 0x1ad6f:	/* off */
-			return xlist->notifyps->lastoff;
-		case 0xddf:	/* on */
-			return xlist->notifyps->laston;
-		case 0x35ce7b:	/* seen */
-			return xlist->notifyps->lastseen;
-		}
-		break;
-
-	case LIST_USERS:
-		data = xlist->pos->data;
-		switch (hash)
-		{
-		case 0xa9118c42:	/* lasttalk */
-			return ((struct User *)data)->lasttalk;
-		}
-	}
-
-	return (time_t) -1;
-}
-
-const char *
-hexchat_list_str (hexchat_plugin *ph, hexchat_list *xlist, const char *name)
+/* resolve a field name once, then read it by id for every entry */
+static int
+list_field_lookup (int type, const char *name)
 {
 	guint32 hash = str_hash (name);
-	gpointer data = ph->context;
-	int type = LIST_CHANNELS;
-
-	/* a NULL xlist is a shortcut to current "channels" context */
-	if (xlist)
-	{
-		data = xlist->pos->data;
-		type = xlist->type;
-	}
 
 	switch (type)
 	{
@@ -1428,53 +1707,99 @@ hexchat_list_str (hexchat_plugin *ph, hexchat_list *xlist, const char *name)
 		switch (hash)
 		{
 		case 0x2c0b7d03: /* channel */
-			return ((session *)data)->channel;
+			return FIELD_CHANNELS_CHANNEL;
 		case 0x8cea5e7c: /* channelkey */
-			return ((session *)data)->channelkey;
+			return FIELD_CHANNELS_CHANNELKEY;
 		case 0x5716ab1e: /* chanmodes */
-			return ((session*)data)->server->chanmodes;
+			return FIELD_CHANNELS_CHANMODES;
 		case 0x577e0867: /* chantypes */
-			return ((session *)data)->server->chantypes;
+			return FIELD_CHANNELS_CHANTYPES;
 		case 0x38b735af: /* context */
-			return data;	/* this is a session * */
+			return FIELD_CHANNELS_CONTEXT;
+		case 0x5cfee87:	/* flags */
+			return FIELD_CHANNELS_FLAGS;
+		case 0xd1b:	/* id */
+			return FIELD_CHANNELS_ID;
+		case 0x1a192: /* lag */
+			return FIELD_CHANNELS_LAG;
+		case 0x1916144c: /* maxmodes */
+			return FIELD_CHANNELS_MAXMODES;
 		case 0x6de15a2e: /* network */
-			return server_get_network (((session *)data)->server, FALSE);
-		case 0x8455e723: /* nickprefixes */
-			return ((session *)data)->server->nick_prefixes;
+			return FIELD_CHANNELS_NETWORK;
 		case 0x829689ad: /* nickmodes */
-			return ((session *)data)->server->nick_modes;
+			return FIELD_CHANNELS_NICKMODES;
+		case 0x8455e723: /* nickprefixes */
+			return FIELD_CHANNELS_NICKPREFIXES;
+		case 0x66f1911: /* queue */
+			return FIELD_CHANNELS_QUEUE;
 		case 0xca022f43: /* server */
-			return ((session *)data)->server->servername;
+			return FIELD_CHANNELS_SERVER;
+		case 0x368f3a:	/* type */
+			return FIELD_CHANNELS_TYPE;
+		case 0x6a68e08: /* users */
+			return FIELD_CHANNELS_USERS;
 		}
 		break;
 
 	case LIST_DCC:
 		switch (hash)
 		{
+		case 0x34207553: /* address32 */
+			return FIELD_DCC_ADDRESS32;
+		case 0x181a6: /* cps */
+			return FIELD_DCC_CPS;
 		case 0x3d9ad31e:	/* destfile */
-			return ((struct DCC *)data)->destfile;
+			return FIELD_DCC_DESTFILE;
 		case 0x2ff57c:	/* file */
-			return ((struct DCC *)data)->file;
+			return FIELD_DCC_FILE;
 		case 0x339763: /* nick */
-			return ((struct DCC *)data)->nick;
+			return FIELD_DCC_NICK;
+		case 0x349881: /* port */
+			return FIELD_DCC_PORT;
+		case 0x1b254: /* pos */
+			return FIELD_DCC_POS;
+		case 0xe8a945f6: /* poshigh */
+			return FIELD_DCC_POSHIGH;
+		case 0xc84dc82d: /* resume */
+			return FIELD_DCC_RESUME;
+		case 0xded4c74f: /* resumehigh */
+			return FIELD_DCC_RESUMEHIGH;
+		case 0x35e001: /* size */
+			return FIELD_DCC_SIZE;
+		case 0x3284d523: /* sizehigh */
+			return FIELD_DCC_SIZEHIGH;
+		case 0xcacdcff2: /* status */
+			return FIELD_DCC_STATUS;
+		case 0x368f3a: /* type */
+			return FIELD_DCC_TYPE;
 		}
 		break;
 
 	case LIST_IGNORE:
 		switch (hash)
 		{
+		case 0x5cfee87:	/* flags */
+			return FIELD_IGNORE_FLAGS;
 		case 0x3306ec:	/* mask */
-			return ((struct ignore *)data)->mask;
+			return FIELD_IGNORE_MASK;
 		}
 		break;
 
 	case LIST_NOTIFY:
 		switch (hash)
 		{
+		case 0x5cfee87: /* flags */
+			return FIELD_NOTIFY_FLAGS;
 		case 0x4e49ec05:	/* networks */
-			return ((struct notify *)data)->networks;
+			return FIELD_NOTIFY_NETWORKS;
 		case 0x339763: /* nick */
-			return ((struct notify *)data)->name;
+			return FIELD_NOTIFY_NICK;
+		case 0x1ad6f:	/* off */
+			return FIELD_NOTIFY_OFF;
+		case 0xddf:	/* on */
+			return FIELD_NOTIFY_ON;
+		case 0x35ce7b:	/* seen */
+			return FIELD_NOTIFY_SEEN;
 		}
 		break;
 
@@ -1482,161 +1807,321 @@ hexchat_list_str (hexchat_plugin *ph, hexchat_list *xlist, const char *name)
 		switch (hash)
 		{
 		case 0xb9d38a2d: /* account */
-			return ((struct User *)data)->account;
-		case 0x339763: /* nick */
-			return ((struct User *)data)->nick;
+			return FIELD_USERS_ACCOUNT;
+		case 0x2de2ee:	/* away */
+			return FIELD_USERS_AWAY;
 		case 0x30f5a8: /* host */
-			return ((struct User *)data)->hostname;
+			return FIELD_USERS_HOST;
+		case 0xa9118c42:	/* lasttalk */
+			return FIELD_USERS_LASTTALK;
+		case 0x339763: /* nick */
+			return FIELD_USERS_NICK;
 		case 0xc594b292: /* prefix */
-			return ((struct User *)data)->prefix;
+			return FIELD_USERS_PREFIX;
 		case 0xccc6d529: /* realname */
-			return ((struct User *)data)->realname;
+			return FIELD_USERS_REALNAME;
+		case 0x4705f29b: /* selected */
+			return FIELD_USERS_SELECTED;
+		}
+		break;
+
+	case LIST_STATS:
+		switch (hash)
+		{
+		case 0x5a7510f: /* count */
+			return FIELD_STATS_COUNT;
+		case 0x1a564: /* max */
+			return FIELD_STATS_MAX;
+		case 0x337a8b: /* name */
+			return FIELD_STATS_NAME;
+		case 0x1ab0b: /* p50 */
+			return FIELD_STATS_P50;
+		case 0x1ab90: /* p99 */
+			return FIELD_STATS_P99;
+		case 0x1be4b: /* sum */
+			return FIELD_STATS_SUM;
+		case 0x36d984: /* unit */
+			return FIELD_STATS_UNIT;
 		}
 		break;
 	}
 
+	return -1;
+}
+
+static int
+list_field_type (int id)
+{
+	if (id < 0 || id >= FIELD_COUNT)
+		return -1;
+	if (id >= FIELD_STATS_COUNT)
+		return LIST_STATS;
+	if (id >= FIELD_USERS_ACCOUNT)
+		return LIST_USERS;
+	if (id >= FIELD_NOTIFY_FLAGS)
+		return LIST_NOTIFY;
+	if (id >= FIELD_IGNORE_FLAGS)
+		return LIST_IGNORE;
+	if (id >= FIELD_DCC_ADDRESS32)
+		return LIST_DCC;
+	return LIST_CHANNELS;
+}
+
+/* the current entry, or NULL if id does not belong to this list.
+   A NULL xlist is a shortcut to current "channels" context. */
+static gpointer
+list_field_data (hexchat_plugin *ph, hexchat_list *xlist, int id)
+{
+	int type = xlist ? xlist->type : LIST_CHANNELS;
+
+	if (list_field_type (id) != type)
+		return NULL;
+	if (!xlist)
+		return ph->context;
+	if (type == LIST_USERS)
+		return xlist->cursor.user;
+	return xlist->pos ? xlist->pos->data : NULL;
+}
+
+int
+hexchat_list_field_id (hexchat_plugin *ph, const char *list, const char *name)
+{
+	int type = list_type_from_name (list);
+
+	if (type == -1)
+		return -1;
+	return list_field_lookup (type, name);
+}
+
+time_t
+hexchat_list_time_id (hexchat_plugin *ph, hexchat_list *xlist, int id)
+{
+	gpointer data = list_field_data (ph, xlist, id);
+
+	if (!data)
+		return (time_t) -1;
+
+	switch (id)
+	{
+	case FIELD_NOTIFY_OFF:
+		return xlist->notifyps ? xlist->notifyps->lastoff : (time_t) -1;
+	case FIELD_NOTIFY_ON:
+		return xlist->notifyps ? xlist->notifyps->laston : (time_t) -1;
+	case FIELD_NOTIFY_SEEN:
+		return xlist->notifyps ? xlist->notifyps->lastseen : (time_t) -1;
+	case FIELD_USERS_LASTTALK:
+		return ((struct User *)data)->lasttalk;
+	}
+
+	return (time_t) -1;
+}
+
+const char *
+hexchat_list_str_id (hexchat_plugin *ph, hexchat_list *xlist, int id)
+{
+	gpointer data = list_field_data (ph, xlist, id);
+
+	if (!data)
+		return NULL;
+
+	switch (id)
+	{
+	case FIELD_CHANNELS_CHANNEL:
+		return ((session *)data)->channel;
+	case FIELD_CHANNELS_CHANNELKEY:
+		return ((session *)data)->channelkey;
+	case FIELD_CHANNELS_CHANMODES:
+		return ((session*)data)->server->chanmodes;
+	case FIELD_CHANNELS_CHANTYPES:
+		return ((session *)data)->server->chantypes;
+	case FIELD_CHANNELS_CONTEXT:
+		return data;	/* this is a session * */
+	case FIELD_CHANNELS_NETWORK:
+		return server_get_network (((session *)data)->server, FALSE);
+	case FIELD_CHANNELS_NICKPREFIXES:
+		return ((session *)data)->server->nick_prefixes;
+	case FIELD_CHANNELS_NICKMODES:
+		return ((session *)data)->server->nick_modes;
+	case FIELD_CHANNELS_SERVER:
+		return ((session *)data)->server->servername;
+
+	case FIELD_DCC_DESTFILE:
+		return ((struct DCC *)data)->destfile;
+	case FIELD_DCC_FILE:
+		return ((struct DCC *)data)->file;
+	case FIELD_DCC_NICK:
+		return ((struct DCC *)data)->nick;
+
+	case FIELD_IGNORE_MASK:
+		return ((struct ignore *)data)->mask;
+
+	case FIELD_NOTIFY_NETWORKS:
+		return ((struct notify *)data)->networks;
+	case FIELD_NOTIFY_NICK:
+		return ((struct notify *)data)->name;
+
+	case FIELD_USERS_ACCOUNT:
+		return ((struct User *)data)->info->account;
+	case FIELD_USERS_NICK:
+		return ((struct User *)data)->nick;
+	case FIELD_USERS_HOST:
+		return ((struct User *)data)->info->hostname;
+	case FIELD_USERS_PREFIX:
+		return ((struct User *)data)->prefix;
+	case FIELD_USERS_REALNAME:
+		return ((struct User *)data)->info->realname;
+
+	case FIELD_STATS_NAME:
+		return ((stats_row *)data)->name;
+	case FIELD_STATS_UNIT:
+		return ((stats_row *)data)->unit == PERF_UNIT_US ? "us" : "bytes";
+	}
+
 	return NULL;
 }
 
 int
-hexchat_list_int (hexchat_plugin *ph, hexchat_list *xlist, const char *name)
+hexchat_list_int_id (hexchat_plugin *ph, hexchat_list *xlist, int id)
 {
-	guint32 hash = str_hash (name);
-	gpointer data = ph->context;
+	gpointer data = list_field_data (ph, xlist, id);
 
 	int channel_flag;
 	int channel_flags[CHANNEL_FLAG_COUNT];
 	int channel_flags_used = 0;
 
-	int type = LIST_CHANNELS;
+	if (!data)
+		return -1;
 
-	/* a NULL xlist is a shortcut to current "channels" context */
-	if (xlist)
+	switch (id)
 	{
-		data = xlist->pos->data;
-		type = xlist->type;
-	}
-
-	switch (type)
+	case FIELD_DCC_ADDRESS32:
+		return ((struct DCC *)data)->addr;
+	case FIELD_DCC_CPS:
 	{
-	case LIST_DCC:
-		switch (hash)
+		gint64 cps = ((struct DCC *)data)->cps;
+		if (cps <= INT_MAX)
 		{
-		case 0x34207553: /* address32 */
-			return ((struct DCC *)data)->addr;
-		case 0x181a6: /* cps */
-		{
-			gint64 cps = ((struct DCC *)data)->cps;
-			if (cps <= INT_MAX)
-			{
-				return (int) cps;
-			}
-			return INT_MAX;
-		}
-		case 0x349881: /* port */
-			return ((struct DCC *)data)->port;
-		case 0x1b254: /* pos */
-			return ((struct DCC *)data)->pos & 0xffffffff;
-		case 0xe8a945f6: /* poshigh */
-			return (((struct DCC *)data)->pos >> 32) & 0xffffffff;
-		case 0xc84dc82d: /* resume */
-			return ((struct DCC *)data)->resumable & 0xffffffff;
-		case 0xded4c74f: /* resumehigh */
-			return (((struct DCC *)data)->resumable >> 32) & 0xffffffff;
-		case 0x35e001: /* size */
-			return ((struct DCC *)data)->size & 0xffffffff;
-		case 0x3284d523: /* sizehigh */
-			return (((struct DCC *)data)->size >> 32) & 0xffffffff;
-		case 0xcacdcff2: /* status */
-			return ((struct DCC *)data)->dccstat;
-		case 0x368f3a: /* type */
-			return ((struct DCC *)data)->type;
-		}
-		break;
-
-	case LIST_IGNORE:
-		switch (hash)
-		{
-		case 0x5cfee87:	/* flags */
-			return ((struct ignore *)data)->type;
+			return (int) cps;
 		}
-		break;
-
-	case LIST_CHANNELS:
-		switch (hash)
-		{
-		case 0xd1b:	/* id */
-			return ((struct session *)data)->server->id;
-		case 0x5cfee87:	/* flags */
-			channel_flags[0] = ((struct session *)data)->server->connected;
-			channel_flags[1] = ((struct session *)data)->server->connecting;
-			channel_flags[2] = ((struct session *)data)->server->is_away;
-			channel_flags[3] = ((struct session *)data)->server->end_of_motd;
-			channel_flags[4] = ((struct session *)data)->server->have_whox;
-			channel_flags[5] = ((struct session *)data)->server->have_idmsg;
-			channel_flags[6] = ((struct session *)data)->text_hidejoinpart;
-			channel_flags[7] = ((struct session *)data)->text_hidejoinpart == SET_DEFAULT;
-			channel_flags[8] = ((struct session *)data)->alert_beep;
-			channel_flags[9] = ((struct session *)data)->alert_beep == SET_DEFAULT;
-			channel_flags[10] = 0; /* unused for historical reasons */
-			channel_flags[11] = ((struct session *)data)->text_logging;
-			channel_flags[12] = ((struct session *)data)->text_logging == SET_DEFAULT;
-			channel_flags[13] = ((struct session *)data)->text_scrollback;
-			channel_flags[14] = ((struct session *)data)->text_scrollback == SET_DEFAULT;
-			channel_flags[15] = ((struct session *)data)->text_strip;
-			channel_flags[16] = ((struct session *)data)->text_strip == SET_DEFAULT;
-			channel_flags[17] = ((struct session *)data)->alert_tray;
-			channel_flags[18] = ((struct session *)data)->alert_tray == SET_DEFAULT;
-			channel_flags[19] = ((struct session *)data)->alert_taskbar;
-			channel_flags[20] = ((struct session *)data)->alert_taskbar == SET_DEFAULT;
-			channel_flags[21] = ((struct session *)data)->alert_balloon;
-			channel_flags[22] = ((struct session *)data)->alert_balloon == SET_DEFAULT;
-
-			/* Set flags */
-			for (channel_flag = 0; channel_flag < CHANNEL_FLAG_COUNT; ++channel_flag) {
-				if (channel_flags[channel_flag]) {
-					channel_flags_used |= 1 << channel_flag;
-				}
+		return INT_MAX;
+	}
+	case FIELD_DCC_PORT:
+		return ((struct DCC *)data)->port;
+	case FIELD_DCC_POS:
+		return ((struct DCC *)data)->pos & 0xffffffff;
+	case FIELD_DCC_POSHIGH:
+		return (((struct DCC *)data)->pos >> 32) & 0xffffffff;
+	case FIELD_DCC_RESUME:
+		return ((struct DCC *)data)->resumable & 0xffffffff;
+	case FIELD_DCC_RESUMEHIGH:
+		return (((struct DCC *)data)->resumable >> 32) & 0xffffffff;
+	case FIELD_DCC_SIZE:
+		return ((struct DCC *)data)->size & 0xffffffff;
+	case FIELD_DCC_SIZEHIGH:
+		return (((struct DCC *)data)->size >> 32) & 0xffffffff;
+	case FIELD_DCC_STATUS:
+		return ((struct DCC *)data)->dccstat;
+	case FIELD_DCC_TYPE:
+		return ((struct DCC *)data)->type;
+
+	case FIELD_IGNORE_FLAGS:
+		return ((struct ignore *)data)->type;
+
+	case FIELD_CHANNELS_ID:
+		return ((struct session *)data)->server->id;
+	case FIELD_CHANNELS_FLAGS:
+		channel_flags[0] = ((struct session *)data)->server->connected;
+		channel_flags[1] = ((struct session *)data)->server->connecting;
+		channel_flags[2] = ((struct session *)data)->server->is_away;
+		channel_flags[3] = ((struct session *)data)->server->end_of_motd;
+		channel_flags[4] = ((struct session *)data)->server->have_whox;
+		channel_flags[5] = ((struct session *)data)->server->have_idmsg;
+		channel_flags[6] = ((struct session *)data)->text_hidejoinpart;
+		channel_flags[7] = ((struct session *)data)->text_hidejoinpart == SET_DEFAULT;
+		channel_flags[8] = ((struct session *)data)->alert_beep;
+		channel_flags[9] = ((struct session *)data)->alert_beep == SET_DEFAULT;
+		channel_flags[10] = 0; /* unused for historical reasons */
+		channel_flags[11] = ((struct session *)data)->text_logging;
+		channel_flags[12] = ((struct session *)data)->text_logging == SET_DEFAULT;
+		channel_flags[13] = ((struct session *)data)->text_scrollback;
+		channel_flags[14] = ((struct session *)data)->text_scrollback == SET_DEFAULT;
+		channel_flags[15] = ((struct session *)data)->text_strip;
+		channel_flags[16] = ((struct session *)data)->text_strip == SET_DEFAULT;
+		channel_flags[17] = ((struct session *)data)->alert_tray;
+		channel_flags[18] = ((struct session *)data)->alert_tray == SET_DEFAULT;
+		channel_flags[19] = ((struct session *)data)->alert_taskbar;
+		channel_flags[20] = ((struct session *)data)->alert_taskbar == SET_DEFAULT;
+		channel_flags[21] = ((struct session *)data)->alert_balloon;
+		channel_flags[22] = ((struct session *)data)->alert_balloon == SET_DEFAULT;
+
+		/* Set flags */
+		for (channel_flag = 0; channel_flag < CHANNEL_FLAG_COUNT; ++channel_flag) {
+			if (channel_flags[channel_flag]) {
+				channel_flags_used |= 1 << channel_flag;
 			}
-
-			return channel_flags_used;
-		case 0x1a192: /* lag */
-			return ((struct session *)data)->server->lag;
-		case 0x1916144c: /* maxmodes */
-			return ((struct session *)data)->server->modes_per_line;
-		case 0x66f1911: /* queue */
-			return ((struct session *)data)->server->sendq_len;
-		case 0x368f3a:	/* type */
-			return ((struct session *)data)->type;
-		case 0x6a68e08: /* users */
-			return ((struct session *)data)->total;
 		}
-		break;
 
-	case LIST_NOTIFY:
+		return channel_flags_used;
+	case FIELD_CHANNELS_LAG:
+		return ((struct session *)data)->server->lag;
+	case FIELD_CHANNELS_MAXMODES:
+		return ((struct session *)data)->server->modes_per_line;
+	case FIELD_CHANNELS_QUEUE:
+		return ((struct session *)data)->server->sendq_len;
+	case FIELD_CHANNELS_TYPE:
+		return ((struct session *)data)->type;
+	case FIELD_CHANNELS_USERS:
+		return ((struct session *)data)->total;
+
+	case FIELD_NOTIFY_FLAGS:
 		if (!xlist->notifyps)
 			return -1;
-		switch (hash)
-		{
-		case 0x5cfee87: /* flags */
-			return xlist->notifyps->ison;
-		}
-
-	case LIST_USERS:
-		switch (hash)
-		{
-		case 0x2de2ee:	/* away */
-			return ((struct User *)data)->away;
-		case 0x4705f29b: /* selected */
-			return ((struct User *)data)->selected;
-		}
-		break;
-
+		return xlist->notifyps->ison;
+
+	case FIELD_USERS_AWAY:
+		return ((struct User *)data)->info->away;
+	case FIELD_USERS_SELECTED:
+		return ((struct User *)data)->selected;
+
+	case FIELD_STATS_COUNT:
+		return MIN (((stats_row *)data)->hist.count, INT_MAX);
+	case FIELD_STATS_MAX:
+		return MIN (((stats_row *)data)->hist.max, INT_MAX);
+	case FIELD_STATS_P50:
+		return MIN (perf_hist_percentile (&((stats_row *)data)->hist, 50), INT_MAX);
+	case FIELD_STATS_P99:
+		return MIN (perf_hist_percentile (&((stats_row *)data)->hist, 99), INT_MAX);
+	case FIELD_STATS_SUM:
+		return MIN (((stats_row *)data)->hist.sum, INT_MAX);
 	}
 
 	return -1;
 }
 
+time_t
+hexchat_list_time (hexchat_plugin *ph, hexchat_list *xlist, const char *name)
+{
+	if (!xlist)
+		return (time_t) -1;
+	return hexchat_list_time_id (ph, xlist, list_field_lookup (xlist->type, name));
+}
+
+const char *
+hexchat_list_str (hexchat_plugin *ph, hexchat_list *xlist, const char *name)
+{
+	int type = xlist ? xlist->type : LIST_CHANNELS;
+
+	return hexchat_list_str_id (ph, xlist, list_field_lookup (type, name));
+}
+
+int
+hexchat_list_int (hexchat_plugin *ph, hexchat_list *xlist, const char *name)
+{
+	int type = xlist ? xlist->type : LIST_CHANNELS;
+
+	return hexchat_list_int_id (ph, xlist, list_field_lookup (type, name));
+}
+
 void *
 hexchat_plugingui_add (hexchat_plugin *ph, const char *filename,
 							const char *name, const char *desc,
@@ -1742,144 +2227,45 @@ hexchat_free (hexchat_plugin *ph, void *ptr)
 	g_free (ptr);
 }
 
-static int
-hexchat_pluginpref_set_str_real (hexchat_plugin *pl, const char *var, const char *value, int mode) /* mode: 0 = delete, 1 = save */
+/* the parsed addon_<name>.conf of a plugin, see cfgfile_open() */
+
+static cfgfile *
+pluginpref_file (hexchat_plugin *pl)
 {
-	FILE *fpIn;
-	int fhOut;
-	int prevSetting;
-	char *confname;
-	char *confname_tmp;
-	char *escaped_value;
-	char *buffer;
-	char *buffer_tmp;
-	char line_buffer[512];		/* the same as in cfg_put_str */
-	char *line_bufp = line_buffer;
-	char *canon;
+	cfgfile *file;
+	char *canon, *confname, *filename;
 
 	canon = g_strdup (pl->name);
 	canonalize_key (canon);
 	confname = g_strdup_printf ("addon_%s.conf", canon);
+	filename = g_build_filename (get_xdir (), confname, NULL);
+
+	file = cfgfile_open (filename);
+
+	g_free (filename);
+	g_free (confname);
 	g_free (canon);
-	confname_tmp = g_strdup_printf ("%s.new", confname);
+	return file;
+}
 
-	fhOut = hexchat_open_file (confname_tmp, O_TRUNC | O_WRONLY | O_CREAT, 0600, XOF_DOMODE);
-	fpIn = hexchat_fopen_file (confname, "r", 0);
+static int
+hexchat_pluginpref_set_str_real (hexchat_plugin *pl, const char *var, const char *value, int mode) /* mode: 0 = delete, 1 = save */
+{
+	char *escaped_value;
+	gboolean ok;
 
-	if (fhOut == -1)		/* unable to save, abort */
+	if (mode)
 	{
-		g_free (confname);
-		g_free (confname_tmp);
-		if (fpIn)
-			fclose (fpIn);
-		return 0;
+		escaped_value = g_strescape (value, NULL);
+		ok = cfgfile_set (pluginpref_file (pl), var, escaped_value);
+		g_free (escaped_value);
 	}
-	else if (fpIn == NULL)	/* no previous config file, no parsing */
+	else
 	{
-		if (mode)
-		{
-			escaped_value = g_strescape (value, NULL);
-			buffer = g_strdup_printf ("%s = %s\n", var, escaped_value);
-			g_free (escaped_value);
-			if (write (fhOut, buffer, strlen (buffer)) < 0)
-				g_warning ("Failed to write plugin config");
-			g_free (buffer);
-			close (fhOut);
-
-			buffer = g_build_filename (get_xdir (), confname, NULL);
-			g_free (confname);
-			buffer_tmp = g_build_filename (get_xdir (), confname_tmp, NULL);
-			g_free (confname_tmp);
-
-			if (g_rename (buffer_tmp, buffer) == 0)
-			{
-				g_free (buffer);
-				g_free (buffer_tmp);
-				return 1;
-			}
-			else
-			{
-				g_free (buffer);
-				g_free (buffer_tmp);
-				return 0;
-			}
-		}
-		else
-		{
-			/* mode = 0, we want to delete but the config file and thus the given setting does not exist, we're ready */
-			close (fhOut);
-			g_free (confname);
-			g_free (confname_tmp);
-			return 1;
-		}
+		ok = cfgfile_set (pluginpref_file (pl), var, NULL);
 	}
-	else	/* existing config file, preserve settings and find & replace current var value if any */
-	{
-		prevSetting = 0;
 
-		while (fscanf (fpIn, " %511[^\n]", line_bufp) != EOF)	/* read whole lines including whitespaces */
-		{
-			buffer_tmp = g_strdup_printf ("%s ", var);	/* add one space, this way it works against var - var2 checks too */
-
-			if (strncmp (buffer_tmp, line_buffer, strlen (var) + 1) == 0)	/* given setting already exists */
-			{
-				if (mode)									/* overwrite the existing matching setting if we are in save mode */
-				{
-					escaped_value = g_strescape (value, NULL);
-					buffer = g_strdup_printf ("%s = %s\n", var, escaped_value);
-					g_free (escaped_value);
-				}
-				else										/* erase the setting in delete mode */
-				{
-					buffer = g_strdup ("");
-				}
-
-				prevSetting = 1;
-			}
-			else
-			{
-				buffer = g_strdup_printf ("%s\n", line_buffer);	/* preserve the existing different settings */
-			}
-
-			if (write (fhOut, buffer, strlen (buffer)) < 0)
-				g_warning ("Failed to write plugin config");
-
-			g_free (buffer);
-			g_free (buffer_tmp);
-		}
-
-		fclose (fpIn);
-
-		if (!prevSetting && mode)	/* var doesn't exist currently, append if we're in save mode */
-		{
-			escaped_value = g_strescape (value, NULL);
-			buffer = g_strdup_printf ("%s = %s\n", var, escaped_value);
-			g_free (escaped_value);
-			if (write (fhOut, buffer, strlen (buffer)) < 0)
-				g_warning ("Failed to write plugin config");
-			g_free (buffer);
-		}
-
-		close (fhOut);
-
-		buffer = g_build_filename (get_xdir (), confname, NULL);
-		g_free (confname);
-		buffer_tmp = g_build_filename (get_xdir (), confname_tmp, NULL);
-		g_free (confname_tmp);
-
-		if (g_rename (buffer_tmp, buffer) == 0)
-		{
-			g_free (buffer);
-			g_free (buffer_tmp);
-			return 1;
-		}
-		else
-		{
-			g_free (buffer);
-			g_free (buffer_tmp);
-			return 0;
-		}
-	}
+	return ok ? 1 : 0;
 }
 
 int
@@ -1891,32 +2277,17 @@ hexchat_pluginpref_set_str (hexchat_plugin *pl, const char *var, const char *val
 static int
 hexchat_pluginpref_get_str_real (hexchat_plugin *pl, const char *var, char *dest, int dest_len)
 {
-	char *confname, *canon, *cfg, *unescaped_value;
-	char buf[512];
-
-	canon = g_strdup (pl->name);
-	canonalize_key (canon);
-	confname = g_strdup_printf ("%s%caddon_%s.conf", get_xdir(), G_DIR_SEPARATOR, canon);
-	g_free (canon);
+	const char *value;
+	char *unescaped_value;
 
-	if (!g_file_get_contents (confname, &cfg, NULL, NULL))
-	{
-		g_free (confname);
+	value = cfgfile_lookup (pluginpref_file (pl), var);
+	if (!value)
 		return 0;
-	}
-	g_free (confname);
 
-	if (!cfg_get_str (cfg, var, buf, sizeof(buf)))
-	{
-		g_free (cfg);
-		return 0;
-	}
-
-	unescaped_value = g_strcompress (buf);
+	unescaped_value = g_strcompress (value);
 	g_strlcpy (dest, unescaped_value, dest_len);
 
 	g_free (unescaped_value);
-	g_free (cfg);
 	return 1;
 }
 
@@ -1966,34 +2337,18 @@ hexchat_pluginpref_delete (hexchat_plugin *pl, const char *var)
 int
 hexchat_pluginpref_list (hexchat_plugin *pl, char* dest)
 {
-	FILE *fpIn;
-	char confname[64];
-	char buffer[512];										/* the same as in cfg_put_str */
-	char *bufp = buffer;
-	char *token;
+	cfgfile *file;
+	guint i;
 
-	token = g_strdup (pl->name);
-	canonalize_key (token);
-	g_snprintf (confname, sizeof (confname), "addon_%s.conf", token);
-	g_free (token);
-
-	fpIn = hexchat_fopen_file (confname, "r", 0);
-
-	if (fpIn == NULL)										/* no existing config file, no parsing */
-	{
+	file = pluginpref_file (pl);
+	if (file->size < 0 && file->names->len == 0)		/* no existing config file */
 		return 0;
-	}
-	else													/* existing config file, get list of settings */
-	{
-		dest[0] = '\0';									/* clean up garbage */
-		while (fscanf (fpIn, " %511[^\n]", bufp) != EOF)	/* read whole lines including whitespaces */
-		{
-			token = strtok (buffer, "=");
-			g_strlcat (dest, g_strchomp (token), 4096); /* Dest must not be smaller than this */
-			g_strlcat (dest, ",", 4096);
-		}
 
-		fclose (fpIn);
+	dest[0] = '\0';
+	for (i = 0; i < file->names->len; i++)
+	{
+		g_strlcat (dest, file->names->pdata[i], 4096); /* Dest must not be smaller than this */
+		g_strlcat (dest, ",", 4096);
 	}
 
 	return 1;
@@ -20,6 +20,8 @@
 #ifndef HEXCHAT_COMMONPLUGIN_H
 #define HEXCHAT_COMMONPLUGIN_H
 
+#include "perf.h"
+
 #ifdef PLUGIN_C
 struct _hexchat_plugin
 {
@@ -149,6 +151,22 @@ struct _hexchat_plugin
 	hexchat_event_attrs *(*hexchat_event_attrs_create) (hexchat_plugin *ph);
 	void (*hexchat_event_attrs_free) (hexchat_plugin *ph,
 									  hexchat_event_attrs *attrs);
+	int (*hexchat_list_field_id) (hexchat_plugin *ph,
+		const char *list,
+		const char *name);
+	const char * (*hexchat_list_str_id) (hexchat_plugin *ph,
+		hexchat_list *xlist,
+		int id);
+	int (*hexchat_list_int_id) (hexchat_plugin *ph,
+		hexchat_list *xlist,
+		int id);
+	time_t (*hexchat_list_time_id) (hexchat_plugin *ph,
+		hexchat_list *xlist,
+		int id);
+	int (*hexchat_command_batch) (hexchat_plugin *ph,
+		const char * const *commands,
+		int count,
+		int flags);
 
 	/* PRIVATE FIELDS! */
 	void *handle;		/* from dlopen */
@@ -160,6 +178,7 @@ struct _hexchat_plugin
 	void *deinit_callback;	/* pointer to hexchat_plugin_deinit */
 	unsigned int fake:1;		/* fake plugin. Added by hexchat_plugingui_add() */
 	unsigned int free_strings:1;		/* free name,desc,version? */
+	perf_hist hook_time;	/* all of its hook callbacks, us */
 };
 #endif
 
@@ -171,6 +190,9 @@ int plugin_kill (char *name, int by_filename);
 void plugin_kill_all (void);
 void plugin_auto_load (session *sess);
 int plugin_emit_command (session *sess, char *name, char *word[], char *word_eol[]);
+int plugin_command_hooked (const char *name);
+void plugin_perf_foreach (perf_row_func *func, gpointer userdata);
+void plugin_perf_reset (void);
 int plugin_emit_server (session *sess, char *name, char *word[], char *word_eol[],
 						time_t server_time);
 int plugin_emit_print (session *sess, char *word[], time_t server_time);
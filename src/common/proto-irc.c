@@ -42,6 +42,9 @@
 #include "hexchatc.h"
 #include "url.h"
 #include "servlist.h"
+#include "netsplit.h"
+#include "batch.h"
+#include "chathistory.h"
 
 static void
 irc_login (server *serv, char *user, char *realname)
@@ -328,11 +331,13 @@ irc_userhost (server *serv, char *nick)
 	tcp_sendf (serv, "USERHOST %s\r\n", nick);
 }
 
+/* only the away flags are wanted here, so a WHOX reply carries nothing
+   else (153) */
 static void
 irc_away_status (server *serv, char *channel)
 {
 	if (serv->have_whox)
-		tcp_sendf (serv, "WHO %s %%chtsunfra,152\r\n", channel);
+		tcp_sendf (serv, "WHO %s %%tcnf,153\r\n", channel);
 	else
 		tcp_sendf (serv, "WHO %s\r\n", channel);
 }
@@ -426,6 +431,10 @@ irc_raw (server *serv, char *raw)
 	char tbuf[4096];
 	if (*raw)
 	{
+		/* one without nicks only gets a 461, not a 303 */
+		if (g_ascii_strncasecmp (raw, "ISON ", 5) == 0 && raw[5 + strspn (raw + 5, " ")])
+			notify_ison_outgoing (serv);
+
 		len = strlen (raw);
 		if (len < sizeof (tbuf) - 3)
 		{
@@ -540,8 +549,8 @@ process_numeric (session * sess, int n,
 		else goto def;
 
 	case 303:
-		word[4]++;
-		notify_markonline (serv, word, tags_data);
+		notify_markonline (serv, word_eol[4][0] == ':' ? word_eol[4] + 1 : word_eol[4],
+								 tags_data);
 		break;
 
 	case 305:
@@ -750,7 +759,7 @@ process_numeric (session * sess, int n,
 			unsigned int away = 0;
 			session *who_sess;
 
-			/* irc_away_status and irc_user_list sends out a "152" */
+			/* irc_user_list sends out a "152", irc_away_status a "153" */
 			if (!strcmp (word[4], "152"))
 			{
 				who_sess = find_channel (serv, word[5]);
@@ -768,6 +777,21 @@ process_numeric (session * sess, int n,
 					EMIT_SIGNAL_TIMESTAMP (XP_TE_SERVTEXT, serv->server_session, text,
 												  word[1], word[2], NULL, 0,
 												  tags_data->timestamp);
+			} else if (!strcmp (word[4], "153"))
+			{
+				/* :server 354 yournick 153 #channel nick H */
+				who_sess = find_channel (serv, word[5]);
+
+				if (*word[7] == 'G')
+					away = 1;
+
+				inbound_user_info (sess, word[5], NULL, NULL, NULL, word[6], NULL,
+										 NULL, away, tags_data);
+
+				if (!who_sess || !who_sess->doing_who)
+					EMIT_SIGNAL_TIMESTAMP (XP_TE_SERVTEXT, serv->server_session, text,
+												  word[1], word[2], NULL, 0,
+												  tags_data->timestamp);
 			} else
 				goto def;
 		}
@@ -947,6 +971,10 @@ process_numeric (session * sess, int n,
 		notify_set_offline_list (serv, word[4] + 1, FALSE, tags_data);
 		break;
 
+	case 734: /* ERR_MONLISTFULL */
+		notify_monitor_full (serv, atoi (word[4]), word[5]);
+		break;
+
 	case 900:	/* successful SASL 'logged in as ' */
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_SERVTEXT, serv->server_session, 
 									  word_eol[6]+1, word[1], word[2], NULL, 0,
@@ -1144,6 +1172,8 @@ process_named_msg (session *sess, char *type, char *word[], char *word_eol[],
 
 		case WORDL('F','A','I','L'):
 			text = STRIP_COLON(word, word_eol, trailing_index(word_eol));
+			if (g_ascii_strcasecmp (word[3], "CHATHISTORY") == 0)
+				chathistory_failed (serv);
 			if (g_strcmp0(word[3], "*") == 0)
 			{
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_FAIL, sess, word[4], text, NULL, NULL, NULL, tags_data->timestamp);
@@ -1192,6 +1222,10 @@ process_named_msg (session *sess, char *type, char *word[], char *word_eol[],
 			inbound_account (serv, nick, STRIP_COLON(word, word_eol, 3), tags_data);
 			return;
 
+		case WORDL('B','A','T','C'):
+			batch_command (serv, word[3], word[4], word_eol[5]);
+			return;
+
 		case WORDL('A', 'U', 'T', 'H'):
 			inbound_sasl_authenticate (sess->server, word_eol[3]);
 			return;
@@ -1206,6 +1240,10 @@ process_named_msg (session *sess, char *type, char *word[], char *word_eol[],
 							   NULL, 0xff, tags_data);
 			return;
 
+		case WORDL('T','A','G','M'):
+			/* message-tags only messages (typing etc.), nothing to show */
+			return;
+
 		case WORDL('I','N','V','I'):
 			if (ignore_check (word[1], IG_INVI))
 				return;
@@ -1404,6 +1442,8 @@ process_named_servermsg (session *sess, char *buf, char *rawname, char *word_eol
 	}
 	if (!strncmp (buf, "ERROR", 5))
 	{
+		if (strstr (buf, "Excess Flood") || strstr (buf, "Max SendQ exceeded"))
+			server_throttle_flooded (sess->server);
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_SERVERERROR, sess, buf + 7, NULL, NULL, NULL,
 									  0, tags_data->timestamp);
 		return;
@@ -1510,6 +1550,34 @@ handle_message_tag_time (const char *time, message_tags_data *tags_data)
 	}
 }
 
+/* undo the tag value escaping (\: \s \\ \r \n) in place */
+static void
+message_tag_unescape (char *value)
+{
+	char *out = value;
+
+	for (; *value; value++)
+	{
+		if (*value != '\\')
+		{
+			*out++ = *value;
+			continue;
+		}
+
+		value++;
+		switch (*value)
+		{
+		case ':': *out++ = ';'; break;
+		case 's': *out++ = ' '; break;
+		case 'r': *out++ = '\r'; break;
+		case 'n': *out++ = '\n'; break;
+		case '\0': value--; break;	/* a lone trailing backslash is dropped */
+		default: *out++ = *value; break;
+		}
+	}
+	*out = 0;
+}
+
 /* Handle message tags.
  *
  * See http://ircv3.atheme.org/specification/message-tags-3.2 
@@ -1545,6 +1613,13 @@ handle_message_tags (server *serv, const char *tags_str,
 
 		if (serv->have_server_time && !strcmp (key, "time"))
 			handle_message_tag_time (value, tags_data);
+
+		if (!strcmp (key, "msgid") && *value)
+		{
+			message_tag_unescape (value);
+			g_free (tags_data->msgid);
+			tags_data->msgid = g_strdup (value);
+		}
 	}
 	
 	g_strfreev (tags);
@@ -1561,6 +1636,10 @@ irc_inline (server *serv, char *buf, int len)
 	char *pdibuf;
 	message_tags_data tags_data = MESSAGE_TAGS_DATA_INIT;
 
+	/* lines of an open IRCv3 batch wait for its end */
+	if (batch_hold (serv, buf, len))
+		return;
+
 	pdibuf = g_malloc (len + 1);
 
 	sess = serv->front_session;
@@ -1588,6 +1667,9 @@ irc_inline (server *serv, char *buf, int len)
 	/* split line into words and words_to_end_of_line */
 	process_data_init (pdibuf, buf, word, word_eol, FALSE, FALSE);
 
+	/* finish a netsplit/netjoin batch unless this line continues it */
+	netsplit_line (serv, buf[0] == ':' ? word[2] : word[1]);
+
 	if (buf[0] == ':')
 	{
 		/* find a context for this message */
@@ -1644,10 +1726,27 @@ xit:
 	g_free (pdibuf);
 }
 
+/* the tags of a raw line, for code that looks at lines before irc_inline */
+void
+message_tags_data_from_line (server *serv, const char *line,
+									  message_tags_data *tags_data)
+{
+	const char *sep;
+	char *tags;
+
+	if (*line != '@' || !(sep = strchr (line, ' ')))
+		return;
+
+	tags = g_strndup (line + 1, sep - line - 1);
+	handle_message_tags (serv, tags, tags_data);
+	g_free (tags);
+}
+
 void
 message_tags_data_free (message_tags_data *tags_data)
 {
 	g_clear_pointer (&tags_data->account, g_free);
+	g_clear_pointer (&tags_data->msgid, g_free);
 }
 
 void
@@ -1686,4 +1785,5 @@ proto_fill_her_up (server *serv)
 	serv->p_ping = irc_ping;
 	serv->p_raw = irc_raw;
 	serv->p_cmp = rfc_casecmp;	/* can be changed by 005 in modes.c */
+	serv->p_casemap = rfc_tolowertab;
 }
@@ -28,6 +28,7 @@
 		NULL, /* account name */		\
 		FALSE, /* identified to nick */ \
 		(time_t)0, /* timestamp */		\
+		NULL, /* msgid */				\
 	}
 
 #define STRIP_COLON(word, word_eol, idx) (word)[(idx)][0] == ':' ? (word_eol)[(idx)]+1 : (word)[(idx)]
@@ -41,8 +42,11 @@ typedef struct
 	char *account;
 	gboolean identified;
 	time_t timestamp;
+	char *msgid;
 } message_tags_data;
 
+void message_tags_data_from_line (server *serv, const char *line,
+											 message_tags_data *tags_data);
 void message_tags_data_free (message_tags_data *tags_data);
 
 void proto_fill_her_up (server *serv);
@@ -31,8 +31,6 @@
 #define WANTARPA
 #include "inet.h"
 
-#include <signal.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
 #include "hexchat.h"
@@ -49,6 +47,11 @@
 #include "proto-irc.h"
 #include "servlist.h"
 #include "server.h"
+#include "perf.h"
+#include "stall.h"
+#include "netsplit.h"
+#include "batch.h"
+#include "joinsched.h"
 
 #ifdef USE_OPENSSL
 #include <openssl/ssl.h>		  /* SSL_() */
@@ -64,11 +67,29 @@ static struct session *g_sess = NULL;
 static GSList *away_list = NULL;
 GSList *serv_list = NULL;
 
+/* an in-flight async connection attempt. It is owned by the pending GIO
+   operation, which frees it on completion; server_stopconnecting() only
+   cancels it, after which the callbacks must not touch ->serv again. */
+
+typedef struct connect_attempt
+{
+	server *serv;
+	GCancellable *cancellable;
+	GSocketClient *client;
+	char *connect_host;		/* where the TCP connection goes: server or proxy */
+	int connect_port;
+	gboolean wingate;			/* proxy type GIO doesn't speak, handled by hand */
+} connect_attempt;
+
+static GQueue connect_queue = G_QUEUE_INIT;	/* servers waiting for a connect slot */
+static int connects_running = 0;
+
 static void auto_reconnect (server *serv, int send_quit, int err);
 static gboolean should_auto_reconnect_on_fail (void);
 static void server_disconnect (session * sess, int sendquit, int err);
 static int server_cleanup (server * serv);
 static void server_connect (server *serv, char *hostname, int port, int no_login);
+static void server_connect_next (void);
 
 static void
 write_error (char *message, GError **error)
@@ -113,22 +134,88 @@ server_send_real (server *serv, char *buf, int len)
 	return tcp_send_real (serv->ssl, serv->sok, serv->write_converter, buf, len);
 }
 
-/* new throttling system, uses the same method as the Undernet
-   ircu2.10 server; under test, a 200-line paste didn't flood
-   off the client */
+/* token bucket flood control. The bucket holds up to burst * refill ms of
+   send time and refills in real time; each line costs one refill period plus
+   a share for its size. The defaults reproduce the old ircu2.10 throttle
+   (2 seconds + 1 per 120 bytes, within a 10 second window). */
+
+static int
+throttle_cost (throttleprofile *prof, int len)
+{
+	int cost = prof->refill;
+
+	if (prof->bytes)
+		cost += (int) ((gint64) len * prof->refill / prof->bytes);
+
+	return cost;
+}
+
+static gint64
+throttle_tokens_now (server *serv, throttleprofile *prof, gint64 now)
+{
+	gint64 full = (gint64) prof->burst * prof->refill;
+	gint64 tokens = serv->throttle_tokens + (now - serv->throttle_stamp);
+
+	return MIN (tokens, full);
+}
+
+/* how long until everything queued now has been sent, in ms */
+
+int
+server_throttle_drain (server *serv)
+{
+	throttleprofile prof;
+	gint64 need;
+
+	if (!serv->sendq_lines)
+		return 0;
+
+	servlist_throttle_get (serv->network, &prof);
+	need = (gint64) serv->sendq_lines * prof.refill;
+	if (prof.bytes)
+		need += (gint64) serv->sendq_len * prof.refill / prof.bytes;
+	need -= throttle_tokens_now (serv, &prof, g_get_monotonic_time () / 1000);
+
+	return (int) CLAMP (need, 0, G_MAXINT);
+}
+
+/* the server closed the link with "Excess Flood": slow this network down */
+
+void
+server_throttle_flooded (server *serv)
+{
+	throttleprofile prof;
+
+	if (!prefs.hex_net_throttle || !serv->network)
+		return;
+
+	if (servlist_throttle_flooded (serv->network))
+	{
+		servlist_throttle_get (serv->network, &prof);
+		PrintTextf (serv->server_session,
+						_("Flood control for %s tightened to %d lines, one every %d ms.\n"),
+						((ircnet *)serv->network)->name, prof.burst, prof.refill);
+	}
+}
 
 static int
 tcp_send_queue (server *serv)
 {
-	char *buf, *p;
-	int len, i, pri;
+	char *buf;
+	int len, pri;
 	GSList *list;
-	time_t now = time (0);
+	throttleprofile prof;
+	gint64 now;
 
 	/* did the server close since the timeout was added? */
 	if (!is_server (serv))
 		return 0;
 
+	servlist_throttle_get (serv->network, &prof);
+	now = g_get_monotonic_time () / 1000;
+	serv->throttle_tokens = throttle_tokens_now (serv, &prof, now);
+	serv->throttle_stamp = now;
+
 	/* try priority 2,1,0 */
 	pri = 2;
 	while (pri >= 0)
@@ -139,24 +226,17 @@ tcp_send_queue (server *serv)
 			buf = (char *) list->data;
 			if (buf[0] == pri)
 			{
+				/* bucket is empty, wait for the timeout to refill it. Lines
+				   may overdraw it, so one bigger than the bucket still goes. */
+				if (serv->throttle_tokens <= 0)
+					return 1;		  /* don't remove the timeout handler */
+
 				buf++;	/* skip the priority byte */
 				len = strlen (buf);
 
-				if (serv->next_send < now)
-					serv->next_send = now;
-				if (serv->next_send - now >= 10)
-				{
-					/* check for clock skew */
-					if (now >= serv->prev_now)
-						return 1;		  /* don't remove the timeout handler */
-					/* it is skewed, reset to something sane */
-					serv->next_send = now;
-				}
-
-				for (p = buf, i = len; i && *p != ' '; p++, i--);
-				serv->next_send += (2 + i / 120);
+				serv->throttle_tokens -= throttle_cost (&prof, len);
 				serv->sendq_len -= len;
-				serv->prev_now = now;
+				serv->sendq_lines--;
 				fe_set_throttle (serv);
 
 				server_send_real (serv, buf, len);
@@ -231,6 +311,8 @@ keep_priority:
 
 	serv->outbound_queue = g_slist_append (serv->outbound_queue, dbuf);
 	serv->sendq_len += len; /* tcp_send_queue uses strlen */
+	serv->sendq_lines++;
+	perf_count_sendq (serv->sendq_len);
 
 	if (tcp_send_queue (serv) && noqueue)
 		fe_timeout_add (500, tcp_send_queue, serv);
@@ -285,8 +367,12 @@ server_inline (server *serv, char *line, gssize len)
 
 	fe_add_rawlog (serv, line, len_utf8, FALSE);
 
+	perf_count_line (len_utf8);
+
 	/* let proto-irc.c handle it */
+	perf_stage_enter (PERF_PARSE);
 	serv->p_inline (serv, line, len_utf8);
+	perf_stage_leave ();
 
 	g_free (line);
 }
@@ -367,7 +453,10 @@ server_read (GIOChannel *source, GIOCondition condition, server *serv)
 		i = 0;
 
 		lbuf[len] = 0;
+		perf_count_read (len);
 
+		perf_stage_enter (PERF_FRAMING);
+		stall_region_push ("server_read", serv->servername, NULL);
 		while (i < len)
 		{
 			switch (lbuf[i])
@@ -391,6 +480,8 @@ server_read (GIOChannel *source, GIOCondition condition, server *serv)
 			}
 			i++;
 		}
+		stall_region_pop ();
+		perf_stage_leave ();
 	}
 }
 
@@ -401,6 +492,7 @@ server_connected (server * serv)
 	serv->ping_recv = time (0);
 	serv->lag_sent = 0;
 	serv->connected = TRUE;
+	hexchat_reinit_timers ();	/* they stop while nothing is connected */
 	set_nonblocking (serv->sok);
 	serv->iotag = fe_input_add (serv->sok, FIA_READ|FIA_EX, server_read, serv);
 	if (!serv->no_login)
@@ -447,12 +539,17 @@ server_stopconnecting (server * serv)
 		serv->joindelay_tag = 0;
 	}
 
-	/* kill the child process trying to connect */
-	kill (serv->childpid, SIGKILL);
-	waitpid (serv->childpid, NULL, 0);
+	/* abandon the connection attempt, or give up our place in the queue */
+	if (serv->connect_attempt)
+	{
+		connect_attempt *att = serv->connect_attempt;
 
-	close (serv->childwrite);
-	close (serv->childread);
+		g_cancellable_cancel (att->cancellable);
+		serv->connect_attempt = NULL;
+		server_connect_next ();
+	}
+	else
+		g_queue_remove (&connect_queue, serv);
 
 #ifdef USE_OPENSSL
 	if (serv->ssl_do_connect_tag)
@@ -756,6 +853,7 @@ server_flush_queue (server *serv)
 {
 	list_free (&serv->outbound_queue);
 	serv->sendq_len = 0;
+	serv->sendq_lines = 0;
 	fe_set_throttle (serv);
 }
 
@@ -795,125 +893,148 @@ server_connect_success (server *serv)
 	server_connected (serv);
 }
 
-/* receive info from the child-process about connection progress */
+static void
+connect_attempt_free (connect_attempt *att)
+{
+	g_object_unref (att->cancellable);
+	g_object_unref (att->client);
+	g_free (att->connect_host);
+	g_free (att);
+}
+
+/* progress reports from GSocketClient */
 
-static gboolean
-server_read_child (GIOChannel *source, GIOCondition condition, server *serv)
+static void
+server_connect_event (GSocketClient *client, GSocketClientEvent event,
+							 GSocketConnectable *connectable, GIOStream *connection,
+							 connect_attempt *att)
 {
-	session *sess = serv->server_session;
-	char tbuf[128];
-	char outbuf[512];
-	char host[100];
-	char ip[100];
+	GInetSocketAddress *addr;
+	char *ip;
+	char port[8];
 
-	waitline2 (source, tbuf, sizeof tbuf);
+	if (g_cancellable_is_cancelled (att->cancellable))
+		return;
 
-	switch (tbuf[0])
+	switch (event)
 	{
-	case '0':	/* print some text */
-		waitline2 (source, tbuf, sizeof tbuf);
-		PrintText (serv->server_session, tbuf);
-		break;
-	case '1':						  /* unknown host */
-		server_stopconnecting (serv);
-		closesocket (serv->sok4);
-		if (serv->proxy_sok4 != -1)
-			closesocket (serv->proxy_sok4);
-		if (serv->sok6 != -1)
-			closesocket (serv->sok6);
-		if (serv->proxy_sok6 != -1)
-			closesocket (serv->proxy_sok6);
-		EMIT_SIGNAL (XP_TE_UKNHOST, sess, NULL, NULL, NULL, NULL, 0);
-		if (!servlist_cycle (serv))
-			if (should_auto_reconnect_on_fail ())
-				auto_reconnect (serv, FALSE, -1);
+	case G_SOCKET_CLIENT_CONNECTING:
+		/* with Happy Eyeballs this fires once per address family raced */
+		if (!G_IS_INET_SOCKET_ADDRESS (connectable))
+			break;
+		addr = G_INET_SOCKET_ADDRESS (connectable);
+		ip = g_inet_address_to_string (g_inet_socket_address_get_address (addr));
+		g_snprintf (port, sizeof (port), "%d", g_inet_socket_address_get_port (addr));
+		EMIT_SIGNAL (XP_TE_CONNECT, att->serv->server_session, att->connect_host,
+						 ip, port, NULL, 0);
+		g_free (ip);
 		break;
-	case '2':						  /* connection failed */
-		waitline2 (source, tbuf, sizeof tbuf);
-		server_stopconnecting (serv);
-		closesocket (serv->sok4);
-		if (serv->proxy_sok4 != -1)
-			closesocket (serv->proxy_sok4);
-		if (serv->sok6 != -1)
-			closesocket (serv->sok6);
-		if (serv->proxy_sok6 != -1)
-			closesocket (serv->proxy_sok6);
-		EMIT_SIGNAL (XP_TE_CONNFAIL, sess, errorstring (atoi (tbuf)), NULL,
-						 NULL, NULL, 0);
-		if (!servlist_cycle (serv))
-			if (should_auto_reconnect_on_fail ())
-				auto_reconnect (serv, FALSE, -1);
+	case G_SOCKET_CLIENT_PROXY_NEGOTIATING:
+		PrintText (att->serv->server_session, _("Negotiating with proxy...\n"));
 		break;
-	case '3':						  /* gethostbyname finished */
-		waitline2 (source, host, sizeof host);
-		waitline2 (source, ip, sizeof ip);
-		waitline2 (source, outbuf, sizeof outbuf);
-		EMIT_SIGNAL (XP_TE_CONNECT, sess, host, ip, outbuf, NULL, 0);
+	default:
 		break;
-	case '4':						  /* success */
-		waitline2 (source, tbuf, sizeof (tbuf));
-		serv->sok = atoi (tbuf);
-		/* close the one we didn't end up using */
-		if (serv->sok == serv->sok4)
-			closesocket (serv->sok6);
-		else
-			closesocket (serv->sok4);
-		if (serv->proxy_sok != -1)
-		{
-			if (serv->proxy_sok == serv->proxy_sok4)
-				closesocket (serv->proxy_sok6);
-			else
-				closesocket (serv->proxy_sok4);
-		}
-
-		{
-			struct sockaddr_storage addr;
-			int addr_len = sizeof (addr);
-			guint16 port;
-			ircnet *net = serv->network;
-
-			if (!getsockname (serv->sok, (struct sockaddr *)&addr, &addr_len))
-			{
-				if (addr.ss_family == AF_INET)
-					port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
-				else
-					port = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+	}
+}
 
-				g_snprintf (outbuf, sizeof (outbuf), "IDENTD %"G_GUINT16_FORMAT" ", port);
-				if (net && net->user && !(net->flags & FLAG_USE_GLOBAL))
-					g_strlcat (outbuf, net->user, sizeof (outbuf));
-				else
-					g_strlcat (outbuf, prefs.hex_irc_user_name, sizeof (outbuf));
+static void
+server_connect_failed (server *serv, GError *error)
+{
+	session *sess = serv->server_session;
 
-				handle_command (serv->server_session, outbuf, FALSE);
-			}
-		}
+	server_stopconnecting (serv);
 
-		server_connect_success (serv);
-		break;
-	case '5':						  /* prefs ip discovered */
-		waitline2 (source, tbuf, sizeof tbuf);
-		prefs.local_ip = inet_addr (tbuf);
-		break;
-	case '7':						  /* gethostbyname (prefs.hex_net_bind_host) failed */
-		g_snprintf (outbuf, sizeof (outbuf),
-					_("Cannot resolve hostname %s\nCheck your IP Settings!\n"),
-					prefs.hex_net_bind_host);
-		PrintText (sess, outbuf);
-		break;
-	case '8':
+	if (error->domain == G_RESOLVER_ERROR)
+	{
+		EMIT_SIGNAL (XP_TE_UKNHOST, sess, NULL, NULL, NULL, NULL, 0);
+	}
+	else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PROXY_FAILED) ||
+				g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PROXY_AUTH_FAILED) ||
+				g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PROXY_NEED_AUTH) ||
+				g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PROXY_NOT_ALLOWED))
+	{
+		PrintTextf (sess, "%s\n", error->message);
 		PrintText (sess, _("Proxy traversal failed.\n"));
-		server_disconnect (sess, FALSE, -1);
-		break;
-	case '9':
-		waitline2 (source, tbuf, sizeof tbuf);
-		EMIT_SIGNAL (XP_TE_SERVERLOOKUP, sess, tbuf, NULL, NULL, NULL, 0);
-		break;
+		return;
+	}
+	else
+	{
+		EMIT_SIGNAL (XP_TE_CONNFAIL, sess, error->message, NULL, NULL, NULL, 0);
 	}
 
-	return TRUE;
+	if (!servlist_cycle (serv))
+		if (should_auto_reconnect_on_fail ())
+			auto_reconnect (serv, FALSE, -1);
 }
 
+static void
+server_connect_done (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	connect_attempt *att = user_data;
+	server *serv = att->serv;
+	GSocketConnection *conn;
+	GError *error = NULL;
+	char outbuf[512];
+
+	conn = g_socket_client_connect_to_host_finish (G_SOCKET_CLIENT (source), res, &error);
+
+	if (g_cancellable_is_cancelled (att->cancellable))
+	{
+		/* server_stopconnecting() gave up on us, serv may already be freed */
+		g_clear_object (&conn);
+		g_clear_error (&error);
+		connect_attempt_free (att);
+		return;
+	}
+
+	serv->connect_attempt = NULL;
+	server_connect_next ();
+
+	if (!conn)
+	{
+		server_connect_failed (serv, error);
+		g_error_free (error);
+		connect_attempt_free (att);
+		return;
+	}
+
+	/* the rest of server.c (and OpenSSL) works on a plain fd */
+	serv->sok = dup (g_socket_get_fd (g_socket_connection_get_socket (conn)));
+	g_object_unref (conn);
+	net_set_socket_options (serv->sok);
+
+	if (att->wingate)
+	{
+		g_snprintf (outbuf, sizeof (outbuf), "%s %d\r\n", serv->hostname, serv->port);
+		send (serv->sok, outbuf, strlen (outbuf), 0);
+	}
+
+	{
+		struct sockaddr_storage addr;
+		socklen_t addr_len = sizeof (addr);
+		guint16 port;
+		ircnet *net = serv->network;
+
+		if (!getsockname (serv->sok, (struct sockaddr *)&addr, &addr_len))
+		{
+			if (addr.ss_family == AF_INET)
+				port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+			else
+				port = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+
+			g_snprintf (outbuf, sizeof (outbuf), "IDENTD %"G_GUINT16_FORMAT" ", port);
+			if (net && net->user && !(net->flags & FLAG_USE_GLOBAL))
+				g_strlcat (outbuf, net->user, sizeof (outbuf));
+			else
+				g_strlcat (outbuf, prefs.hex_irc_user_name, sizeof (outbuf));
+
+			handle_command (serv->server_session, outbuf, FALSE);
+		}
+	}
+
+	connect_attempt_free (att);
+	server_connect_success (serv);
+}
 /* kill all sockets & iotags of a server. Stop a connection attempt, or
    disconnect if already connected. */
 
@@ -922,6 +1043,12 @@ server_cleanup (server * serv)
 {
 	fe_set_lag (serv, 0);
 
+	/* apply a pending netsplit batch while the channels are still there,
+	   half received IRCv3 batches are of no use after this */
+	netsplit_flush (serv);
+	batch_server_free (serv);
+	joinsched_server_free (serv);
+
 	if (serv->iotag)
 	{
 		fe_input_remove (serv->iotag);
@@ -946,21 +1073,18 @@ server_cleanup (server * serv)
 	if (serv->connecting)
 	{
 		server_stopconnecting (serv);
-		closesocket (serv->sok4);
-		if (serv->proxy_sok4 != -1)
-			closesocket (serv->proxy_sok4);
-		if (serv->sok6 != -1)
-			closesocket (serv->sok6);
-		if (serv->proxy_sok6 != -1)
-			closesocket (serv->proxy_sok6);
+		if (serv->sok != -1)
+		{
+			closesocket (serv->sok);
+			serv->sok = -1;
+		}
 		return 1;
 	}
 
 	if (serv->connected)
 	{
 		close_socket (serv->sok);
-		if (serv->proxy_sok)
-			close_socket (serv->proxy_sok);
+		serv->sok = -1;
 		serv->connected = FALSE;
 		serv->end_of_motd = FALSE;
 		return 2;
@@ -982,7 +1106,6 @@ server_disconnect (session * sess, int sendquit, int err)
 {
 	server *serv = sess->server;
 	GSList *list;
-	char tbuf[64];
 	gboolean shutup = FALSE;
 
 	/* send our QUIT reason */
@@ -1000,8 +1123,7 @@ server_disconnect (session * sess, int sendquit, int err)
 		notc_msg (sess);
 		return;
 	case 1:							  /* it was in the process of connecting */
-		sprintf (tbuf, "%d", sess->server->childpid);
-		EMIT_SIGNAL (XP_TE_STOPCONNECT, sess, tbuf, NULL, NULL, NULL, 0);
+		EMIT_SIGNAL (XP_TE_STOPCONNECT, sess, serv->hostname, NULL, NULL, NULL, 0);
 		return;
 	case 3:
 		shutup = TRUE;	/* won't print "disconnected" in channels */
@@ -1034,539 +1156,209 @@ server_disconnect (session * sess, int sendquit, int err)
 	notify_cleanup ();
 }
 
-/* send a "print text" command to the parent process - MUST END IN \n! */
+/* point the attempt at the configured proxy. GIO speaks SOCKS4/5 and HTTP
+   CONNECT itself, and the system proxy settings for "auto"; wingate is just
+   a plain connection to the proxy with one line sent first. */
 
 static void
-proxy_error (int fd, char *msg)
+server_connect_set_proxy (server *serv, connect_attempt *att)
 {
-	if (write (fd, "0\n", 2) < 0 ||
-	    write (fd, msg, strlen (msg)) < 0)
-		g_warning ("Failed to write proxy error");
-}
-
-struct sock_connect
-{
-	char version;
-	char type;
-	guint16 port;
-	guint32 address;
-	char username[10];
-};
-
-/* traverse_socks() returns:
- *				0 success                *
- *          1 socks traversal failed */
-
-static int
-traverse_socks (int print_fd, int sok, char *serverAddr, int port)
-{
-	struct sock_connect sc;
-	unsigned char buf[256];
-
-	sc.version = 4;
-	sc.type = 1;
-	sc.port = htons (port);
-	sc.address = inet_addr (serverAddr);
-	g_strlcpy (sc.username, prefs.hex_irc_user_name, sizeof (sc.username));
-
-	send (sok, (char *) &sc, 8 + strlen (sc.username) + 1, 0);
-	buf[1] = 0;
-	recv (sok, buf, 10, 0);
-	if (buf[1] == 90)
-		return 0;
-
-	g_snprintf (buf, sizeof (buf), "SOCKS\tServer reported error %d,%d.\n", buf[0], buf[1]);
-	proxy_error (print_fd, buf);
-	return 1;
-}
+	static const char * const schemes[] = { NULL, NULL, "socks4", "socks5", "http" };
+	GProxyResolver *resolver;
+	char *host, *uri, *user, *pass;
+	int type = prefs.hex_net_proxy_type;
 
-struct sock5_connect1
-{
-	char version;
-	char nmethods;
-	char method;
-};
+	att->connect_host = g_strdup (serv->hostname);
+	att->connect_port = serv->port;
 
-static int
-traverse_socks5 (int print_fd, int sok, char *serverAddr, int port)
-{
-	struct sock5_connect1 sc1;
-	unsigned char *sc2;
-	unsigned int packetlen, addrlen;
-	unsigned char buf[260];
-	int auth = prefs.hex_net_proxy_auth && prefs.hex_net_proxy_user[0] && prefs.hex_net_proxy_pass[0];
-
-	sc1.version = 5;
-	sc1.nmethods = 1;
-	if (auth)
-		sc1.method = 2;  /* Username/Password Authentication (UPA) */
-	else
-		sc1.method = 0;  /* NO Authentication */
-	send (sok, (char *) &sc1, 3, 0);
-	if (recv (sok, buf, 2, 0) != 2)
-		goto read_error;
-
-	if (buf[0] != 5)
+	if (serv->dont_use_proxy || type <= 0)
 	{
-		proxy_error (print_fd, "SOCKS\tServer is not socks version 5.\n");
-		return 1;
+		g_socket_client_set_enable_proxy (att->client, FALSE);
+		return;
 	}
 
-	/* did the server say no auth required? */
-	if (buf[1] == 0)
-		auth = 0;
+	if (type == 5)	/* auto: GSocketClient uses the system resolver by default */
+		return;
 
-	if (auth)
+	if (!prefs.hex_net_proxy_host[0] || type >= G_N_ELEMENTS (schemes) ||
+		 prefs.hex_net_proxy_use == 2)	/* proxy is dcc-only */
 	{
-		int len_u=0, len_p=0;
-		unsigned char *u_p_buf;
-
-		/* authentication sub-negotiation (RFC1929) */
-		if (buf[1] != 2)  /* UPA not supported by server */
-		{
-			proxy_error (print_fd, "SOCKS\tServer doesn't support UPA authentication.\n");
-			return 1;
-		}
-
-		/* form the UPA request */
-		len_u = strlen (prefs.hex_net_proxy_user);
-		len_p = strlen (prefs.hex_net_proxy_pass);
-
-        packetlen = 2 + len_u + 1 + len_p;
-		u_p_buf = g_malloc0 (packetlen);
-
-		u_p_buf[0] = 1;
-		u_p_buf[1] = len_u;
-		memcpy (u_p_buf + 2, prefs.hex_net_proxy_user, len_u);
-		u_p_buf[2 + len_u] = len_p;
-		memcpy (u_p_buf + 3 + len_u, prefs.hex_net_proxy_pass, len_p);
-
-		send (sok, u_p_buf, packetlen, 0);
-		g_free(u_p_buf);
-
-		if ( recv (sok, buf, 2, 0) != 2 )
-			goto read_error;
-		if ( buf[1] != 0 )
-		{
-			proxy_error (print_fd, "SOCKS\tAuthentication failed. "
-							 "Is username and password correct?\n");
-			return 1; /* UPA failed! */
-		}
+		g_socket_client_set_enable_proxy (att->client, FALSE);
+		return;
 	}
-	else
+
+	if (type == 1)
 	{
-		if (buf[1] != 0)
-		{
-			proxy_error (print_fd, "SOCKS\tAuthentication required but disabled in settings.\n");
-			return 1;
-		}
+		g_socket_client_set_enable_proxy (att->client, FALSE);
+		g_free (att->connect_host);
+		att->connect_host = g_strdup (prefs.hex_net_proxy_host);
+		att->connect_port = prefs.hex_net_proxy_port;
+		att->wingate = TRUE;
+		return;
 	}
 
-	addrlen = strlen (serverAddr);
-	packetlen = 4 + 1 + addrlen + 2;
-	sc2 = g_malloc (packetlen);
-	sc2[0] = 5;						  /* version */
-	sc2[1] = 1;						  /* command */
-	sc2[2] = 0;						  /* reserved */
-	sc2[3] = 3;						  /* address type */
-	sc2[4] = (unsigned char) addrlen;	/* hostname length */
-	memcpy (sc2 + 5, serverAddr, addrlen);
-	*((unsigned short *) (sc2 + 5 + addrlen)) = htons (port);
-	send (sok, sc2, packetlen, 0);
-	g_free (sc2);
-
-	/* consume all of the reply */
-	if (recv (sok, buf, 4, 0) != 4)
-		goto read_error;
-	if (buf[0] != 5 || buf[1] != 0)
+	/* IPv6 literals need brackets inside a URI */
+	if (strchr (prefs.hex_net_proxy_host, ':'))
+		host = g_strdup_printf ("[%s]", prefs.hex_net_proxy_host);
+	else
+		host = g_strdup (prefs.hex_net_proxy_host);
+
+	if (prefs.hex_net_proxy_auth && prefs.hex_net_proxy_user[0])
 	{
-		if (buf[1] == 2)
-			g_snprintf (buf, sizeof (buf), "SOCKS\tProxy refused to connect to host (not allowed).\n");
-		else
-			g_snprintf (buf, sizeof (buf), "SOCKS\tProxy failed to connect to host (error %d).\n", buf[1]);
-		proxy_error (print_fd, buf);
-		return 1;
+		user = g_uri_escape_string (prefs.hex_net_proxy_user, NULL, FALSE);
+		pass = g_uri_escape_string (prefs.hex_net_proxy_pass, NULL, FALSE);
+		uri = g_strdup_printf ("%s://%s:%s@%s:%d", schemes[type], user, pass,
+									  host, prefs.hex_net_proxy_port);
+		g_free (user);
+		g_free (pass);
 	}
-	if (buf[3] == 1)	/* IPV4 32bit address */
-	{
-		if (recv (sok, buf, 6, 0) != 6)
-			goto read_error;
-	} else if (buf[3] == 4)	/* IPV6 128bit address */
-	{
-		if (recv (sok, buf, 18, 0) != 18)
-			goto read_error;
-	} else if (buf[3] == 3)	/* string, 1st byte is size */
+	else
 	{
-		if (recv (sok, buf, 1, 0) != 1)	/* read the string size */
-			goto read_error;
-		packetlen = buf[0] + 2;	/* can't exceed 260 */
-		if (recv (sok, buf, packetlen, 0) != packetlen)
-			goto read_error;
+		uri = g_strdup_printf ("%s://%s:%d", schemes[type], host, prefs.hex_net_proxy_port);
 	}
 
-	return 0;	/* success */
-
-read_error:
-	proxy_error (print_fd, "SOCKS\tRead error from server.\n");
-	return 1;
-}
-
-static int
-traverse_wingate (int print_fd, int sok, char *serverAddr, int port)
-{
-	char buf[128];
-
-	g_snprintf (buf, sizeof (buf), "%s %d\r\n", serverAddr, port);
-	send (sok, buf, strlen (buf), 0);
-
-	return 0;
+	resolver = g_simple_proxy_resolver_new (uri, NULL);
+	g_socket_client_set_proxy_resolver (att->client, resolver);
+	g_object_unref (resolver);
+	g_free (uri);
+	g_free (host);
 }
 
-/* stuff for HTTP auth is here */
-
 static void
-three_to_four (char *from, char *to)
+server_connect_bind (connect_attempt *att, GInetAddress *addr)
 {
-	static const char tab64[64]=
-	{
-		'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P',
-		'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f',
-		'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v',
-		'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/'
-	};
-
-	to[0] = tab64 [ (from[0] >> 2) & 63 ];
-	to[1] = tab64 [ ((from[0] << 4) | (from[1] >> 4)) & 63 ];
-	to[2] = tab64 [ ((from[1] << 2) | (from[2] >> 6)) & 63 ];
-	to[3] = tab64 [ from[2] & 63 ];
-};
+	GSocketAddress *local;
+	char *ip;
 
-void
-base64_encode (char *to, char *from, unsigned int len)
-{
-	while (len >= 3)
+	local = g_inet_socket_address_new (addr, 0);
+	g_socket_client_set_local_address (att->client, local);
+	g_object_unref (local);
+
+	if (g_inet_address_get_family (addr) == G_SOCKET_FAMILY_IPV4)
 	{
-		three_to_four (from, to);
-		len -= 3;
-		from += 3;
-		to += 4;
+		ip = g_inet_address_to_string (addr);
+		prefs.local_ip = inet_addr (ip);
+		g_free (ip);
 	}
-	if (len)
-	{
-		char three[3] = {0,0,0};
-		unsigned int i;
-		for (i = 0; i < len; i++)
-		{
-			three[i] = *from++;
-		}
-		three_to_four (three, to);
-		if (len == 1)
-		{
-			to[2] = to[3] = '=';
-		}
-		else if (len == 2)
-		{
-			to[3] = '=';
-		}
-		to += 4;
-	};
-	to[0] = 0;
 }
 
-static int
-http_read_line (int print_fd, int sok, char *buf, int len)
+static void
+server_connect_go (connect_attempt *att)
 {
-	len = waitline (sok, buf, len, TRUE);
-	if (len >= 1)
-	{
-		/* print the message out (send it to the parent process) */
-		if (write (print_fd, "0\n", 2) < 0)
-			g_warning ("Failed to write to child pipe");
-
-		if (buf[len-1] == '\r')
-		{
-			buf[len-1] = '\n';
-			if (write (print_fd, buf, len) < 0)
-				g_warning ("Failed to write to child pipe");
-		} else
-		{
-			if (write (print_fd, buf, len) < 0 ||
-			    write (print_fd, "\n", 1) < 0)
-				g_warning ("Failed to write to child pipe");
-		}
-	}
-
-	return len;
+	/* GSocketClient races IPv6 and IPv4 addresses itself (RFC 8305) */
+	g_socket_client_connect_to_host_async (att->client, att->connect_host,
+														att->connect_port, att->cancellable,
+														server_connect_done, att);
 }
 
-static int
-traverse_http (int print_fd, int sok, char *serverAddr, int port)
+static void
+server_connect_bind_resolved (GObject *source, GAsyncResult *res, gpointer user_data)
 {
-	char buf[512];
-	char *auth_data = NULL;
-	char *auth_plain = NULL;
-	char *connect_req = NULL;
-	int n;
+	connect_attempt *att = user_data;
+	GList *addrs;
+	GError *error = NULL;
 
-	if (prefs.hex_net_proxy_auth)
-	{
-		auth_plain = g_strdup_printf ("%s:%s",
-							 prefs.hex_net_proxy_user, prefs.hex_net_proxy_pass);
-		auth_data = g_base64_encode ((const guchar *) auth_plain, strlen (auth_plain));
-		connect_req = g_strdup_printf ("CONNECT %s:%d HTTP/1.0\r\n"
-								   "Proxy-Authorization: Basic %s\r\n"
-								   "\r\n",
-								   serverAddr, port, auth_data);
-	}
-	else
-	{
-		connect_req = g_strdup_printf ("CONNECT %s:%d HTTP/1.0\r\n\r\n", serverAddr, port);
-	}
+	addrs = g_resolver_lookup_by_name_finish (G_RESOLVER (source), res, &error);
 
-	if (connect_req == NULL)
+	if (g_cancellable_is_cancelled (att->cancellable))
 	{
-		g_free (auth_data);
-		g_free (auth_plain);
-		return 1;
+		g_resolver_free_addresses (addrs);
+		g_clear_error (&error);
+		connect_attempt_free (att);
+		return;
 	}
 
-	send (sok, connect_req, strlen (connect_req), 0);
-	g_free (connect_req);
-	g_free (auth_data);
-	g_free (auth_plain);
-
-	n = http_read_line (print_fd, sok, buf, sizeof (buf));
-	/* "HTTP/1.0 200 OK" */
-	if (n < 12)
-		return 1;
-	if (memcmp (buf, "HTTP/", 5) || memcmp (buf + 9, "200", 3))
-		return 1;
-	while (1)
+	if (addrs)
 	{
-		/* read until blank line */
-		n = http_read_line (print_fd, sok, buf, sizeof (buf));
-		if (n < 1 || (n == 1 && buf[0] == '\n'))
-			break;
+		server_connect_bind (att, addrs->data);
+		g_resolver_free_addresses (addrs);
 	}
-	return 0;
-}
-
-static int
-traverse_proxy (int proxy_type, int print_fd, int sok, char *ip, int port, netstore *ns_proxy, int csok4, int csok6, int *csok, char bound)
-{
-	switch (proxy_type)
+	else
 	{
-	case 1:
-		return traverse_wingate (print_fd, sok, ip, port);
-	case 2:
-		return traverse_socks (print_fd, sok, ip, port);
-	case 3:
-		return traverse_socks5 (print_fd, sok, ip, port);
-	case 4:
-		return traverse_http (print_fd, sok, ip, port);
+		PrintTextf (att->serv->server_session,
+						_("Cannot resolve hostname %s\nCheck your IP Settings!\n"),
+						prefs.hex_net_bind_host);
+		g_error_free (error);
 	}
 
-	return 1;
+	server_connect_go (att);
 }
 
-/* this is the child process making the connection attempt */
-
-static int
-server_child (server * serv)
+static void
+server_connect_start (server *serv)
 {
-	netstore *ns_server;
-	netstore *ns_proxy = NULL;
-	netstore *ns_local;
-	int port = serv->port;
-	int error;
-	int sok, psok;
-	char *hostname = serv->hostname;
-	char *real_hostname = NULL;
-	char *ip;
-	char *proxy_ip = NULL;
-	char *local_ip;
-	int connect_port;
-	char buf[512];
-	char bound = 0;
-	int proxy_type = 0;
-	char *proxy_host = NULL;
-	int proxy_port;
+	connect_attempt *att;
+	GInetAddress *local;
+	GResolver *resolver;
+
+	connects_running++;
+
+	att = g_new0 (connect_attempt, 1);
+	att->serv = serv;
+	att->cancellable = g_cancellable_new ();
+	att->client = g_socket_client_new ();
+	serv->connect_attempt = att;
 
-	ns_server = net_store_new ();
+	server_connect_set_proxy (serv, att);
+	g_signal_connect (att->client, "event", G_CALLBACK (server_connect_event), att);
 
 	/* is a hostname set? - bind to it */
-	if (prefs.hex_net_bind_host[0])
+	if (!prefs.hex_net_bind_host[0])
 	{
-		ns_local = net_store_new ();
-		local_ip = net_resolve (ns_local, prefs.hex_net_bind_host, 0, &real_hostname);
-		if (local_ip != NULL)
-		{
-			g_snprintf (buf, sizeof (buf), "5\n%s\n", local_ip);
-			if (write (serv->childwrite, buf, strlen (buf)) < 0)
-				g_warning ("Failed to write to child pipe");
-			net_bind (ns_local, serv->sok4, serv->sok6);
-			bound = 1;
-		} else
-		{
-			if (write (serv->childwrite, "7\n", 2) < 0)
-				g_warning ("Failed to write to child pipe");
-		}
-		net_store_destroy (ns_local);
+		server_connect_go (att);
+		return;
 	}
 
-	if (!serv->dont_use_proxy) /* blocked in serverlist? */
+	local = g_inet_address_new_from_string (prefs.hex_net_bind_host);
+	if (local)
 	{
-		if (prefs.hex_net_proxy_type == 5)
-		{
-			char **proxy_list;
-			char *url, *proxy;
-			GProxyResolver *resolver;
-			GError *error = NULL;
-
-			resolver = g_proxy_resolver_get_default ();
-			url = g_strdup_printf ("irc://%s:%d", hostname, port);
-			proxy_list = g_proxy_resolver_lookup (resolver, url, NULL, &error);
-
-			if (proxy_list) {
-				/* can use only one */
-				proxy = proxy_list[0];
-				if (!strncmp (proxy, "direct", 6))
-					proxy_type = 0;
-				else if (!strncmp (proxy, "http", 4))
-					proxy_type = 4;
-				else if (!strncmp (proxy, "socks5", 6))
-					proxy_type = 3;
-				else if (!strncmp (proxy, "socks", 5))
-					proxy_type = 2;
-			} else {
-				write_error ("Failed to lookup proxy", &error);
-			}
-
-			if (proxy_type) {
-				char *c;
-				c = strchr (proxy, ':') + 3;
-				proxy_host = g_strdup (c);
-				c = strchr (proxy_host, ':');
-				*c = '\0';
-				proxy_port = atoi (c + 1);
-			}
-
-			g_strfreev (proxy_list);
-			g_free (url);
-		}
-
-		if (prefs.hex_net_proxy_host[0] &&
-			   prefs.hex_net_proxy_type > 0 &&
-			   prefs.hex_net_proxy_use != 2) /* proxy is NOT dcc-only */
-		{
-			proxy_type = prefs.hex_net_proxy_type;
-			proxy_host = g_strdup (prefs.hex_net_proxy_host);
-			proxy_port = prefs.hex_net_proxy_port;
-		}
+		server_connect_bind (att, local);
+		g_object_unref (local);
+		server_connect_go (att);
+		return;
 	}
 
-	serv->proxy_type = proxy_type;
+	resolver = g_resolver_get_default ();
+	g_resolver_lookup_by_name_async (resolver, prefs.hex_net_bind_host, att->cancellable,
+												server_connect_bind_resolved, att);
+	g_object_unref (resolver);
+}
 
-	/* first resolve where we want to connect to */
-	if (proxy_type > 0)
-	{
-		g_snprintf (buf, sizeof (buf), "9\n%s\n", proxy_host);
-		if (write (serv->childwrite, buf, strlen (buf)) < 0)
-			g_warning ("Failed to write to child pipe");
-		ip = net_resolve (ns_server, proxy_host, proxy_port, &real_hostname);
-		g_free (proxy_host);
-		if (!ip)
-		{
-			if (write (serv->childwrite, "1\n", 2) < 0)
-				g_warning ("Failed to write to child pipe");
-			goto xit;
-		}
-		connect_port = proxy_port;
+/* a connect slot was freed, start whoever is waiting for one */
 
-		/* if using socks4 or MS Proxy, attempt to resolve ip for irc server */
-		if ((proxy_type == 2) || (proxy_type == 5))
-		{
-			ns_proxy = net_store_new ();
-			proxy_ip = net_resolve (ns_proxy, hostname, port, &real_hostname);
-			if (!proxy_ip)
-			{
-				if (write (serv->childwrite, "1\n", 2) < 0)
-					g_warning ("Failed to write to child pipe");
-				goto xit;
-			}
-		} else						  /* otherwise we can just use the hostname */
-			proxy_ip = g_strdup (hostname);
-	} else
-	{
-		ip = net_resolve (ns_server, hostname, port, &real_hostname);
-		if (!ip)
-		{
-			if (write (serv->childwrite, "1\n", 2) < 0)
-				g_warning ("Failed to write to child pipe");
-			goto xit;
-		}
-		connect_port = port;
-	}
+static void
+server_connect_next (void)
+{
+	server *serv;
 
-	g_snprintf (buf, sizeof (buf), "3\n%s\n%s\n%d\n",
-				 real_hostname, ip, connect_port);
-	if (write (serv->childwrite, buf, strlen (buf)) < 0)
-		g_warning ("Failed to write to child pipe");
+	connects_running--;
 
-	if (!serv->dont_use_proxy && (proxy_type == 5))
-		error = net_connect (ns_server, serv->proxy_sok4, serv->proxy_sok6, &psok);
-	else
+	while (prefs.hex_net_connect_limit <= 0 || connects_running < prefs.hex_net_connect_limit)
 	{
-		error = net_connect (ns_server, serv->sok4, serv->sok6, &sok);
-		psok = sok;
+		serv = g_queue_pop_head (&connect_queue);
+		if (!serv)
+			break;
+		server_connect_start (serv);
 	}
+}
 
-	if (error != 0)
-	{
-		g_snprintf (buf, sizeof (buf), "2\n%d\n", sock_error ());
-		if (write (serv->childwrite, buf, strlen (buf)) < 0)
-			g_warning ("Failed to write to child pipe");
-	} else
+/* auto-connecting to many networks at once shouldn't open them all at the
+   same time, so only net_connect_limit attempts run concurrently */
+
+static void
+server_connect_queue (server *serv)
+{
+	if (prefs.hex_net_connect_limit > 0 && connects_running >= prefs.hex_net_connect_limit)
 	{
-		/* connect succeeded */
-		if (proxy_ip)
-		{
-			switch (traverse_proxy (proxy_type, serv->childwrite, psok, proxy_ip, port, ns_proxy, serv->sok4, serv->sok6, &sok, bound))
-			{
-			case 0:	/* success */
-				g_snprintf (buf, sizeof (buf), "4\n%d\n", sok);	/* success */
-				if (write (serv->childwrite, buf, strlen (buf)) < 0)
-					g_warning ("Failed to write to child pipe");
-				break;
-			case 1:	/* socks traversal failed */
-				if (write (serv->childwrite, "8\n", 2) < 0)
-					g_warning ("Failed to write to child pipe");
-				break;
-			}
-		} else
-		{
-			g_snprintf (buf, sizeof (buf), "4\n%d\n", sok);	/* success */
-			if (write (serv->childwrite, buf, strlen (buf)) < 0)
-				g_warning ("Failed to write to child pipe");
-		}
+		g_queue_push_tail (&connect_queue, serv);
+		return;
 	}
 
-xit:
-
-	/* this is probably not needed */
-	net_store_destroy (ns_server);
-	if (ns_proxy)
-		net_store_destroy (ns_proxy);
-
-	/* no need to free ip/real_hostname, this process is exiting */
-	return 0;
-	/* cppcheck-suppress memleak */
+	server_connect_start (serv);
 }
-
 static void
 server_connect (server *serv, char *hostname, int port, int no_login)
 {
-	int pid, read_des[2];
 	session *sess = serv->server_session;
 
 #ifdef USE_OPENSSL
@@ -1643,42 +1435,7 @@ server_connect (server *serv, char *hostname, int port, int no_login)
 	fe_set_away (serv);
 	server_flush_queue (serv);
 
-	if (pipe (read_des) < 0)
-		return;
-#ifdef __EMX__ /* os/2 */
-	setmode (read_des[0], O_BINARY);
-	setmode (read_des[1], O_BINARY);
-#endif
-	serv->childread = read_des[0];
-	serv->childwrite = read_des[1];
-
-	/* create both sockets now, drop one later */
-	net_sockets (&serv->sok4, &serv->sok6);
-	serv->proxy_sok4 = -1;
-	serv->proxy_sok6 = -1;
-
-#ifdef LOOKUPD
-	/* CL: net_resolve calls rand() when LOOKUPD is set, so prepare a different
-	 * seed for each child. This method gives a bigger variation in seed values
-	 * than calling srand(time(0)) in the child itself.
-	 */
-	rand();
-#endif
-	switch (pid = fork ())
-	{
-	case -1:
-		return;
-
-	case 0:
-		/* this is the child */
-		if (setuid (getuid ()) < 0)
-			g_warning ("Failed to drop privileges");
-		server_child (serv);
-		_exit (0);
-	}
-	serv->childpid = pid;
-	serv->iotag = fe_input_add (serv->childread, FIA_READ, server_read_child,
-								serv);
+	server_connect_queue (serv);
 }
 
 void
@@ -1784,6 +1541,7 @@ server_set_defaults (server *serv)
 	serv->nick_prefixes = g_strdup ("@%+");
 	serv->nick_modes = g_strdup ("ohv");
 	serv->modes_per_line = 3; /* https://datatracker.ietf.org/doc/html/rfc1459#section-4.2.3.1 */
+	serv->privmsg_targets = 1;
 	serv->sasl_mech = MECH_PLAIN;
 
 	if (!serv->encoding)
@@ -1796,6 +1554,7 @@ server_set_defaults (server *serv)
 	serv->is_away = FALSE;
 	serv->supports_watch = FALSE;
 	serv->supports_monitor = FALSE;
+	notify_server_reset (serv);
 	serv->bad_prefix = FALSE;
 	serv->use_who = TRUE;
 	serv->have_namesx = FALSE;
@@ -1807,6 +1566,9 @@ server_set_defaults (server *serv)
 	serv->have_extjoin = FALSE;
 	serv->have_account_tag = FALSE;
 	serv->have_server_time = FALSE;
+	serv->have_batch = FALSE;
+	serv->have_chathistory = FALSE;
+	serv->chathistory_limit = 0;
 	serv->have_sasl = FALSE;
 	serv->have_except = FALSE;
 	serv->have_invite = FALSE;
@@ -1861,6 +1623,7 @@ server_set_name (server *serv, char *name)
 		{
 			safe_strcpy (serv->server_session->channel, name, CHANLEN);
 		}
+		session_fold_channel (serv->server_session);
 		fe_set_channel (serv->server_session);
 	}
 }
@@ -1933,6 +1696,11 @@ server_free (server *serv)
 	dcc_notify_kill (serv);
 	serv->flush_queue (serv);
 	server_away_free_messages (serv);
+	userlist_server_free (serv);
+	notify_server_free (serv);
+	netsplit_server_free (serv);
+	batch_server_free (serv);
+	joinsched_server_free (serv);
 
 	g_free (serv->nick_modes);
 	g_free (serv->nick_prefixes);
@@ -26,6 +26,8 @@ extern GSList *serv_list;
 int tcp_send_len (server *serv, char *buf, int len);
 void tcp_sendf (server *serv, const char *fmt, ...) G_GNUC_PRINTF (2, 3);
 int tcp_send_real (void *ssl, int sok, GIConv write_converter, char *buf, int len);
+int server_throttle_drain (server *serv);
+void server_throttle_flooded (server *serv);
 
 server *server_new (void);
 int is_server (server *serv);
@@ -39,6 +41,5 @@ void server_free (server *serv);
 void server_away_save_message (server *serv, char *nick, char *msg);
 struct away_msg *server_away_find_message (server *serv, char *nick);
 
-void base64_encode (char *to, char *from, unsigned int len);
 
 #endif
@@ -26,6 +26,7 @@
 
 #include "hexchat.h"
 #include "cfgfiles.h"
+#include "dnscache.h"
 #include "fe.h"
 #include "server.h"
 #include "text.h"
@@ -346,6 +347,35 @@ servlist_favchan_copy (favchannel *fav)
 	return newfav;
 }
 
+/* while this server is connecting, resolve the one servlist_cycle() would
+   move on to, so a failed attempt doesn't also wait on DNS */
+
+static void
+servlist_prefetch_next (server *serv, ircnet *net)
+{
+	ircserver *next;
+	GSList *list;
+	char *host, *port;
+
+	if (!(net->flags & FLAG_CYCLE))
+		return;
+	/* a proxy resolves the server name for us */
+	if (!serv->dont_use_proxy && prefs.hex_net_proxy_type > 0)
+		return;
+
+	list = g_slist_nth (net->servlist, net->selected + 1);
+	if (!list)
+		list = net->servlist;
+	next = list->data;
+
+	host = g_strdup (next->hostname);
+	port = strrchr (host, '/');
+	if (port)
+		*port = 0;
+	dnscache_prefetch (host);
+	g_free (host);
+}
+
 void
 servlist_connect (session *sess, ircnet *net, gboolean join)
 {
@@ -442,6 +472,8 @@ servlist_connect (session *sess, ircnet *net, gboolean join)
 		serv->connect (serv, ircserv->hostname, -1, FALSE);
 
 	server_set_encoding (serv, net->encoding);
+
+	servlist_prefetch_next (serv, net);
 }
 
 int
@@ -1068,6 +1100,10 @@ servlist_load (void)
 			case 'D':
 				net->selected = atoi (buf + 2);
 				break;
+			case 'T':
+				sscanf (buf + 2, "%d,%d,%d", &net->throttle.burst,
+						  &net->throttle.refill, &net->throttle.bytes);
+				break;
 			/* FIXME Migration code. In 2.9.5 the order was:
 			 *
 			 * P=serverpass, A=saslpass, B=nickservpass
@@ -1202,6 +1238,9 @@ servlist_save (void)
 		}
 
 		fprintf (fp, "F=%d\nD=%d\n", net->flags, net->selected);
+		if (net->throttle.burst || net->throttle.refill || net->throttle.bytes)
+			fprintf (fp, "T=%d,%d,%d\n", net->throttle.burst,
+						net->throttle.refill, net->throttle.bytes);
 
 		netlist = net->servlist;
 		while (netlist)
@@ -1279,3 +1318,64 @@ joinlist_is_in_list (server *serv, char *channel)
 		return FALSE;
 	}
 }
+
+/* fill in the effective flood control profile for a network, falling back
+   to the global net_throttle_* settings for anything it doesn't override */
+
+void
+servlist_throttle_get (ircnet *net, throttleprofile *prof)
+{
+	prof->burst = prefs.hex_net_throttle_burst;
+	prof->refill = prefs.hex_net_throttle_refill;
+	prof->bytes = prefs.hex_net_throttle_bytes;
+
+	if (net)
+	{
+		if (net->throttle.burst > 0)
+			prof->burst = net->throttle.burst;
+		if (net->throttle.refill > 0)
+			prof->refill = net->throttle.refill;
+		if (net->throttle.bytes > 0)
+			prof->bytes = net->throttle.bytes;
+	}
+
+	/* keep the bucket maths sane whatever the config says */
+	prof->burst = CLAMP (prof->burst, 1, 100);
+	prof->refill = CLAMP (prof->refill, 10, 60000);
+	if (prof->bytes < 1)
+		prof->bytes = 0;	/* size doesn't matter */
+}
+
+void
+servlist_throttle_set (ircnet *net, int burst, int refill, int bytes)
+{
+	net->throttle.burst = MAX (burst, 0);
+	net->throttle.refill = MAX (refill, 0);
+	net->throttle.bytes = MAX (bytes, 0);
+	servlist_save ();
+}
+
+/* the server killed us for flooding: back off this network's profile a
+   step so the next connection stays under its limit. Returns FALSE once
+   the profile can't get any slower. */
+
+gboolean
+servlist_throttle_flooded (ircnet *net)
+{
+	throttleprofile prof;
+
+	if (!net)
+		return FALSE;
+
+	servlist_throttle_get (net, &prof);
+	if (prof.burst <= 1 && prof.refill >= 10000)
+		return FALSE;
+
+	if (prof.burst > 1)
+		prof.burst--;
+	/* only ever slow down; a refill set above the cap stays as it is */
+	prof.refill = MAX (prof.refill, MIN (prof.refill + prof.refill / 4, 10000));
+
+	servlist_throttle_set (net, prof.burst, prof.refill, net->throttle.bytes);
+	return TRUE;
+}
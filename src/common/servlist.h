@@ -36,6 +36,14 @@ typedef struct favchannel
 	char *key;
 } favchannel;
 
+/* outbound token bucket, see tcp_send_queue(). 0 means "use the global default" */
+typedef struct throttleprofile
+{
+	int burst;			/* lines that may be sent back to back */
+	int refill;			/* ms to earn one line back */
+	int bytes;			/* payload bytes that cost one extra line */
+} throttleprofile;
+
 typedef struct ircnet
 {
 	char *name;
@@ -51,6 +59,7 @@ typedef struct ircnet
 	GSList *favchanlist;
 	int selected;
 	guint32 flags;
+	throttleprofile throttle;
 } ircnet;
 
 extern GSList *network_list;
@@ -125,6 +134,10 @@ GSList *servlist_favchan_listadd (GSList *chanlist, char *channel, char *key);
 
 gboolean joinlist_is_in_list (server *serv, char *channel);
 
+void servlist_throttle_get (ircnet *net, throttleprofile *prof);
+void servlist_throttle_set (ircnet *net, int burst, int refill, int bytes);
+gboolean servlist_throttle_flooded (ircnet *net);
+
 /* FIXME
 void joinlist_split (char *autojoin, GSList **channels, GSList **keys);
 void joinlist_free (GSList *channels, GSList *keys);
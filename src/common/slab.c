@@ -0,0 +1,91 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "slab.h"
+
+void
+slab_init (slab *s, gsize size, guint per_chunk)
+{
+	memset (s, 0, sizeof (*s));
+	/* every free object doubles as a free list link */
+	s->size = MAX (size, sizeof (gpointer));
+	s->size = (s->size + sizeof (gpointer) - 1) & ~(sizeof (gpointer) - 1);
+	s->per_chunk = per_chunk;
+}
+
+static void
+slab_grow (slab *s)
+{
+	char *chunk, *obj;
+	guint i;
+
+	chunk = g_malloc (s->size * s->per_chunk);
+	s->chunks = g_slist_prepend (s->chunks, chunk);
+	s->n_chunks++;
+
+	for (i = s->per_chunk; i > 0; i--)
+	{
+		obj = chunk + (i - 1) * s->size;
+		*(gpointer *)obj = s->free_list;
+		s->free_list = obj;
+	}
+}
+
+gpointer
+slab_alloc0 (slab *s)
+{
+	gpointer obj;
+
+	if (!s->free_list)
+		slab_grow (s);
+
+	obj = s->free_list;
+	s->free_list = *(gpointer *)obj;
+	s->in_use++;
+
+	memset (obj, 0, s->size);
+	return obj;
+}
+
+void
+slab_free (slab *s, gpointer obj)
+{
+	*(gpointer *)obj = s->free_list;
+	s->free_list = obj;
+	s->in_use--;
+}
+
+/* releases every object in one go, individual slab_free calls are not needed */
+void
+slab_clear (slab *s)
+{
+	g_slist_free_full (s->chunks, g_free);
+	s->chunks = NULL;
+	s->free_list = NULL;
+	s->in_use = 0;
+	s->n_chunks = 0;
+}
+
+gsize
+slab_bytes (const slab *s)
+{
+	return (gsize)s->n_chunks * s->per_chunk * s->size;
+}
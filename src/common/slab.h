@@ -0,0 +1,43 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef HEXCHAT_SLAB_H
+#define HEXCHAT_SLAB_H
+
+#include <glib.h>
+
+/* fixed-size object allocator: objects are carved out of large chunks and
+   recycled through a free list, and everything can be released at once */
+typedef struct slab
+{
+	gsize size;					/* object size, pointer aligned */
+	guint per_chunk;
+	GSList *chunks;
+	gpointer free_list;
+	guint in_use;				/* objects handed out */
+	guint n_chunks;
+} slab;
+
+void slab_init (slab *s, gsize size, guint per_chunk);
+gpointer slab_alloc0 (slab *s);
+void slab_free (slab *s, gpointer obj);
+void slab_clear (slab *s);
+gsize slab_bytes (const slab *s);
+
+#endif
@@ -0,0 +1,281 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "hexchat.h"
+#include "hexchatc.h"
+#include "cfgfiles.h"
+#include "perf.h"
+#include "stall.h"
+
+#define STALL_MAX_DEPTH 8
+#define STALL_DETAIL_LEN 96
+#define STALL_MAX_UPDATES 4	/* "still blocked" lines per stall */
+
+typedef struct
+{
+	const char *what;
+	char detail[STALL_DETAIL_LEN];
+} stall_region;
+
+/* written by the main thread only; the monitor reads them seqlock style,
+   retrying while region_seq is odd or moves under it */
+static stall_region regions[STALL_MAX_DEPTH];
+static gint region_depth;
+static gint region_seq;
+
+static GMutex beat_lock;
+static GCond beat_cond;
+static gint64 last_beat;		/* guarded by beat_lock */
+static gint64 sampled_beat;	/* last_beat of the stall the monitor caught */
+static gboolean monitor_quit;	/* guarded by beat_lock */
+static GThread *monitor;
+static guint beat_tag;
+static gint64 interval_us;
+static gint64 threshold_us;
+static char *report_path;
+
+void
+stall_region_push (const char *what, const char *owner, const char *name)
+{
+	stall_region *r;
+
+	g_atomic_int_inc (&region_seq);
+	if (region_depth < STALL_MAX_DEPTH)
+	{
+		r = &regions[region_depth];
+		r->what = what;
+		g_strlcpy (r->detail, owner ? owner : "", sizeof (r->detail));
+		if (name)
+		{
+			g_strlcat (r->detail, owner ? ":" : "", sizeof (r->detail));
+			g_strlcat (r->detail, name, sizeof (r->detail));
+		}
+	}
+	g_atomic_int_set (&region_depth, region_depth + 1);
+	g_atomic_int_inc (&region_seq);
+}
+
+void
+stall_region_pop (void)
+{
+	if (region_depth == 0)
+		return;
+
+	g_atomic_int_inc (&region_seq);
+	g_atomic_int_set (&region_depth, region_depth - 1);
+	g_atomic_int_inc (&region_seq);
+}
+
+/* monitor thread: copy out the region stack, "a x > b y" outermost first */
+static void
+stall_snapshot (GString *out)
+{
+	int tries, depth, i, seq;
+
+	for (tries = 0; tries < 16; tries++)
+	{
+		seq = g_atomic_int_get (&region_seq);
+		if (seq & 1)
+		{
+			g_usleep (50);
+			continue;
+		}
+
+		g_string_truncate (out, 0);
+		depth = MIN (g_atomic_int_get (&region_depth), STALL_MAX_DEPTH);
+		for (i = 0; i < depth; i++)
+		{
+			if (i)
+				g_string_append (out, " > ");
+			g_string_append (out, regions[i].what);
+			if (regions[i].detail[0])
+			{
+				g_string_append_c (out, ' ');
+				g_string_append_len (out, regions[i].detail,
+											strnlen (regions[i].detail, STALL_DETAIL_LEN));
+			}
+		}
+		if (!depth)
+			g_string_append (out, "(main loop, no instrumented region)");
+
+		if (g_atomic_int_get (&region_seq) == seq)
+			return;
+	}
+
+	g_string_assign (out, "(regions changing too fast to sample)");
+}
+
+static void
+stall_report (const char *line)
+{
+	GDateTime *now;
+	char *stamp;
+	FILE *fp;
+
+	fp = g_fopen (report_path, "a");
+	if (!fp)
+		return;
+
+	now = g_date_time_new_now_local ();
+	stamp = g_date_time_format (now, "%Y-%m-%d %H:%M:%S");
+	fprintf (fp, "%s %s\n", stamp, line);
+	fclose (fp);
+
+	g_free (stamp);
+	g_date_time_unref (now);
+}
+
+static gpointer
+stall_monitor (gpointer data)
+{
+	GString *where, *last_where, *line;
+	gint64 beat, stalled_beat = 0, blocked;
+	int updates = 0;
+
+	where = g_string_new (NULL);
+	last_where = g_string_new (NULL);
+	line = g_string_new (NULL);
+
+	g_mutex_lock (&beat_lock);
+	while (!monitor_quit)
+	{
+		g_cond_wait_until (&beat_cond, &beat_lock, g_get_monotonic_time () + interval_us);
+		if (monitor_quit)
+			break;
+
+		beat = last_beat;
+		blocked = g_get_monotonic_time () - beat - interval_us;
+		if (blocked > threshold_us)
+			sampled_beat = beat;
+		g_mutex_unlock (&beat_lock);
+
+		if (stalled_beat && beat != stalled_beat)
+		{
+			g_string_printf (line, "stall: main loop resumed after %" G_GINT64_FORMAT " ms",
+								  (beat - stalled_beat - interval_us) / 1000);
+			stall_report (line->str);
+			stalled_beat = 0;
+		}
+		else if (blocked > threshold_us)
+		{
+			stall_snapshot (where);
+			if (!stalled_beat)
+			{
+				g_string_printf (line, "stall: main loop blocked for %" G_GINT64_FORMAT " ms in %s",
+									  blocked / 1000, where->str);
+				stall_report (line->str);
+				stalled_beat = beat;
+				updates = 0;
+				g_string_assign (last_where, where->str);
+			}
+			else if (updates < STALL_MAX_UPDATES && strcmp (where->str, last_where->str) != 0)
+			{
+				g_string_printf (line, "stall: still blocked after %" G_GINT64_FORMAT " ms, now in %s",
+									  blocked / 1000, where->str);
+				stall_report (line->str);
+				updates++;
+				g_string_assign (last_where, where->str);
+			}
+		}
+
+		g_mutex_lock (&beat_lock);
+	}
+	g_mutex_unlock (&beat_lock);
+
+	g_string_free (where, TRUE);
+	g_string_free (last_where, TRUE);
+	g_string_free (line, TRUE);
+
+	return NULL;
+}
+
+static gboolean
+stall_heartbeat_cb (gpointer data)
+{
+	gint64 now = g_get_monotonic_time ();
+	gint64 late;
+	gboolean sampled;
+	char buf[128];
+
+	g_mutex_lock (&beat_lock);
+	late = now - last_beat - interval_us;
+	sampled = (sampled_beat == last_beat);
+	last_beat = now;
+	g_mutex_unlock (&beat_lock);
+
+	if (late > threshold_us)
+	{
+		perf_count_stall (late);
+
+		/* over before the monitor woke up, so nobody saw where */
+		if (!sampled)
+		{
+			g_snprintf (buf, sizeof (buf), "stall: main loop blocked for %" G_GINT64_FORMAT
+							" ms, too briefly to sample", late / 1000);
+			stall_report (buf);
+		}
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* called from fe_main(), a threshold change applies on the next start */
+void
+stall_start (void)
+{
+	if (monitor || prefs.hex_gui_stall_threshold <= 0)
+		return;
+
+	threshold_us = (gint64)prefs.hex_gui_stall_threshold * 1000;
+	/* beat often enough to resolve the threshold, without waking an idle
+	   client more than a few times a second */
+	interval_us = CLAMP (threshold_us / 2, 50000, 1000000);
+
+	g_free (report_path);
+	report_path = g_build_filename (get_xdir (), "stall.log", NULL);
+
+	last_beat = g_get_monotonic_time ();
+	monitor_quit = FALSE;
+	beat_tag = g_timeout_add (interval_us / 1000, stall_heartbeat_cb, NULL);
+	monitor = g_thread_new ("stall-monitor", stall_monitor, NULL);
+}
+
+void
+stall_stop (void)
+{
+	if (!monitor)
+		return;
+
+	g_source_remove (beat_tag);
+	beat_tag = 0;
+
+	g_mutex_lock (&beat_lock);
+	monitor_quit = TRUE;
+	g_cond_signal (&beat_cond);
+	g_mutex_unlock (&beat_lock);
+
+	g_thread_join (monitor);
+	monitor = NULL;
+}
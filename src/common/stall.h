@@ -0,0 +1,36 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+#ifndef HEXCHAT_STALL_H
+#define HEXCHAT_STALL_H
+
+/* main loop watchdog: a heartbeat source plus a thread that notices when
+   it stops beating, and writes what the main thread was doing to
+   stall.log in the config dir */
+void stall_start (void);
+void stall_stop (void);
+
+/* label what the main thread is doing; regions nest and must be popped in
+   order. what must be a static string, detail is copied ("owner:name",
+   either may be NULL) */
+void stall_region_push (const char *what, const char *owner, const char *name);
+void stall_region_pop (void);
+
+#endif
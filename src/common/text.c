@@ -37,6 +37,8 @@
 #include "util.h"
 #include "outbound.h"
 #include "hexchatc.h"
+#include "chathistory.h"
+#include "perf.h"
 #include "text.h"
 #include "typedef.h"
 
@@ -217,7 +219,7 @@ scrollback_load (session *sess)
 	GDataInputStream *istream;
 	gchar *buf, *text;
 	gint lines = 0;
-	time_t stamp = 0;
+	time_t stamp = 0, first = 0;
 
 	if (sess->text_scrollback == SET_DEFAULT)
 	{
@@ -279,6 +281,8 @@ scrollback_load (session *sess)
 					g_warning ("Invalid timestamp in scrollback file");
 					continue;
 				}
+				if (!first)
+					first = stamp;
 
 				text = strchr (buf + 3, ' ');
 				if (text && text[1])
@@ -335,6 +339,13 @@ scrollback_load (session *sess)
 
 	sess->scrollwritten = lines;
 
+	/* chathistory then only asks for what's newer than the log */
+	if (first)
+	{
+		chathistory_seen (sess, first, NULL);
+		chathistory_seen (sess, stamp, NULL);
+	}
+
 	if (lines)
 	{
 		text = ctime (&stamp);
@@ -642,7 +653,8 @@ get_stamp_str (char *fmt, time_t tim, char **ret)
 static void
 log_write (session *sess, char *text, time_t ts)
 {
-	char *temp;
+	static GString *scratch;
+	const char *temp;
 	char *stamp;
 	char *file;
 	int len;
@@ -697,7 +709,9 @@ log_write (session *sess, char *text, time_t ts)
 		}
 	}
 
-	temp = strip_color (text, -1, STRIP_ALL);
+	if (!scratch)
+		scratch = g_string_sized_new (512);
+	temp = strip_color_scratch (text, STRIP_ALL, scratch);
 	len = strlen (temp);
 	if (write (sess->logfd, temp, len) < 0)
 		g_warning ("Failed to write to log");
@@ -705,7 +719,6 @@ log_write (session *sess, char *text, time_t ts)
 	if (len == 0 || temp[len - 1] != '\n')
 		if (write (sess->logfd, "\n", 1) < 0)
 			g_warning ("Failed to write to log");
-	g_free (temp);
 }
 
 /**
@@ -845,9 +858,17 @@ PrintTextTimeStamp (session *sess, char *text, time_t timestamp)
 		text = text_fixup_invalid_utf8 (text, -1, NULL);
 	}
 
-	log_write (sess, text, timestamp);
-	scrollback_save (sess, text, timestamp);
-	fe_print_text (sess, text, timestamp, FALSE);
+	/* older history would land out of order in files written in order */
+	if (!sess->text_prepend)
+	{
+		perf_stage_enter (PERF_LOGGING);
+		log_write (sess, text, timestamp);
+		scrollback_save (sess, text, timestamp);
+		perf_stage_leave ();
+	}
+	perf_stage_enter (PERF_FRONTEND);
+	fe_print_text (sess, text, timestamp, sess->text_batch > 0);
+	perf_stage_leave ();
 	g_free (text);
 }
 
@@ -1051,6 +1072,19 @@ static char * const pevt_quit_help[] = {
 	N_("Host"),
 };
 
+static char * const pevt_netsplit_help[] = {
+	N_("First server of the split"),
+	N_("Second server of the split"),
+	N_("Number of nicks"),
+	N_("The nicks"),
+};
+
+static char * const pevt_playback_help[] = {
+	N_("Channel or nick"),
+	N_("Number of lines"),
+	N_("Batch type"),
+};
+
 static char * const pevt_pingrep_help[] = {
 	N_("Who it's from"),
 	N_("The time in x.x format (see below)"),
@@ -1314,7 +1348,7 @@ static char * const pevt_connect_help[] = {
 };
 
 static char * const pevt_sconnect_help[] = {
-	"PID"
+	N_("Server Name")
 };
 
 static char * const pevt_generic_nick_help[] = {
@@ -2026,11 +2060,9 @@ text_color_of (char *name)
 }
 
 
-/* called by EMIT_SIGNAL macro */
-
-void
-text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
-			  time_t timestamp)
+static void
+text_emit_real (int index, session *sess, char *a, char *b, char *c, char *d,
+				 time_t timestamp)
 {
 	char *word[PDIWORDS];
 	int i;
@@ -2076,6 +2108,8 @@ text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
 	case XP_TE_PART:
 	case XP_TE_PARTREASON:
 	case XP_TE_QUIT:
+	case XP_TE_NETJOIN:
+	case XP_TE_NETSPLIT:
 		/* implement ConfMode / Hide Join and Part Messages */
 		if (chanopt_is_set (prefs.hex_irc_conf_mode, sess->text_hidejoinpart))
 			return;
@@ -2086,6 +2120,8 @@ text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
 	case XP_TE_DPRIVMSG:
 	case XP_TE_PRIVACTION:
 	case XP_TE_DPRIVACTION:
+		if (sess->text_batch)	/* history being played back */
+			break;
 		if (chanopt_is_set (prefs.hex_input_beep_priv, sess->alert_beep) && (!prefs.hex_away_omit_alerts || !sess->server->is_away))
 			sound_beep (sess);
 		if (chanopt_is_set (prefs.hex_input_flash_priv, sess->alert_taskbar) && (!prefs.hex_away_omit_alerts || !sess->server->is_away))
@@ -2098,6 +2134,8 @@ text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
 	/* ===Highlighted message=== */
 	case XP_TE_HCHANACTION:
 	case XP_TE_HCHANMSG:
+		if (sess->text_batch)	/* history being played back */
+			break;
 		if (chanopt_is_set (prefs.hex_input_beep_hilight, sess->alert_beep) && (!prefs.hex_away_omit_alerts || !sess->server->is_away))
 			sound_beep (sess);
 		if (chanopt_is_set (prefs.hex_input_flash_hilight, sess->alert_taskbar) && (!prefs.hex_away_omit_alerts || !sess->server->is_away))
@@ -2109,6 +2147,8 @@ text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
 	/* ===Channel message=== */
 	case XP_TE_CHANACTION:
 	case XP_TE_CHANMSG:
+		if (sess->text_batch)	/* history being played back */
+			break;
 		if (chanopt_is_set (prefs.hex_input_beep_chans, sess->alert_beep) && (!prefs.hex_away_omit_alerts || !sess->server->is_away))
 			sound_beep (sess);
 		if (chanopt_is_set (prefs.hex_input_flash_chans, sess->alert_taskbar) && (!prefs.hex_away_omit_alerts || !sess->server->is_away))
@@ -2124,9 +2164,22 @@ text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
 		break;
 	}
 
-	if (!prefs.hex_away_omit_alerts || !sess->server->is_away)
+	if (!sess->text_batch && (!prefs.hex_away_omit_alerts || !sess->server->is_away))
 		sound_play_event (index);
+	perf_stage_enter (PERF_DISPLAY);
 	display_event (sess, index, word, stripcolor_args, timestamp);
+	perf_stage_leave ();
+}
+
+/* called by EMIT_SIGNAL macro */
+
+void
+text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
+			  time_t timestamp)
+{
+	perf_stage_enter (PERF_TEXT_EMIT);
+	text_emit_real (index, sess, a, b, c, d, timestamp);
+	perf_stage_leave ();
 }
 
 char *
@@ -0,0 +1,355 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+/* A hierarchical timer wheel (as in the classic BSD/Linux kernel timers):
+   level 0 holds the next 64 ticks one slot each, every further level
+   covers 64 times the span of the one below at a slot per lower span.
+   When level 0 wraps, the next slot of level 1 is redistributed over it,
+   and so on up. Adding and removing is O(1), and the main loop source is
+   only armed for the nearest slot that has anything in it. */
+
+#include <glib.h>
+
+#include "timerwheel.h"
+
+#define TW_TICK 4				/* ms per tick */
+#define TW_BITS 6
+#define TW_SIZE (1 << TW_BITS)
+#define TW_MASK (TW_SIZE - 1)
+#define TW_LEVELS 4			/* 4 ms * 64^4: about 18 hours */
+#define TW_SPAN ((guint64) 1 << (TW_BITS * TW_LEVELS))
+
+typedef struct
+{
+	GList link;				/* in its slot, data points back here */
+	GQueue *slot;			/* NULL while it runs */
+	int tag;
+	int interval;			/* ms */
+	int slack;				/* ms */
+	gint64 expires;		/* monotonic ms */
+	guint64 tick;			/* when it fires, slack applied */
+	GSourceFunc func;
+	gpointer data;
+	gboolean removed;		/* removed from inside its own callback */
+} tw_timer;
+
+static GQueue wheel[TW_LEVELS][TW_SIZE];
+static guint64 tw_next;		/* first tick not run yet */
+static guint tw_count;
+static GHashTable *tw_tags;	/* tag -> tw_timer */
+static int tw_last_tag;
+static tw_timer *tw_running;
+static GSource *tw_source;
+
+static gint64
+tw_now (void)
+{
+	return g_get_monotonic_time () / 1000;
+}
+
+/* the tick a timer fires on: its deadline with the slack spent on
+   landing on a round multiple of a power of two, which timers with
+   similar deadlines share */
+static guint64
+tw_deadline_tick (tw_timer *t)
+{
+	gint64 deadline = t->expires + t->slack;
+	gint64 grain;
+
+	if (t->slack > 0)
+	{
+		grain = 1;
+		while (grain * 2 <= t->slack)
+			grain *= 2;
+		deadline -= deadline % grain;
+	}
+	return (guint64) (deadline + TW_TICK - 1) / TW_TICK;
+}
+
+static void
+tw_insert (tw_timer *t)
+{
+	guint64 tick = t->tick;
+	guint64 delta;
+	int level;
+
+	if (tick < tw_next)
+		tick = tw_next;
+	delta = tick - tw_next;
+	/* too far out for the top level: park it at its end, it's put back
+	   further when that slot comes down */
+	if (delta >= TW_SPAN)
+	{
+		tick = tw_next + TW_SPAN - 1;
+		delta = TW_SPAN - 1;
+	}
+
+	for (level = 0; level < TW_LEVELS - 1; level++)
+	{
+		if (delta < ((guint64) 1 << (TW_BITS * (level + 1))))
+			break;
+	}
+
+	t->slot = &wheel[level][(tick >> (TW_BITS * level)) & TW_MASK];
+	g_queue_push_tail_link (t->slot, &t->link);
+}
+
+static tw_timer *
+tw_pop (GQueue *slot)
+{
+	GList *link = g_queue_pop_head_link (slot);
+	tw_timer *t;
+
+	if (!link)
+		return NULL;
+	t = link->data;
+	t->slot = NULL;
+	return t;
+}
+
+static void
+tw_cascade (int level, guint64 tick)
+{
+	GQueue *slot = &wheel[level][(tick >> (TW_BITS * level)) & TW_MASK];
+	tw_timer *t;
+
+	while ((t = tw_pop (slot)))
+		tw_insert (t);
+}
+
+static void
+tw_free (tw_timer *t)
+{
+	g_hash_table_remove (tw_tags, GINT_TO_POINTER (t->tag));
+	tw_count--;
+	g_free (t);
+}
+
+static void
+tw_fire (tw_timer *t, gint64 now)
+{
+	gboolean again;
+
+	tw_running = t;
+	again = t->func (t->data);
+	tw_running = NULL;
+
+	if (!again || t->removed)
+	{
+		tw_free (t);
+		return;
+	}
+
+	/* keep the phase, but a late run doesn't cause a burst to catch up */
+	t->expires += t->interval;
+	if (t->expires < now)
+		t->expires = now + t->interval;
+	t->tick = tw_deadline_tick (t);
+	tw_insert (t);
+}
+
+static void
+tw_run (guint64 until)
+{
+	GQueue *slot;
+	tw_timer *t;
+	guint64 tick;
+	int level;
+
+	while (tw_next <= until && tw_count)
+	{
+		tick = tw_next;
+		for (level = 1; level < TW_LEVELS; level++)
+		{
+			if (tick & (((guint64) 1 << (TW_BITS * level)) - 1))
+				break;
+			tw_cascade (level, tick);
+		}
+
+		/* anything the callbacks add for now goes on the next tick */
+		tw_next = tick + 1;
+		slot = &wheel[0][tick & TW_MASK];
+		while ((t = tw_pop (slot)))
+		{
+			if (t->tick > tick)
+				tw_insert (t);		/* came from the parking slot */
+			else
+				tw_fire (t, tw_now ());
+		}
+	}
+
+	if (!tw_count)
+		tw_next = 0;
+}
+
+/* the earliest tick a timer in a slot covering [start, start + span)
+   fires on; parked ones don't fire there, but get moved on at start */
+static guint64
+tw_slot_first (GQueue *slot, guint64 start, guint64 span)
+{
+	GList *link;
+	tw_timer *t;
+	guint64 first = start + span;
+
+	for (link = slot->head; link; link = link->next)
+	{
+		t = link->data;
+		if (t->tick < first)
+			first = t->tick;
+	}
+
+	if (first < start || first >= start + span)
+		return start;
+	return first;
+}
+
+/* the first tick that has to be looked at, G_MAXUINT64 if none. Higher
+   levels are only looked into while they may hold something earlier. */
+static guint64
+tw_next_wakeup (void)
+{
+	guint64 best = G_MAXUINT64;
+	guint64 base, tick;
+	GQueue *slot;
+	int level, shift, k;
+
+	for (level = 0; level < TW_LEVELS; level++)
+	{
+		shift = TW_BITS * level;
+		base = tw_next >> shift;
+		if (level && best <= (base + 1) << shift)
+			break;
+
+		/* level 0 starts with the tick at hand, the others with the next
+		   slot: theirs was cascaded already */
+		for (k = level ? 1 : 0; k <= TW_SIZE - (level ? 0 : 1); k++)
+		{
+			slot = &wheel[level][(base + k) & TW_MASK];
+			if (g_queue_is_empty (slot))
+				continue;
+			tick = tw_slot_first (slot, (base + k) << shift, (guint64) 1 << shift);
+			if (tick < best)
+				best = tick;
+			break;
+		}
+	}
+
+	return best;
+}
+
+static void
+tw_arm (void)
+{
+	guint64 tick;
+
+	if (!tw_source)
+		return;
+
+	tick = tw_count ? tw_next_wakeup () : G_MAXUINT64;
+	if (tick == G_MAXUINT64)
+		g_source_set_ready_time (tw_source, -1);
+	else
+		g_source_set_ready_time (tw_source, (gint64) tick * TW_TICK * 1000);
+}
+
+static gboolean
+tw_dispatch (GSource *source, GSourceFunc callback, gpointer userdata)
+{
+	tw_run ((guint64) tw_now () / TW_TICK);
+	tw_arm ();
+	return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs tw_source_funcs =
+{
+	NULL, NULL, tw_dispatch, NULL
+};
+
+int
+timerwheel_default_slack (int interval)
+{
+	/* about 6%, at most a second */
+	return MIN (interval / 16, 1000);
+}
+
+int
+timerwheel_add (int interval, int slack, GSourceFunc func, gpointer data)
+{
+	tw_timer *t;
+
+	if (!tw_source)
+	{
+		tw_tags = g_hash_table_new (g_direct_hash, g_direct_equal);
+		tw_source = g_source_new (&tw_source_funcs, sizeof (GSource));
+		g_source_set_name (tw_source, "timerwheel");
+		g_source_attach (tw_source, NULL);
+	}
+
+	t = g_new0 (tw_timer, 1);
+	t->link.data = t;
+	t->interval = MAX (interval, 0);
+	t->slack = MAX (slack, 0);
+	t->func = func;
+	t->data = data;
+	t->expires = tw_now () + t->interval;
+	t->tick = tw_deadline_tick (t);
+
+	do
+	{
+		if (++tw_last_tag <= 0)
+			tw_last_tag = 1;
+	}
+	while (g_hash_table_contains (tw_tags, GINT_TO_POINTER (tw_last_tag)));
+	t->tag = tw_last_tag;
+	g_hash_table_insert (tw_tags, GINT_TO_POINTER (t->tag), t);
+
+	/* an empty wheel has nothing to catch up on */
+	if (!tw_count++)
+		tw_next = (guint64) tw_now () / TW_TICK;
+
+	tw_insert (t);
+	if (!tw_running)
+		tw_arm ();
+	return t->tag;
+}
+
+void
+timerwheel_remove (int tag)
+{
+	tw_timer *t;
+
+	if (!tw_tags)
+		return;
+
+	t = g_hash_table_lookup (tw_tags, GINT_TO_POINTER (tag));
+	if (!t)
+		return;
+
+	if (t == tw_running)
+	{
+		t->removed = TRUE;
+		return;
+	}
+
+	if (t->slot)
+		g_queue_unlink (t->slot, &t->link);
+	tw_free (t);
+}
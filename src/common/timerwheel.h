@@ -0,0 +1,37 @@
+/* HexChat
+ * Copyright (C) 1998-2010 Peter Zelezny.
+ * Copyright (C) 2009-2013 Berke Viktor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+
+#ifndef HEXCHAT_TIMERWHEEL_H
+#define HEXCHAT_TIMERWHEEL_H
+
+#include <glib.h>
+
+/* Periodic timers of the core and of plugins, all run from one main loop
+   source. A timer may fire up to its slack (ms) late, so timers due close
+   together share a wakeup. func returning FALSE stops the timer, like a
+   GLib timeout. Returns a tag for timerwheel_remove(), never 0. */
+int timerwheel_add (int interval, int slack, GSourceFunc func, gpointer data);
+void timerwheel_remove (int tag);
+
+/* the slack that suits a timer of this interval when nobody cares */
+int timerwheel_default_slack (int interval);
+
+#endif
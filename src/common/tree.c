@@ -183,6 +183,38 @@ tree_remove_at_pos (tree *t, int pos)
 	return ret;
 }
 
+void *
+tree_get_at_pos (tree *t, int pos)
+{
+	if (!t || pos < 0 || pos >= t->elements)
+		return NULL;
+
+	return t->array[pos];
+}
+
+/* position of the first element that sorts after key */
+int
+tree_find_after (tree *t, const void *key, tree_cmp_func *cmp, void *data)
+{
+	int l, u, idx;
+
+	if (!t)
+		return 0;
+
+	l = 0;
+	u = t->elements;
+	while (l < u)
+	{
+		idx = (l + u) / 2;
+		if (cmp (key, t->array[idx], data) < 0)
+			u = idx;
+		else
+			l = idx + 1;
+	}
+
+	return l;
+}
+
 int
 tree_remove (tree *t, void *key, int *pos)
 {
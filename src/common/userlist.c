@@ -25,6 +25,7 @@
 #include "fe.h"
 #include "notify.h"
 #include "tree.h"
+#include "slab.h"
 #include "hexchatc.h"
 #include "util.h"
 
@@ -49,13 +50,13 @@ nick_cmp_az_ops (server *serv, struct User *user1, struct User *user2)
 		}
 	}
 
-	return serv->p_cmp (user1->nick, user2->nick);
+	return strcmp (user1->nick_fold, user2->nick_fold);
 }
 
 int
 nick_cmp_alpha (struct User *user1, struct User *user2, server *serv)
 {
-	return serv->p_cmp (user1->nick, user2->nick);
+	return strcmp (user1->nick_fold, user2->nick_fold);
 }
 
 /*
@@ -74,106 +75,244 @@ userlist_insertname (session *sess, struct User *newuser)
 	return tree_insert (sess->usertree, newuser);
 }
 
-void
-userlist_set_away (struct session *sess, char *nick, unsigned int away)
+/* hostnames and servernames repeat across thousands of users, keep one copy
+   of each per server, refcounted */
+static char *
+user_string_ref (server *serv, const char *str)
+{
+	gpointer key, refs;
+
+	if (!str)
+		return NULL;
+
+	if (!serv->user_strings)
+		serv->user_strings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	if (g_hash_table_lookup_extended (serv->user_strings, str, &key, &refs))
+	{
+		g_hash_table_insert (serv->user_strings, key, GUINT_TO_POINTER (GPOINTER_TO_UINT (refs) + 1));
+		return key;
+	}
+
+	key = g_strdup (str);
+	g_hash_table_insert (serv->user_strings, key, GUINT_TO_POINTER (1));
+	return key;
+}
+
+static void
+user_string_unref (server *serv, const char *str)
+{
+	guint refs;
+
+	if (!str)
+		return;
+
+	refs = GPOINTER_TO_UINT (g_hash_table_lookup (serv->user_strings, str));
+	if (refs <= 1)
+		g_hash_table_remove (serv->user_strings, str);
+	else
+		g_hash_table_insert (serv->user_strings, (char *)str, GUINT_TO_POINTER (refs - 1));
+}
+
+static void
+user_string_set (server *serv, char **field, const char *str)
+{
+	char *old = *field;
+
+	*field = user_string_ref (serv, str);
+	user_string_unref (serv, old);
+}
+
+struct userinfo *
+userlist_find_info (server *serv, const char *name)
+{
+	char key[NICKLEN];
+
+	if (!serv->users)
+		return NULL;
+
+	casemap_fold (serv->p_casemap, key, name, sizeof (key));
+	return g_hash_table_lookup (serv->users, key);
+}
+
+/* records per slab chunk: registries grow large, channels mostly stay small */
+#define USERINFO_CHUNK 256
+#define MEMBER_CHUNK 32
+
+static void
+userinfo_free (server *serv, struct userinfo *info)
+{
+	user_string_unref (serv, info->hostname);
+	user_string_unref (serv, info->servername);
+	user_string_unref (serv, info->realname);
+	user_string_unref (serv, info->account);
+	slab_free (serv->userinfo_slab, info);
+}
+
+/* returns the registry record for nick, creating it on first sight */
+static struct userinfo *
+userinfo_get (server *serv, const char *nick)
+{
+	struct userinfo *info;
+
+	if (!serv->users)
+	{
+		serv->users = g_hash_table_new (g_str_hash, g_str_equal);
+		serv->userinfo_slab = g_new (slab, 1);
+		slab_init (serv->userinfo_slab, sizeof (struct userinfo), USERINFO_CHUNK);
+	}
+
+	info = userlist_find_info (serv, nick);
+	if (!info)
+	{
+		info = slab_alloc0 (serv->userinfo_slab);
+		safe_strcpy (info->nick, nick, NICKLEN);
+		casemap_fold (serv->p_casemap, info->nick_fold, info->nick, NICKLEN);
+		g_hash_table_insert (serv->users, info->nick_fold, info);
+	}
+
+	return info;
+}
+
+static void
+userinfo_link (struct userinfo *info, struct User *user)
+{
+	user->info = info;
+	user->prev_member = NULL;
+	user->next_member = info->members;
+	if (info->members)
+		info->members->prev_member = user;
+	info->members = user;
+}
+
+/* drops one membership; the record goes away with its last channel */
+static void
+userinfo_unlink (server *serv, struct User *user)
+{
+	struct userinfo *info = user->info;
+
+	if (user->prev_member)
+		user->prev_member->next_member = user->next_member;
+	else
+		info->members = user->next_member;
+	if (user->next_member)
+		user->next_member->prev_member = user->prev_member;
+
+	if (!info->members)
+	{
+		g_hash_table_remove (serv->users, info->nick_fold);
+		userinfo_free (serv, info);
+	}
+}
+
+/* tell every channel showing this user that its details changed */
+static void
+userinfo_update_gui (struct userinfo *info, gboolean rehash)
 {
 	struct User *user;
 
-	user = userlist_find (sess, nick);
-	if (user)
+	for (user = info->members; user; user = user->next_member)
 	{
-		if (user->away != away)
-		{
-			user->away = away;
-			/* rehash GUI */
-			fe_userlist_rehash (sess, user);
-			if (away)
-				fe_userlist_update (sess, user);
-		}
+		fe_userlist_update (user->sess, user);
+		if (rehash)
+			fe_userlist_rehash (user->sess, user);
 	}
 }
 
 void
-userlist_set_account (struct session *sess, char *nick, char *account)
+userlist_set_away (server *serv, char *nick, unsigned int away)
 {
-	struct User *user;
+	struct userinfo *info;
 
-	user = userlist_find (sess, nick);
-	if (user)
+	info = userlist_find_info (serv, nick);
+	if (info && info->away != away)
+	{
+		info->away = away;
+		/* rehash GUI */
+		userinfo_update_gui (info, TRUE);
+	}
+}
+
+void
+userlist_set_account (server *serv, char *nick, char *account)
+{
+	struct userinfo *info;
+
+	info = userlist_find_info (serv, nick);
+	if (info)
 	{
 		if (strcmp (account, "*") == 0)
-		{
-			g_clear_pointer (&user->account, g_free);
-		} else if (g_strcmp0 (user->account, account))
-		{
-			g_free (user->account);
-			user->account = g_strdup (account);
-		}
+			user_string_set (serv, &info->account, NULL);
+		else if (g_strcmp0 (info->account, account))
+			user_string_set (serv, &info->account, account);
 
 		/* gui doesnt currently reflect login status, maybe later
-		fe_userlist_rehash (sess, user); */
+		userinfo_update_gui (info, TRUE); */
 	}
 }
 
 int
-userlist_add_hostname (struct session *sess, char *nick, char *hostname,
+userlist_add_hostname (server *serv, char *nick, char *hostname,
 							  char *realname, char *servername, char *account, unsigned int away)
 {
-	struct User *user;
+	struct userinfo *info;
 	gboolean do_rehash = FALSE;
 
-	user = userlist_find (sess, nick);
-	if (user)
+	info = userlist_find_info (serv, nick);
+	if (info)
 	{
-		if (hostname && (!user->hostname || strcmp(user->hostname, hostname)))
+		if (hostname && (!info->hostname || strcmp(info->hostname, hostname)))
 		{
 			if (prefs.hex_gui_ulist_show_hosts)
 				do_rehash = TRUE;
-			g_free (user->hostname);
-			user->hostname = g_strdup (hostname);
+			user_string_set (serv, &info->hostname, hostname);
 		}
-		if (realname && *realname && g_strcmp0 (user->realname, realname) != 0)
-		{
-			g_free (user->realname);
-			user->realname = g_strdup (realname);
-		}
-		if (!user->servername && servername)
-			user->servername = g_strdup (servername);
-		if (!user->account && account && strcmp (account, "0") != 0)
-			user->account = g_strdup (account);
+		if (realname && *realname && g_strcmp0 (info->realname, realname) != 0)
+			user_string_set (serv, &info->realname, realname);
+		if (!info->servername && servername)
+			info->servername = user_string_ref (serv, servername);
+		if (!info->account && account && strcmp (account, "0") != 0)
+			info->account = user_string_ref (serv, account);
 		if (away != 0xff)
 		{
-			if (user->away != away)
+			if (info->away != away)
 				do_rehash = TRUE;
-			user->away = away;
+			info->away = away;
 		}
 
-		fe_userlist_update (sess, user);
-		if (do_rehash)
-			fe_userlist_rehash (sess, user);
+		userinfo_update_gui (info, do_rehash);
 
 		return 1;
 	}
 	return 0;
 }
 
-static int
-free_user (struct User *user, gpointer data)
+static void
+free_user (session *sess, struct User *user)
 {
-	g_free (user->realname);
-	g_free (user->hostname);
-	g_free (user->servername);
-	g_free (user->account);
-	g_free (user);
+	userinfo_unlink (sess->server, user);
+	slab_free (sess->user_slab, user);
+}
 
+static int
+unlink_cb (struct User *user, server *serv)
+{
+	userinfo_unlink (serv, user);
 	return TRUE;
 }
 
 void
 userlist_free (session *sess)
 {
-	tree_foreach (sess->usertree, (tree_traverse_func *)free_user, NULL);
+	/* the registry still has to forget each membership, but their storage
+	   goes back in one slab_clear instead of a free per user */
+	tree_foreach (sess->usertree, (tree_traverse_func *)unlink_cb, sess->server);
 	tree_destroy (sess->usertree);
+	if (sess->user_slab)
+	{
+		slab_clear (sess->user_slab);
+		g_clear_pointer (&sess->user_slab, g_free);
+	}
 
 	sess->usertree = NULL;
 	sess->me = NULL;
@@ -193,41 +332,49 @@ userlist_clear (session *sess)
 }
 
 static int
-find_cmp (const char *name, struct User *user, server *serv)
+find_cmp (const char *key, struct User *user, server *serv)
 {
-	return serv->p_cmp ((char *)name, user->nick);
+	return strcmp (key, user->nick_fold);
 }
 
 struct User *
 userlist_find (struct session *sess, const char *name)
 {
+	char key[NICKLEN];
 	int pos;
 
 	if (sess->usertree)
-		return tree_find (sess->usertree, name,
+	{
+		casemap_fold (sess->server->p_casemap, key, name, sizeof (key));
+		return tree_find (sess->usertree, key,
 								(tree_cmp_func *)find_cmp, sess->server, &pos);
+	}
 
 	return NULL;
 }
 
+/* any one channel membership of name, for callers that want its details */
 struct User *
 userlist_find_global (struct server *serv, char *name)
 {
-	struct User *user;
-	session *sess;
-	GSList *list = sess_list;
-	while (list)
+	struct userinfo *info = userlist_find_info (serv, name);
+
+	if (info)
+		return info->members;
+	return NULL;
+}
+
+void
+userlist_server_free (server *serv)
+{
+	/* every session has been freed by now, so both tables are empty */
+	g_clear_pointer (&serv->users, g_hash_table_destroy);
+	g_clear_pointer (&serv->user_strings, g_hash_table_destroy);
+	if (serv->userinfo_slab)
 	{
-		sess = (session *) list->data;
-		if (sess->server == serv)
-		{
-			user = userlist_find (sess, name);
-			if (user)
-				return user;
-		}
-		list = list->next;
+		slab_clear (serv->userinfo_slab);
+		g_clear_pointer (&serv->userinfo_slab, g_free);
 	}
-	return NULL;
 }
 
 static void
@@ -302,26 +449,48 @@ userlist_update_mode (session *sess, char *name, char mode, char sign)
 	fe_userlist_numbers (sess);
 }
 
-int
-userlist_change (struct session *sess, char *oldname, char *newname)
+/* renames the nick in every channel it is on, returns its record or NULL */
+struct userinfo *
+userlist_change (server *serv, char *oldname, char *newname)
 {
-	struct User *user = userlist_find (sess, oldname);
+	struct userinfo *info = userlist_find_info (serv, oldname);
+	struct userinfo *stale;
+	struct User *user, *next;
 	int pos;
 
-	if (user)
+	if (!info)
+		return NULL;
+
+	/* a leftover record already using the new nick, e.g. a missed QUIT */
+	stale = userlist_find_info (serv, newname);
+	if (stale && stale != info)
 	{
-		tree_remove (sess->usertree, user, &pos);
-		fe_userlist_remove (sess, user);
+		/* the last removal frees stale, so don't touch it afterwards */
+		for (user = stale->members; user; user = next)
+		{
+			next = user->next_member;
+			userlist_remove_user (user->sess, user);
+		}
+	}
+
+	g_hash_table_remove (serv->users, info->nick_fold);
+	safe_strcpy (info->nick, newname, NICKLEN);
+	casemap_fold (serv->p_casemap, info->nick_fold, info->nick, NICKLEN);
+	g_hash_table_insert (serv->users, info->nick_fold, info);
 
-		safe_strcpy (user->nick, newname, NICKLEN);
+	for (user = info->members; user; user = user->next_member)
+	{
+		tree_remove (user->sess->usertree, user, &pos);
+		fe_userlist_remove (user->sess, user);
 
-		tree_insert (sess->usertree, user);
-		fe_userlist_insert (sess, user, FALSE);
+		strcpy (user->nick, info->nick);
+		strcpy (user->nick_fold, info->nick_fold);
 
-		return 1;
+		tree_insert (user->sess->usertree, user);
+		fe_userlist_insert (user->sess, user, FALSE);
 	}
 
-	return 0;
+	return info;
 }
 
 int
@@ -348,20 +517,23 @@ userlist_remove_user (struct session *sess, struct User *user)
 	if (user->hop)
 		sess->hops--;
 	sess->total--;
-	fe_userlist_numbers (sess);
+	if (!sess->userlist_frozen)
+		fe_userlist_numbers (sess);
 	fe_userlist_remove (sess, user);
 
 	if (user == sess->me)
 		sess->me = NULL;
 
 	tree_remove (sess->usertree, user, &pos);
-	free_user (user, NULL);
+	free_user (sess, user);
 }
 
 void
 userlist_add (struct session *sess, char *name, char *hostname,
 				  char *account, char *realname, const message_tags_data *tags_data)
 {
+	server *serv = sess->server;
+	struct userinfo *info;
 	struct User *user;
 	int row, prefix_chars;
 	unsigned int acc;
@@ -370,28 +542,36 @@ userlist_add (struct session *sess, char *name, char *hostname,
 
 	notify_set_online (sess->server, name + prefix_chars, tags_data);
 
-	user = g_new0 (struct User, 1);
+	if (!sess->user_slab)
+	{
+		sess->user_slab = g_new (slab, 1);
+		slab_init (sess->user_slab, sizeof (struct User), MEMBER_CHUNK);
+	}
+	user = slab_alloc0 (sess->user_slab);
 
 	user->access = acc;
+	user->sess = sess;
 
 	/* assume first char is the highest level nick prefix */
 	if (prefix_chars)
 		user->prefix[0] = name[0];
 
 	/* add it to our linked list */
-	if (hostname)
-		user->hostname = g_strdup (hostname);
-	safe_strcpy (user->nick, name + prefix_chars, NICKLEN);
+	info = userinfo_get (serv, name + prefix_chars);
+	if (hostname && g_strcmp0 (info->hostname, hostname) != 0)
+		user_string_set (serv, &info->hostname, hostname);
+	strcpy (user->nick, info->nick);
+	strcpy (user->nick_fold, info->nick_fold);
 	/* is it me? */
-	if (!sess->server->p_cmp (user->nick, sess->server->nick))
+	if (!serv->p_cmp (user->nick, serv->nick))
 		user->me = TRUE;
 	/* extended join info */
-	if (sess->server->have_extjoin)
+	if (serv->have_extjoin)
 	{
-		if (account && *account)
-			user->account = g_strdup (account);
-		if (realname && *realname)
-			user->realname = g_strdup (realname);
+		if (account && *account && g_strcmp0 (info->account, account) != 0)
+			user_string_set (serv, &info->account, account);
+		if (realname && *realname && g_strcmp0 (info->realname, realname) != 0)
+			user_string_set (serv, &info->realname, realname);
 	}
 
 	row = userlist_insertname (sess, user);
@@ -399,13 +579,13 @@ userlist_add (struct session *sess, char *name, char *hostname,
 	/* duplicate? some broken servers trigger this */
 	if (row == -1)
 	{
-		g_free (user->hostname);
-		g_free (user->account);
-		g_free (user->realname);
-		g_free (user);
+		/* info already lists the original membership, so it can't go away */
+		slab_free (sess->user_slab, user);
 		return;
 	}
 
+	userinfo_link (info, user);
+
 	sess->total++;
 
 	/* most ircds don't support multiple modechars in front of the nickname
@@ -421,10 +601,28 @@ userlist_add (struct session *sess, char *name, char *hostname,
 		sess->me = user;
 
 	fe_userlist_insert (sess, user, FALSE);
-	if(sess->end_of_names)
+	if(sess->end_of_names && !sess->userlist_frozen)
 		fe_userlist_numbers (sess);
 }
 
+/* drop a batch of nicks, letting the frontend update its model once */
+void
+userlist_remove_nicks (session *sess, GPtrArray *nicks)
+{
+	struct User *user;
+	guint i;
+
+	sess->userlist_frozen = TRUE;
+	for (i = 0; i < nicks->len; i++)
+	{
+		user = userlist_find (sess, nicks->pdata[i]);
+		if (user)
+			userlist_remove_user (sess, user);
+	}
+	sess->userlist_frozen = FALSE;
+	fe_userlist_numbers (sess);
+}
+
 static int
 rehash_cb (struct User *user, session *sess)
 {
@@ -438,6 +636,97 @@ userlist_rehash (session *sess)
 	tree_foreach (sess->usertree, (tree_traverse_func *)rehash_cb, sess);
 }
 
+struct refold
+{
+	session *sess;
+	GSList *dupes;
+};
+
+static int
+refold_cb (struct User *user, struct refold *rf)
+{
+	casemap_fold (rf->sess->server->p_casemap, user->nick_fold, user->nick, NICKLEN);
+	if (tree_insert (rf->sess->usertree, user) == -1)
+		rf->dupes = g_slist_prepend (rf->dupes, user);
+	return TRUE;
+}
+
+/* the server changed its CASEMAPPING: recompute every key and re-sort */
+void
+userlist_refold (session *sess)
+{
+	struct refold rf;
+	struct User *user;
+	tree *old = sess->usertree;
+
+	if (!old)
+		return;
+
+	rf.sess = sess;
+	rf.dupes = NULL;
+	sess->usertree = tree_new ((tree_cmp_func *)nick_cmp_alpha, sess->server);
+	tree_foreach (old, (tree_traverse_func *)refold_cb, &rf);
+	tree_destroy (old);
+
+	/* nicks that only differed under the old mapping are now the same user */
+	while (rf.dupes)
+	{
+		user = rf.dupes->data;
+		if (user->voice)
+			sess->voices--;
+		if (user->op)
+			sess->ops--;
+		if (user->hop)
+			sess->hops--;
+		sess->total--;
+		if (user == sess->me)
+			sess->me = NULL;
+		fe_userlist_remove (sess, user);
+		free_user (sess, user);
+		rf.dupes = g_slist_delete_link (rf.dupes, rf.dupes);
+	}
+	fe_userlist_numbers (sess);
+}
+
+/* the server changed its CASEMAPPING: rekey the registry, merging records
+   that now fold to the same nick. userlist_refold() then drops duplicate
+   memberships from each channel. */
+void
+userlist_refold_server (server *serv)
+{
+	GHashTable *old = serv->users;
+	GHashTableIter iter;
+	struct userinfo *info, *other;
+	struct User *user, *next;
+
+	if (!old)
+		return;
+
+	serv->users = g_hash_table_new (g_str_hash, g_str_equal);
+
+	g_hash_table_iter_init (&iter, old);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&info))
+	{
+		casemap_fold (serv->p_casemap, info->nick_fold, info->nick, NICKLEN);
+		other = g_hash_table_lookup (serv->users, info->nick_fold);
+		if (!other)
+		{
+			g_hash_table_insert (serv->users, info->nick_fold, info);
+			continue;
+		}
+
+		for (user = info->members; user; user = next)
+		{
+			next = user->next_member;
+			userinfo_link (other, user);
+		}
+		info->members = NULL;
+		userinfo_free (serv, info);
+	}
+
+	g_hash_table_destroy (old);
+}
+
 static int
 flat_cb (struct User *user, GSList **list)
 {
@@ -454,6 +743,30 @@ userlist_flat_list (session *sess)
 	return g_slist_reverse (list);
 }
 
+/* walks the tree in place; if the previous user moved or left, carry on
+   from the first nick sorting after it */
+struct User *
+userlist_cursor_next (session *sess, userlist_cursor *cur)
+{
+	struct User *user;
+
+	if (!sess->usertree)
+		return NULL;
+
+	if (cur->user && tree_get_at_pos (sess->usertree, cur->pos - 1) != cur->user)
+		cur->pos = tree_find_after (sess->usertree, cur->nick_fold,
+											 (tree_cmp_func *)find_cmp, sess->server);
+
+	user = tree_get_at_pos (sess->usertree, cur->pos);
+	if (!user)
+		return NULL;
+
+	cur->pos++;
+	cur->user = user;
+	safe_strcpy (cur->nick_fold, user->nick_fold, sizeof (cur->nick_fold));
+	return user;
+}
+
 static int
 double_cb (struct User *user, GList **list)
 {
@@ -23,13 +23,29 @@
 #ifndef HEXCHAT_USERLIST_H
 #define HEXCHAT_USERLIST_H
 
-struct User
+/* one record per nick per server, shared by every channel the nick is on */
+struct userinfo
 {
 	char nick[NICKLEN];
+	char nick_fold[NICKLEN];	/* key in server->users */
+	/* all four strings are interned in server->user_strings */
 	char *hostname;
-	char *realname;
 	char *servername;
+	char *realname;
 	char *account;
+	unsigned int away:1;
+	struct User *members;		/* one per channel, linked through next_member */
+};
+
+/* a nick's membership of one channel */
+struct User
+{
+	char nick[NICKLEN];
+	char nick_fold[NICKLEN];	/* nick, casefolded by server->p_casemap */
+	struct userinfo *info;
+	struct User *next_member;	/* same nick in the server's other channels */
+	struct User *prev_member;
+	struct session *sess;
 	time_t lasttalk;
 	unsigned int access;	/* axs bit field */
 	char prefix[2]; /* @ + % */
@@ -37,30 +53,43 @@ struct User
 	unsigned int hop:1;
 	unsigned int voice:1;
 	unsigned int me:1;
-	unsigned int away:1;
 	unsigned int selected:1;
 };
 
 #define USERACCESS_SIZE 12
 
-int userlist_add_hostname (session *sess, char *nick,
+/* position in a channel's userlist that stays valid while users come and go */
+typedef struct
+{
+	int pos;
+	struct User *user;
+	char nick_fold[NICKLEN];
+} userlist_cursor;
+
+int userlist_add_hostname (server *serv, char *nick,
 									char *hostname, char *realname,
 									char *servername, char *account, unsigned int away);
-void userlist_set_away (session *sess, char *nick, unsigned int away);
-void userlist_set_account (session *sess, char *nick, char *account);
+void userlist_set_away (server *serv, char *nick, unsigned int away);
+void userlist_set_account (server *serv, char *nick, char *account);
 struct User *userlist_find (session *sess, const char *name);
 struct User *userlist_find_global (server *serv, char *name);
+struct userinfo *userlist_find_info (server *serv, const char *name);
 void userlist_clear (session *sess);
 void userlist_free (session *sess);
 void userlist_add (session *sess, char *name, char *hostname, char *account,
 						 char *realname, const message_tags_data *tags_data);
 int userlist_remove (session *sess, char *name);
 void userlist_remove_user (session *sess, struct User *user);
-int userlist_change (session *sess, char *oldname, char *newname);
+void userlist_remove_nicks (session *sess, GPtrArray *nicks);
+struct userinfo *userlist_change (server *serv, char *oldname, char *newname);
 void userlist_update_mode (session *sess, char *name, char mode, char sign);
 GSList *userlist_flat_list (session *sess);
+struct User *userlist_cursor_next (session *sess, userlist_cursor *cur);
 GList *userlist_double_list (session *sess);
 void userlist_rehash (session *sess);
+void userlist_refold (session *sess);
+void userlist_refold_server (server *serv);
+void userlist_server_free (server *serv);
 int nick_cmp_az_ops (server *serv, struct User *user1, struct User *user2);
 int nick_cmp_alpha (struct User *user1, struct User *user2, server *serv);
 
@@ -42,6 +42,10 @@
 #include <ctype.h>
 #include "util.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #if defined (__FreeBSD__) || defined (__APPLE__)
 #include <sys/sysctl.h>
 #endif
@@ -173,6 +177,48 @@ expand_homedir (char *file)
 	return g_strdup (file);
 }
 
+/* Find the first byte below 0x20 in [src, end). Every formatting code is a
+   control character and most lines have none, so this decides how much can
+   be copied without looking at it byte by byte. */
+
+static const char *
+strip_find_ctrl (const char *src, const char *end)
+{
+#ifdef __SSE2__
+	const __m128i limit = _mm_set1_epi8 (0x1f);
+	__m128i v;
+	int mask;
+
+	while (end - src >= 16)
+	{
+		v = _mm_loadu_si128 ((const __m128i *) src);
+		/* unsigned v <= 0x1f */
+		mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_min_epu8 (v, limit), v));
+		if (mask)
+			return src + g_bit_nth_lsf (mask, -1);
+		src += 16;
+	}
+#else
+	const guint64 ones = G_GUINT64_CONSTANT (0x0101010101010101);
+	const guint64 highs = G_GUINT64_CONSTANT (0x8080808080808080);
+	guint64 w;
+
+	/* a word has a byte below 0x20 if subtracting 0x20 from each borrows */
+	while (end - src >= 8)
+	{
+		memcpy (&w, src, 8);
+		if ((w - ones * 0x20) & ~w & highs)
+			break;
+		src += 8;
+	}
+#endif
+
+	while (src < end && (unsigned char) *src >= 0x20)
+		src++;
+
+	return src;
+}
+
 gchar *
 strip_color (const char *text, int len, int flags)
 {
@@ -194,17 +240,51 @@ strip_color (const char *text, int len, int flags)
 	return new_str;
 }
 
+/* Like strip_color(), but doesn't allocate: text itself is returned when
+   there is nothing to strip, otherwise the result is written to scratch.
+   text must be nul terminated; STRIP_ESCMARKUP isn't supported. */
+const char *
+strip_color_scratch (const char *text, int flags, GString *scratch)
+{
+	size_t len = strlen (text);
+
+	if (strip_find_ctrl (text, text + len) == text + len)
+		return text;
+
+	g_string_set_size (scratch, len + 1);
+	g_string_truncate (scratch, strip_color2 (text, len, scratch->str, flags));
+	return scratch->str;
+}
+
 /* CL: strip_color2 strips src and writes the output at dst; pass the same pointer
 	in both arguments to strip in place. */
 int
 strip_color2 (const char *src, int len, char *dst, int flags)
 {
 	int rcol = 0, bgcol = 0;
+	const char *end, *run;
 	char *start = dst;
 
 	if (len == -1) len = strlen (src);
-	while (len-- > 0)
+	end = src + len;
+
+	while (src < end)
 	{
+		if (rcol == 0)
+		{
+			/* no code can start before the next control character */
+			run = strip_find_ctrl (src, end);
+			if (run != src)
+			{
+				if (dst != src)
+					memmove (dst, src, run - src);
+				dst += run - src;
+				src = run;
+				if (src == end)
+					break;
+			}
+		}
+
 		if (rcol > 0 && (isdigit ((unsigned char)*src) ||
 			(*src == ',' && isdigit ((unsigned char)src[1]) && !bgcol)))
 		{
@@ -877,20 +957,43 @@ make_ping_time (void)
 }
 
 int
-rfc_casecmp (const char *s1, const char *s2)
+casemap_cmp (const unsigned char *map, const char *s1, const char *s2)
 {
-	int c1, c2;
+	const unsigned char *p1 = (const unsigned char *)s1;
+	const unsigned char *p2 = (const unsigned char *)s2;
 
-	while (*s1 && *s2)
+	while (*p1 && map[*p1] == map[*p2])
 	{
-		c1 = (int)rfc_tolower (*s1);
-		c2 = (int)rfc_tolower (*s2);
-		if (c1 != c2)
-			return (c1 - c2);
-		s1++;
-		s2++;
+		p1++;
+		p2++;
 	}
-	return (((int)*s1) - ((int)*s2));
+	return (int)map[*p1] - (int)map[*p2];
+}
+
+/* folds src into dest (at most size bytes, always terminated) so that
+   two names can be compared with a plain strcmp afterwards */
+void
+casemap_fold (const unsigned char *map, char *dest, const char *src, size_t size)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	unsigned char *d = (unsigned char *)dest;
+	unsigned char *end = d + size - 1;
+
+	while (*s && d < end)
+		*d++ = map[*s++];
+	*d = 0;
+}
+
+int
+rfc_casecmp (const char *s1, const char *s2)
+{
+	return casemap_cmp (rfc_tolowertab, s1, s2);
+}
+
+int
+strict_rfc_casecmp (const char *s1, const char *s2)
+{
+	return casemap_cmp (strict_rfc_tolowertab, s1, s2);
 }
 
 int
@@ -913,6 +1016,7 @@ rfc_ncasecmp (char *s1, char *s2, int n)
 	return (n == 0) ? 0 : (c1 - c2);
 }
 
+/* CASEMAPPING=rfc1459, the default: [ \ ] ^ are the uppercase of { | } ~ */
 const unsigned char rfc_tolowertab[] =
 	{ 0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0x8, 0x9, 0xa,
 	0xb, 0xc, 0xd, 0xe, 0xf, 0x10, 0x11, 0x12, 0x13, 0x14,
@@ -948,6 +1052,78 @@ const unsigned char rfc_tolowertab[] =
 	0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
 };
 
+/* CASEMAPPING=strict-rfc1459: like rfc1459 but ^ and ~ are distinct */
+const unsigned char strict_rfc_tolowertab[] =
+	{ 0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0x8, 0x9, 0xa,
+	0xb, 0xc, 0xd, 0xe, 0xf, 0x10, 0x11, 0x12, 0x13, 0x14,
+	0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f,
+	' ', '!', '"', '#', '$', '%', '&', 0x27, '(', ')',
+	'*', '+', ',', '-', '.', '/',
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+	':', ';', '<', '=', '>', '?',
+	'@', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
+	'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's',
+	't', 'u', 'v', 'w', 'x', 'y', 'z', '{', '|', '}', '^',
+	'_',
+	'`', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
+	'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's',
+	't', 'u', 'v', 'w', 'x', 'y', 'z', '{', '|', '}', '~',
+	0x7f,
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+	0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9,
+	0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9,
+	0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+	0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+	0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+	0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+	0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+	0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9,
+	0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+
+/* CASEMAPPING=ascii: only A-Z fold */
+const unsigned char ascii_tolowertab[] =
+	{ 0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0x8, 0x9, 0xa,
+	0xb, 0xc, 0xd, 0xe, 0xf, 0x10, 0x11, 0x12, 0x13, 0x14,
+	0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f,
+	' ', '!', '"', '#', '$', '%', '&', 0x27, '(', ')',
+	'*', '+', ',', '-', '.', '/',
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+	':', ';', '<', '=', '>', '?',
+	'@', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
+	'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's',
+	't', 'u', 'v', 'w', 'x', 'y', 'z', '[', '\\', ']', '^',
+	'_',
+	'`', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i',
+	'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's',
+	't', 'u', 'v', 'w', 'x', 'y', 'z', '{', '|', '}', '~',
+	0x7f,
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+	0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9,
+	0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9,
+	0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+	0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+	0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+	0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+	0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+	0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9,
+	0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+
 static gboolean
 file_exists (char *fname)
 {
@@ -38,6 +38,8 @@
 #define ELLIPSIS "\xe2\x80\xa6"
 
 extern const unsigned char rfc_tolowertab[];
+extern const unsigned char strict_rfc_tolowertab[];
+extern const unsigned char ascii_tolowertab[];
 
 char *expand_homedir (char *file);
 void path_part (char *file, char *path, int pathlen);
@@ -45,6 +47,9 @@ int match (const char *mask, const char *string);
 char *file_part (char *file);
 void for_files (const char *dirname, const char *mask, void callback (char *file));
 int rfc_casecmp (const char *, const char *);
+int strict_rfc_casecmp (const char *, const char *);
+int casemap_cmp (const unsigned char *map, const char *s1, const char *s2);
+void casemap_fold (const unsigned char *map, char *dest, const char *src, size_t size);
 int rfc_ncasecmp (char *, char *, int);
 int buf_get_line (char *, char **, int *, int len);
 char *nocasestrstr (const char *text, const char *tofind);
@@ -58,11 +63,11 @@ void util_exec (const char *cmd);
 #define STRIP_ESCMARKUP 8
 #define STRIP_ALL 7
 gchar *strip_color (const char *text, int len, int flags);
+const char *strip_color_scratch (const char *text, int flags, GString *scratch);
 int strip_color2 (const char *src, int len, char *dst, int flags);
 int strip_hidden_attribute (char *src, char *dst);
 char *errorstring (int err);
 int waitline (int sok, char *buf, int bufsize, int);
-#define waitline2(source,buf,size) waitline(serv->childread,buf,size,0)
 unsigned long make_ping_time (void);
 void move_file (char *src_dir, char *dst_dir, char *fname, int dccpermissions);
 int token_foreach (char *str, char sep, int (*callback) (char *str, void *ud), void *ud);
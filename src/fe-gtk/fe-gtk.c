@@ -673,6 +673,13 @@ fe_print_text (struct session *sess, char *text, time_t stamp,
 		fe_set_tab_color (sess, FE_COLOR_NEW_DATA);
 }
 
+void
+fe_text_batch (struct session *sess, fe_text_batch_mode mode)
+{
+	/* gtk_xtext already coalesces appends into a timed redraw; it can't
+	   insert on top, but nothing here asks for older history either */
+}
+
 void
 fe_beep (session *sess)
 {
@@ -813,8 +820,11 @@ fe_set_throttle (server *serv)
 	float per;
 	char tbuf[96];
 	char tip[160];
+	int drain;
 
-	per = (float) serv->sendq_len / 1024.0;
+	/* the meter fills up as the queue approaches 10 seconds of sending */
+	drain = server_throttle_drain (serv);
+	per = (float) drain / 10000.0;
 	if (per > 1.0)
 		per = 1.0;
 
@@ -824,7 +834,8 @@ fe_set_throttle (server *serv)
 		if (sess->server == serv)
 		{
 			g_snprintf (tbuf, sizeof (tbuf) - 1, _("%d bytes"), serv->sendq_len);
-			g_snprintf (tip, sizeof (tip) - 1, _("Network send queue: %d bytes"), serv->sendq_len);
+			g_snprintf (tip, sizeof (tip) - 1, _("Network send queue: %d bytes, empty in %d.%d seconds"),
+						 serv->sendq_len, drain / 1000, (drain / 100) % 10);
 
 			g_free (sess->res->queue_tip);
 			sess->res->queue_tip = g_strdup (tip);
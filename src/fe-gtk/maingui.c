@@ -29,6 +29,7 @@
 #include "../common/hexchatc.h"
 #include "../common/outbound.h"
 #include "../common/inbound.h"
+#include "../common/joinsched.h"
 #include "../common/plugin.h"
 #include "../common/modes.h"
 #include "../common/url.h"
@@ -525,6 +526,8 @@ mg_focus (session *sess)
 		current_tab = sess;
 	current_sess = sess;
 
+	joinsched_users_needed (sess);
+
 	/* dirty trick to avoid auto-selection */
 	SPELL_ENTRY_SET_EDITABLE (sess->gui->input_box, FALSE);
 	gtk_widget_grab_focus (sess->gui->input_box);
@@ -128,10 +128,10 @@ nick_command_parse (session *sess, char *cmd, char *nick, char *allnick)
 		user = userlist_find (sess, nick);
 		if (user)
 		{
-			if (user->hostname)
-				host = strchr (user->hostname, '@') + 1;
-			if (user->account)
-				account = user->account;
+			if (user->info->hostname)
+				host = strchr (user->info->hostname, '@') + 1;
+			if (user->info->account)
+				account = user->info->account;
 		}
 	}
 
@@ -614,9 +614,9 @@ menu_create_nickinfo_menu (struct User *user, GtkWidget *submenu)
 	fmt = _("<tt><b>%-11s</b></tt> %s");
 	g_snprintf (unknown, sizeof (unknown), "<i>%s</i>", _("Unknown"));
 
-	if (user->realname)
+	if (user->info->realname)
 	{
-		real = strip_color (user->realname, -1, STRIP_ALL|STRIP_ESCMARKUP);
+		real = strip_color (user->info->realname, -1, STRIP_ALL|STRIP_ESCMARKUP);
 		g_snprintf (buf, sizeof (buf), fmt, _("Real Name:"), real);
 		g_free (real);
 	} else
@@ -626,23 +626,23 @@ menu_create_nickinfo_menu (struct User *user, GtkWidget *submenu)
 	item = menu_quick_item (0, buf, submenu, XCMENU_MARKUP, 0, 0);
 	g_signal_connect (G_OBJECT (item), "activate",
 							G_CALLBACK (copy_to_clipboard_cb), 
-							user->realname ? user->realname : unknown);
+							user->info->realname ? user->info->realname : unknown);
 
 	g_snprintf (buf, sizeof (buf), fmt, _("User:"),
-				 user->hostname ? user->hostname : unknown);
+				 user->info->hostname ? user->info->hostname : unknown);
 	item = menu_quick_item (0, buf, submenu, XCMENU_MARKUP, 0, 0);
 	g_signal_connect (G_OBJECT (item), "activate",
 							G_CALLBACK (copy_to_clipboard_cb), 
-							user->hostname ? user->hostname : unknown);
+							user->info->hostname ? user->info->hostname : unknown);
 	
 	g_snprintf (buf, sizeof (buf), fmt, _("Account:"),
-				 user->account ? user->account : unknown);
+				 user->info->account ? user->info->account : unknown);
 	item = menu_quick_item (0, buf, submenu, XCMENU_MARKUP, 0, 0);
 	g_signal_connect (G_OBJECT (item), "activate",
 							G_CALLBACK (copy_to_clipboard_cb), 
-							user->account ? user->account : unknown);
+							user->info->account ? user->info->account : unknown);
 
-	users_country = country (user->hostname);
+	users_country = country (user->info->hostname);
 	if (users_country)
 	{
 		g_snprintf (buf, sizeof (buf), fmt, _ ("Country:"), users_country);
@@ -652,11 +652,11 @@ menu_create_nickinfo_menu (struct User *user, GtkWidget *submenu)
 	}
 
 	g_snprintf (buf, sizeof (buf), fmt, _("Server:"),
-				 user->servername ? user->servername : unknown);
+				 user->info->servername ? user->info->servername : unknown);
 	item = menu_quick_item (0, buf, submenu, XCMENU_MARKUP, 0, 0);
 	g_signal_connect (G_OBJECT (item), "activate",
 							G_CALLBACK (copy_to_clipboard_cb), 
-							user->servername ? user->servername : unknown);
+							user->info->servername ? user->info->servername : unknown);
 
 	if (user->lasttalk)
 	{
@@ -671,7 +671,7 @@ menu_create_nickinfo_menu (struct User *user, GtkWidget *submenu)
 	}
 	menu_quick_item (0, buf, submenu, XCMENU_MARKUP, 0, 0);
 
-	if (user->away)
+	if (user->info->away)
 	{
 		away = server_away_find_message (current_sess->server, user->nick);
 		if (away)
@@ -747,7 +747,7 @@ menu_nickmenu (session *sess, GdkEventButton *event, char *nick, int num_sel)
 			nick_submenu = submenu = menu_quick_sub (nick, menu, NULL, XCMENU_DOLIST, -1);
 
 			if (menu_create_nickinfo_menu (user, submenu) ||
-				 !user->hostname || !user->realname || !user->servername)
+				 !user->info->hostname || !user->info->realname || !user->info->servername)
 			{
 				g_signal_connect (G_OBJECT (submenu), "show", G_CALLBACK (menu_nickinfo_cb), sess);
 			}
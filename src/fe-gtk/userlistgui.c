@@ -320,13 +320,13 @@ fe_userlist_rehash (session *sess, struct User *user)
 	if (!iter)
 		return;
 
-	if (prefs.hex_away_track && user->away)
+	if (prefs.hex_away_track && user->info->away)
 		nick_color = COL_AWAY;
 	else if (prefs.hex_gui_ulist_color)
 		nick_color = text_color_of(user->nick);
 
 	gtk_list_store_set (GTK_LIST_STORE (sess->res->user_model), iter,
-							  COL_HOST, user->hostname,
+							  COL_HOST, user->info->hostname,
 							  COL_GDKCOLOR, nick_color ? &colors[nick_color] : NULL,
 							  -1);
 }
@@ -340,7 +340,7 @@ fe_userlist_insert (session *sess, struct User *newuser, gboolean sel)
 	char *nick;
 	int nick_color = 0;
 
-	if (prefs.hex_away_track && newuser->away)
+	if (prefs.hex_away_track && newuser->info->away)
 		nick_color = COL_AWAY;
 	else if (prefs.hex_gui_ulist_color)
 		nick_color = text_color_of(newuser->nick);
@@ -360,7 +360,7 @@ fe_userlist_insert (session *sess, struct User *newuser, gboolean sel)
 	gtk_list_store_insert_with_values (GTK_LIST_STORE (model), &iter, 0,
 									COL_PIX, pix,
 									COL_NICK, nick,
-									COL_HOST, newuser->hostname,
+									COL_HOST, newuser->info->hostname,
 									COL_USER, newuser,
 									COL_GDKCOLOR, nick_color ? &colors[nick_color] : NULL,
 								  -1);
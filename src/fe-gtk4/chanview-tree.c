@@ -7,6 +7,15 @@
 
 #define CHANVIEW_TREE_ROW_UI_PATH "/org/ditrigon/ui/gtk4/rows/chanview-tree-row.ui"
 
+/* What a session row last showed. Activity only touches this and queues
+ * the node; the row itself is redrawn at most once per frame. */
+typedef struct
+{
+	guint16 unread;		/* lines since the tab was last looked at, capped at 999 */
+	guint8 state;		/* sess->tab_state when the node was queued */
+	guint8 dirty:1;		/* sitting in tree_dirty_nodes */
+} HcChanActivity;
+
 typedef struct _HcChanNode
 {
 	GObject parent_instance;
@@ -15,6 +24,7 @@ typedef struct _HcChanNode
 	server *serv;
 	GListStore *children;
 	GListStore *owner;
+	HcChanActivity act;
 } HcChanNode;
 
 typedef struct _HcChanNodeClass
@@ -37,7 +47,8 @@ static GParamSpec *chan_node_props[PROP_LAST];
 
 static GHashTable *tree_session_nodes;
 static GHashTable *tree_server_nodes;
-static GHashTable *tree_unread_counts;
+static GPtrArray *tree_dirty_nodes;
+static guint tree_flush_tick;
 static GListStore *tree_root_nodes;
 static GtkTreeListModel *tree_model;
 static GtkSingleSelection *tree_selection;
@@ -185,45 +196,22 @@ tree_clear_badge_classes (GtkWidget *badge)
 		gtk_widget_remove_css_class (badge, classes[i]);
 }
 
-static int
-tree_unread_count_get (session *sess)
-{
-	if (!tree_unread_counts || !sess)
-		return 0;
-
-	return GPOINTER_TO_INT (g_hash_table_lookup (tree_unread_counts, sess));
-}
-
 static void
-tree_unread_count_set (session *sess, int count)
+tree_unread_count_set (HcChanNode *node, int count)
 {
-	if (!tree_unread_counts || !sess)
-		return;
-
-	if (count <= 0)
-	{
-		g_hash_table_remove (tree_unread_counts, sess);
-		return;
-	}
-
+	if (count < 0)
+		count = 0;
 	if (count > 999)
 		count = 999;
 
-	g_hash_table_replace (tree_unread_counts, sess, GINT_TO_POINTER (count));
+	node->act.unread = count;
 }
 
 static void
-tree_unread_count_bump (session *sess)
+tree_unread_count_bump (HcChanNode *node)
 {
-	int count;
-
-	if (!sess)
-		return;
-
-	count = tree_unread_count_get (sess);
-	if (count < 999)
-		count++;
-	tree_unread_count_set (sess, count);
+	if (node->act.unread < 999)
+		node->act.unread++;
 }
 
 static void
@@ -399,7 +387,7 @@ tree_update_list_item (GtkListItem *list_item, HcChanNode *node)
 	{
 		tree_clear_badge_classes (badge);
 		show_badge = FALSE;
-		unread_count = tree_unread_count_get (sess);
+		unread_count = node ? node->act.unread : 0;
 
 		if (sess && sess != current_tab && !server_entry && unread_count > 0)
 		{
@@ -1097,6 +1085,53 @@ tree_refresh_node (HcChanNode *node)
 	g_object_notify_by_pspec (G_OBJECT (node), chan_node_props[PROP_LABEL]);
 }
 
+static gboolean
+tree_flush_dirty_cb (GtkWidget *widget, GdkFrameClock *clock, gpointer user_data)
+{
+	GPtrArray *dirty;
+	HcChanNode *node;
+	guint i;
+
+	(void) widget;
+	(void) clock;
+	(void) user_data;
+
+	/* swap first: a refresh may end up queueing more work for next frame */
+	dirty = tree_dirty_nodes;
+	tree_dirty_nodes = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (i = 0; i < dirty->len; i++)
+	{
+		node = g_ptr_array_index (dirty, i);
+		node->act.dirty = 0;
+		tree_refresh_node (node);
+	}
+	g_ptr_array_unref (dirty);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+tree_flush_tick_removed (gpointer user_data)
+{
+	(void) user_data;
+	tree_flush_tick = 0;
+}
+
+static void
+tree_mark_dirty (HcChanNode *node)
+{
+	if (!node || node->act.dirty || !tree_view || !tree_dirty_nodes)
+		return;
+
+	node->act.dirty = 1;
+	g_ptr_array_add (tree_dirty_nodes, g_object_ref (node));
+
+	if (!tree_flush_tick)
+		tree_flush_tick = gtk_widget_add_tick_callback (tree_view, tree_flush_dirty_cb,
+			NULL, tree_flush_tick_removed);
+}
+
 static HcChanNode *
 tree_server_lookup (server *serv)
 {
@@ -1515,8 +1550,8 @@ fe_gtk4_chanview_tree_init (void)
 	if (!tree_server_nodes)
 		tree_server_nodes = g_hash_table_new_full (g_direct_hash, g_direct_equal,
 			NULL, g_object_unref);
-	if (!tree_unread_counts)
-		tree_unread_counts = g_hash_table_new (g_direct_hash, g_direct_equal);
+	if (!tree_dirty_nodes)
+		tree_dirty_nodes = g_ptr_array_new_with_free_func (g_object_unref);
 
 	tree_select_syncing = FALSE;
 }
@@ -1534,10 +1569,13 @@ fe_gtk4_chanview_tree_cleanup (void)
 		g_hash_table_unref (tree_server_nodes);
 		tree_server_nodes = NULL;
 	}
-	if (tree_unread_counts)
+	if (tree_flush_tick && tree_view)
+		gtk_widget_remove_tick_callback (tree_view, tree_flush_tick);
+	tree_flush_tick = 0;
+	if (tree_dirty_nodes)
 	{
-		g_hash_table_unref (tree_unread_counts);
-		tree_unread_counts = NULL;
+		g_ptr_array_unref (tree_dirty_nodes);
+		tree_dirty_nodes = NULL;
 	}
 
 	if (tree_ctx_popover)
@@ -1718,9 +1756,6 @@ fe_gtk4_chanview_tree_remove (session *sess)
 	if (!tree_root_nodes || !tree_session_nodes || !sess)
 		return;
 
-	if (tree_unread_counts)
-		g_hash_table_remove (tree_unread_counts, sess);
-
 	node = tree_session_lookup (sess);
 	if (!node)
 	{
@@ -1761,12 +1796,16 @@ fe_gtk4_chanview_tree_select (session *sess)
 	if (!tree_selection || !tree_model || !sess)
 		return;
 
-	tree_unread_count_set (sess, 0);
-
 	node = tree_session_lookup (sess);
 	if (!node)
 		return;
 
+	if (node->act.unread)
+	{
+		tree_unread_count_set (node, 0);
+		tree_mark_dirty (node);
+	}
+
 	grouped = tree_group_by_server ();
 	if (grouped && sess->server)
 	{
@@ -1786,23 +1825,39 @@ fe_gtk4_chanview_tree_select (session *sess)
 void
 fe_gtk4_chanview_tree_note_activity (session *sess, int color)
 {
+	HcChanNode *node;
+	int unread;
+
 	if (!sess || !is_session (sess))
 		return;
 
+	node = tree_session_lookup (sess);
+	if (!node)
+		return;
+
+	unread = node->act.unread;
 	if (color == FE_COLOR_NONE || sess == current_tab)
 	{
-		tree_unread_count_set (sess, 0);
-		return;
+		tree_unread_count_set (node, 0);
 	}
-
-	switch (color)
+	else
 	{
-	case FE_COLOR_NEW_DATA:
-	case FE_COLOR_NEW_MSG:
-	case FE_COLOR_NEW_HILIGHT:
-		tree_unread_count_bump (sess);
-		break;
-	default:
-		break;
+		switch (color)
+		{
+		case FE_COLOR_NEW_DATA:
+		case FE_COLOR_NEW_MSG:
+		case FE_COLOR_NEW_HILIGHT:
+			tree_unread_count_bump (node);
+			break;
+		default:
+			break;
+		}
 	}
+
+	/* most lines land in a tab that already looks like this */
+	if (node->act.unread == unread && node->act.state == sess->tab_state)
+		return;
+
+	node->act.state = sess->tab_state;
+	tree_mark_dirty (node);
 }
@@ -147,11 +147,13 @@ void
 fe_main (void)
 {
 	fe_gtk4_create_main_window ();
+	stall_start ();
 
 	if (frontend_app)
 	{
 		g_application_run (G_APPLICATION (frontend_app), 0, NULL);
 		g_clear_object (&frontend_app);
+		stall_stop ();
 		return;
 	}
 
@@ -159,6 +161,7 @@ fe_main (void)
 	g_main_loop_run (frontend_loop);
 	g_main_loop_unref (frontend_loop);
 	frontend_loop = NULL;
+	stall_stop ();
 }
 
 void
@@ -19,6 +19,7 @@
 #ifdef USE_PLUGIN
 #include "../common/plugin.h"
 #endif
+#include "../common/stall.h"
 
 #include "palette.h"
 #include "pixmaps.h"
@@ -86,6 +87,7 @@ void fe_gtk4_xtext_init (void);
 void fe_gtk4_xtext_cleanup (void);
 GtkWidget *fe_gtk4_xtext_create_widget (void);
 void fe_gtk4_xtext_append_for_session (session *sess, const char *text);
+void fe_gtk4_xtext_batch (session *sess, fe_text_batch_mode mode);
 void fe_gtk4_xtext_show_session (session *sess);
 void fe_gtk4_xtext_force_scroll_to_end (void);
 void fe_gtk4_xtext_set_marker_last (session *sess);
@@ -166,6 +168,7 @@ void fe_gtk4_dccgui_cleanup (void);
 void fe_gtk4_ignoregui_cleanup (void);
 void fe_gtk4_notifygui_cleanup (void);
 void fe_gtk4_rawlog_cleanup (void);
+void fe_gtk4_rawlog_server_free (server *serv);
 void fe_gtk4_urlgrab_cleanup (void);
 void fe_gtk4_joind_cleanup (void);
 
@@ -4,6 +4,7 @@
 #include "fe-gtk4.h"
 
 #include "../common/history.h"
+#include "../common/joinsched.h"
 #include "../common/userlist.h"
 
 #include <fcntl.h>
@@ -289,6 +290,8 @@ nick_completion_start (GtkWidget *wid, session *sess)
 	postfix = g_strdup (cursor_ptr);
 	append_suffix = ((!prefix[0] || has_nick_prefix) && prefs.hex_completion_suffix[0] != '\0');
 
+	/* the user is talking here, fetch what the join WHO would have */
+	joinsched_users_needed (sess);
 	candidates = nick_completion_build_candidates (sess, seed, strlen (seed));
 	g_free (seed);
 
@@ -1407,6 +1407,12 @@ fe_print_text (struct session *sess, char *text, time_t stamp, gboolean no_activ
 	g_string_free (line, TRUE);
 }
 
+void
+fe_text_batch (struct session *sess, fe_text_batch_mode mode)
+{
+	fe_gtk4_xtext_batch (sess, mode);
+}
+
 void
 fe_message (char *msg, int flags)
 {
@@ -1744,9 +1750,9 @@ fe_set_tab_color (struct session *sess, tabcolor col)
 		break;
 	}
 
+	/* the sidebar picks this up on its next frame */
 	fe_gtk4_chanview_note_activity (sess, col_noflags);
 	sess->last_tab_state = sess->tab_state;
-	fe_gtk4_session_sidebar_update_label (sess);
 }
 
 void
@@ -1815,6 +1821,10 @@ fe_server_callback (struct server *serv)
 	if (current_tab && current_tab->server == serv)
 		fe_set_title (current_tab);
 	fe_gtk4_menu_sync_actions ();
+
+	/* server_free() drops it from serv_list before calling us */
+	if (!g_slist_find (serv_list, serv))
+		fe_gtk4_rawlog_server_free (serv);
 }
 
 void
@@ -1835,6 +1845,8 @@ fe_gtk4_session_switch_to (session *sess)
 	if (!sess)
 		return;
 
+	stall_region_push ("session_switch", sess->channel, NULL);
+
 	prev = current_tab;
 	current_sess = sess;
 	current_tab = sess;
@@ -1850,6 +1862,8 @@ fe_gtk4_session_switch_to (session *sess)
 	topic_update_for_session (sess);
 	fe_set_title (sess);
 	fe_gtk4_menu_sync_actions ();
+
+	stall_region_pop ();
 }
 
 void
@@ -369,16 +369,16 @@ nick_menu_command_parse (session *sess, const char *cmd, const char *nick, const
 	user = userlist_find (sess, nick_safe);
 	if (user)
 	{
-		if (user->hostname && user->hostname[0])
+		if (user->info->hostname && user->info->hostname[0])
 		{
-			at = strchr (user->hostname, '@');
+			at = strchr (user->info->hostname, '@');
 			if (at && at[1])
 				host = at + 1;
 			else
-				host = user->hostname;
+				host = user->info->hostname;
 		}
-		if (user->account && user->account[0])
-			account = user->account;
+		if (user->info->account && user->info->account[0])
+			account = user->info->account;
 	}
 
 	network = server_get_network (sess->server, TRUE);
@@ -590,10 +590,10 @@ nick_menu_create_info_popover (GtkWidget *relative_to, session *sess, const char
 	gtk_widget_set_margin_bottom (grid, 10);
 	gtk_popover_set_child (GTK_POPOVER (popover), grid);
 
-	real = user->realname ? strip_color (user->realname, -1, STRIP_ALL) : NULL;
-	host = (user->hostname && user->hostname[0]) ? user->hostname : _("Unknown");
-	account = (user->account && user->account[0]) ? user->account : _("Unknown");
-	serv = (user->servername && user->servername[0]) ? user->servername : _("Unknown");
+	real = user->info->realname ? strip_color (user->info->realname, -1, STRIP_ALL) : NULL;
+	host = (user->info->hostname && user->info->hostname[0]) ? user->info->hostname : _("Unknown");
+	account = (user->info->account && user->info->account[0]) ? user->info->account : _("Unknown");
+	serv = (user->info->servername && user->info->servername[0]) ? user->info->servername : _("Unknown");
 	if (user->lasttalk)
 	{
 		g_snprintf (mins, sizeof (mins), _("%u minutes ago"),
@@ -608,7 +608,7 @@ nick_menu_create_info_popover (GtkWidget *relative_to, session *sess, const char
 	nick_menu_append_info_row (grid, 0, _("Real Name:"), real ? real : _("Unknown"));
 	nick_menu_append_info_row (grid, 1, _("User:"), host);
 	nick_menu_append_info_row (grid, 2, _("Account:"), account);
-	users_country = country (user->hostname);
+	users_country = country (user->info->hostname);
 	nick_menu_append_info_row (grid, 3, _("Country:"),
 							   (users_country && users_country[0]) ? users_country : _("Unknown"));
 	nick_menu_append_info_row (grid, 4, _("Server:"), serv);
@@ -7,28 +7,62 @@
 
 #define RAWLOG_UI_PATH "/org/ditrigon/ui/gtk4/dialogs/rawlog-window.ui"
 
+/*
+ * Each server keeps its raw lines in a byte ring of text_rawlog_size KB,
+ * allocated as it fills. Lines are only copied into the GtkTextView while
+ * the window shows that server, a frame's worth at a time.
+ */
+#define RAWLOG_RING_MIN (64 * 1024)
+#define RAWLOG_FRAME_BYTES (64 * 1024)
+
+typedef struct
+{
+	char *buf;
+	gsize size;			/* allocated, grows up to the configured cap */
+	gsize head;			/* next write offset */
+	gsize used;
+	guint64 written;	/* bytes ever written, the view catches up from this */
+	gboolean wrapped;	/* older lines were overwritten */
+} HcRawlogRing;
+
 typedef struct
 {
 	GtkWidget *window;
 	GtkWidget *text_view;
 	GtkTextBuffer *buffer;
 	server *serv;
+	guint64 shown;		/* ring->written as of the last text inserted */
+	gsize view_bytes;	/* bytes currently in buffer */
+	guint tick_id;
 } HcRawlogView;
 
 static HcRawlogView rawlog_view;
 static GHashTable *rawlog_logs;
 
+static gsize
+rawlog_cap (void)
+{
+	if (prefs.hex_text_rawlog_size <= 0)
+		return 0;
+	return (gsize) prefs.hex_text_rawlog_size * 1024;
+}
+
 static void
 rawlog_value_free (gpointer data)
 {
-	if (data)
-		g_string_free ((GString *) data, TRUE);
+	HcRawlogRing *ring = data;
+
+	if (ring)
+	{
+		g_free (ring->buf);
+		g_free (ring);
+	}
 }
 
-static GString *
+static HcRawlogRing *
 rawlog_log_ensure (server *serv)
 {
-	GString *log;
+	HcRawlogRing *ring;
 
 	if (!serv)
 		return NULL;
@@ -37,16 +71,16 @@ rawlog_log_ensure (server *serv)
 		rawlog_logs = g_hash_table_new_full (g_direct_hash, g_direct_equal,
 			NULL, rawlog_value_free);
 
-	log = g_hash_table_lookup (rawlog_logs, serv);
-	if (log)
-		return log;
+	ring = g_hash_table_lookup (rawlog_logs, serv);
+	if (ring)
+		return ring;
 
-	log = g_string_new ("");
-	g_hash_table_insert (rawlog_logs, serv, log);
-	return log;
+	ring = g_new0 (HcRawlogRing, 1);
+	g_hash_table_insert (rawlog_logs, serv, ring);
+	return ring;
 }
 
-static GString *
+static HcRawlogRing *
 rawlog_log_lookup (server *serv)
 {
 	if (!rawlog_logs || !serv)
@@ -55,6 +89,101 @@ rawlog_log_lookup (server *serv)
 	return g_hash_table_lookup (rawlog_logs, serv);
 }
 
+static void
+rawlog_ring_reset (HcRawlogRing *ring)
+{
+	g_clear_pointer (&ring->buf, g_free);
+	ring->size = ring->head = ring->used = 0;
+	ring->wrapped = FALSE;
+}
+
+/* copy len bytes starting at byte number from, which must still be held */
+static void
+rawlog_ring_read (HcRawlogRing *ring, guint64 from, char *dest, gsize len)
+{
+	gsize start, first;
+
+	start = (ring->head + ring->size - (gsize) ((ring->written - from) % ring->size)) % ring->size;
+	first = MIN (len, ring->size - start);
+	memcpy (dest, ring->buf + start, first);
+	memcpy (dest + first, ring->buf, len - first);
+}
+
+static void
+rawlog_ring_write (HcRawlogRing *ring, const char *data, gsize len, gsize cap)
+{
+	gsize first;
+
+	if (len > cap)
+	{
+		data += len - cap;
+		len = cap;
+	}
+
+	/* the cap was lowered since this ring was sized */
+	if (ring->size > cap)
+		rawlog_ring_reset (ring);
+
+	/* still filling up, or the cap was raised: grow instead of wrapping */
+	if (ring->size < cap && ring->used + len > ring->size)
+	{
+		gsize size = MAX (ring->size, RAWLOG_RING_MIN);
+		char *buf;
+
+		while (size < ring->used + len)
+			size *= 2;
+		size = MIN (size, cap);
+
+		if (ring->head == ring->used)
+			ring->buf = g_realloc (ring->buf, size);
+		else
+		{
+			/* wrapped: the old offsets mean nothing at the new size */
+			buf = g_malloc (size);
+			rawlog_ring_read (ring, ring->written - ring->used, buf, ring->used);
+			g_free (ring->buf);
+			ring->buf = buf;
+			ring->head = ring->used;
+		}
+		ring->size = size;
+	}
+
+	first = MIN (len, ring->size - ring->head);
+	memcpy (ring->buf + ring->head, data, first);
+	memcpy (ring->buf, data + first, len - first);
+	ring->head = (ring->head + len) % ring->size;
+	if (ring->used + len > ring->size)
+		ring->wrapped = TRUE;
+	ring->used = MIN (ring->used + len, ring->size);
+	ring->written += len;
+}
+
+/* everything held, starting at the first whole line */
+static char *
+rawlog_ring_dup (HcRawlogRing *ring, gsize *len)
+{
+	char *text, *nl;
+
+	if (!ring || !ring->used)
+	{
+		*len = 0;
+		return g_strdup ("");
+	}
+
+	text = g_malloc (ring->used + 1);
+	rawlog_ring_read (ring, ring->written - ring->used, text, ring->used);
+	text[ring->used] = 0;
+	*len = ring->used;
+
+	if (ring->wrapped && (nl = memchr (text, '\n', ring->used)))
+	{
+		*len = ring->used - (nl + 1 - text);
+		memmove (text, nl + 1, *len + 1);
+	}
+
+	return text;
+}
+
 static void
 rawlog_scroll_to_end (void)
 {
@@ -68,32 +197,105 @@ rawlog_scroll_to_end (void)
 		&end, 0.0, FALSE, 0.0, 1.0);
 }
 
+/* drop whole lines from the top until at least excess bytes are gone */
 static void
-rawlog_append_visible (const char *text)
+rawlog_trim_front (gsize excess)
 {
-	GtkTextIter end;
+	GtkTextIter start, cut;
+	gsize removed = 0;
 
-	if (!rawlog_view.buffer || !text)
-		return;
+	gtk_text_buffer_get_start_iter (rawlog_view.buffer, &cut);
+	while (removed < excess)
+	{
+		removed += gtk_text_iter_get_bytes_in_line (&cut);
+		if (!gtk_text_iter_forward_line (&cut))
+			break;
+	}
 
-	gtk_text_buffer_get_end_iter (rawlog_view.buffer, &end);
-	gtk_text_buffer_insert (rawlog_view.buffer, &end, text, -1);
-	rawlog_scroll_to_end ();
+	gtk_text_buffer_get_start_iter (rawlog_view.buffer, &start);
+	gtk_text_buffer_delete (rawlog_view.buffer, &start, &cut);
+	rawlog_view.view_bytes -= MIN (removed, rawlog_view.view_bytes);
 }
 
 static void
 rawlog_refresh_visible (void)
 {
-	GString *log;
+	HcRawlogRing *ring;
+	char *text;
+	gsize len;
 
 	if (!rawlog_view.buffer)
 		return;
 
-	log = rawlog_log_lookup (rawlog_view.serv);
-	gtk_text_buffer_set_text (rawlog_view.buffer, log ? log->str : "", -1);
+	ring = rawlog_log_lookup (rawlog_view.serv);
+	text = rawlog_ring_dup (ring, &len);
+	gtk_text_buffer_set_text (rawlog_view.buffer, text, len);
+	g_free (text);
+	rawlog_view.shown = ring ? ring->written : 0;
+	rawlog_view.view_bytes = len;
 	rawlog_scroll_to_end ();
 }
 
+/* bring the view up to date with the ring, at most a frame's worth */
+static gboolean
+rawlog_tick_cb (GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
+{
+	HcRawlogRing *ring;
+	GtkTextIter end;
+	guint64 pending;
+	gsize len;
+	char *text, *nl;
+
+	(void) widget;
+	(void) frame_clock;
+	(void) user_data;
+
+	ring = rawlog_log_lookup (rawlog_view.serv);
+	if (!rawlog_view.buffer || !ring || ring->written == rawlog_view.shown)
+	{
+		rawlog_view.tick_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	pending = ring->written - rawlog_view.shown;
+	/* the ring lapped the view: what it still needs is gone */
+	if (pending > ring->used)
+	{
+		rawlog_refresh_visible ();
+		return G_SOURCE_CONTINUE;
+	}
+
+	len = MIN (pending, RAWLOG_FRAME_BYTES);
+	text = g_malloc (len + 1);
+	rawlog_ring_read (ring, rawlog_view.shown, text, len);
+	text[len] = 0;
+
+	/* stop at a line end so a multibyte character is never split */
+	if (len < pending && (nl = g_strrstr_len (text, len, "\n")))
+		len = nl + 1 - text;
+
+	gtk_text_buffer_get_end_iter (rawlog_view.buffer, &end);
+	gtk_text_buffer_insert (rawlog_view.buffer, &end, text, len);
+	g_free (text);
+	rawlog_view.shown += len;
+	rawlog_view.view_bytes += len;
+	if (rawlog_cap () && rawlog_view.view_bytes > rawlog_cap ())
+		rawlog_trim_front (rawlog_view.view_bytes - rawlog_cap ());
+	rawlog_scroll_to_end ();
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+rawlog_queue_update (void)
+{
+	if (rawlog_view.tick_id || !rawlog_view.text_view)
+		return;
+
+	rawlog_view.tick_id = gtk_widget_add_tick_callback (rawlog_view.text_view,
+		rawlog_tick_cb, NULL, NULL);
+}
+
 static void
 rawlog_update_title (void)
 {
@@ -133,6 +335,9 @@ rawlog_close_request_cb (GtkWindow *window, gpointer userdata)
 	(void) window;
 	(void) userdata;
 
+	if (rawlog_view.tick_id)
+		gtk_widget_remove_tick_callback (rawlog_view.text_view, rawlog_view.tick_id);
+	rawlog_view.tick_id = 0;
 	rawlog_view.window = NULL;
 	rawlog_view.text_view = NULL;
 	rawlog_view.buffer = NULL;
@@ -143,7 +348,7 @@ rawlog_close_request_cb (GtkWindow *window, gpointer userdata)
 static void
 rawlog_clear_cb (GtkButton *button, gpointer userdata)
 {
-	GString *log;
+	HcRawlogRing *ring;
 
 	(void) button;
 	(void) userdata;
@@ -151,9 +356,10 @@ rawlog_clear_cb (GtkButton *button, gpointer userdata)
 	if (!rawlog_view.serv)
 		return;
 
-	log = rawlog_log_ensure (rawlog_view.serv);
-	if (log)
-		g_string_truncate (log, 0);
+	ring = rawlog_log_ensure (rawlog_view.serv);
+	rawlog_ring_reset (ring);
+	rawlog_view.shown = ring->written;
+	rawlog_view.view_bytes = 0;
 
 	if (rawlog_view.buffer)
 		gtk_text_buffer_set_text (rawlog_view.buffer, "", -1);
@@ -163,19 +369,22 @@ static void
 rawlog_save_file_cb (void *userdata, char *file)
 {
 	server *serv;
-	GString *log;
+	HcRawlogRing *ring;
 	GError *error;
+	char *text;
+	gsize len;
 
 	serv = userdata;
 	if (!serv || !file || !file[0])
 		return;
 
-	log = rawlog_log_lookup (serv);
-	if (!log)
+	ring = rawlog_log_lookup (serv);
+	if (!ring)
 		return;
 
+	text = rawlog_ring_dup (ring, &len);
 	error = NULL;
-	if (!g_file_set_contents (file, log->str, log->len, &error))
+	if (!g_file_set_contents (file, text, len, &error))
 	{
 		if (error)
 		{
@@ -183,6 +392,7 @@ rawlog_save_file_cb (void *userdata, char *file)
 			g_error_free (error);
 		}
 	}
+	g_free (text);
 }
 
 static void
@@ -203,28 +413,6 @@ rawlog_save_cb (GtkButton *button, gpointer userdata)
 	g_free (initial);
 }
 
-static void
-rawlog_append_line (server *serv, const char *line, gboolean outbound)
-{
-	GString *log;
-	char *prefixed;
-
-	if (!serv || !line)
-		return;
-
-	log = rawlog_log_ensure (serv);
-	if (!log)
-		return;
-
-	prefixed = g_strdup_printf ("%s %s\n", outbound ? "<<" : ">>", line);
-	g_string_append (log, prefixed);
-
-	if (rawlog_view.window && rawlog_view.serv == serv)
-		rawlog_append_visible (prefixed);
-
-	g_free (prefixed);
-}
-
 void
 open_rawlog (struct server *serv)
 {
@@ -269,29 +457,59 @@ open_rawlog (struct server *serv)
 void
 fe_add_rawlog (struct server *serv, char *text, int len, int outbound)
 {
-	char *copy;
-	char **split_text;
-	gsize i;
+	HcRawlogRing *ring;
+	char *end, *line, *nl;
+	gsize cap = rawlog_cap ();
 
-	if (!serv || !text || len <= 0)
+	if (!serv || !text || len <= 0 || !cap)
 		return;
 
-	copy = g_strndup (text, len);
-	split_text = g_strsplit (copy, "\r\n", 0);
-	for (i = 0; split_text && split_text[i]; i++)
+	ring = rawlog_log_ensure (serv);
+	end = text + len;
+	for (line = text; line < end; line = nl + 1)
 	{
-		if (split_text[i][0] == 0)
+		nl = memchr (line, '\n', end - line);
+		if (!nl)
+			nl = end;
+
+		len = nl - line;
+		if (len && line[len - 1] == '\r')
+			len--;
+		if (!len)
 			continue;
 
-		rawlog_append_line (serv, split_text[i], outbound != 0);
+		rawlog_ring_write (ring, outbound ? "<< " : ">> ", 3, cap);
+		rawlog_ring_write (ring, line, len, cap);
+		rawlog_ring_write (ring, "\n", 1, cap);
+	}
+
+	if (rawlog_view.window && rawlog_view.serv == serv)
+		rawlog_queue_update ();
+}
+
+/* called once serv has left serv_list and is about to be freed */
+void
+fe_gtk4_rawlog_server_free (struct server *serv)
+{
+	if (rawlog_view.serv == serv)
+	{
+		rawlog_view.serv = NULL;
+		if (rawlog_view.buffer)
+			gtk_text_buffer_set_text (rawlog_view.buffer, "", -1);
+		rawlog_update_title ();
 	}
-	g_strfreev (split_text);
-	g_free (copy);
+
+	if (rawlog_logs)
+		g_hash_table_remove (rawlog_logs, serv);
 }
 
 void
 fe_gtk4_rawlog_cleanup (void)
 {
+	if (rawlog_view.tick_id)
+		gtk_widget_remove_tick_callback (rawlog_view.text_view, rawlog_view.tick_id);
+	rawlog_view.tick_id = 0;
+
 	if (rawlog_view.window)
 		gtk_window_destroy (GTK_WINDOW (rawlog_view.window));
 
@@ -4,6 +4,7 @@
 #include "fe-gtk4.h"
 #include <adwaita.h>
 
+#include "../common/joinsched.h"
 #include "../common/text.h"
 #include "../common/userlist.h"
 
@@ -454,7 +455,7 @@ user_markup_text (struct User *user, const char *display)
 	nick_color = 0;
 	if (user)
 	{
-		if (prefs.hex_away_track && user->away)
+		if (prefs.hex_away_track && user->info->away)
 			nick_color = COL_AWAY;
 		else if (prefs.hex_gui_ulist_color)
 			nick_color = text_color_of (user->nick);
@@ -510,7 +511,7 @@ hc_user_item_new (session *sess, struct User *user)
 	item = g_object_new (HC_TYPE_USER_ITEM, NULL);
 	item->user = user;
 	item->display = user_display_text (user);
-	item->host = g_strdup (user && user->hostname ? user->hostname : "");
+	item->host = g_strdup (user && user->info->hostname ? user->info->hostname : "");
 	item->prefix = (user && user->prefix[0]) ? user->prefix[0] : 0;
 
 	return item;
@@ -901,7 +902,7 @@ userlist_apply_row (GtkListItem *list_item, HcUserItem *item)
 		return;
 	}
 
-	userlist_set_presence_icon (presence_image, item->user && item->user->away);
+	userlist_set_presence_icon (presence_image, item->user && item->user->info->away);
 
 	markup = user_markup_text (item->user, item->display);
 	gtk_label_set_markup (GTK_LABEL (name_label), markup);
@@ -916,7 +917,7 @@ userlist_apply_row (GtkListItem *list_item, HcUserItem *item)
 
 	if (prefs.hex_gui_ulist_show_hosts && item->host && item->host[0])
 		host_text = item->host;
-	else if (prefs.hex_away_track && item->user && item->user->away)
+	else if (prefs.hex_away_track && item->user && item->user->info->away)
 		host_text = _("Away");
 	else
 		host_text = NULL;
@@ -1195,6 +1196,7 @@ fe_gtk4_userlist_create_widget (void)
 void
 fe_gtk4_userlist_show (session *sess)
 {
+	joinsched_users_needed (sess);
 	userlist_rebuild_for_session (sess);
 }
 
@@ -1258,8 +1260,9 @@ fe_userlist_insert (struct session *sess, struct User *newuser, gboolean sel)
 	if (!sess || !newuser)
 		return;
 
-	/* During initial NAMES, defer model churn and rebuild once at end-of-names. */
-	if (sess->ignore_names && !sess->end_of_names)
+	/* During initial NAMES or a netjoin, defer model churn and rebuild once
+	 * at the end. */
+	if ((sess->ignore_names && !sess->end_of_names) || sess->userlist_frozen)
 	{
 		userlist_mark_bulk_rebuild (sess);
 		return;
@@ -1286,6 +1289,11 @@ fe_userlist_remove (struct session *sess, struct User *user)
 
 	selected = user->selected ? TRUE : FALSE;
 
+	/* a netsplit batch: the rebuild follows before we get back to the
+	 * main loop, so the stale rows never get drawn */
+	if (sess && sess->userlist_frozen)
+		userlist_mark_bulk_rebuild (sess);
+
 	if (sess && userlist_bulk_rebuild_pending (sess))
 		return selected ? 1 : 0;
 
@@ -1326,7 +1334,8 @@ fe_userlist_numbers (struct session *sess)
 	if (!sess)
 		return;
 
-	if (sess->end_of_names && userlist_bulk_rebuild_pending (sess))
+	if (sess->end_of_names && !sess->userlist_frozen &&
+		 userlist_bulk_rebuild_pending (sess))
 	{
 		store_rebuild_for_session (sess);
 		userlist_unmark_bulk_rebuild (sess);
@@ -4,6 +4,7 @@
 #include "fe-gtk4.h"
 #include "../common/url.h"
 #include "../common/userlist.h"
+#include "../common/chathistory.h"
 
 #define XTEXT_UI_PATH "/org/ditrigon/ui/gtk4/maingui/xtext-scroll.ui"
 
@@ -50,6 +51,8 @@ typedef struct
 	gboolean replay_marklast;
 	gboolean has_tab_metrics;
 	HcSessionTabMetrics tab_metrics;
+	int batch_depth;		/* fe_text_batch() nesting, appends only go to the log */
+	GString *prepend;		/* older text of a PREPEND batch, goes on top at its end */
 } HcSessionState;
 
 #define HC_STICKY_BOTTOM_EPSILON_PX 70.0
@@ -1097,6 +1100,8 @@ session_state_free (gpointer data)
 		session_widget_free (state->widget);
 	if (state->log)
 		g_string_free (state->log, TRUE);
+	if (state->prepend)
+		g_string_free (state->prepend, TRUE);
 
 	g_free (state);
 }
@@ -1364,6 +1369,17 @@ session_widget_free (gpointer data)
 	g_free (widget);
 }
 
+static void
+xtext_edge_reached_cb (GtkScrolledWindow *scroll, GtkPositionType pos, gpointer userdata)
+{
+	(void) scroll;
+	(void) userdata;
+
+	/* only the shown window scrolls; fetch the page above it */
+	if (pos == GTK_POS_TOP && xtext_session_is_valid (current_tab))
+		chathistory_request_older (current_tab);
+}
+
 static HcSessionWidget *
 session_widget_ensure (session *sess)
 {
@@ -1405,6 +1421,8 @@ session_widget_ensure (session *sess)
 	if (buf)
 		gtk_text_view_set_buffer (GTK_TEXT_VIEW (view), buf);
 
+	g_signal_connect (scroll, "edge-reached", G_CALLBACK (xtext_edge_reached_cb), NULL);
+
 	gtk_stack_add_child (GTK_STACK (xtext_stack), scroll);
 	state->widget = widget;
 	return widget;
@@ -2353,6 +2371,9 @@ xtext_render_raw_all (GtkTextBuffer *buf, const char *raw)
 		anchor_offset = gtk_text_iter_get_offset (&iter);
 	}
 
+	stall_region_push ("xtext_render_raw_all",
+							 xtext_render_session ? xtext_render_session->channel : NULL, NULL);
+
 	text = raw ? raw : "";
 	col_px = xtext_compute_message_column_px (text, &stamp_px);
 	if (xtext_render_session)
@@ -2379,6 +2400,8 @@ xtext_render_raw_all (GtkTextBuffer *buf, const char *raw)
 		gtk_text_buffer_get_iter_at_offset (buf, &iter, anchor_offset);
 		gtk_text_buffer_move_mark (buf, anchor, &iter);
 	}
+
+	stall_region_pop ();
 }
 
 static void
@@ -3102,10 +3125,23 @@ fe_gtk4_xtext_append_for_session (session *sess, const char *text)
 		return;
 	}
 
+	state = session_state_lookup (sess);
+	if (state && state->prepend)
+	{
+		g_string_append (state->prepend, text);
+		return;
+	}
+
 	log = session_log_ensure (sess);
 	if (log)
 		g_string_append (log, text);
-	state = session_state_lookup (sess);
+
+	/* Inside a batch the buffer is re-rendered once at the end. */
+	if (state && state->batch_depth > 0)
+	{
+		session_buffer_set_dirty (sess, TRUE);
+		return;
+	}
 
 	/* For background sessions, keep already-rendered buffers live so
 	 * GtkScrolledWindow can preserve precise scroll state across tab switches.
@@ -3116,6 +3152,115 @@ fe_gtk4_xtext_append_for_session (session *sess, const char *text)
 	xtext_append_visible_session (sess, state, text);
 }
 
+/* Older history goes in front of the log. A rendered buffer gets it
+ * inserted at its start, with the view kept on the line it showed. */
+static void
+xtext_prepend_flush (session *sess, HcSessionState *state)
+{
+	GString *older;
+	GString *log;
+	GtkTextBuffer *buf;
+	GtkTextIter iter;
+	GtkTextMark *top;
+	int added_col_px;
+	int added_stamp_px;
+	int cached_col_px;
+	int cached_stamp_px;
+
+	older = state->prepend;
+	state->prepend = NULL;
+	if (older->len == 0)
+	{
+		g_string_free (older, TRUE);
+		return;
+	}
+
+	log = session_log_ensure (sess);
+	if (log)
+		g_string_prepend (log, older->str);
+
+	buf = state->buffer;
+	if (!buf || state->buffer_dirty)
+	{
+		session_buffer_set_dirty (sess, TRUE);
+		g_string_free (older, TRUE);
+		return;
+	}
+
+	added_col_px = xtext_compute_message_column_px (older->str, &added_stamp_px);
+	if (session_tab_metrics_get (sess, &cached_col_px, &cached_stamp_px))
+	{
+		added_col_px = MAX (added_col_px, cached_col_px);
+		added_stamp_px = MAX (added_stamp_px, cached_stamp_px);
+	}
+	session_tab_metrics_set (sess, added_col_px, added_stamp_px);
+	if (sess == current_tab)
+		xtext_set_message_tab_stop (added_col_px, added_stamp_px);
+
+	/* right gravity: stays on the first old line as text goes in before it */
+	gtk_text_buffer_get_start_iter (buf, &iter);
+	top = gtk_text_buffer_create_mark (buf, NULL, &iter, FALSE);
+
+	xtext_render_session = sess;
+	xtext_render_raw_at_iter (buf, &iter, older->str);
+	xtext_render_session = NULL;
+
+	if (sess == current_tab && state->widget)
+		gtk_text_view_scroll_to_mark (GTK_TEXT_VIEW (state->widget->view), top,
+			0.0, TRUE, 0.0, 0.0);
+	gtk_text_buffer_delete_mark (buf, top);
+	g_string_free (older, TRUE);
+}
+
+void
+fe_gtk4_xtext_batch (session *sess, fe_text_batch_mode mode)
+{
+	HcSessionState *state;
+	HcSessionWidget *widget;
+	GtkTextBuffer *buf;
+	gboolean stick_to_end;
+
+	if (!xtext_session_is_valid (sess))
+		return;
+
+	if (mode != FE_TEXT_BATCH_END)
+	{
+		state = session_state_ensure (sess);
+		if (!state)
+			return;
+		state->batch_depth++;
+		if (mode == FE_TEXT_BATCH_PREPEND && !state->prepend)
+			state->prepend = g_string_new ("");
+		return;
+	}
+
+	state = session_state_lookup (sess);
+	if (!state || state->batch_depth == 0 || --state->batch_depth > 0)
+		return;
+
+	if (state->prepend)
+		xtext_prepend_flush (sess, state);
+
+	/* Background sessions render from the log on their next show. */
+	if (sess != current_tab || !state->buffer_dirty)
+		return;
+
+	widget = session_widget_ensure (sess);
+	buf = session_buffer_ensure (sess);
+	if (!buf || !widget)
+		return;
+
+	log_view = widget->view;
+	log_buffer = buf;
+	stick_to_end = xtext_view_is_at_end (log_view);
+	xtext_render_session = sess;
+	xtext_render_raw_all (buf, state->log ? state->log->str : "");
+	xtext_render_session = NULL;
+	session_buffer_set_dirty (sess, FALSE);
+	if (stick_to_end)
+		xtext_scroll_to_end ();
+}
+
 void
 fe_gtk4_xtext_force_scroll_to_end (void)
 {
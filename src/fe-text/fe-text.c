@@ -35,6 +35,8 @@
 #include "../common/outbound.h"
 #include "../common/util.h"
 #include "../common/fe.h"
+#include "../common/perf.h"
+#include "../common/stall.h"
 #include "fe-text.h"
 
 
@@ -350,6 +352,7 @@ static char *arg_cfgdir = NULL;
 static gint arg_show_autoload = 0;
 static gint arg_show_config = 0;
 static gint arg_show_version = 0;
+static char *arg_bench_report = NULL;
 
 static const GOptionEntry gopt_entries[] = 
 {
@@ -360,6 +363,7 @@ static const GOptionEntry gopt_entries[] =
  {"configdir",	'u', 0, G_OPTION_ARG_NONE,	&arg_show_config, N_("Show user config directory"), NULL},
  {"url",	 0,  G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING,	&arg_url, N_("Open an irc://server:port/channel URL"), "URL"},
  {"version",	'v', 0, G_OPTION_ARG_NONE,	&arg_show_version, N_("Show version information"), NULL},
+ {"bench-report",	0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME,	&arg_bench_report, N_("Time the inbound path and write a report on exit"), "FILE"},
  {G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_STRING_ARRAY, &arg_urls, N_("Open an irc://server:port/channel?key URL"), "URL"},
  {NULL}
 };
@@ -421,6 +425,9 @@ fe_args (int argc, char *argv[])
 		g_free (arg_cfgdir);
 	}
 
+	if (arg_bench_report)
+		perf_enable ();
+
 	return -1;
 }
 
@@ -447,7 +454,12 @@ fe_main (void)
 
 	g_io_add_watch(keyboard_input, G_IO_IN, handle_line, NULL);
 
+	stall_start ();
 	g_main_loop_run(main_loop);
+	stall_stop ();
+
+	if (arg_bench_report && !perf_write_report (arg_bench_report))
+		fprintf (stderr, "Could not write %s\n", arg_bench_report);
 
 	return;
 }
@@ -548,6 +560,10 @@ fe_text_clear (struct session *sess, int lines)
 {
 }
 void
+fe_text_batch (struct session *sess, fe_text_batch_mode mode)
+{
+}
+void
 fe_progressbar_start (struct session *sess)
 {
 }
@@ -0,0 +1,385 @@
+#!/usr/bin/env python3
+"""
+Headless replay benchmark for the Ditrigon core.
+
+Drives hexchat-text (built with -Dtext-frontend=true) against a local fake
+server that replays a recorded IRC stream as fast as the client reads it:
+- NAMES bursts, channel chatter, a netsplit and rejoin, tagged playback
+  and a /LIST reply, each timed as its own section
+- a section ends with a PING, so its time covers the client processing
+  every line rather than the kernel buffering them
+- per-stage CPU time comes from the client's --bench-report, peak RSS from
+  the exit rusage
+
+The result is printed as one JSON object (and written to --output) so runs
+can be compared by a script.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import os
+import queue
+import random
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+NICK = "bench"
+SERVER = "bench.srv"
+CAPS = "server-time message-tags account-tag multi-prefix"
+
+
+def _users(rng: random.Random, count: int) -> list[str]:
+    return ["u%d%s" % (i, "".join(rng.choice("abcdefghij") for _ in range(4)))
+            for i in range(count)]
+
+
+def _names_section(channels: list[str], users: list[str]) -> list[str]:
+    lines = []
+    prefixes = ("", "", "", "+", "@")
+    for chan in channels:
+        lines.append(":%s!%s@bench.host JOIN %s" % (NICK, NICK, chan))
+        for i in range(0, len(users), 20):
+            chunk = " ".join(prefixes[(i + j) % len(prefixes)] + nick
+                             for j, nick in enumerate(users[i:i + 20]))
+            lines.append(":%s 353 %s = %s :%s" % (SERVER, NICK, chan, chunk))
+        lines.append(":%s 366 %s %s :End of /NAMES list." % (SERVER, NICK, chan))
+    return lines
+
+
+def _chatter_section(rng: random.Random, channels: list[str], users: list[str],
+                     count: int) -> list[str]:
+    lines = []
+    for i in range(count):
+        nick = rng.choice(users)
+        chan = rng.choice(channels)
+        text = " ".join(rng.choice(("lorem", "ipsum", "dolor", "sit", "amet",
+                                    NICK, "http://example.org/x", "\x02bold\x02"))
+                        for _ in range(rng.randint(3, 24)))
+        if i % 50 == 0:
+            lines.append(":%s!u@h PRIVMSG %s :\x01ACTION %s\x01" % (nick, chan, text))
+        elif i % 30 == 0:
+            lines.append(":%s!u@h NOTICE %s :%s" % (nick, chan, text))
+        else:
+            lines.append(":%s!u@h PRIVMSG %s :%s" % (nick, chan, text))
+    return lines
+
+
+def _netsplit_section(channels: list[str], users: list[str]) -> list[str]:
+    split = users[::2]
+    lines = [":%s!u@h QUIT :hub.bench leaf.bench" % nick for nick in split]
+    for nick in split:
+        for chan in channels:
+            lines.append(":%s!u@h JOIN %s" % (nick, chan))
+    for chan in channels:
+        for i in range(0, len(split), 4):
+            modes = split[i:i + 4]
+            lines.append(":hub.bench MODE %s +%s %s" % (chan, "v" * len(modes), " ".join(modes)))
+    return lines
+
+
+def _playback_section(rng: random.Random, channels: list[str], users: list[str],
+                      count: int) -> list[str]:
+    lines = []
+    base = 1700000000
+    for i in range(count):
+        stamp = time.strftime("%Y-%m-%dT%H:%M:%S", time.gmtime(base + i))
+        nick = rng.choice(users)
+        lines.append("@time=%s.%03dZ;msgid=bench%d;account=%s :%s!u@h PRIVMSG %s :playback line %d"
+                     % (stamp, i % 1000, i, nick, nick, rng.choice(channels), i))
+    return lines
+
+
+def _list_section(rng: random.Random, count: int) -> list[str]:
+    lines = [":%s 321 %s Channel :Users  Name" % (SERVER, NICK)]
+    for i in range(count):
+        lines.append(":%s 322 %s #list%d %d :[+nt] topic of channel %d"
+                     % (SERVER, NICK, i, rng.randint(1, 5000), i))
+    lines.append(":%s 323 %s :End of /LIST" % (SERVER, NICK))
+    return lines
+
+
+def generate_stream(seed: int, scale: int) -> list[tuple[str, list[str]]]:
+    rng = random.Random(seed)
+    channels = ["#bench%d" % i for i in range(4 * scale)]
+    users = _users(rng, 1000 * scale)
+
+    return [
+        ("names", _names_section(channels, users)),
+        ("chatter", _chatter_section(rng, channels, users, 20000 * scale)),
+        ("netsplit", _netsplit_section(channels, users)),
+        ("playback", _playback_section(rng, channels, users, 10000 * scale)),
+        ("list", _list_section(rng, 20000 * scale)),
+    ]
+
+
+def load_recording(path: str) -> list[tuple[str, list[str]]]:
+    """A recording is raw server lines; "# name" starts a new section."""
+    sections: list[tuple[str, list[str]]] = []
+    with open(path, "r", encoding="utf-8", errors="surrogateescape") as fp:
+        for line in fp:
+            line = line.rstrip("\r\n")
+            if line.startswith("# "):
+                sections.append((line[2:].strip(), []))
+            elif line:
+                if not sections:
+                    sections.append(("replay", []))
+                sections[-1][1].append(line)
+    return sections
+
+
+def save_recording(path: str, sections: list[tuple[str, list[str]]]) -> None:
+    with open(path, "w", encoding="utf-8", errors="surrogateescape") as fp:
+        for name, lines in sections:
+            fp.write("# %s\n" % name)
+            for line in lines:
+                fp.write(line + "\n")
+
+
+class ReplayServer:
+    def __init__(self) -> None:
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.bind(("127.0.0.1", 0))
+        self.sock.listen(1)
+        self.sock.settimeout(10.0)
+        self.port = self.sock.getsockname()[1]
+        self.conn: socket.socket | None = None
+        self.pongs: queue.Queue[str] = queue.Queue()
+        self.registered = threading.Event()
+        self.send_lock = threading.Lock()
+
+    def accept(self) -> None:
+        self.conn, _ = self.sock.accept()
+        self.conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        threading.Thread(target=self._reader, daemon=True).start()
+
+    def _reader(self) -> None:
+        buf = b""
+        saw_user = False
+        assert self.conn is not None
+        while True:
+            try:
+                data = self.conn.recv(65536)
+            except OSError:
+                break
+            if not data:
+                break
+            buf += data
+            while b"\n" in buf:
+                raw, buf = buf.split(b"\n", 1)
+                words = raw.rstrip(b"\r").decode("utf-8", "replace").split(" ")
+                cmd = words[0].upper()
+                if cmd == "CAP" and len(words) > 1:
+                    sub = words[1].upper()
+                    if sub == "LS":
+                        self.send([":%s CAP * LS :%s" % (SERVER, CAPS)])
+                    elif sub == "REQ":
+                        self.send([":%s CAP * ACK %s" % (SERVER, " ".join(words[2:]))])
+                    elif sub == "END":
+                        self.registered.set()
+                elif cmd == "USER":
+                    saw_user = True
+                elif cmd == "PONG" and len(words) > 1:
+                    self.pongs.put(words[-1].lstrip(":"))
+                elif cmd == "PING" and len(words) > 1:
+                    self.send([":%s PONG %s %s" % (SERVER, SERVER, words[-1])])
+            if saw_user and not self.registered.is_set():
+                # a client that skips CAP negotiation registers on USER
+                threading.Timer(2.0, self.registered.set).start()
+                saw_user = False
+
+    def send(self, lines: list[str]) -> None:
+        assert self.conn is not None
+        with self.send_lock:
+            self.conn.sendall(("\r\n".join(lines) + "\r\n").encode("utf-8", "surrogateescape"))
+
+    def sync(self, token: str, timeout: float) -> bool:
+        self.send(["PING :%s" % token])
+        deadline = time.monotonic() + timeout
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return False
+            try:
+                if self.pongs.get(timeout=remaining) == token:
+                    return True
+            except queue.Empty:
+                return False
+
+    def close(self) -> None:
+        if self.conn:
+            try:
+                self.conn.close()
+            except OSError:
+                pass
+        self.sock.close()
+
+
+def _write_config(cfgdir: str) -> None:
+    with open(os.path.join(cfgdir, "hexchat.conf"), "w", encoding="utf-8") as fp:
+        fp.write("irc_nick1 = %s\n" % NICK)
+        fp.write("irc_logging = 1\n")
+        fp.write("net_auto_reconnect = 0\n")
+
+
+def _wait_client(proc: subprocess.Popen, timeout: float) -> tuple[int, int]:
+    """Reap the client, returning (exit status, peak RSS in KiB)."""
+    deadline = time.monotonic() + timeout
+    while True:
+        pid, status, usage = os.wait4(proc.pid, os.WNOHANG)
+        if pid:
+            proc.returncode = os.waitstatus_to_exitcode(status)
+            return proc.returncode, usage.ru_maxrss
+        if time.monotonic() > deadline:
+            try:
+                os.killpg(proc.pid, signal.SIGKILL)
+            except (OSError, ProcessLookupError):
+                pass
+            _, status, usage = os.wait4(proc.pid, 0)
+            proc.returncode = 124
+            return 124, usage.ru_maxrss
+        time.sleep(0.02)
+
+
+def run(binary: str, sections: list[tuple[str, list[str]]], timeout: float) -> dict:
+    cfgdir = tempfile.mkdtemp(prefix="hexchat-benchcfg-")
+    report_path = os.path.join(cfgdir, "bench-report.json")
+    _write_config(cfgdir)
+    errlog = tempfile.TemporaryFile()
+
+    server = ReplayServer()
+    proc = subprocess.Popen(
+        [binary, "-d", cfgdir, "-n", "--bench-report", report_path,
+         # Use negative port syntax so /server treats this as insecure TCP.
+         "irc://127.0.0.1:-%d" % server.port],
+        stdin=subprocess.PIPE,
+        stdout=subprocess.DEVNULL,
+        stderr=errlog,
+        start_new_session=True,
+    )
+
+    result: dict = {"binary": binary, "sections": []}
+    quit_sent = False
+    try:
+        server.accept()
+        if not server.registered.wait(timeout):
+            raise RuntimeError("client did not register")
+
+        server.send([
+            ":%s 001 %s :Welcome to the replay benchmark" % (SERVER, NICK),
+            ":%s 005 %s CHANTYPES=# PREFIX=(qaohv)~&@%%+ CHANMODES=beI,k,l,imnpst "
+            "NETWORK=Bench TARGMAX=PRIVMSG:4 :are supported by this server" % (SERVER, NICK),
+            ":%s 376 %s :End of /MOTD command." % (SERVER, NICK),
+        ])
+        if not server.sync("bench-login", timeout):
+            raise RuntimeError("client did not answer the login PING")
+
+        total_lines = total_bytes = 0
+        total_time = 0.0
+        for idx, (name, lines) in enumerate(sections):
+            size = sum(len(line) + 2 for line in lines)
+            start = time.perf_counter()
+            # sendall() blocks once the client stops reading, so this paces
+            # the replay to the client's own throughput
+            for i in range(0, len(lines), 512):
+                server.send(lines[i:i + 512])
+            if not server.sync("bench-%d" % idx, timeout):
+                raise RuntimeError("client stalled in section %s" % name)
+            elapsed = time.perf_counter() - start
+
+            result["sections"].append({
+                "name": name,
+                "lines": len(lines),
+                "bytes": size,
+                "seconds": round(elapsed, 6),
+                "lines_per_sec": round(len(lines) / elapsed, 1) if elapsed else None,
+            })
+            print("  %-10s %8d lines %9.3fs %12.1f lines/s"
+                  % (name, len(lines), elapsed, len(lines) / elapsed if elapsed else 0),
+                  file=sys.stderr, flush=True)
+            total_lines += len(lines)
+            total_bytes += size
+            total_time += elapsed
+
+        result["total"] = {
+            "lines": total_lines,
+            "bytes": total_bytes,
+            "seconds": round(total_time, 6),
+            "lines_per_sec": round(total_lines / total_time, 1) if total_time else None,
+        }
+
+        assert proc.stdin is not None
+        proc.stdin.write(b"/killall\n")
+        proc.stdin.flush()
+        quit_sent = True
+    finally:
+        rc, max_rss = _wait_client(proc, timeout if quit_sent else 0)
+        server.close()
+
+        result["exit_status"] = rc
+        result["peak_rss_kb"] = max_rss
+        try:
+            with open(report_path, "r", encoding="utf-8") as fp:
+                result["client"] = json.load(fp)
+        except (OSError, ValueError):
+            result["client"] = None
+        shutil.rmtree(cfgdir, ignore_errors=True)
+
+        if rc != 0:
+            errlog.seek(0)
+            sys.stderr.write(errlog.read().decode("utf-8", "replace")[-2000:])
+        errlog.close()
+
+    return result
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("binary", help="path to hexchat-text")
+    parser.add_argument("--recording", help="replay this file instead of generated traffic")
+    parser.add_argument("--save-recording", metavar="FILE",
+                        help="write the generated traffic out as a recording")
+    parser.add_argument("--scale", type=int, default=1, help="multiply the generated traffic")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--timeout", type=float, default=120.0,
+                        help="seconds to wait for any one section")
+    parser.add_argument("--output", metavar="FILE", help="also write the JSON result here")
+    args = parser.parse_args()
+
+    if not os.access(args.binary, os.X_OK):
+        print("binary not found: %s" % args.binary, file=sys.stderr)
+        return 2
+
+    if args.recording:
+        sections = load_recording(args.recording)
+    else:
+        sections = generate_stream(args.seed, max(1, args.scale))
+    if args.save_recording:
+        save_recording(args.save_recording, sections)
+
+    try:
+        result = run(args.binary, sections, args.timeout)
+    except (OSError, RuntimeError) as exc:
+        print("REPLAY_BENCH=FAIL %s" % exc, file=sys.stderr)
+        return 1
+
+    text = json.dumps(result, indent=2)
+    print(text)
+    if args.output:
+        with open(args.output, "w", encoding="utf-8") as fp:
+            fp.write(text + "\n")
+
+    return 0 if result["exit_status"] == 0 and result["client"] else 1
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())